@@ -139,11 +139,11 @@ void os_tty_raw(int fd, bool allow_sigs)
 	atexit(os_fd_restore);
 }
 
-void *os_malloc(size_t length)
+static void *os_malloc_at(void *addr, size_t length)
 {
 	struct os_mem_hdr *hdr;
 
-	hdr = mmap(NULL, length + sizeof(*hdr), PROT_READ | PROT_WRITE,
+	hdr = mmap(addr, length + sizeof(*hdr), PROT_READ | PROT_WRITE,
 		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 	if (hdr == MAP_FAILED)
 		return NULL;
@@ -152,6 +152,17 @@ void *os_malloc(size_t length)
 	return hdr + 1;
 }
 
+void *os_malloc(size_t length)
+{
+	return os_malloc_at(NULL, length);
+}
+
+void *os_malloc_low(size_t length)
+{
+	/* Only a hint: the host may put the memory somewhere else */
+	return os_malloc_at((void *)0x10000000, length);
+}
+
 void os_free(void *ptr)
 {
 	struct os_mem_hdr *hdr = ptr;
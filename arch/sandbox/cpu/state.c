@@ -356,7 +356,7 @@ int state_init(void)
 	state = &main_state;
 
 	state->ram_size = CONFIG_SYS_SDRAM_SIZE;
-	state->ram_buf = os_malloc(state->ram_size);
+	state->ram_buf = os_malloc_low(state->ram_size);
 	assert(state->ram_buf);
 
 	/* No reset yet, so mark it as such. Always allow power reset */
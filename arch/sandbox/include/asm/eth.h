@@ -14,4 +14,53 @@ void sandbox_eth_disable_response(int index, bool disable);
 
 void sandbox_eth_skip_timeout(void);
 
+void sandbox_eth_set_tftp_file(int size);
+
+void sandbox_eth_set_tftp_part_size(int size);
+
+int sandbox_eth_get_tftp_acks(void);
+
+void sandbox_eth_drop_tftp_block(int block);
+
+void sandbox_eth_dup_tftp_block(int block);
+
+int sandbox_eth_get_arp_requests(void);
+
+void sandbox_eth_set_http_file(int size);
+void sandbox_eth_set_http_hdr_pad(int pad);
+
+/* Flags changing how the fake NFS server behaves */
+enum sandbox_nfs_flags {
+	SB_NFS_V2_ONLY	= 1 << 0,	/* no NFSv3 */
+	SB_NFS_REORDER	= 1 << 1,	/* answer the newest READ first */
+	SB_NFS_SHORT	= 1 << 2,	/* return half of what READ asks for */
+};
+
+void sandbox_eth_set_nfs_file(int size, int flags);
+
+int sandbox_eth_get_nfs_max_reads(void);
+
+int sandbox_eth_get_nfs_version(void);
+
+/* Replies counted by the fake DHCP server */
+enum sandbox_dhcp_reply {
+	SB_DHCP_OFFER,
+	SB_DHCP_ACK,
+	SB_DHCP_NAK,
+
+	SB_DHCP_REPLY_COUNT,
+};
+
+void sandbox_eth_set_dhcp(const char *addr, bool rapid_commit);
+
+int sandbox_eth_get_dhcp_replies(enum sandbox_dhcp_reply reply);
+
+void sandbox_eth_set_rx_flood(const void *packet, int length, int count);
+
+/* Contents of the file served by the fake TFTP, HTTP and NFS servers */
+static inline u8 sandbox_eth_file_byte(int offset)
+{
+	return offset ^ (offset >> 8);
+}
+
 #endif /* __ETH_H */
@@ -79,4 +79,88 @@ long sandbox_i2c_rtc_get_set_base_time(struct udevice *dev, long base_time);
 
 int sandbox_usb_keyb_add_string(struct udevice *dev, const char *str);
 
+/**
+ * sandbox_flash_get_inquiry_count() - Count the INQUIRY commands received
+ *
+ * @dev:		Flash-stick emulator device
+ * @return number of INQUIRY commands received since the device was bound
+ */
+int sandbox_flash_get_inquiry_count(struct udevice *dev);
+
+/**
+ * sandbox_hub_get_reset_stats() - Find out how ports of a hub were reset
+ *
+ * A port counts as being reset from SET_FEATURE(PORT_RESET) until its
+ * C_PORT_RESET change is cleared.
+ *
+ * @dev:		Hub emulator
+ * @resets:		Returns the number of port resets started
+ * @max_in_reset:	Returns the largest number of ports in reset at once
+ */
+void sandbox_hub_get_reset_stats(struct udevice *dev, int *resets,
+				 int *max_in_reset);
+
+/**
+ * sandbox_sdhci_get_stats() - Find out how an emulated SDHCI moved data
+ *
+ * @dev:		SDHCI device
+ * @adma_descs:		Returns the number of ADMA descriptors processed
+ * @pio_bytes:		Returns the number of bytes moved by PIO
+ */
+void sandbox_sdhci_get_stats(struct udevice *dev, int *adma_descs,
+			     int *pio_bytes);
+
+/**
+ * sandbox_sdhci_set_64bit() - Select whether an emulated SDHCI has 64-bit DMA
+ *
+ * This sets SDHCI_CAN_64BIT in the capabilities, and whether ADMA64 is
+ * accepted. It takes effect when the device is next probed.
+ *
+ * @dev:		SDHCI device
+ * @can_64bit:		true to support 64-bit addresses, false for 32-bit only
+ */
+void sandbox_sdhci_set_64bit(struct udevice *dev, bool can_64bit);
+
+/**
+ * sandbox_mmc_set_tuning_fail() - Make the emulated MMC tuning fail
+ *
+ * @dev:		MMC device
+ * @fail:		true to corrupt the tuning block, false for normal
+ */
+void sandbox_mmc_set_tuning_fail(struct udevice *dev, bool fail);
+
+/**
+ * sandbox_mmc_set_hs400_fail() - Make the emulated eMMC reject HS400
+ *
+ * @dev:		MMC device
+ * @fail:		true to fail the switch to HS400, false for normal
+ */
+void sandbox_mmc_set_hs400_fail(struct udevice *dev, bool fail);
+
+/**
+ * sandbox_mmc_set_cmd11_fail() - Make the emulated SD card reject CMD11
+ *
+ * @dev:		MMC device
+ * @fail:		true to fail the switch to 1.8V, false for normal
+ */
+void sandbox_mmc_set_cmd11_fail(struct udevice *dev, bool fail);
+
+/**
+ * sandbox_mmc_power_cycle() - Power-cycle the emulated card
+ *
+ * This is what happens when a card is changed. An SD card goes back to
+ * 3.3V signalling.
+ *
+ * @dev:		MMC device
+ */
+void sandbox_mmc_power_cycle(struct udevice *dev);
+
+/**
+ * sandbox_mmc_get_tuning_count() - Count the tuning procedures run
+ *
+ * @dev:		MMC device
+ * @return number of times the host was tuned since the device was probed
+ */
+int sandbox_mmc_get_tuning_count(struct udevice *dev);
+
 #endif
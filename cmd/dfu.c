@@ -55,6 +55,7 @@ static int do_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	board_usb_init(controller_index, USB_INIT_DEVICE);
 	g_dnl_clear_detach();
 	g_dnl_register("usb_dnl_dfu");
+	dfu_set_write_queue(true);
 	while (1) {
 		if (g_dnl_detach()) {
 			/*
@@ -101,8 +102,10 @@ static int do_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 
 		WATCHDOG_RESET();
 		usb_gadget_handle_interrupts(controller_index);
+		dfu_write_poll();
 	}
 exit:
+	dfu_set_write_queue(false);
 	g_dnl_unregister();
 	board_usb_cleanup(controller_index, USB_INIT_DEVICE);
 done:
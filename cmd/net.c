@@ -110,6 +110,36 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_WGET)
+static int do_wget(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	return netboot_common(WGET, cmdtp, argc, argv);
+}
+
+U_BOOT_CMD(
+	wget,	3,	1,	do_wget,
+	"boot image via network using HTTP protocol",
+	"[loadAddress] [[hostIPaddr:]path]\n"
+	"    - the server port is taken from 'httpdstp' (default 80)"
+);
+#endif
+
+#if defined(CONFIG_CMD_TFTPMULTI)
+static int do_tftpmulti(cmd_tbl_t *cmdtp, int flag, int argc,
+			char * const argv[])
+{
+	return netboot_common(TFTPMULTI, cmdtp, argc, argv);
+}
+
+U_BOOT_CMD(
+	tftpmulti,	3,	1,	do_tftpmulti,
+	"load file via network using TFTP over several interfaces",
+	"[loadAddress] [[hostIPaddr:]bootfilename]\n"
+	"    - the file is read in parts named bootfilename.0, .1, ... of\n"
+	"      'tftppartsize' bytes, using the interfaces in 'tftpdevs'"
+);
+#endif
+
 static void netboot_update_env(void)
 {
 	char tmp[22];
@@ -15,6 +15,7 @@
 #include <common.h>
 #include <libfdt.h>
 #include <malloc.h>
+#include <dm/timing.h>
 #include <linux/compiler.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -150,6 +151,11 @@ uint32_t bootstage_accum(enum bootstage_id id)
 	return duration;
 }
 
+uint32_t bootstage_get_time(enum bootstage_id id)
+{
+	return record[id].time_us;
+}
+
 /**
  * Get a record name as a printable string
  *
@@ -247,6 +253,9 @@ static int add_bootstages_devicetree(struct fdt_header *blob)
 			return -1;
 	}
 
+	if (dm_timing_fdt_add(blob, bootstage))
+		return -1;
+
 	return 0;
 }
 
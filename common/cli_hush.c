@@ -1541,6 +1541,7 @@ static int run_pipe_real(struct pipe *pi)
 	struct child_prog *child;
 	struct built_in_command *x;
 	char *p;
+	int sp;
 # if __GNUC__
 	/* Avoid longjmp clobbering */
 	(void) &i;
@@ -1553,6 +1554,7 @@ static int run_pipe_real(struct pipe *pi)
 	int flag = do_repeat ? CMD_FLAG_REPEAT : 0;
 	struct child_prog *child;
 	char *p;
+	int sp;
 # if __GNUC__
 	/* Avoid longjmp clobbering */
 	(void) &i;
@@ -1619,6 +1621,7 @@ static int run_pipe_real(struct pipe *pi)
 			}
 			return EXIT_SUCCESS;   /* don't worry about errors in set_local_var() yet */
 		}
+		sp = child->sp;
 		for (i = 0; is_assignment(child->argv[i]); i++) {
 			p = insert_var_value(child->argv[i]);
 #ifndef __U_BOOT__
@@ -1627,11 +1630,11 @@ static int run_pipe_real(struct pipe *pi)
 			set_local_var(p, 0);
 #endif
 			if (p != child->argv[i]) {
-				child->sp--;
+				sp--;
 				free(p);
 			}
 		}
-		if (child->sp) {
+		if (sp) {
 			char * str = NULL;
 
 			str = make_string(child->argv + i,
@@ -1764,6 +1767,7 @@ static int run_list_real(struct pipe *pi)
 	char *save_name = NULL;
 	char **list = NULL;
 	char **save_list = NULL;
+	struct pipe *save_pipe = NULL;
 	struct pipe *rpipe;
 	int flag_rep = 0;
 #ifndef __U_BOOT__
@@ -1803,7 +1807,8 @@ static int run_list_real(struct pipe *pi)
 				/* check Ctrl-C */
 				ctrlc();
 				if ((had_ctrlc())) {
-					return 1;
+					rcode = 1;
+					break;
 				}
 #endif
 				flag_restore = 0;
@@ -1833,12 +1838,14 @@ static int run_list_real(struct pipe *pi)
 					pi->progs->argv[0]);
 				save_list = list;
 				save_name = pi->progs->argv[0];
+				save_pipe = pi;
 				pi->progs->argv[0] = NULL;
 				flag_rep = 1;
 			}
 			if (!(*list)) {
 				free(pi->progs->argv[0]);
 				free(save_list);
+				save_list = NULL;
 				list = NULL;
 				flag_rep = 0;
 				pi->progs->argv[0] = save_name;
@@ -1903,7 +1910,8 @@ static int run_list_real(struct pipe *pi)
 #else
 		if (rcode < -1) {
 			last_return_code = -rcode - 2;
-			return -2;	/* exit */
+			rcode = -2;	/* exit */
+			break;
 		}
 		last_return_code=(rcode == 0) ? 0 : 1;
 #endif
@@ -1923,6 +1931,16 @@ static int run_list_real(struct pipe *pi)
 		checkjobs(NULL);
 #endif
 	}
+#ifdef __U_BOOT__
+	/* If we stopped inside a 'for' loop, put the list back as it was */
+	if (save_list) {
+		free(save_pipe->progs->argv[0]);
+		while (*list)
+			free(*list++);
+		free(save_list);
+		save_pipe->progs->argv[0] = save_name;
+	}
+#endif
 	return rcode;
 }
 
@@ -3284,6 +3302,153 @@ int parse_string_outer(const char *s, int flag)
 #endif
 }
 
+#if defined(__U_BOOT__) && defined(CONFIG_HUSH_CACHE)
+/*
+ * Cache of parsed scripts, so that running the same environment variable
+ * repeatedly (e.g. from a loop in bootcmd) does not parse it again each
+ * time. Each entry is keyed by variable name and holds a copy of the text
+ * which was parsed, so that it is parsed again if the variable changes.
+ *
+ * Running a list does not change it, except while a 'for' loop is in
+ * progress, so an entry is marked busy while running. A script which
+ * runs itself is parsed again rather than sharing the busy entry.
+ */
+struct hush_cache_entry {
+	char *name;
+	char *text;
+	struct pipe *list;
+	ulong last_used;
+	int busy;
+};
+
+static struct hush_cache_entry hush_cache[CONFIG_HUSH_CACHE_ENTRIES];
+static ulong hush_cache_seq;
+
+static void hush_cache_free(struct hush_cache_entry *entry)
+{
+	if (entry->list)
+		free_pipe_list(entry->list, 0);
+	free(entry->name);
+	free(entry->text);
+	memset(entry, '\0', sizeof(*entry));
+}
+
+/*
+ * Parse a string into a list without running it. This follows the
+ * single-pass (FLAG_EXIT_FROM_LOOP) path of parse_stream_outer().
+ */
+static struct pipe *parse_string_list(const char *s, int flag)
+{
+	struct in_str input;
+	struct p_context ctx;
+	o_string temp = NULL_O_STRING;
+	char *p = NULL;
+	int rcode;
+
+	if (!(p = strchr(s, '\n')) || *++p) {
+		p = xmalloc(strlen(s) + 2);
+		strcpy(p, s);
+		strcat(p, "\n");
+		s = p;
+	} else {
+		p = NULL;
+	}
+	setup_string_in_str(&input, s);
+	ctx.type = flag;
+	initialize_context(&ctx);
+	update_ifs_map();
+	if (!(flag & FLAG_PARSE_SEMICOLON) || (flag & FLAG_REPARSING))
+		mapset((uchar *)";$&|", 0);
+	input.promptmode = 1;
+	rcode = parse_stream(&temp, &ctx, &input,
+			     flag & FLAG_CONT_ON_NEWLINE ? -1 : '\n');
+	if (rcode != 1 && ctx.old_flag != 0)
+		syntax();
+	if (rcode != 1 && ctx.old_flag == 0) {
+		done_word(&temp, &ctx);
+		done_pipe(&ctx, PIPE_SEQ);
+	} else {
+		if (ctx.old_flag != 0)
+			free(ctx.stack);
+		flag_repeat = 0;
+		free_pipe_list(ctx.list_head, 0);
+		ctx.list_head = NULL;
+	}
+	b_free(&temp);
+	free(p);
+
+	return ctx.list_head;
+}
+
+static struct hush_cache_entry *hush_cache_get(const char *name,
+					       const char *s)
+{
+	struct hush_cache_entry *entry, *victim = NULL;
+	int i;
+
+	for (i = 0, entry = hush_cache; i < CONFIG_HUSH_CACHE_ENTRIES;
+	     i++, entry++) {
+		if (entry->name && !strcmp(entry->name, name)) {
+			if (entry->busy)
+				return NULL;
+			if (!strcmp(entry->text, s))
+				return entry;
+			victim = entry;		/* variable has changed */
+			break;
+		}
+		if (entry->busy)
+			continue;
+		if (!victim || !entry->name ||
+		    (victim->name && entry->last_used < victim->last_used))
+			victim = entry;
+	}
+	if (!victim)
+		return NULL;
+
+	hush_cache_free(victim);
+	victim->list = parse_string_list(s, FLAG_PARSE_SEMICOLON |
+					 FLAG_EXIT_FROM_LOOP |
+					 FLAG_CONT_ON_NEWLINE);
+	if (!victim->list)
+		return victim;	/* syntax error, reported by caller */
+	victim->name = strdup(name);
+	victim->text = strdup(s);
+	if (!victim->name || !victim->text) {
+		hush_cache_free(victim);
+		return NULL;
+	}
+
+	return victim;
+}
+
+int parse_string_cached(const char *name, const char *s)
+{
+	struct hush_cache_entry *entry;
+	int code;
+
+	if (!*s)
+		return 0;
+	entry = hush_cache_get(name, s);
+	if (!entry)
+		return parse_string_outer(s, FLAG_PARSE_SEMICOLON |
+					  FLAG_EXIT_FROM_LOOP |
+					  FLAG_CONT_ON_NEWLINE);
+	if (!entry->list)
+		return 1;
+
+	entry->last_used = ++hush_cache_seq;
+	entry->busy = 1;
+	code = run_list_real(entry->list);
+	entry->busy = 0;
+	if (code == -2)		/* exit */
+		code = 0;
+	else if (code == -1)
+		flag_repeat = 0;
+
+	return code != 0 ? 1 : 0;
+}
+#endif /* __U_BOOT__ && CONFIG_HUSH_CACHE */
+
 #ifndef __U_BOOT__
 static int parse_file_outer(FILE *f)
 #else
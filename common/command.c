@@ -12,8 +12,11 @@
 #include <common.h>
 #include <command.h>
 #include <console.h>
+#include <malloc.h>
 #include <linux/ctype.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 /*
  * Use puts() instead of printf() to avoid printf buffer overflow
  * for long help messages
@@ -117,10 +120,93 @@ cmd_tbl_t *find_cmd_tbl(const char *cmd, cmd_tbl_t *table, int table_len)
 	return NULL;	/* not found or ambiguous command */
 }
 
+#ifdef CONFIG_CMD_INDEX
+/*
+ * Sorted index of the linker-list command table, built on first use. This
+ * allows find_cmd() to use a binary search while still supporting
+ * abbreviated commands, since all commands with a given prefix are
+ * adjacent in the index.
+ */
+static cmd_tbl_t **cmd_index;
+
+static int h_compare_cmd(const void *p1, const void *p2)
+{
+	const cmd_tbl_t *cmd1 = *(const cmd_tbl_t **)p1;
+	const cmd_tbl_t *cmd2 = *(const cmd_tbl_t **)p2;
+	int ret;
+
+	ret = strcmp(cmd1->name, cmd2->name);
+	if (ret)
+		return ret;
+
+	/* Keep duplicates in table order, so the first one wins as before */
+	return cmd1 < cmd2 ? -1 : 1;
+}
+
+static cmd_tbl_t **cmd_index_get(cmd_tbl_t *table, int table_len)
+{
+	int i;
+
+	/* Commands are not fixed up until relocation is complete */
+	if (cmd_index || !(gd->flags & GD_FLG_RELOC))
+		return cmd_index;
+
+	cmd_index = malloc(table_len * sizeof(*cmd_index));
+	if (!cmd_index)
+		return NULL;
+	for (i = 0; i < table_len; i++)
+		cmd_index[i] = table + i;
+	qsort(cmd_index, table_len, sizeof(*cmd_index), h_compare_cmd);
+
+	return cmd_index;
+}
+
+static cmd_tbl_t *find_cmd_index(const char *cmd, cmd_tbl_t **index,
+				 int table_len)
+{
+	const char *p;
+	int low, high;
+	int len;
+
+	/* As with find_cmd_tbl(), only compare up to the first dot */
+	len = ((p = strchr(cmd, '.')) == NULL) ? strlen(cmd) : (p - cmd);
+
+	/* Find the first command which is not less than the prefix */
+	low = 0;
+	high = table_len;
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (strncmp(index[mid]->name, cmd, len) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == table_len || strncmp(index[low]->name, cmd, len))
+		return NULL;	/* not found */
+
+	/* A full match sorts before any longer command with this prefix */
+	if (index[low]->name[len] == '\0')
+		return index[low];
+
+	if (low + 1 < table_len && !strncmp(index[low + 1]->name, cmd, len))
+		return NULL;	/* ambiguous abbreviation */
+
+	return index[low];
+}
+#endif /* CONFIG_CMD_INDEX */
+
 cmd_tbl_t *find_cmd(const char *cmd)
 {
 	cmd_tbl_t *start = ll_entry_start(cmd_tbl_t, cmd);
 	const int len = ll_entry_count(cmd_tbl_t, cmd);
+#ifdef CONFIG_CMD_INDEX
+	cmd_tbl_t **index;
+
+	index = cmd_index_get(start, len);
+	if (index && cmd)
+		return find_cmd_index(cmd, index, len);
+#endif
 	return find_cmd_tbl(cmd, start, len);
 }
 
@@ -439,8 +525,6 @@ int cmd_get_data_size(char* arg, int default_size)
 #endif
 
 #if defined(CONFIG_NEEDS_MANUAL_RELOC)
-DECLARE_GLOBAL_DATA_PTR;
-
 void fixup_cmdtable(cmd_tbl_t *cmdtp, int size)
 {
 	int	i;
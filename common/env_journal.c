@@ -0,0 +1,257 @@
+/*
+ * Incremental environment saving
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+/*
+ * Saving the environment normally rewrites the whole environment area,
+ * which on SPI flash means a sector erase each time, even if only one
+ * variable (e.g. a boot counter) has changed.
+ *
+ * With a journal, saveenv instead appends a record holding just the
+ * variables which changed (in himport_r() format) to a separate journal
+ * area. When the environment is loaded, the records are applied in turn.
+ * Only when the journal is full is the whole environment written again
+ * and the journal erased.
+ *
+ * Each record holds the CRC of the environment it applies to, so records
+ * left over from before the last full save are ignored.
+ */
+
+#include <common.h>
+#include <environment.h>
+#include <errno.h>
+#include <malloc.h>
+#include <search.h>
+
+#ifdef CONFIG_ENV_AES
+#error "CONFIG_ENV_JOURNAL cannot be used with CONFIG_ENV_AES"
+#endif
+
+#define ENV_JOURNAL_MAGIC	0x4c4e4a45	/* "EJNL" */
+#define ENV_JOURNAL_ERASED	0xffffffff
+
+/**
+ * struct env_journal_hdr - Header of a journal record
+ *
+ * @magic:	ENV_JOURNAL_MAGIC
+ * @base_crc:	CRC of the full environment which this record updates
+ * @size:	Number of data bytes following the header
+ * @crc:	CRC32 of the data bytes
+ */
+struct env_journal_hdr {
+	uint32_t magic;
+	uint32_t base_crc;
+	uint32_t size;
+	uint32_t crc;
+};
+
+/* Environment as it is on storage, i.e. with all records applied */
+static env_t *journal_env;
+/* CRC of the full environment which the journal applies to */
+static uint32_t journal_base_crc;
+/* Bytes used in the journal; CONFIG_ENV_JOURNAL_SIZE if it must be erased */
+static ulong journal_used = CONFIG_ENV_JOURNAL_SIZE;
+
+static ulong env_journal_rec_size(ulong size)
+{
+	return ALIGN(sizeof(struct env_journal_hdr) + size, 4);
+}
+
+/* Compare the names of two exported 'name=value' entries */
+static int env_journal_name_cmp(const char *a, const char *b)
+{
+	while (*a != '=' && *a == *b) {
+		a++;
+		b++;
+	}
+
+	return (*a == '=' ? 0 : (uchar)*a) - (*b == '=' ? 0 : (uchar)*b);
+}
+
+static int env_journal_add(char **outp, char *end, const char *str, int len)
+{
+	if (*outp + len + 1 > end)
+		return -ENOSPC;
+	memcpy(*outp, str, len);
+	*outp += len;
+	*(*outp)++ = '\0';
+
+	return 0;
+}
+
+/*
+ * Work out the changes needed to turn one exported environment into
+ * another. Since both are sorted by name, this is a simple merge.
+ * Deleted variables are recorded as just 'name', which himport_r()
+ * treats as a deletion.
+ *
+ * @return number of bytes written to out, or -ENOSPC if it did not fit
+ */
+static int env_journal_diff(const char *old, const char *new, char *out,
+			    int max)
+{
+	char *p = out, *end = out + max;
+	int ret = 0;
+	int cmp;
+
+	while (!ret && (*old || *new)) {
+		if (!*old)
+			cmp = 1;
+		else if (!*new)
+			cmp = -1;
+		else
+			cmp = env_journal_name_cmp(old, new);
+
+		if (cmp < 0) {
+			ret = env_journal_add(&p, end, old,
+					      strchr(old, '=') - old);
+		} else if (cmp > 0 || strcmp(old, new)) {
+			ret = env_journal_add(&p, end, new, strlen(new));
+		}
+		if (cmp <= 0)
+			old += strlen(old) + 1;
+		if (cmp >= 0)
+			new += strlen(new) + 1;
+	}
+
+	return ret ? ret : p - out;
+}
+
+static void env_journal_snapshot(const env_t *env)
+{
+	if (!journal_env)
+		journal_env = malloc(sizeof(env_t));
+	if (journal_env)
+		memcpy(journal_env, env, sizeof(env_t));
+}
+
+void env_journal_load(const struct env_journal_ops *ops, uint32_t base_crc)
+{
+	struct env_journal_hdr hdr;
+	bool dirty = false;
+	env_t *env;
+	char *data;
+	int count = 0;
+
+	journal_base_crc = base_crc;
+	journal_used = 0;
+	while (journal_used + sizeof(hdr) <= CONFIG_ENV_JOURNAL_SIZE) {
+		/* Anything but a valid record or erased space needs an erase */
+		dirty = true;
+		if (ops->read(journal_used, sizeof(hdr), &hdr))
+			break;
+		if (hdr.magic == ENV_JOURNAL_ERASED) {
+			dirty = false;
+			break;
+		}
+		if (hdr.magic != ENV_JOURNAL_MAGIC ||
+		    hdr.base_crc != base_crc ||
+		    journal_used + env_journal_rec_size(hdr.size) >
+		    CONFIG_ENV_JOURNAL_SIZE)
+			break;
+		data = malloc(hdr.size);
+		if (!data)
+			break;
+		if (ops->read(journal_used + sizeof(hdr), hdr.size, data) ||
+		    crc32(0, (uchar *)data, hdr.size) != hdr.crc) {
+			free(data);
+			break;
+		}
+		if (!himport_r(&env_htab, data, hdr.size, '\0',
+			       H_NOCLEAR | H_FORCE, 0, 0, NULL)) {
+			error("Cannot apply environment journal: errno = %d\n",
+			      errno);
+		}
+		free(data);
+		journal_used += env_journal_rec_size(hdr.size);
+		dirty = false;
+		count++;
+	}
+	if (dirty)
+		journal_used = CONFIG_ENV_JOURNAL_SIZE;
+	debug("%s: %d records, %lu bytes used\n", __func__, count,
+	      journal_used);
+
+	/* Remember what is on storage, so we can work out what changes */
+	env = malloc(sizeof(env_t));
+	if (env && !env_export(env))
+		env_journal_snapshot(env);
+	free(env);
+}
+
+int env_journal_save(const struct env_journal_ops *ops, env_t *env_new)
+{
+	struct env_journal_hdr *hdr;
+	ulong avail, rec_size;
+	char *buf;
+	int size;
+	int ret;
+
+	if (!journal_env)
+		return -ENOENT;
+	if (journal_used + sizeof(*hdr) >= CONFIG_ENV_JOURNAL_SIZE)
+		return -ENOSPC;
+
+	/* Leave room for an erased header after the record (see below) */
+	avail = CONFIG_ENV_JOURNAL_SIZE - journal_used;
+	buf = malloc(avail + sizeof(*hdr));
+	if (!buf)
+		return -ENOMEM;
+	hdr = (struct env_journal_hdr *)buf;
+	size = env_journal_diff((char *)journal_env->data,
+				(char *)env_new->data, buf + sizeof(*hdr),
+				avail - sizeof(*hdr));
+	if (size <= 0) {
+		free(buf);
+		if (size < 0)
+			return size;
+		puts("No changes to save\n");
+		return 0;
+	}
+
+	hdr->magic = ENV_JOURNAL_MAGIC;
+	hdr->base_crc = journal_base_crc;
+	hdr->size = size;
+	hdr->crc = crc32(0, (uchar *)buf + sizeof(*hdr), size);
+	rec_size = env_journal_rec_size(size);
+	if (rec_size + sizeof(*hdr) > avail) {
+		free(buf);
+		return -ENOSPC;
+	}
+
+	/*
+	 * Mark the end of the journal in the same write, since on storage
+	 * without erase (e.g. MMC) old records may follow.
+	 */
+	memset(buf + sizeof(*hdr) + size, 0xff, rec_size - size);
+
+	printf("Saving %d bytes of changes...", size);
+	ret = ops->write(journal_used, rec_size + sizeof(*hdr), buf);
+	free(buf);
+	if (ret) {
+		/* We don't know what was written, so erase next time */
+		journal_used = CONFIG_ENV_JOURNAL_SIZE;
+		return ret;
+	}
+	journal_used += rec_size;
+	env_journal_snapshot(env_new);
+	puts("done\n");
+
+	return 0;
+}
+
+int env_journal_reset(const struct env_journal_ops *ops, env_t *env_new)
+{
+	int ret;
+
+	journal_base_crc = env_new->crc;
+	env_journal_snapshot(env_new);
+	ret = ops->erase();
+	journal_used = ret ? CONFIG_ENV_JOURNAL_SIZE : 0;
+
+	return ret;
+}
@@ -22,6 +22,10 @@
 #error CONFIG_ENV_SIZE_REDUND should be the same as CONFIG_ENV_SIZE
 #endif
 
+#if defined(CONFIG_ENV_JOURNAL) && !defined(CONFIG_ENV_JOURNAL_OFFSET)
+#error CONFIG_ENV_JOURNAL needs CONFIG_ENV_JOURNAL_OFFSET
+#endif
+
 char *env_name_spec = "MMC";
 
 #ifdef ENV_IS_EMBEDDED
@@ -123,6 +127,66 @@ static void fini_mmc_for_env(struct mmc *mmc)
 #endif
 }
 
+#ifdef CONFIG_ENV_JOURNAL
+/* Device holding the journal, valid between init/fini_mmc_for_env() */
+static struct mmc *env_journal_mmc;
+
+/* Read or write part of the journal, using whole blocks */
+static int env_mmc_journal_xfer(ulong offset, ulong size, void *buf,
+				bool write)
+{
+	struct blk_desc *desc = mmc_get_blk_desc(env_journal_mmc);
+	ulong start = CONFIG_ENV_JOURNAL_OFFSET + offset;
+	lbaint_t blk = start / desc->blksz;
+	lbaint_t cnt = DIV_ROUND_UP(start + size, desc->blksz) - blk;
+	ulong skip = start - blk * desc->blksz;
+	char *bounce;
+	int ret = -EIO;
+
+	bounce = malloc_cache_aligned(cnt * desc->blksz);
+	if (!bounce)
+		return -ENOMEM;
+	if (blk_dread(desc, blk, cnt, bounce) != cnt)
+		goto out;
+	if (write) {
+		memcpy(bounce + skip, buf, size);
+		if (blk_dwrite(desc, blk, cnt, bounce) != cnt)
+			goto out;
+	} else {
+		memcpy(buf, bounce + skip, size);
+	}
+	ret = 0;
+out:
+	free(bounce);
+
+	return ret;
+}
+
+static int env_mmc_journal_read(ulong offset, ulong size, void *buf)
+{
+	return env_mmc_journal_xfer(offset, size, buf, false);
+}
+
+static int env_mmc_journal_write(ulong offset, ulong size, const void *buf)
+{
+	return env_mmc_journal_xfer(offset, size, (void *)buf, true);
+}
+
+/* There is no erase, so just mark the journal as empty */
+static int env_mmc_journal_erase(void)
+{
+	u32 erased = 0xffffffff;
+
+	return env_mmc_journal_xfer(0, sizeof(erased), &erased, true);
+}
+
+static const struct env_journal_ops env_mmc_journal_ops = {
+	.read	= env_mmc_journal_read,
+	.write	= env_mmc_journal_write,
+	.erase	= env_mmc_journal_erase,
+};
+#endif
+
 #ifdef CONFIG_CMD_SAVEENV
 static inline int write_env(struct mmc *mmc, unsigned long size,
 			    unsigned long offset, const void *buffer)
@@ -161,6 +225,12 @@ int saveenv(void)
 	if (ret)
 		goto fini;
 
+#ifdef CONFIG_ENV_JOURNAL
+	env_journal_mmc = mmc;
+	if (!env_journal_save(&env_mmc_journal_ops, env_new))
+		goto fini;
+#endif
+
 #ifdef CONFIG_ENV_OFFSET_REDUND
 	env_new->flags	= ++env_flags; /* increase the serial */
 
@@ -186,6 +256,9 @@ int saveenv(void)
 #ifdef CONFIG_ENV_OFFSET_REDUND
 	gd->env_valid = gd->env_valid == 2 ? 1 : 2;
 #endif
+#ifdef CONFIG_ENV_JOURNAL
+	env_journal_reset(&env_mmc_journal_ops, env_new);
+#endif
 
 fini:
 	fini_mmc_for_env(mmc);
@@ -285,7 +358,14 @@ void env_relocate_spec(void)
 		ep = tmp_env2;
 
 	env_flags = ep->flags;
+#ifdef CONFIG_ENV_JOURNAL
+	if (env_import((char *)ep, 0)) {
+		env_journal_mmc = mmc;
+		env_journal_load(&env_mmc_journal_ops, ep->crc);
+	}
+#else
 	env_import((char *)ep, 0);
+#endif
 	ret = 0;
 
 fini:
@@ -329,7 +409,14 @@ void env_relocate_spec(void)
 		goto fini;
 	}
 
+#ifdef CONFIG_ENV_JOURNAL
+	if (env_import(buf, 1)) {
+		env_journal_mmc = mmc;
+		env_journal_load(&env_mmc_journal_ops, ((env_t *)buf)->crc);
+	}
+#else
 	env_import(buf, 1);
+#endif
 	ret = 0;
 
 fini:
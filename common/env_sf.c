@@ -31,6 +31,10 @@
 # define CONFIG_ENV_SPI_MODE	SPI_MODE_3
 #endif
 
+#if defined(CONFIG_ENV_JOURNAL) && !defined(CONFIG_ENV_JOURNAL_OFFSET)
+#error CONFIG_ENV_JOURNAL needs CONFIG_ENV_JOURNAL_OFFSET
+#endif
+
 #ifdef CONFIG_ENV_OFFSET_REDUND
 static ulong env_offset		= CONFIG_ENV_OFFSET;
 static ulong env_new_offset	= CONFIG_ENV_OFFSET_REDUND;
@@ -45,6 +49,32 @@ char *env_name_spec = "SPI Flash";
 
 static struct spi_flash *env_flash;
 
+#ifdef CONFIG_ENV_JOURNAL
+static int env_sf_journal_read(ulong offset, ulong size, void *buf)
+{
+	return spi_flash_read(env_flash, CONFIG_ENV_JOURNAL_OFFSET + offset,
+			      size, buf);
+}
+
+static int env_sf_journal_write(ulong offset, ulong size, const void *buf)
+{
+	return spi_flash_write(env_flash, CONFIG_ENV_JOURNAL_OFFSET + offset,
+			       size, buf);
+}
+
+static int env_sf_journal_erase(void)
+{
+	return spi_flash_erase(env_flash, CONFIG_ENV_JOURNAL_OFFSET,
+			       CONFIG_ENV_JOURNAL_SIZE);
+}
+
+static const struct env_journal_ops env_sf_journal_ops = {
+	.read	= env_sf_journal_read,
+	.write	= env_sf_journal_write,
+	.erase	= env_sf_journal_erase,
+};
+#endif
+
 #if defined(CONFIG_ENV_OFFSET_REDUND)
 int saveenv(void)
 {
@@ -80,6 +110,10 @@ int saveenv(void)
 	ret = env_export(&env_new);
 	if (ret)
 		return ret;
+#ifdef CONFIG_ENV_JOURNAL
+	if (!env_journal_save(&env_sf_journal_ops, &env_new))
+		return 0;
+#endif
 	env_new.flags	= ACTIVE_FLAG;
 
 	if (gd->env_valid == 1) {
@@ -139,6 +173,9 @@ int saveenv(void)
 	puts("done\n");
 
 	gd->env_valid = gd->env_valid == 2 ? 1 : 2;
+#ifdef CONFIG_ENV_JOURNAL
+	env_journal_reset(&env_sf_journal_ops, &env_new);
+#endif
 
 	printf("Valid environment: %d\n", (int)gd->env_valid);
 
@@ -227,6 +264,10 @@ void env_relocate_spec(void)
 		error("Cannot import environment: errno = %d\n", errno);
 		set_default_env("!env_import failed");
 	}
+#ifdef CONFIG_ENV_JOURNAL
+	if (ret)
+		env_journal_load(&env_sf_journal_ops, ep->crc);
+#endif
 
 err_read:
 	spi_flash_free(env_flash);
@@ -267,6 +308,15 @@ int saveenv(void)
 	}
 #endif
 
+	ret = env_export(&env_new);
+	if (ret)
+		goto done;
+#ifdef CONFIG_ENV_JOURNAL
+	if (!env_journal_save(&env_sf_journal_ops, &env_new))
+		goto done;
+	ret = 1;
+#endif
+
 	/* Is the sector larger than the env (i.e. embedded) */
 	if (CONFIG_ENV_SECT_SIZE > CONFIG_ENV_SIZE) {
 		saved_size = CONFIG_ENV_SECT_SIZE - CONFIG_ENV_SIZE;
@@ -287,10 +337,6 @@ int saveenv(void)
 			sector++;
 	}
 
-	ret = env_export(&env_new);
-	if (ret)
-		goto done;
-
 	puts("Erasing SPI flash...");
 	ret = spi_flash_erase(env_flash, CONFIG_ENV_OFFSET,
 		sector * CONFIG_ENV_SECT_SIZE);
@@ -312,6 +358,9 @@ int saveenv(void)
 
 	ret = 0;
 	puts("done\n");
+#ifdef CONFIG_ENV_JOURNAL
+	env_journal_reset(&env_sf_journal_ops, &env_new);
+#endif
 
  done:
 	if (saved_buffer)
@@ -343,8 +392,12 @@ void env_relocate_spec(void)
 	}
 
 	ret = env_import(buf, 1);
-	if (ret)
+	if (ret) {
 		gd->env_valid = 1;
+#ifdef CONFIG_ENV_JOURNAL
+		env_journal_load(&env_sf_journal_ops, ((env_t *)buf)->crc);
+#endif
+	}
 out:
 	spi_flash_free(env_flash);
 	if (buf)
@@ -151,6 +151,56 @@ void fb_mmc_flash_write(const char *cmd, void *download_buffer,
 	}
 }
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+static struct fb_mmc_sparse stream_priv;
+static struct sparse_storage stream_storage;
+
+int fb_mmc_flash_stream_start(const char *cmd, struct sparse_stream *stream,
+			      unsigned int download_bytes)
+{
+	struct blk_desc *dev_desc;
+	disk_partition_t info;
+	int ret;
+
+	dev_desc = blk_get_dev("mmc", CONFIG_FASTBOOT_FLASH_MMC_DEV);
+	if (!dev_desc || dev_desc->type == DEV_TYPE_UNKNOWN) {
+		error("invalid mmc device\n");
+		fastboot_fail("invalid mmc device");
+		return -ENODEV;
+	}
+
+	/* The GPT is checked as a whole before it is written */
+	if (strcmp(cmd, CONFIG_FASTBOOT_GPT_NAME) == 0) {
+		fastboot_fail("cannot stream GPT partitions");
+		return -EINVAL;
+	}
+
+	if (part_get_info_efi_by_name_or_alias(dev_desc, cmd, &info)) {
+		error("cannot find partition: '%s'\n", cmd);
+		fastboot_fail("cannot find partition");
+		return -ENOENT;
+	}
+
+	stream_priv.dev_desc = dev_desc;
+
+	stream_storage.blksz = info.blksz;
+	stream_storage.start = info.start;
+	stream_storage.size = info.size;
+	stream_storage.write = fb_mmc_sparse_write;
+	stream_storage.reserve = fb_mmc_sparse_reserve;
+	stream_storage.priv = &stream_priv;
+
+	printf("Streaming image to offset " LBAFU "\n", stream_storage.start);
+
+	ret = sparse_stream_start(stream, &stream_storage, cmd,
+				  download_bytes);
+	if (ret)
+		fastboot_fail(stream->error);
+
+	return ret;
+}
+#endif
+
 void fb_mmc_erase(const char *cmd)
 {
 	int ret;
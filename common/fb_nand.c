@@ -201,6 +201,52 @@ void fb_nand_flash_write(const char *cmd, void *download_buffer,
 	fastboot_okay("");
 }
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+static struct fb_nand_sparse stream_priv;
+static struct sparse_storage stream_storage;
+
+int fb_nand_flash_stream_start(const char *cmd, struct sparse_stream *stream,
+			       unsigned int download_bytes)
+{
+	struct part_info *part;
+	struct mtd_info *mtd = NULL;
+	int ret;
+
+	ret = fb_nand_lookup(cmd, &mtd, &part);
+	if (ret) {
+		error("invalid NAND device");
+		fastboot_fail("invalid NAND device");
+		return ret;
+	}
+
+	ret = board_fastboot_write_partition_setup(part->name);
+	if (ret) {
+		error("failed to set up partition '%s'", part->name);
+		fastboot_fail("failed to set up partition");
+		return ret;
+	}
+
+	stream_priv.mtd = mtd;
+	stream_priv.part = part;
+
+	stream_storage.blksz = mtd->writesize;
+	stream_storage.start = part->offset / stream_storage.blksz;
+	stream_storage.size = part->size / stream_storage.blksz;
+	stream_storage.write = fb_nand_sparse_write;
+	stream_storage.reserve = fb_nand_sparse_reserve;
+	stream_storage.priv = &stream_priv;
+
+	printf("Streaming image to offset " LBAFU "\n", stream_storage.start);
+
+	ret = sparse_stream_start(stream, &stream_storage, cmd,
+				  download_bytes);
+	if (ret)
+		fastboot_fail(stream->error);
+
+	return ret;
+}
+#endif
+
 void fb_nand_erase(const char *cmd)
 {
 	struct part_info *part;
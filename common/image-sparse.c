@@ -49,6 +49,7 @@
 #define CONFIG_FASTBOOT_FLASH_FILLBUF_SIZE (1024 * 512)
 #endif
 
+#ifdef CONFIG_FASTBOOT_FLASH
 void write_sparse_image(
 		struct sparse_storage *info, const char *part_name,
 		void *data, unsigned sz)
@@ -262,3 +263,429 @@ void write_sparse_image(
 
 	return;
 }
+#endif
+
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+enum {
+	SPARSE_STREAM_FILE_HDR,
+	SPARSE_STREAM_CHUNK_HDR,
+	SPARSE_STREAM_RAW,
+	SPARSE_STREAM_FILL,
+	SPARSE_STREAM_SKIP,
+	SPARSE_STREAM_IMAGE,
+	SPARSE_STREAM_DONE,
+	SPARSE_STREAM_ERROR,
+};
+
+static int sparse_stream_fail(struct sparse_stream *ss, const char *reason)
+{
+	ss->state = SPARSE_STREAM_ERROR;
+	ss->error = reason;
+
+	return -EIO;
+}
+
+/* Write whole blocks at the current position */
+static int sparse_stream_put(struct sparse_stream *ss, const void *buf,
+			     lbaint_t blkcnt)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t blks;
+
+	if (ss->blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		return sparse_stream_fail(ss,
+					  "Request would exceed partition size!");
+	}
+
+	blks = info->write(info, ss->blk, blkcnt, buf);
+	/* blks might be > blkcnt (eg. NAND bad-blocks) */
+	if (blks < blkcnt) {
+		printf("%s: %s" LBAFU " [" LBAFU "]\n", __func__,
+		       "Write failed, block #", ss->blk, blks);
+		return sparse_stream_fail(ss, "flash write failure");
+	}
+	ss->blk += blks;
+	ss->bytes_written += blkcnt * info->blksz;
+
+	return 0;
+}
+
+/*
+ * Write raw data, which need not be a whole number of blocks. Any partial
+ * block at the end is kept until the rest of it arrives.
+ */
+static int sparse_stream_raw(struct sparse_stream *ss, const u8 *data,
+			     unsigned int len)
+{
+	unsigned int blksz = ss->info->blksz;
+	unsigned int blkcnt;
+	unsigned int n;
+
+	if (ss->blk_len) {
+		n = min(len, blksz - ss->blk_len);
+		memcpy(ss->blk_buf + ss->blk_len, data, n);
+		ss->blk_len += n;
+		data += n;
+		len -= n;
+		if (ss->blk_len < blksz)
+			return 0;
+		if (sparse_stream_put(ss, ss->blk_buf, 1))
+			return -EIO;
+		ss->blk_len = 0;
+	}
+
+	blkcnt = len / blksz;
+	if (blkcnt) {
+		if (sparse_stream_put(ss, data, blkcnt))
+			return -EIO;
+		data += blkcnt * blksz;
+		len -= blkcnt * blksz;
+	}
+
+	if (len) {
+		memcpy(ss->blk_buf, data, len);
+		ss->blk_len = len;
+	}
+
+	return 0;
+}
+
+/* Collect the next part of a header of @want bytes, return bytes used */
+static unsigned int sparse_stream_gather(struct sparse_stream *ss,
+					 const u8 *data, unsigned int len,
+					 unsigned int want)
+{
+	unsigned int n = min(len, want - ss->hdr_len);
+
+	if (ss->hdr_len < sizeof(ss->hdr_buf))
+		memcpy(ss->hdr_buf + ss->hdr_len, data,
+		       min_t(unsigned int, n,
+			     sizeof(ss->hdr_buf) - ss->hdr_len));
+	ss->hdr_len += n;
+
+	return n;
+}
+
+static void sparse_stream_next_chunk(struct sparse_stream *ss)
+{
+	ss->hdr_len = 0;
+	if (ss->chunks_left)
+		ss->state = SPARSE_STREAM_CHUNK_HDR;
+	else
+		ss->state = SPARSE_STREAM_DONE;
+}
+
+/* The image is not sparse, so write it as it is */
+static void sparse_stream_image(struct sparse_stream *ss)
+{
+	unsigned int blkcnt = DIV_ROUND_UP(ss->size, ss->info->blksz);
+	unsigned int n = ss->hdr_len;
+
+	if (blkcnt > ss->info->size) {
+		error("too large for partition: '%s'\n", ss->part_name);
+		sparse_stream_fail(ss, "too large for partition");
+		return;
+	}
+
+	puts("Flashing Raw Image\n");
+
+	ss->state = SPARSE_STREAM_IMAGE;
+	ss->remaining = ss->size - n;
+	ss->hdr_len = 0;
+	if (sparse_stream_raw(ss, ss->hdr_buf, n))
+		return;
+	if (!ss->remaining)
+		ss->state = SPARSE_STREAM_DONE;
+}
+
+static void sparse_stream_file_hdr(struct sparse_stream *ss)
+{
+	sparse_header_t *sparse_header = &ss->sparse_header;
+	unsigned int offset;
+
+	if (!is_sparse_image(ss->hdr_buf)) {
+		sparse_stream_image(ss);
+		return;
+	}
+	memcpy(sparse_header, ss->hdr_buf, sizeof(*sparse_header));
+
+	debug("=== Sparse Image Header ===\n");
+	debug("file_hdr_sz: %d\n", sparse_header->file_hdr_sz);
+	debug("chunk_hdr_sz: %d\n", sparse_header->chunk_hdr_sz);
+	debug("blk_sz: %d\n", sparse_header->blk_sz);
+	debug("total_blks: %d\n", sparse_header->total_blks);
+	debug("total_chunks: %d\n", sparse_header->total_chunks);
+
+	if (sparse_header->file_hdr_sz < sizeof(sparse_header_t) ||
+	    sparse_header->chunk_hdr_sz < sizeof(chunk_header_t)) {
+		sparse_stream_fail(ss, "sparse image header size issue");
+		return;
+	}
+
+	/*
+	 * Verify that the sparse block size is a multiple of our
+	 * storage backend block size
+	 */
+	div_u64_rem(sparse_header->blk_sz, ss->info->blksz, &offset);
+	if (offset) {
+		printf("%s: Sparse image block size issue [%u]\n",
+		       __func__, sparse_header->blk_sz);
+		sparse_stream_fail(ss, "sparse image block size issue");
+		return;
+	}
+
+	puts("Flashing Sparse Image\n");
+
+	ss->chunks_left = sparse_header->total_chunks;
+	/* Skip the remaining bytes of a header longer than we expected */
+	ss->remaining = sparse_header->file_hdr_sz - sizeof(sparse_header_t);
+	ss->hdr_len = 0;
+	if (ss->remaining)
+		ss->state = SPARSE_STREAM_SKIP;
+	else
+		sparse_stream_next_chunk(ss);
+}
+
+static void sparse_stream_chunk_hdr(struct sparse_stream *ss)
+{
+	sparse_header_t *sparse_header = &ss->sparse_header;
+	chunk_header_t *chunk_header = &ss->chunk_header;
+	struct sparse_storage *info = ss->info;
+	unsigned int chunk_data_sz;
+	lbaint_t blkcnt;
+
+	memcpy(chunk_header, ss->hdr_buf, sizeof(*chunk_header));
+	ss->hdr_len = 0;
+	ss->chunks_left--;
+
+	if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
+		debug("=== Chunk Header ===\n");
+		debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
+		debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
+		debug("total_size: 0x%x\n", chunk_header->total_sz);
+	}
+
+	if (chunk_header->total_sz < sparse_header->chunk_hdr_sz) {
+		sparse_stream_fail(ss, "Bogus chunk size");
+		return;
+	}
+
+	chunk_data_sz = sparse_header->blk_sz * chunk_header->chunk_sz;
+	switch (chunk_header->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (chunk_header->total_sz !=
+		    (sparse_header->chunk_hdr_sz + chunk_data_sz)) {
+			sparse_stream_fail(ss,
+					   "Bogus chunk size for chunk type Raw");
+			return;
+		}
+		ss->total_blocks += chunk_header->chunk_sz;
+		ss->remaining = chunk_data_sz;
+		if (ss->remaining)
+			ss->state = SPARSE_STREAM_RAW;
+		else
+			sparse_stream_next_chunk(ss);
+		return;
+
+	case CHUNK_TYPE_FILL:
+		if (chunk_header->total_sz !=
+		    (sparse_header->chunk_hdr_sz + sizeof(uint32_t))) {
+			sparse_stream_fail(ss,
+					   "Bogus chunk size for chunk type FILL");
+			return;
+		}
+		ss->state = SPARSE_STREAM_FILL;
+		return;
+
+	case CHUNK_TYPE_DONT_CARE:
+		blkcnt = chunk_data_sz / info->blksz;
+		ss->blk += info->reserve(info, ss->blk, blkcnt);
+		break;
+
+	case CHUNK_TYPE_CRC32:
+		break;
+
+	default:
+		printf("%s: Unknown chunk type: %x\n", __func__,
+		       chunk_header->chunk_type);
+		sparse_stream_fail(ss, "Unknown chunk type");
+		return;
+	}
+
+	ss->total_blocks += chunk_header->chunk_sz;
+	ss->remaining = chunk_header->total_sz - sparse_header->chunk_hdr_sz;
+	if (ss->remaining)
+		ss->state = SPARSE_STREAM_SKIP;
+	else
+		sparse_stream_next_chunk(ss);
+}
+
+static void sparse_stream_fill(struct sparse_stream *ss)
+{
+	struct sparse_storage *info = ss->info;
+	unsigned int fill_buf_num_blks;
+	unsigned int blkcnt;
+	uint32_t fill_val;
+	unsigned int i;
+	unsigned int j;
+
+	fill_buf_num_blks = CONFIG_FASTBOOT_FLASH_FILLBUF_SIZE / info->blksz;
+	blkcnt = ss->sparse_header.blk_sz * ss->chunk_header.chunk_sz /
+		 info->blksz;
+
+	if (!ss->fill_buf) {
+		ss->fill_buf = memalign(ARCH_DMA_MINALIGN,
+					ROUNDUP(info->blksz * fill_buf_num_blks,
+						ARCH_DMA_MINALIGN));
+		if (!ss->fill_buf) {
+			sparse_stream_fail(ss,
+					   "Malloc failed for: CHUNK_TYPE_FILL");
+			return;
+		}
+	}
+
+	memcpy(&fill_val, ss->hdr_buf, sizeof(fill_val));
+	for (i = 0; i < info->blksz * fill_buf_num_blks / sizeof(fill_val);
+	     i++)
+		ss->fill_buf[i] = fill_val;
+
+	for (i = 0; i < blkcnt; i += j) {
+		j = min(blkcnt - i, fill_buf_num_blks);
+		if (sparse_stream_put(ss, ss->fill_buf, j))
+			return;
+	}
+	ss->total_blocks += ss->chunk_header.chunk_sz;
+
+	sparse_stream_next_chunk(ss);
+}
+
+int sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info,
+			const char *part_name, unsigned int size)
+{
+	memset(ss, 0, sizeof(*ss));
+	ss->info = info;
+	ss->part_name = part_name;
+	ss->size = size;
+	ss->state = SPARSE_STREAM_FILE_HDR;
+	ss->blk = info->start;
+
+	ss->blk_buf = memalign(ARCH_DMA_MINALIGN,
+			       ROUNDUP(info->blksz, ARCH_DMA_MINALIGN));
+	if (!ss->blk_buf) {
+		sparse_stream_fail(ss, "Malloc failed for sparse stream");
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+int sparse_stream_write(struct sparse_stream *ss, const void *data,
+			unsigned int len)
+{
+	const u8 *p = data;
+	unsigned int n;
+
+	while (len) {
+		switch (ss->state) {
+		case SPARSE_STREAM_FILE_HDR:
+			n = sparse_stream_gather(ss, p, len,
+						 sizeof(sparse_header_t));
+			if (ss->hdr_len == sizeof(sparse_header_t))
+				sparse_stream_file_hdr(ss);
+			break;
+
+		case SPARSE_STREAM_CHUNK_HDR:
+			n = sparse_stream_gather(ss, p, len,
+						 ss->sparse_header.chunk_hdr_sz);
+			if (ss->hdr_len == ss->sparse_header.chunk_hdr_sz)
+				sparse_stream_chunk_hdr(ss);
+			break;
+
+		case SPARSE_STREAM_FILL:
+			n = sparse_stream_gather(ss, p, len, sizeof(uint32_t));
+			if (ss->hdr_len == sizeof(uint32_t))
+				sparse_stream_fill(ss);
+			break;
+
+		case SPARSE_STREAM_RAW:
+		case SPARSE_STREAM_IMAGE:
+			n = min(len, ss->remaining);
+			if (sparse_stream_raw(ss, p, n))
+				break;
+			ss->remaining -= n;
+			if (ss->remaining)
+				break;
+			if (ss->state == SPARSE_STREAM_IMAGE)
+				ss->state = SPARSE_STREAM_DONE;
+			else
+				sparse_stream_next_chunk(ss);
+			break;
+
+		case SPARSE_STREAM_SKIP:
+			n = min(len, ss->remaining);
+			ss->remaining -= n;
+			if (!ss->remaining)
+				sparse_stream_next_chunk(ss);
+			break;
+
+		case SPARSE_STREAM_ERROR:
+			return -EIO;
+
+		default:
+			/* Anything after the end of the image is ignored */
+			return 0;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return ss->state == SPARSE_STREAM_ERROR ? -EIO : 0;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss)
+{
+	unsigned int blksz = ss->info->blksz;
+
+	/* An image shorter than a sparse header can only be a raw one */
+	if (ss->state == SPARSE_STREAM_FILE_HDR && ss->hdr_len)
+		sparse_stream_image(ss);
+
+	/* Pad the last block of a raw image */
+	if (ss->state == SPARSE_STREAM_DONE && ss->blk_len) {
+		memset(ss->blk_buf + ss->blk_len, '\0', blksz - ss->blk_len);
+		sparse_stream_put(ss, ss->blk_buf, 1);
+		ss->blk_len = 0;
+	}
+
+	if (ss->state != SPARSE_STREAM_ERROR &&
+	    ss->sparse_header.magic == SPARSE_HEADER_MAGIC) {
+		debug("Wrote %d blocks, expected to write %d blocks\n",
+		      ss->total_blocks, ss->sparse_header.total_blks);
+		if (ss->state != SPARSE_STREAM_DONE)
+			sparse_stream_fail(ss, "sparse image truncated");
+		else if (ss->total_blocks != ss->sparse_header.total_blks)
+			sparse_stream_fail(ss, "sparse image write failure");
+	} else if (ss->state != SPARSE_STREAM_ERROR &&
+		   ss->state != SPARSE_STREAM_DONE) {
+		sparse_stream_fail(ss, "image truncated");
+	}
+
+	sparse_stream_abort(ss);
+	if (ss->state == SPARSE_STREAM_ERROR)
+		return -EIO;
+
+	printf("........ wrote %llu bytes to '%s'\n",
+	       (unsigned long long)ss->bytes_written, ss->part_name);
+
+	return 0;
+}
+
+void sparse_stream_abort(struct sparse_stream *ss)
+{
+	free(ss->fill_buf);
+	ss->fill_buf = NULL;
+	free(ss->blk_buf);
+	ss->blk_buf = NULL;
+}
+#endif
@@ -59,11 +59,12 @@ static int dev_index;
  */
 int usb_init(void)
 {
-	void *ctrl;
+	void *ctrl[CONFIG_USB_MAX_CONTROLLER_COUNT];
+	bool scanned[CONFIG_USB_MAX_CONTROLLER_COUNT];
 	struct usb_device *dev;
-	int i, start_index = 0;
+	int i, j, count;
 	int controllers_initialized = 0;
-	int ret;
+	int ret, scan_ret;
 
 	dev_index = 0;
 	asynch_allowed = 1;
@@ -75,11 +76,16 @@ int usb_init(void)
 		usb_dev[i].devnum = -1;
 	}
 
-	/* init low_level USB */
+	/*
+	 * Set up the root hubs of all controllers first, so that their ports
+	 * are scanned together.
+	 */
+	memset(scanned, '\0', sizeof(scanned));
+	usb_hub_scan_begin();
 	for (i = 0; i < CONFIG_USB_MAX_CONTROLLER_COUNT; i++) {
 		/* init low_level USB */
 		printf("USB%d:   ", i);
-		ret = usb_lowlevel_init(i, USB_INIT_HOST, &ctrl);
+		ret = usb_lowlevel_init(i, USB_INIT_HOST, &ctrl[i]);
 		if (ret == -ENODEV) {	/* No such device. */
 			puts("Port not available.\n");
 			controllers_initialized++;
@@ -95,9 +101,8 @@ int usb_init(void)
 		 * i.e. search HUBs and configure them
 		 */
 		controllers_initialized++;
-		start_index = dev_index;
-		printf("scanning bus %d for devices... ", i);
-		ret = usb_alloc_new_device(ctrl, &dev);
+		scanned[i] = true;
+		ret = usb_alloc_new_device(ctrl[i], &dev);
 		if (ret)
 			break;
 
@@ -108,16 +113,30 @@ int usb_init(void)
 		ret = usb_new_device(dev);
 		if (ret)
 			usb_free_device(dev->controller);
+	}
+	scan_ret = usb_hub_scan_end();
 
-		if (start_index == dev_index) {
-			puts("No USB Device found\n");
+	for (i = 0; i < CONFIG_USB_MAX_CONTROLLER_COUNT; i++) {
+		if (!scanned[i])
 			continue;
-		} else {
-			printf("%d USB Device(s) found\n",
-				dev_index - start_index);
+
+		count = 0;
+		for (j = 0; j < dev_index; j++) {
+			if (usb_dev[j].controller == ctrl[i])
+				count++;
 		}
 
-		usb_started = 1;
+		printf("scanning bus %d for devices... ", i);
+		/* The port scan stopped early, so it is incomplete on all */
+		if (scan_ret)
+			printf("failed, error %d\n", scan_ret);
+		else if (!count)
+			puts("No USB Device found\n");
+		else
+			printf("%d USB Device(s) found\n", count);
+
+		if (count)
+			usb_started = 1;
 	}
 
 	debug("scan end\n");
@@ -285,6 +304,59 @@ int usb_bulk_msg(struct usb_device *dev, unsigned int pipe,
 		return -EIO;
 }
 
+__weak int submit_bulk_queue(struct usb_device *dev, unsigned long pipe,
+			     struct usb_bulk_xfer *xfer, int count)
+{
+	return -ENOSYS;
+}
+
+/*
+ * Queue several bulk transfers on one pipe, e.g. the data and status stages
+ * of a mass storage command, so that the controller can run them back to
+ * back. A short transfer only ends that one. Controllers which cannot queue
+ * them get them one at a time.
+ *
+ * Returns 0 if all of them succeeded, else -EIO with the status of the
+ * failed one set.
+ */
+int usb_bulk_queue(struct usb_device *dev, unsigned int pipe,
+		   struct usb_bulk_xfer *xfer, int count, int timeout)
+{
+	int i, ret;
+
+	for (i = 0; i < count; i++) {
+		if (xfer[i].length < 0)
+			return -EINVAL;
+		xfer[i].act_len = 0;
+		xfer[i].status = USB_ST_NOT_PROC;
+	}
+
+	dev->status = USB_ST_NOT_PROC; /*not yet processed */
+	ret = submit_bulk_queue(dev, pipe, xfer, count);
+	if (ret == -ENOSYS) {
+		for (i = 0; i < count; i++) {
+			ret = usb_bulk_msg(dev, pipe, xfer[i].buffer,
+					   xfer[i].length, &xfer[i].act_len,
+					   timeout);
+			xfer[i].status = dev->status;
+			if (ret)
+				return ret;
+		}
+		return 0;
+	}
+	if (ret < 0)
+		return -EIO;
+	while (timeout--) {
+		if (!((volatile unsigned long)dev->status & USB_ST_NOT_PROC))
+			break;
+		mdelay(1);
+	}
+	if (dev->status == 0)
+		return 0;
+	else
+		return -EIO;
+}
+
 
 /*-------------------------------------------------------------------
  * Max Packet stuff
@@ -23,6 +23,7 @@
  */
 
 #include <common.h>
+#include <bootstage.h>
 #include <command.h>
 #include <dm.h>
 #include <errno.h>
@@ -51,10 +52,20 @@ DECLARE_GLOBAL_DATA_PTR;
 
 #define PORT_OVERCURRENT_MAX_SCAN_COUNT		3
 
+enum usb_scan_state {
+	USB_SCAN_CONNECT,		/* Waiting for a device to connect */
+	USB_SCAN_RESET,			/* Waiting for the port reset to end */
+};
+
 struct usb_device_scan {
 	struct usb_device *dev;		/* USB hub device to scan */
 	struct usb_hub_device *hub;	/* USB hub struct */
 	int port;			/* USB port to scan */
+	enum usb_scan_state state;
+	unsigned short portstatus;	/* Port status when it connected */
+	unsigned short portchange;	/* Port change when it connected */
+	ulong reset_timeout;		/* When to look at the port reset */
+	int reset_tries;
 	struct list_head list;
 };
 
@@ -62,6 +73,7 @@ struct usb_device_scan {
 static struct usb_hub_device hub_dev[USB_MAX_HUB];
 static int usb_hub_index;
 static LIST_HEAD(usb_scan_list);
+static int usb_scan_running;
 
 __weak void usb_hub_reset_devices(int port)
 {
@@ -198,12 +210,62 @@ static inline char *portspeed(int portstatus)
 	return speed_str;
 }
 
+/*
+ * Check whether a port reset, started by setting USB_PORT_FEAT_RESET, has
+ * enabled the port. Returns 0 and the port status if so, -EAGAIN if the port
+ * is not enabled (yet), or another error.
+ */
+static int hub_port_reset_done(struct usb_device *dev, int port,
+			       unsigned short *portstat)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
+	unsigned short portstatus, portchange;
+
+	if (usb_get_port_status(dev, port + 1, portsts) < 0) {
+		debug("get_port_status failed status %lX\n", dev->status);
+		return -1;
+	}
+	portstatus = le16_to_cpu(portsts->wPortStatus);
+	portchange = le16_to_cpu(portsts->wPortChange);
+
+	debug("portstatus %x, change %x, %s\n", portstatus, portchange,
+						portspeed(portstatus));
+
+	debug("STAT_C_CONNECTION = %d STAT_CONNECTION = %d" \
+	      "  USB_PORT_STAT_ENABLE %d\n",
+	      (portchange & USB_PORT_STAT_C_CONNECTION) ? 1 : 0,
+	      (portstatus & USB_PORT_STAT_CONNECTION) ? 1 : 0,
+	      (portstatus & USB_PORT_STAT_ENABLE) ? 1 : 0);
+
+	/*
+	 * Perhaps we should check for the following here:
+	 * - C_CONNECTION hasn't been set.
+	 * - CONNECTION is still set.
+	 *
+	 * Doing so would ensure that the device is still connected
+	 * to the bus, and hasn't been unplugged or replaced while the
+	 * USB bus reset was going on.
+	 *
+	 * However, if we do that, then (at least) a San Disk Ultra
+	 * USB 3.0 16GB device fails to reset on (at least) an NVIDIA
+	 * Tegra Jetson TK1 board. For some reason, the device appears
+	 * to briefly drop off the bus when this second bus reset is
+	 * executed, yet if we retry this loop, it'll eventually come
+	 * back after another reset or two.
+	 */
+
+	if (!(portstatus & USB_PORT_STAT_ENABLE))
+		return -EAGAIN;
+
+	usb_clear_port_feature(dev, port + 1, USB_PORT_FEAT_C_RESET);
+	*portstat = portstatus;
+	return 0;
+}
+
 int legacy_hub_port_reset(struct usb_device *dev, int port,
 			unsigned short *portstat)
 {
 	int err, tries;
-	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
-	unsigned short portstatus, portchange;
 	int delay = HUB_SHORT_RESET_TIME; /* start with short reset delay */
 
 #ifdef CONFIG_DM_USB
@@ -219,57 +281,18 @@ int legacy_hub_port_reset(struct usb_device *dev, int port,
 
 		mdelay(delay);
 
-		if (usb_get_port_status(dev, port + 1, portsts) < 0) {
-			debug("get_port_status failed status %lX\n",
-			      dev->status);
-			return -1;
-		}
-		portstatus = le16_to_cpu(portsts->wPortStatus);
-		portchange = le16_to_cpu(portsts->wPortChange);
-
-		debug("portstatus %x, change %x, %s\n", portstatus, portchange,
-							portspeed(portstatus));
-
-		debug("STAT_C_CONNECTION = %d STAT_CONNECTION = %d" \
-		      "  USB_PORT_STAT_ENABLE %d\n",
-		      (portchange & USB_PORT_STAT_C_CONNECTION) ? 1 : 0,
-		      (portstatus & USB_PORT_STAT_CONNECTION) ? 1 : 0,
-		      (portstatus & USB_PORT_STAT_ENABLE) ? 1 : 0);
-
-		/*
-		 * Perhaps we should check for the following here:
-		 * - C_CONNECTION hasn't been set.
-		 * - CONNECTION is still set.
-		 *
-		 * Doing so would ensure that the device is still connected
-		 * to the bus, and hasn't been unplugged or replaced while the
-		 * USB bus reset was going on.
-		 *
-		 * However, if we do that, then (at least) a San Disk Ultra
-		 * USB 3.0 16GB device fails to reset on (at least) an NVIDIA
-		 * Tegra Jetson TK1 board. For some reason, the device appears
-		 * to briefly drop off the bus when this second bus reset is
-		 * executed, yet if we retry this loop, it'll eventually come
-		 * back after another reset or two.
-		 */
-
-		if (portstatus & USB_PORT_STAT_ENABLE)
-			break;
+		err = hub_port_reset_done(dev, port, portstat);
+		if (err != -EAGAIN)
+			return err;
 
 		/* Switch to long reset delay for the next round */
 		delay = HUB_LONG_RESET_TIME;
 	}
 
-	if (tries == MAX_TRIES) {
-		debug("Cannot enable port %i after %i retries, " \
-		      "disabling port.\n", port + 1, MAX_TRIES);
-		debug("Maybe the USB cable is bad?\n");
-		return -1;
-	}
-
-	usb_clear_port_feature(dev, port + 1, USB_PORT_FEAT_C_RESET);
-	*portstat = portstatus;
-	return 0;
+	debug("Cannot enable port %i after %i retries, " \
+	      "disabling port.\n", port + 1, MAX_TRIES);
+	debug("Maybe the USB cable is bad?\n");
+	return -1;
 }
 
 #ifdef CONFIG_DM_USB
@@ -281,11 +304,15 @@ int hub_port_reset(struct udevice *dev, int port, unsigned short *portstat)
 }
 #endif
 
-int usb_hub_port_connect_change(struct usb_device *dev, int port)
+/*
+ * Acknowledge a connection change on a port. Returns 0 if a device is
+ * connected and the port should be reset, -ENOTCONN if not.
+ */
+static int hub_port_connect(struct usb_device *dev, int port)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
 	unsigned short portstatus;
-	int ret, speed;
+	int ret;
 
 	/* Check status */
 	ret = usb_get_port_status(dev, port + 1, portsts);
@@ -313,13 +340,14 @@ int usb_hub_port_connect_change(struct usb_device *dev, int port)
 			return -ENOTCONN;
 	}
 
-	/* Reset the port */
-	ret = legacy_hub_port_reset(dev, port, &portstatus);
-	if (ret < 0) {
-		if (ret != -ENXIO)
-			printf("cannot reset port %i!?\n", port + 1);
-		return ret;
-	}
+	return 0;
+}
+
+/* Set up the device on a port which has been reset with this status */
+static int hub_port_new_device(struct usb_device *dev, int port,
+			       unsigned short portstatus)
+{
+	int ret, speed;
 
 	switch (portstatus & USB_PORT_STAT_SPEED_MASK) {
 	case USB_PORT_STAT_SUPER_SPEED:
@@ -369,66 +397,79 @@ int usb_hub_port_connect_change(struct usb_device *dev, int port)
 	return ret;
 }
 
-static int usb_scan_port(struct usb_device_scan *usb_scan)
+int usb_hub_port_connect_change(struct usb_device *dev, int port)
 {
-	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
 	unsigned short portstatus;
-	unsigned short portchange;
-	struct usb_device *dev;
-	struct usb_hub_device *hub;
-	int ret = 0;
-	int i;
-
-	dev = usb_scan->dev;
-	hub = usb_scan->hub;
-	i = usb_scan->port;
+	int ret;
 
-	/*
-	 * Don't talk to the device before the query delay is expired.
-	 * This is needed for voltages to stabalize.
-	 */
-	if (get_timer(0) < hub->query_delay)
-		return 0;
+	ret = hub_port_connect(dev, port);
+	if (ret)
+		return ret;
 
-	ret = usb_get_port_status(dev, i + 1, portsts);
+	/* Reset the port */
+	ret = legacy_hub_port_reset(dev, port, &portstatus);
 	if (ret < 0) {
-		debug("get_port_status failed\n");
-		if (get_timer(0) >= hub->connect_timeout) {
-			debug("devnum=%d port=%d: timeout\n",
-			      dev->devnum, i + 1);
-			/* Remove this device from scanning list */
-			list_del(&usb_scan->list);
-			free(usb_scan);
-			return 0;
-		}
-		return 0;
+		if (ret != -ENXIO)
+			printf("cannot reset port %i!?\n", port + 1);
+		return ret;
 	}
 
-	portstatus = le16_to_cpu(portsts->wPortStatus);
-	portchange = le16_to_cpu(portsts->wPortChange);
-	debug("Port %d Status %X Change %X\n", i + 1, portstatus, portchange);
+	return hub_port_new_device(dev, port, portstatus);
+}
 
-	/* No connection change happened, wait a bit more. */
-	if (!(portchange & USB_PORT_STAT_C_CONNECTION)) {
-		if (get_timer(0) >= hub->connect_timeout) {
-			debug("devnum=%d port=%d: timeout\n",
-			      dev->devnum, i + 1);
-			/* Remove this device from scanning list */
-			list_del(&usb_scan->list);
-			free(usb_scan);
-			return 0;
-		}
-		return 0;
+/*
+ * A device answers at address 0 from its port reset until it is given an
+ * address, so only one port on each bus may be reset at a time.
+ */
+static bool usb_scan_bus_busy(struct usb_device *dev)
+{
+	struct usb_device_scan *usb_scan;
+
+	list_for_each_entry(usb_scan, &usb_scan_list, list) {
+		if (usb_scan->state != USB_SCAN_RESET)
+			continue;
+#ifdef CONFIG_DM_USB
+		if (usb_scan->dev->controller_dev == dev->controller_dev)
+#else
+		if (usb_scan->dev->controller == dev->controller)
+#endif
+			return true;
 	}
 
-	/* Test if the connection came up, and if not exit */
-	if (!(portstatus & USB_PORT_STAT_CONNECTION))
-		return 0;
+	return false;
+}
 
-	/* A new USB device is ready at this point */
-	debug("devnum=%d port=%d: USB dev found\n", dev->devnum, i + 1);
+/* Start a port reset, to be checked once @delay ms have passed */
+static int usb_scan_port_reset_start(struct usb_device_scan *usb_scan,
+				     int delay)
+{
+	int ret;
 
-	usb_hub_port_connect_change(dev, i);
+	ret = usb_set_port_feature(usb_scan->dev, usb_scan->port + 1,
+				   USB_PORT_FEAT_RESET);
+	if (ret < 0)
+		return ret;
+
+#ifdef CONFIG_SANDBOX
+	if (state_get_skip_delays())
+		delay = 0;
+#endif
+	usb_scan->state = USB_SCAN_RESET;
+	usb_scan->reset_timeout = get_timer(0) + delay;
+
+	return 0;
+}
+
+/* Deal with the port changes seen on connection, once the port is set up */
+static int usb_scan_port_done(struct usb_device_scan *usb_scan)
+{
+	unsigned short portstatus = usb_scan->portstatus;
+	unsigned short portchange = usb_scan->portchange;
+	struct usb_device *dev = usb_scan->dev;
+	struct usb_hub_device *hub = usb_scan->hub;
+	int i = usb_scan->port;
+
+	usb_scan->state = USB_SCAN_CONNECT;
 
 	if (portchange & USB_PORT_STAT_C_ENABLE) {
 		debug("port %d enable change, status %x\n", i + 1, portstatus);
@@ -494,18 +535,139 @@ static int usb_scan_port(struct usb_device_scan *usb_scan)
 	return 0;
 }
 
+/* See whether the port reset has finished, and set up the device if so */
+static int usb_scan_port_reset(struct usb_device_scan *usb_scan)
+{
+	struct usb_device *dev = usb_scan->dev;
+	unsigned short portstatus;
+	int i = usb_scan->port;
+	int ret;
+
+	if (get_timer(0) < usb_scan->reset_timeout)
+		return 0;
+
+	ret = hub_port_reset_done(dev, i, &portstatus);
+	if (ret == -EAGAIN) {
+		/* Switch to long reset delay for the next round */
+		if (++usb_scan->reset_tries < MAX_TRIES) {
+			ret = usb_scan_port_reset_start(usb_scan,
+							HUB_LONG_RESET_TIME);
+			if (!ret)
+				return 0;
+		} else {
+			debug("Cannot enable port %i after %i retries, " \
+			      "disabling port.\n", i + 1, MAX_TRIES);
+			debug("Maybe the USB cable is bad?\n");
+			ret = -1;
+		}
+	}
+	if (ret < 0) {
+		if (ret != -ENXIO)
+			printf("cannot reset port %i!?\n", i + 1);
+	} else {
+		hub_port_new_device(dev, i, portstatus);
+	}
+
+	return usb_scan_port_done(usb_scan);
+}
+
+static int usb_scan_port(struct usb_device_scan *usb_scan)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
+	unsigned short portstatus;
+	unsigned short portchange;
+	struct usb_device *dev;
+	struct usb_hub_device *hub;
+	int ret = 0;
+	int i;
+
+	dev = usb_scan->dev;
+	hub = usb_scan->hub;
+	i = usb_scan->port;
+
+	if (usb_scan->state == USB_SCAN_RESET)
+		return usb_scan_port_reset(usb_scan);
+
+	/*
+	 * Don't talk to the device before the query delay is expired.
+	 * This is needed for voltages to stabalize.
+	 */
+	if (get_timer(0) < hub->query_delay)
+		return 0;
+
+	ret = usb_get_port_status(dev, i + 1, portsts);
+	if (ret < 0) {
+		debug("get_port_status failed\n");
+		if (get_timer(0) >= hub->connect_timeout) {
+			debug("devnum=%d port=%d: timeout\n",
+			      dev->devnum, i + 1);
+			/* Remove this device from scanning list */
+			list_del(&usb_scan->list);
+			free(usb_scan);
+			return 0;
+		}
+		return 0;
+	}
+
+	portstatus = le16_to_cpu(portsts->wPortStatus);
+	portchange = le16_to_cpu(portsts->wPortChange);
+	debug("Port %d Status %X Change %X\n", i + 1, portstatus, portchange);
+
+	/* No connection change happened, wait a bit more. */
+	if (!(portchange & USB_PORT_STAT_C_CONNECTION)) {
+		if (get_timer(0) >= hub->connect_timeout) {
+			debug("devnum=%d port=%d: timeout\n",
+			      dev->devnum, i + 1);
+			/* Remove this device from scanning list */
+			list_del(&usb_scan->list);
+			free(usb_scan);
+			return 0;
+		}
+		return 0;
+	}
+
+	/* Test if the connection came up, and if not exit */
+	if (!(portstatus & USB_PORT_STAT_CONNECTION))
+		return 0;
+
+	/* Wait for any other device on this bus to get its address */
+	if (usb_scan_bus_busy(dev))
+		return 0;
+
+	/* A new USB device is ready at this point */
+	debug("devnum=%d port=%d: USB dev found\n", dev->devnum, i + 1);
+
+	usb_scan->portstatus = portstatus;
+	usb_scan->portchange = portchange;
+	if (!hub_port_connect(dev, i)) {
+		/* Reset the port, and come back once it has had time */
+		usb_scan->reset_tries = 0;
+		ret = usb_scan_port_reset_start(usb_scan,
+						HUB_SHORT_RESET_TIME);
+		if (!ret)
+			return 0;
+		printf("cannot reset port %i!?\n", i + 1);
+	}
+
+	return usb_scan_port_done(usb_scan);
+}
+
 static int usb_device_list_scan(void)
 {
 	struct usb_device_scan *usb_scan;
 	struct usb_device_scan *tmp;
-	static int running;
 	int ret = 0;
 
-	/* Only run this loop once for each controller */
-	if (running)
+	/*
+	 * Only run this loop once. Hubs found while it runs, and those on
+	 * other controllers set up before usb_hub_scan_end(), add their
+	 * ports to the list and are scanned together.
+	 */
+	if (usb_scan_running)
 		return 0;
 
-	running = 1;
+	usb_scan_running = 1;
+	bootstage_start(BOOTSTAGE_ID_ACCUM_USB_SCAN, "usb_scan");
 
 	while (1) {
 		/* We're done, once the list is empty again */
@@ -513,8 +675,6 @@ static int usb_device_list_scan(void)
 			goto out;
 
 		list_for_each_entry_safe(usb_scan, tmp, &usb_scan_list, list) {
-			int ret;
-
 			/* Scan this port */
 			ret = usb_scan_port(usb_scan);
 			if (ret)
@@ -524,15 +684,27 @@ static int usb_device_list_scan(void)
 
 out:
 	/*
-	 * This USB controller has finished scanning all its connected
-	 * USB devices. Set "running" back to 0, so that other USB controllers
-	 * will scan their devices too.
+	 * All the connected USB devices have been scanned. Set "running"
+	 * back to 0, so that the next scan can start.
 	 */
-	running = 0;
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_USB_SCAN);
+	usb_scan_running = 0;
 
 	return ret;
 }
 
+void usb_hub_scan_begin(void)
+{
+	usb_scan_running = 1;
+}
+
+int usb_hub_scan_end(void)
+{
+	usb_scan_running = 0;
+
+	return usb_device_list_scan();
+}
+
 static int usb_hub_configure(struct usb_device *dev)
 {
 	int i, length;
@@ -47,6 +47,7 @@
 
 #include <part.h>
 #include <usb.h>
+#include <u-boot/crc.h>
 
 #undef BBB_COMDAT_TRACE
 #undef BBB_XPORT_TRACE
@@ -100,7 +101,21 @@ struct us_data {
 	trans_cmnd	transport;		/* transport routine */
 };
 
-#ifdef CONFIG_USB_EHCI
+/* Blocks per command when the controller gives no limit */
+#define USB_MAX_XFER_BLK_DEFAULT	20
+
+#ifdef CONFIG_DM_USB
+/* The SCSI READ(10) and WRITE(10) commands are limited to 65535 blocks */
+#define USB_MAX_XFER_BLK	65535
+#elif defined(CONFIG_USB_XHCI_HCD)
+/*
+ * Without driver model there is only one kind of controller. The xHCI
+ * driver takes a transfer of up to some 60MB on a bulk endpoint
+ * (XHCI_BULK_RING_SEGS). Transfer 4MB at a time with 512-byte blocks, which
+ * is enough to keep a USB 3.0 stick busy, and still fits with 4k blocks.
+ */
+#define USB_MAX_XFER_BLK	8192
+#elif defined(CONFIG_USB_EHCI)
 /*
  * The U-Boot EHCI driver can handle any transfer length as long as there is
  * enough free heap space left, but the SCSI READ(10) and WRITE(10) commands are
@@ -108,7 +123,7 @@ struct us_data {
  */
 #define USB_MAX_XFER_BLK	65535
 #else
-#define USB_MAX_XFER_BLK	20
+#define USB_MAX_XFER_BLK	USB_MAX_XFER_BLK_DEFAULT
 #endif
 
 #ifndef CONFIG_BLK
@@ -194,6 +209,216 @@ static unsigned int usb_get_max_lun(struct us_data *us)
 	return (len > 0) ? *result : 0;
 }
 
+#ifdef CONFIG_USB_STORAGE_CACHE
+/*
+ * What was found on a LUN the last time it was scanned. When a device comes
+ * back with the same IDs and serial number, e.g. after 'usb reset', INQUIRY,
+ * READ CAPACITY and the partition-table probe are skipped, as long as its
+ * first two blocks still have the same checksum.
+ */
+struct usb_stor_cache {
+	bool		valid;
+	unsigned short	vendor_id;
+	unsigned short	product_id;
+	unsigned char	lun;
+	char		serial[32];
+	unsigned char	type;
+	unsigned char	removable;
+	char		vendor[40 + 1];
+	char		product[20 + 1];
+	char		revision[8 + 1];
+	lbaint_t	lba;
+	unsigned long	blksz;
+	unsigned char	part_type;
+	u32		crc;
+};
+
+static struct usb_stor_cache usb_stor_cache[USB_MAX_STOR_DEV];
+static int usb_stor_cache_next;
+
+static bool usb_stor_cache_match(struct usb_stor_cache *ent,
+				 struct usb_device *udev, int lun)
+{
+	return ent->vendor_id == udev->descriptor.idVendor &&
+		ent->product_id == udev->descriptor.idProduct &&
+		ent->lun == lun && !strcmp(ent->serial, udev->serial);
+}
+
+static struct usb_stor_cache *usb_stor_cache_find(struct usb_device *udev,
+						  int lun)
+{
+	int i;
+
+	/* Without a serial number we cannot tell two sticks apart */
+	if (!udev->serial[0])
+		return NULL;
+	for (i = 0; i < USB_MAX_STOR_DEV; i++) {
+		struct usb_stor_cache *ent = &usb_stor_cache[i];
+
+		if (ent->valid && usb_stor_cache_match(ent, udev, lun))
+			return ent;
+	}
+
+	return NULL;
+}
+
+static void usb_stor_cache_add(struct usb_device *udev,
+			       struct blk_desc *dev_desc, u32 crc)
+{
+	struct usb_stor_cache *ent = NULL;
+	int i;
+
+	if (!udev->serial[0])
+		return;
+	for (i = 0; i < USB_MAX_STOR_DEV; i++) {
+		if (usb_stor_cache_match(&usb_stor_cache[i], udev,
+					 dev_desc->lun)) {
+			ent = &usb_stor_cache[i];
+			break;
+		}
+	}
+	if (!ent) {
+		ent = &usb_stor_cache[usb_stor_cache_next];
+		usb_stor_cache_next = (usb_stor_cache_next + 1) %
+			USB_MAX_STOR_DEV;
+	}
+
+	ent->vendor_id = udev->descriptor.idVendor;
+	ent->product_id = udev->descriptor.idProduct;
+	ent->lun = dev_desc->lun;
+	strlcpy(ent->serial, udev->serial, sizeof(ent->serial));
+	ent->type = dev_desc->type;
+	ent->removable = dev_desc->removable;
+	strcpy(ent->vendor, dev_desc->vendor);
+	strcpy(ent->product, dev_desc->product);
+	strcpy(ent->revision, dev_desc->revision);
+	ent->lba = dev_desc->lba;
+	ent->blksz = dev_desc->blksz;
+	ent->part_type = dev_desc->part_type;
+	ent->crc = crc;
+	ent->valid = true;
+}
+
+/* Fill in the INQUIRY details of @dev_desc from the last scan, if any */
+static bool usb_stor_cache_get_ident(struct usb_device *udev,
+				     struct blk_desc *dev_desc)
+{
+	struct usb_stor_cache *ent = usb_stor_cache_find(udev, dev_desc->lun);
+
+	if (!ent)
+		return false;
+	dev_desc->type = ent->type;
+	dev_desc->removable = ent->removable;
+	strcpy(dev_desc->vendor, ent->vendor);
+	strcpy(dev_desc->product, ent->product);
+	strcpy(dev_desc->revision, ent->revision);
+
+	return true;
+}
+
+/* Fill in the capacity of @dev_desc from the last scan, if any */
+static bool usb_stor_cache_get_capacity(struct usb_device *udev,
+					struct blk_desc *dev_desc)
+{
+	struct usb_stor_cache *ent = usb_stor_cache_find(udev, dev_desc->lun);
+
+	if (!ent)
+		return false;
+	dev_desc->lba = ent->lba;
+	dev_desc->blksz = ent->blksz;
+	dev_desc->log2blksz = LOG2(ent->blksz);
+
+	return true;
+}
+
+/* Checksum the first two blocks, which hold the partition table headers */
+static int usb_stor_cache_crc(struct blk_desc *dev_desc, u32 *crcp)
+{
+	void *buf;
+	int ret = 0;
+
+	if (dev_desc->lba < 2)
+		return -ENODEV;
+	buf = malloc_cache_aligned(2 * dev_desc->blksz);
+	if (!buf)
+		return -ENOMEM;
+	if (blk_dread(dev_desc, 0, 2, buf) == 2)
+		*crcp = crc32(0, buf, 2 * dev_desc->blksz);
+	else
+		ret = -EIO;
+	free(buf);
+
+	return ret;
+}
+
+void usb_stor_cache_invalidate(void)
+{
+	memset(usb_stor_cache, '\0', sizeof(usb_stor_cache));
+}
+
+/*
+ * Set the partition type of a LUN, reusing the last scan if the first two
+ * blocks are unchanged. If they have changed and the cache was used to set
+ * up @dev_desc, fetch its details from the device again.
+ */
+static int usb_stor_part_init(struct usb_device *udev, struct us_data *ss,
+			      struct blk_desc *dev_desc)
+{
+	struct usb_stor_cache *ent;
+	u32 crc;
+	int ret;
+
+	ent = usb_stor_cache_find(udev, dev_desc->lun);
+	/* Blocks cached from before a medium change must not be checked */
+	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
+	ret = usb_stor_cache_crc(dev_desc, &crc);
+	if (ent && !ret && ent->crc == crc) {
+		debug("%s: Using cached details for '%s'\n", __func__,
+		      udev->serial);
+		dev_desc->part_type = ent->part_type;
+		return 0;
+	}
+	if (ent) {
+		ent->valid = false;
+		/* If the medium has changed, its capacity may have too */
+		if (ret != -ENODEV) {
+			if (usb_stor_get_info(udev, ss, dev_desc) != 1)
+				return -ENODEV;
+			ret = usb_stor_cache_crc(dev_desc, &crc);
+		}
+	}
+	part_init(dev_desc);
+	if (!ret)
+		usb_stor_cache_add(udev, dev_desc, crc);
+
+	return 0;
+}
+#else
+static bool usb_stor_cache_get_ident(struct usb_device *udev,
+				     struct blk_desc *dev_desc)
+{
+	return false;
+}
+
+static bool usb_stor_cache_get_capacity(struct usb_device *udev,
+					struct blk_desc *dev_desc)
+{
+	return false;
+}
+
+void usb_stor_cache_invalidate(void)
+{
+}
+
+static int usb_stor_part_init(struct usb_device *udev, struct us_data *ss,
+			      struct blk_desc *dev_desc)
+{
+	part_init(dev_desc);
+
+	return 0;
+}
+#endif
+
 static int usb_stor_probe_device(struct usb_device *udev)
 {
 	int lun, max_lun;
@@ -239,7 +464,7 @@ static int usb_stor_probe_device(struct usb_device *udev)
 
 		ret = usb_stor_get_info(udev, data, blkdev);
 		if (ret == 1)
-			ret = blk_prepare_device(dev);
+			ret = usb_stor_part_init(udev, data, blkdev);
 		if (!ret) {
 			usb_max_devs++;
 			debug("%s: Found device %p\n", __func__, udev);
@@ -285,9 +510,8 @@ static int usb_stor_probe_device(struct usb_device *udev)
 		blkdev->priv = udev;
 
 		if (usb_stor_get_info(udev, &usb_stor[start],
-				      &usb_dev_desc[usb_max_devs]) == 1) {
-			debug("partype: %d\n", blkdev->part_type);
-			part_init(blkdev);
+				      &usb_dev_desc[usb_max_devs]) == 1 &&
+		    !usb_stor_part_init(udev, &usb_stor[start], blkdev)) {
 			debug("partype: %d\n", blkdev->part_type);
 			usb_max_devs++;
 			debug("%s: Found device %p\n", __func__, udev);
@@ -723,6 +947,7 @@ static int usb_stor_BBB_transport(ccb *srb, struct us_data *us)
 	int dir_in;
 	int actlen, data_actlen;
 	unsigned int pipe, pipein, pipeout;
+	struct usb_bulk_xfer xfer[2];
 	ALLOC_CACHE_ALIGN_BUFFER(struct umass_bbb_csw, csw, 1);
 #ifdef BBB_XPORT_TRACE
 	unsigned char *ptr;
@@ -755,8 +980,31 @@ static int usb_stor_BBB_transport(ccb *srb, struct us_data *us)
 	else
 		pipe = pipeout;
 
-	result = usb_bulk_msg(us->pusb_dev, pipe, srb->pdata, srb->datalen,
-			      &data_actlen, USB_CNTL_TIMEOUT * 5);
+	if (dir_in) {
+		/*
+		 * Queue the CSW behind the data, so that the controller can
+		 * receive it without waiting for us
+		 */
+		xfer[0].buffer = srb->pdata;
+		xfer[0].length = srb->datalen;
+		xfer[1].buffer = csw;
+		xfer[1].length = UMASS_BBB_CSW_SIZE;
+		result = usb_bulk_queue(us->pusb_dev, pipe, xfer, 2,
+					USB_CNTL_TIMEOUT * 5);
+		data_actlen = xfer[0].act_len;
+		actlen = xfer[1].act_len;
+		if (result >= 0)
+			goto st_done;
+		/* Only the status stage failed, read it again */
+		if (xfer[0].status == 0 && xfer[1].status != USB_ST_NOT_PROC) {
+			retry = 0;
+			goto st_failed;
+		}
+	} else {
+		result = usb_bulk_msg(us->pusb_dev, pipe, srb->pdata,
+				      srb->datalen, &data_actlen,
+				      USB_CNTL_TIMEOUT * 5);
+	}
 	/* special handling of STALL in DATA phase */
 	if ((result < 0) && (us->pusb_dev->status & USB_ST_STALLED)) {
 		debug("DATA:stall\n");
@@ -786,6 +1034,7 @@ again:
 	result = usb_bulk_msg(us->pusb_dev, pipein, csw, UMASS_BBB_CSW_SIZE,
 				&actlen, USB_CNTL_TIMEOUT*5);
 
+st_failed:
 	/* special handling of STALL in STATUS phase */
 	if ((result < 0) && (retry < 1) &&
 	    (us->pusb_dev->status & USB_ST_STALLED)) {
@@ -802,6 +1051,7 @@ again:
 		usb_stor_BBB_reset(us);
 		return USB_STOR_TRANSPORT_FAILED;
 	}
+st_done:
 #ifdef BBB_XPORT_TRACE
 	ptr = (unsigned char *)csw;
 	for (index = 0; index < UMASS_BBB_CSW_SIZE; index++)
@@ -997,9 +1247,19 @@ static int usb_request_sense(ccb *srb, struct us_data *ss)
 	return 0;
 }
 
+/*
+ * Most devices are ready at once or within a few tens of milliseconds, so
+ * poll quickly at first and back off to USB_TUR_MAX_DELAY_MS between tries.
+ * Give up after about the same time as a fixed 100ms poll with 10 retries.
+ */
+#define USB_TUR_MIN_DELAY_MS	10
+#define USB_TUR_MAX_DELAY_MS	100
+#define USB_TUR_TIMEOUT_MS	1000
+
 static int usb_test_unit_ready(ccb *srb, struct us_data *ss)
 {
-	int retries = 10;
+	int delay = USB_TUR_MIN_DELAY_MS;
+	int waited = 0;
 
 	do {
 		memset(&srb->cmd[0], 0, 12);
@@ -1022,8 +1282,10 @@ static int usb_test_unit_ready(ccb *srb, struct us_data *ss)
 		if ((srb->sense_buf[2] == 0x02) &&
 		    (srb->sense_buf[12] == 0x3a))
 			return -1;
-		mdelay(100);
-	} while (retries--);
+		mdelay(delay);
+		waited += delay;
+		delay = min(delay * 2, USB_TUR_MAX_DELAY_MS);
+	} while (waited <= USB_TUR_TIMEOUT_MS);
 
 	return -1;
 }
@@ -1104,6 +1366,24 @@ static void usb_bin_fixup(struct usb_device_descriptor descriptor,
 }
 #endif /* CONFIG_USB_BIN_FIXUP */
 
+/* Number of blocks to move with one command on this device's controller */
+static unsigned short usb_stor_max_xfer_blk(struct usb_device *udev,
+					    unsigned long blksz)
+{
+#ifdef CONFIG_DM_USB
+	struct usb_bus_priv *priv = dev_get_uclass_priv(udev->controller_dev);
+	size_t blks;
+
+	if (!priv->max_xfer_size)
+		return USB_MAX_XFER_BLK_DEFAULT;
+	blks = priv->max_xfer_size / blksz;
+
+	return clamp_t(size_t, blks, 1, USB_MAX_XFER_BLK);
+#else
+	return USB_MAX_XFER_BLK;
+#endif
+}
+
 #ifdef CONFIG_BLK
 static unsigned long usb_stor_read(struct udevice *dev, lbaint_t blknr,
 				   lbaint_t blkcnt, void *buffer)
@@ -1114,7 +1394,7 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 {
 	lbaint_t start, blks;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks, max_xfer_blk;
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
@@ -1139,6 +1419,7 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 	}
 #endif
 	ss = (struct us_data *)udev->privptr;
+	max_xfer_blk = usb_stor_max_xfer_blk(udev, block_dev->blksz);
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 	srb->lun = block_dev->lun;
@@ -1153,12 +1434,12 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 		/* XXX need some comment here */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > USB_MAX_XFER_BLK)
-			smallblks = USB_MAX_XFER_BLK;
+		if (blks > max_xfer_blk)
+			smallblks = max_xfer_blk;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == USB_MAX_XFER_BLK)
+		if (smallblks == max_xfer_blk)
 			usb_show_progress();
 		srb->datalen = block_dev->blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1181,7 +1462,7 @@ retry_it:
 	      start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= USB_MAX_XFER_BLK)
+	if (blkcnt >= max_xfer_blk)
 		debug("\n");
 	return blkcnt;
 }
@@ -1196,7 +1477,7 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 {
 	lbaint_t start, blks;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks, max_xfer_blk;
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
@@ -1222,6 +1503,7 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 	}
 #endif
 	ss = (struct us_data *)udev->privptr;
+	max_xfer_blk = usb_stor_max_xfer_blk(udev, block_dev->blksz);
 
 	usb_disable_asynch(1); /* asynch transfer not allowed */
 
@@ -1239,12 +1521,12 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 		 */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (blks > USB_MAX_XFER_BLK)
-			smallblks = USB_MAX_XFER_BLK;
+		if (blks > max_xfer_blk)
+			smallblks = max_xfer_blk;
 		else
 			smallblks = (unsigned short) blks;
 retry_it:
-		if (smallblks == USB_MAX_XFER_BLK)
+		if (smallblks == max_xfer_blk)
 			usb_show_progress();
 		srb->datalen = block_dev->blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1266,7 +1548,7 @@ retry_it:
 	      PRIxPTR "\n", start, smallblks, buf_addr);
 
 	usb_disable_asynch(0); /* asynch transfer allowed */
-	if (blkcnt >= USB_MAX_XFER_BLK)
+	if (blkcnt >= max_xfer_blk)
 		debug("\n");
 	return blkcnt;
 
@@ -1406,6 +1688,10 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 	pccb->lun = dev_desc->lun;
 	debug(" address %d\n", dev_desc->target);
 
+	if (usb_stor_cache_get_ident(dev, dev_desc)) {
+		perq = dev_desc->type;
+		goto ready;
+	}
 	if (usb_inquiry(pccb, ss)) {
 		debug("%s: usb_inquiry() failed\n", __func__);
 		return -1;
@@ -1438,6 +1724,7 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 #endif /* CONFIG_USB_BIN_FIXUP */
 	debug("ISO Vers %X, Response Data %X\n", usb_stor_buf[2],
 	      usb_stor_buf[3]);
+ready:
 	if (usb_test_unit_ready(pccb, ss)) {
 		printf("Device NOT ready\n"
 		       "   Request Sense returned %02X %02X %02X\n",
@@ -1449,6 +1736,10 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 		}
 		return 0;
 	}
+	if (usb_stor_cache_get_capacity(dev, dev_desc)) {
+		ss->flags &= ~USB_READY;
+		return 1;
+	}
 	pccb->pdata = (unsigned char *)cap;
 	memset(pccb->pdata, 0, 8);
 	if (usb_read_capacity(pccb, ss) != 0) {
@@ -14,6 +14,7 @@
 #include <malloc.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
+#include <dm/timing.h>
 #include <dm/uclass.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
@@ -111,6 +112,7 @@ int device_unbind(struct udevice *dev)
 		list_del(&dev->sibling_node);
 
 	devres_release_all(dev);
+	dm_timing_drop(dev);
 
 	if (dev->flags & DM_FLAG_NAME_ALLOCED)
 		free((char *)dev->name);
@@ -151,7 +153,7 @@ void device_free(struct udevice *dev)
 	devres_release_probe(dev);
 }
 
-int device_remove(struct udevice *dev)
+static int device_do_remove(struct udevice *dev)
 {
 	const struct driver *drv;
 	int ret;
@@ -207,3 +209,21 @@ err:
 
 	return ret;
 }
+
+int device_remove(struct udevice *dev)
+{
+	struct dm_timing_ctx ctx;
+	int ret;
+
+	if (!dev)
+		return -EINVAL;
+
+	if (!(dev->flags & DM_FLAG_ACTIVATED))
+		return 0;
+
+	dm_timing_start(&ctx);
+	ret = device_do_remove(dev);
+	dm_timing_end(&ctx, ret ? NULL : dev, DM_TIMING_REMOVE);
+
+	return ret;
+}
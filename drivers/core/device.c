@@ -19,6 +19,7 @@
 #include <dm/lists.h>
 #include <dm/pinctrl.h>
 #include <dm/platdata.h>
+#include <dm/timing.h>
 #include <dm/uclass.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
@@ -27,10 +28,10 @@
 
 DECLARE_GLOBAL_DATA_PTR;
 
-static int device_bind_common(struct udevice *parent, const struct driver *drv,
-			      const char *name, void *platdata,
-			      ulong driver_data, int of_offset,
-			      uint of_platdata_size, struct udevice **devp)
+static int device_do_bind(struct udevice *parent, const struct driver *drv,
+			  const char *name, void *platdata, ulong driver_data,
+			  int of_offset, uint of_platdata_size,
+			  struct udevice **devp)
 {
 	struct udevice *dev;
 	struct uclass *uc;
@@ -213,6 +214,25 @@ fail_alloc1:
 	return ret;
 }
 
+static int device_bind_common(struct udevice *parent, const struct driver *drv,
+			      const char *name, void *platdata,
+			      ulong driver_data, int of_offset,
+			      uint of_platdata_size, struct udevice **devp)
+{
+	struct dm_timing_ctx ctx;
+	struct udevice *dev;
+	int ret;
+
+	dm_timing_start(&ctx);
+	ret = device_do_bind(parent, drv, name, platdata, driver_data,
+			     of_offset, of_platdata_size, &dev);
+	dm_timing_end(&ctx, ret ? NULL : dev, DM_TIMING_BIND);
+	if (devp)
+		*devp = ret ? NULL : dev;
+
+	return ret;
+}
+
 int device_bind_with_driver_data(struct udevice *parent,
 				 const struct driver *drv, const char *name,
 				 ulong driver_data, int of_offset,
@@ -264,7 +284,7 @@ static void *alloc_priv(int size, uint flags)
 	return priv;
 }
 
-int device_probe(struct udevice *dev)
+static int device_do_probe(struct udevice *dev)
 {
 	const struct driver *drv;
 	int size = 0;
@@ -391,6 +411,24 @@ fail:
 	return ret;
 }
 
+int device_probe(struct udevice *dev)
+{
+	struct dm_timing_ctx ctx;
+	int ret;
+
+	if (!dev)
+		return -EINVAL;
+
+	if (dev->flags & DM_FLAG_ACTIVATED)
+		return 0;
+
+	dm_timing_start(&ctx);
+	ret = device_do_probe(dev);
+	dm_timing_end(&ctx, ret ? NULL : dev, DM_TIMING_PROBE);
+
+	return ret;
+}
+
 void *dev_get_platdata(struct udevice *dev)
 {
 	if (!dev) {
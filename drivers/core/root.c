@@ -17,6 +17,7 @@
 #include <dm/lists.h>
 #include <dm/platdata.h>
 #include <dm/root.h>
+#include <dm/timing.h>
 #include <dm/uclass.h>
 #include <dm/util.h>
 #include <linux/list.h>
@@ -171,6 +172,7 @@ int dm_uninit(void)
 {
 	device_remove(dm_root());
 	device_unbind(dm_root());
+	dm_timing_clear();
 
 	return 0;
 }
@@ -0,0 +1,246 @@
+/*
+ * Per-device timing for driver model
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <errno.h>
+#include <libfdt.h>
+#include <dm/lists.h>
+#include <dm/timing.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define DM_TIMING_NAME_LEN	24
+
+/**
+ * struct dm_timing_rec - Timing record for a single device
+ *
+ * The name is copied since devices bound before relocation are discarded
+ * afterwards, but we still want to report on them.
+ *
+ * @dev:	Device this record refers to
+ * @name:	Device name (possibly truncated)
+ * @uclass_id:	Uclass of the device
+ * @count:	Number of times each operation has been recorded
+ * @time_us:	Total time spent in each operation, excluding nested ones
+ */
+struct dm_timing_rec {
+	struct udevice *dev;
+	char name[DM_TIMING_NAME_LEN];
+	u16 uclass_id;
+	u16 count[DM_TIMING_OP_COUNT];
+	u32 time_us[DM_TIMING_OP_COUNT];
+};
+
+/* This is used before relocation, so must not be in BSS */
+static struct dm_timing_rec dm_timing[CONFIG_DM_TIMING_COUNT]
+	__attribute__((section(".data")));
+static int dm_timing_used __attribute__((section(".data")));
+static int dm_timing_lost __attribute__((section(".data")));
+static ulong dm_timing_nested_us __attribute__((section(".data")));
+
+static ulong dm_timing_now(void)
+{
+#if defined(CONFIG_TIMER) && !defined(CONFIG_TIMER_EARLY)
+	/*
+	 * With driver-model timers, reading the time before the timer is
+	 * set up would probe it, landing us back here.
+	 */
+	if (!gd->timer)
+		return 0;
+#endif
+	return timer_get_us();
+}
+
+void dm_timing_start(struct dm_timing_ctx *ctx)
+{
+	ctx->start_us = dm_timing_now();
+	ctx->outer_us = dm_timing_nested_us;
+	dm_timing_nested_us = 0;
+}
+
+static struct dm_timing_rec *dm_timing_find(struct udevice *dev, bool add)
+{
+	struct dm_timing_rec *rec;
+	int i;
+
+	for (i = 0, rec = dm_timing; i < dm_timing_used; i++, rec++) {
+		if (rec->dev == dev && !strncmp(rec->name, dev->name,
+						sizeof(rec->name) - 1))
+			return rec;
+	}
+	if (!add)
+		return NULL;
+	if (dm_timing_used == CONFIG_DM_TIMING_COUNT) {
+		dm_timing_lost++;
+		return NULL;
+	}
+	rec = &dm_timing[dm_timing_used++];
+	memset(rec, '\0', sizeof(*rec));
+	rec->dev = dev;
+	strlcpy(rec->name, dev->name, sizeof(rec->name));
+	rec->uclass_id = device_get_uclass_id(dev);
+
+	return rec;
+}
+
+void dm_timing_end(struct dm_timing_ctx *ctx, struct udevice *dev,
+		   enum dm_timing_op op)
+{
+	struct dm_timing_rec *rec;
+	ulong elapsed, self;
+
+	if (!ctx->start_us) {
+		dm_timing_nested_us = ctx->outer_us;
+		return;
+	}
+	elapsed = dm_timing_now() - ctx->start_us;
+	self = elapsed > dm_timing_nested_us ? elapsed - dm_timing_nested_us :
+		0;
+	dm_timing_nested_us = ctx->outer_us + elapsed;
+
+	if (!dev)
+		return;
+	rec = dm_timing_find(dev, true);
+	if (rec) {
+		/* A new device bound at the address of an old one */
+		if (op == DM_TIMING_BIND && rec->count[op]) {
+			memset(rec->count, '\0', sizeof(rec->count));
+			memset(rec->time_us, '\0', sizeof(rec->time_us));
+		}
+		rec->time_us[op] += self;
+		rec->count[op]++;
+	}
+}
+
+long dm_timing_get(struct udevice *dev, enum dm_timing_op op)
+{
+	struct dm_timing_rec *rec;
+
+	rec = dm_timing_find(dev, false);
+	if (!rec)
+		return -ENOENT;
+
+	return rec->time_us[op];
+}
+
+void dm_timing_drop(struct udevice *dev)
+{
+	struct dm_timing_rec *rec;
+
+	rec = dm_timing_find(dev, false);
+	if (rec)
+		*rec = dm_timing[--dm_timing_used];
+}
+
+void dm_timing_clear(void)
+{
+	dm_timing_used = 0;
+	dm_timing_lost = 0;
+}
+
+static ulong dm_timing_total(const struct dm_timing_rec *rec)
+{
+	ulong total = 0;
+	int op;
+
+	for (op = 0; op < DM_TIMING_OP_COUNT; op++)
+		total += rec->time_us[op];
+
+	return total;
+}
+
+static int h_compare_timing(const void *r1, const void *r2)
+{
+	ulong t1 = dm_timing_total(r1);
+	ulong t2 = dm_timing_total(r2);
+
+	if (t1 == t2)
+		return 0;
+
+	return t1 < t2 ? 1 : -1;
+}
+
+static const char *dm_timing_uclass_name(const struct dm_timing_rec *rec)
+{
+	struct uclass_driver *uc_drv;
+
+	uc_drv = lists_uclass_lookup(rec->uclass_id);
+
+	return uc_drv ? uc_drv->name : "?";
+}
+
+void dm_timing_show(void)
+{
+	struct dm_timing_rec *rec;
+	ulong total = 0;
+	int i;
+
+	qsort(dm_timing, dm_timing_used, sizeof(*dm_timing),
+	      h_compare_timing);
+
+	printf(" %-23s %-11s %9s %9s %9s %6s\n", "Name", "Class", "Bind us",
+	       "Probe us", "Remove us", "Probes");
+	puts("------------------------------------------------------------------------\n");
+	for (i = 0, rec = dm_timing; i < dm_timing_used; i++, rec++) {
+		printf(" %-23s %-11.11s %9u %9u %9u %6u\n", rec->name,
+		       dm_timing_uclass_name(rec),
+		       rec->time_us[DM_TIMING_BIND],
+		       rec->time_us[DM_TIMING_PROBE],
+		       rec->time_us[DM_TIMING_REMOVE],
+		       rec->count[DM_TIMING_PROBE]);
+		total += dm_timing_total(rec);
+	}
+	printf("%d devices, total %lu us\n", dm_timing_used, total);
+	if (dm_timing_lost) {
+		printf("%d devices not recorded, increase CONFIG_DM_TIMING_COUNT\n",
+		       dm_timing_lost);
+	}
+}
+
+#ifdef CONFIG_OF_LIBFDT
+static const char *const dm_timing_op_name[DM_TIMING_OP_COUNT] = {
+	"bind",
+	"probe",
+	"remove",
+};
+
+int dm_timing_fdt_add(void *blob, int parent)
+{
+	struct dm_timing_rec *rec;
+	int timing;
+	int i, op;
+	int ret;
+
+	timing = fdt_add_subnode(blob, parent, "dm-timing");
+	if (timing < 0)
+		return timing;
+
+	for (i = dm_timing_used - 1; i >= 0; i--) {
+		int node;
+
+		rec = &dm_timing[i];
+		node = fdt_add_subnode(blob, timing, simple_itoa(i));
+		if (node < 0)
+			return node;
+		ret = fdt_setprop_string(blob, node, "name", rec->name);
+		if (!ret)
+			ret = fdt_setprop_string(blob, node, "uclass",
+						 dm_timing_uclass_name(rec));
+		for (op = 0; !ret && op < DM_TIMING_OP_COUNT; op++) {
+			ret = fdt_setprop_cell(blob, node,
+					       dm_timing_op_name[op],
+					       rec->time_us[op]);
+		}
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+#endif
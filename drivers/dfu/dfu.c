@@ -16,12 +16,28 @@
 #include <hash.h>
 #include <linux/list.h>
 #include <linux/compiler.h>
+#include <div64.h>
 
 static LIST_HEAD(dfu_list);
 static int dfu_alt_num;
 static int alt_num_cnt;
 static struct hash_algo *dfu_hash_algo;
 
+/* Entity whose full buffers are written by dfu_write_poll() */
+static struct dfu_entity *dfu_write_active;
+static bool dfu_write_queue;
+
+/* Throughput of the last download to each alt setting, for "dfu list" */
+#define DFU_STATS_NUM	8
+
+static struct dfu_stats {
+	char name[32];
+	u64 bytes;
+	ulong time_ms;
+	ulong write_ms;
+} dfu_stats[DFU_STATS_NUM];
+static int dfu_stats_next;
+
 /*
  * The purpose of the dfu_usb_get_reset() function is to
  * provide information if after USB_DETACH request
@@ -92,29 +108,50 @@ unsigned long dfu_get_buf_size(void)
 
 unsigned char *dfu_get_buf(struct dfu_entity *dfu)
 {
-	char *s;
+	unsigned long size;
 
 	if (dfu_buf != NULL)
 		return dfu_buf;
 
-	s = getenv("dfu_bufsiz");
-	if (s)
-		dfu_buf_size = (unsigned long)simple_strtol(s, NULL, 0);
-
-	if (!s || !dfu_buf_size)
-		dfu_buf_size = CONFIG_SYS_DFU_DATA_BUF_SIZE;
-
-	if (dfu->max_buf_size && dfu_buf_size > dfu->max_buf_size)
-		dfu_buf_size = dfu->max_buf_size;
-
-	dfu_buf = memalign(CONFIG_SYS_CACHELINE_SIZE, dfu_buf_size);
+	/* Room for CONFIG_SYS_DFU_DATA_BUF_COUNT of the largest buffer */
+	size = dfu_buf_size * CONFIG_SYS_DFU_DATA_BUF_COUNT;
+	dfu_buf = memalign(CONFIG_SYS_CACHELINE_SIZE, size);
 	if (dfu_buf == NULL)
 		printf("%s: Could not memalign 0x%lx bytes\n",
-		       __func__, dfu_buf_size);
+		       __func__, size);
 
 	return dfu_buf;
 }
 
+static void dfu_set_buf_size(struct dfu_entity *dfu)
+{
+	char name[sizeof("dfu_bufsiz_") + sizeof(dfu->name)];
+	unsigned long size = 0;
+	char *s;
+
+	sprintf(name, "dfu_bufsiz_%s", dfu->name);
+	s = getenv(name);
+	if (!s)
+		s = getenv("dfu_bufsiz");
+	if (s)
+		size = simple_strtoul(s, NULL, 0);
+	if (!size)
+		size = CONFIG_SYS_DFU_DATA_BUF_SIZE;
+
+	if (dfu->max_buf_size && size > dfu->max_buf_size)
+		size = dfu->max_buf_size;
+
+	dfu->buf_size = size;
+	if (size > dfu_buf_size)
+		dfu_buf_size = size;
+}
+
+/* Buffer @n of the ring used for writing to @dfu */
+static unsigned char *dfu_write_buf(struct dfu_entity *dfu, int n)
+{
+	return dfu_buf + (n % CONFIG_SYS_DFU_DATA_BUF_COUNT) * dfu->buf_size;
+}
+
 static char *dfu_get_hash_algo(void)
 {
 	char *s;
@@ -132,11 +169,100 @@ static char *dfu_get_hash_algo(void)
 	return NULL;
 }
 
-static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+static int dfu_write_medium(struct dfu_entity *dfu, void *buf, long *len)
+{
+	ulong start = get_timer(0);
+	int ret;
+
+	ret = dfu->write_medium(dfu, dfu->offset, buf, len);
+	if (ret)
+		debug("%s: Write error!\n", __func__);
+
+	dfu->stat_write_ms += get_timer(start);
+	dfu->stat_bytes += *len;
+
+	/* update offset */
+	dfu->offset += *len;
+
+	return ret;
+}
+
+/*
+ * Write the oldest queued buffer, or only its next @slice bytes when @slice
+ * is not zero.
+ */
+static int dfu_write_queued(struct dfu_entity *dfu, long slice)
+{
+	long left = dfu->w_len[dfu->w_head] - dfu->w_done;
+	long w_size = left;
+	int ret;
+
+	if (slice && w_size > slice)
+		w_size = slice;
+
+	ret = dfu_write_medium(dfu, dfu_write_buf(dfu, dfu->w_head) +
+			       dfu->w_done, &w_size);
+	if (ret)
+		return ret;
+
+	dfu->w_done += w_size;
+	if (dfu->w_done < dfu->w_len[dfu->w_head])
+		return 0;
+
+	dfu->w_head = (dfu->w_head + 1) % CONFIG_SYS_DFU_DATA_BUF_COUNT;
+	dfu->w_count--;
+	dfu->w_done = 0;
+
+	puts("#");
+
+	return 0;
+}
+
+static int dfu_write_queue_wait(struct dfu_entity *dfu)
 {
-	long w_size;
 	int ret;
 
+	if (dfu->w_error)
+		return dfu->w_error;
+
+	while (dfu->w_count) {
+		ret = dfu_write_queued(dfu, 0);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Called from the DFU command loop between USB transfers: write the next
+ * slice of a queued buffer, so that storage is busy while the host sends
+ * the next one.
+ */
+void dfu_write_poll(void)
+{
+	struct dfu_entity *dfu = dfu_write_active;
+
+	if (!dfu || !dfu->w_count || dfu->w_error)
+		return;
+
+	dfu->w_error = dfu_write_queued(dfu, dfu->write_slice);
+}
+
+void dfu_set_write_queue(bool enable)
+{
+	dfu_write_queue = enable;
+}
+
+/*
+ * Write out the buffer. A full one (@queue) is only queued when the DFU
+ * command loop polls, so that it can be written while the next one fills.
+ */
+static int dfu_write_buffer_drain(struct dfu_entity *dfu, bool queue)
+{
+	long w_size;
+	int ret, n;
+
 	/* flush size? */
 	w_size = dfu->i_buf - dfu->i_buf_start;
 	if (w_size == 0)
@@ -146,21 +272,59 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
 					   dfu->i_buf_start, w_size, 0);
 
-	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
+	if (queue && dfu_write_queue && CONFIG_SYS_DFU_DATA_BUF_COUNT > 1) {
+		/* Leave this buffer to dfu_write_poll() and fill the next */
+		if (dfu->w_count == CONFIG_SYS_DFU_DATA_BUF_COUNT - 1) {
+			ret = dfu_write_queued(dfu, 0);
+			if (ret)
+				return ret;
+		}
+		n = dfu->w_head + dfu->w_count;
+		dfu->w_len[n % CONFIG_SYS_DFU_DATA_BUF_COUNT] = w_size;
+		dfu->w_count++;
+		dfu_write_active = dfu;
+
+		dfu->i_buf_start = dfu_write_buf(dfu, n + 1);
+		dfu->i_buf_end = dfu->i_buf_start + dfu->buf_size;
+		dfu->i_buf = dfu->i_buf_start;
+
+		return 0;
+	}
+
+	ret = dfu_write_queue_wait(dfu);
 	if (ret)
-		debug("%s: Write error!\n", __func__);
+		return ret;
+
+	ret = dfu_write_medium(dfu, dfu->i_buf_start, &w_size);
 
 	/* point back */
 	dfu->i_buf = dfu->i_buf_start;
 
-	/* update offset */
-	dfu->offset += w_size;
-
 	puts("#");
 
 	return ret;
 }
 
+static void dfu_save_stats(struct dfu_entity *dfu)
+{
+	struct dfu_stats *st;
+	int i;
+
+	for (i = 0; i < DFU_STATS_NUM; i++)
+		if (!strcmp(dfu_stats[i].name, dfu->name))
+			break;
+	if (i == DFU_STATS_NUM) {
+		i = dfu_stats_next;
+		dfu_stats_next = (i + 1) % DFU_STATS_NUM;
+	}
+
+	st = &dfu_stats[i];
+	strcpy(st->name, dfu->name);
+	st->bytes = dfu->stat_bytes;
+	st->time_ms = get_timer(dfu->stat_start);
+	st->write_ms = dfu->stat_write_ms;
+}
+
 void dfu_write_transaction_cleanup(struct dfu_entity *dfu)
 {
 	/* clear everything */
@@ -170,16 +334,27 @@ void dfu_write_transaction_cleanup(struct dfu_entity *dfu)
 	dfu->i_buf_start = dfu_buf;
 	dfu->i_buf_end = dfu_buf;
 	dfu->i_buf = dfu->i_buf_start;
+	dfu->w_head = 0;
+	dfu->w_count = 0;
+	dfu->w_done = 0;
+	dfu->w_error = 0;
 	dfu->inited = 0;
+
+	if (dfu_write_active == dfu)
+		dfu_write_active = NULL;
 }
 
 int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
 	int ret = 0;
 
-	ret = dfu_write_buffer_drain(dfu);
-	if (ret)
+	ret = dfu_write_buffer_drain(dfu, false);
+	if (!ret)
+		ret = dfu_write_queue_wait(dfu);
+	if (ret) {
+		dfu_write_transaction_cleanup(dfu);
 		return ret;
+	}
 
 	if (dfu->flush_medium)
 		ret = dfu->flush_medium(dfu);
@@ -188,11 +363,27 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		printf("\nDFU complete %s: 0x%08x\n", dfu_hash_algo->name,
 		       dfu->crc);
 
+	dfu_save_stats(dfu);
 	dfu_write_transaction_cleanup(dfu);
 
 	return ret;
 }
 
+/*
+ * Return where dfu_write() will put the next block of @size bytes, so that
+ * it can be received there instead of being copied. @room is set to the
+ * space left at that address.
+ */
+void *dfu_write_dest(struct dfu_entity *dfu, int size, unsigned int *room)
+{
+	/* The buffer is set up and drained by dfu_write() */
+	if (!dfu->inited || (dfu->i_buf + size) > dfu->i_buf_end)
+		return NULL;
+
+	*room = dfu->i_buf_end - dfu->i_buf;
+	return dfu->i_buf;
+}
+
 int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
 	int ret;
@@ -210,12 +401,22 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		dfu->i_buf_start = dfu_get_buf(dfu);
 		if (dfu->i_buf_start == NULL)
 			return -ENOMEM;
-		dfu->i_buf_end = dfu_get_buf(dfu) + dfu_buf_size;
+		dfu->i_buf_end = dfu->i_buf_start + dfu->buf_size;
 		dfu->i_buf = dfu->i_buf_start;
+		dfu->stat_bytes = 0;
+		dfu->stat_write_ms = 0;
+		dfu->stat_start = get_timer(0);
 
 		dfu->inited = 1;
 	}
 
+	/* A queued buffer failed to write in the background */
+	if (dfu->w_error) {
+		ret = dfu->w_error;
+		dfu_write_transaction_cleanup(dfu);
+		return ret;
+	}
+
 	if (dfu->i_blk_seq_num != blk_seq_num) {
 		printf("%s: Wrong sequence number! [%d] [%d]\n",
 		       __func__, dfu->i_blk_seq_num, blk_seq_num);
@@ -241,7 +442,7 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 	/* flush buffer if overflow */
 	if ((dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
+		ret = dfu_write_buffer_drain(dfu, true);
 		if (ret) {
 			dfu_write_transaction_cleanup(dfu);
 			return ret;
@@ -256,12 +457,14 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		return -1;
 	}
 
-	memcpy(dfu->i_buf, buf, size);
+	/* The block may have been received in place */
+	if (buf != dfu->i_buf)
+		memcpy(dfu->i_buf, buf, size);
 	dfu->i_buf += size;
 
 	/* if end or if buffer full flush */
 	if (size == 0 || (dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
+		ret = dfu_write_buffer_drain(dfu, size != 0);
 		if (ret) {
 			dfu_write_transaction_cleanup(dfu);
 			return ret;
@@ -344,7 +547,7 @@ int dfu_read(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		dfu->i_blk_seq_num = 0;
 		dfu->crc = 0;
 		dfu->offset = 0;
-		dfu->i_buf_end = dfu_get_buf(dfu) + dfu_buf_size;
+		dfu->i_buf_end = dfu->i_buf_start + dfu->buf_size;
 		dfu->i_buf = dfu->i_buf_start;
 		dfu->b_left = 0;
 
@@ -400,6 +603,7 @@ static int dfu_fill_entity(struct dfu_entity *dfu, char *s, int alt,
 
 	dfu->alt = alt;
 	dfu->max_buf_size = 0;
+	dfu->write_slice = 0;
 	dfu->free_entity = NULL;
 
 	/* Specific for mmc device */
@@ -420,7 +624,7 @@ static int dfu_fill_entity(struct dfu_entity *dfu, char *s, int alt,
 		       __func__,  interface);
 		return -1;
 	}
-	dfu_get_buf(dfu);
+	dfu_set_buf_size(dfu);
 
 	return 0;
 }
@@ -430,6 +634,8 @@ void dfu_free_entities(void)
 	struct dfu_entity *dfu, *p, *t = NULL;
 
 	dfu_free_buf();
+	dfu_buf_size = 0;
+	dfu_write_active = NULL;
 	list_for_each_entry_safe_reverse(dfu, p, &dfu_list, list) {
 		list_del(&dfu->list);
 		if (dfu->free_entity)
@@ -493,6 +699,27 @@ const char *dfu_get_layout(enum dfu_layout l)
 	return dfu_layout[l];
 }
 
+static void dfu_show_stats(struct dfu_entity *dfu)
+{
+	struct dfu_stats *st;
+	u64 rate;
+	int i;
+
+	for (i = 0; i < DFU_STATS_NUM; i++)
+		if (!strcmp(dfu_stats[i].name, dfu->name))
+			break;
+	if (i == DFU_STATS_NUM)
+		return;
+
+	st = &dfu_stats[i];
+	rate = st->bytes;
+	if (st->time_ms)
+		rate = lldiv(rate, st->time_ms);
+	printf("    last write: %llu bytes in %lu ms (%llu KiB/s), storage busy %lu ms\n",
+	       (unsigned long long)st->bytes, st->time_ms,
+	       (unsigned long long)lldiv(rate * 1000, 1024), st->write_ms);
+}
+
 void dfu_show_entities(void)
 {
 	struct dfu_entity *dfu;
@@ -500,9 +727,10 @@ void dfu_show_entities(void)
 	puts("DFU alt settings list:\n");
 
 	list_for_each_entry(dfu, &dfu_list, list) {
-		printf("dev: %s alt: %d name: %s layout: %s\n",
+		printf("dev: %s alt: %d name: %s layout: %s buffer: 0x%lx\n",
 		       dfu_get_dev_type(dfu->dev_type), dfu->alt,
-		       dfu->name, dfu_get_layout(dfu->layout));
+		       dfu->name, dfu_get_layout(dfu->layout), dfu->buf_size);
+		dfu_show_stats(dfu);
 	}
 }
 
@@ -566,13 +794,7 @@ int dfu_write_from_mem_addr(struct dfu_entity *dfu, void *buf, int size)
 	int i, ret = 0;
 	void *dp = buf;
 
-	/*
-	 * Here we must call dfu_get_buf(dfu) first to be sure that dfu_buf_size
-	 * has been properly initialized - e.g. if "dfu_bufsiz" has been taken
-	 * into account.
-	 */
-	dfu_get_buf(dfu);
-	dfu_buf_size = dfu_get_buf_size();
+	dfu_buf_size = dfu->buf_size;
 	debug("%s: dfu buf size: %lu\n", __func__, dfu_buf_size);
 
 	for (i = 0; left > 0; i++) {
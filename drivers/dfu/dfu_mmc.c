@@ -392,6 +392,10 @@ int dfu_fill_entity_mmc(struct dfu_entity *dfu, char *devstr, char *s)
 	dfu->inited = 0;
 	dfu->free_entity = dfu_free_entity_mmc;
 
+	/* Raw writes can be split up, file writes are buffered anyway */
+	if (dfu->layout == DFU_RAW_ADDR)
+		dfu->write_slice = CONFIG_SYS_DFU_WRITE_SLICE;
+
 	/* Check if file buffer is ready */
 	if (!dfu_file_buf) {
 		dfu_file_buf = memalign(CONFIG_SYS_CACHELINE_SIZE,
@@ -47,6 +47,18 @@ __weak int board_mmc_getcd(struct mmc *mmc)
 {
 	return -1;
 }
+
+static void mmc_set_ios(struct mmc *mmc)
+{
+	if (mmc->cfg->ops->set_ios)
+		mmc->cfg->ops->set_ios(mmc);
+}
+
+/* Only driver-model hosts can tune, so HS200 and UHS-I are not used here */
+static int mmc_execute_tuning(struct mmc *mmc, uint opcode)
+{
+	return -ENOSYS;
+}
 #endif
 
 #ifdef CONFIG_MMC_TRACE
@@ -303,12 +315,44 @@ static int mmc_go_idle(struct mmc *mmc)
 	return 0;
 }
 
+/*
+ * Switch an SD card to 1.8V signalling with CMD11, as needed for the UHS-I
+ * bus speed modes. The host changes its I/O voltage in set_ios().
+ */
+static int sd_switch_voltage(struct mmc *mmc)
+{
+	struct mmc_cmd cmd;
+	int err;
+
+	cmd.cmdidx = SD_CMD_SWITCH_UHS18V;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
+
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (err)
+		return err;
+
+	mmc->signal_voltage = MMC_SIGNAL_VOLTAGE_180;
+	mmc_set_ios(mmc);
+
+	/* Give the card time to settle at the new voltage */
+	udelay(5000);
+
+	return 0;
+}
+
+static int mmc_send_if_cond(struct mmc *mmc);
+
 static int sd_send_op_cond(struct mmc *mmc)
 {
-	int timeout = 1000;
+	int timeout;
 	int err;
 	struct mmc_cmd cmd;
+	bool uhs = !mmc_host_is_spi(mmc) &&
+		(mmc->cfg->host_caps & MMC_MODE_UHS);
 
+retry:
+	timeout = 1000;
 	while (1) {
 		cmd.cmdidx = MMC_CMD_APP_CMD;
 		cmd.resp_type = MMC_RSP_R1;
@@ -332,8 +376,11 @@ static int sd_send_op_cond(struct mmc *mmc)
 		cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
 			(mmc->cfg->voltages & 0xff8000);
 
-		if (mmc->version == SD_VERSION_2)
+		if (mmc->version == SD_VERSION_2) {
 			cmd.cmdarg |= OCR_HCS;
+			if (uhs)
+				cmd.cmdarg |= OCR_S18R;
+		}
 
 		err = mmc_send_cmd(mmc, &cmd, NULL);
 
@@ -368,6 +415,26 @@ static int sd_send_op_cond(struct mmc *mmc)
 	mmc->high_capacity = ((mmc->ocr & OCR_HCS) == OCR_HCS);
 	mmc->rca = 0;
 
+	/*
+	 * The card accepted 1.8V signalling, which UHS-I modes need. A card
+	 * which is still at 1.8V from an earlier init, since it has not been
+	 * power-cycled, does not offer the switch again and the host stays at
+	 * 1.8V with it.
+	 */
+	if (uhs && mmc->version == SD_VERSION_2 && (mmc->ocr & OCR_S18R)) {
+		err = sd_switch_voltage(mmc);
+		if (err) {
+			/* Start again at 3.3V, without asking for 1.8V */
+			debug("%s: voltage switch failed: %d\n", __func__, err);
+			uhs = false;
+			err = mmc_go_idle(mmc);
+			if (err)
+				return err;
+			mmc_send_if_cond(mmc);
+			goto retry;
+		}
+	}
+
 	return 0;
 }
 
@@ -503,7 +570,7 @@ int mmc_switch(struct mmc *mmc, u8 set, u8 index, u8 value)
 static int mmc_change_freq(struct mmc *mmc)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(u8, ext_csd, MMC_MAX_BLOCK_LEN);
-	char cardtype;
+	u8 cardtype;
 	int err;
 
 	mmc->card_caps = 0;
@@ -522,7 +589,7 @@ static int mmc_change_freq(struct mmc *mmc)
 	if (err)
 		return err;
 
-	cardtype = ext_csd[EXT_CSD_CARD_TYPE] & 0xf;
+	cardtype = ext_csd[EXT_CSD_CARD_TYPE];
 
 	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING, 1);
 
@@ -543,6 +610,11 @@ static int mmc_change_freq(struct mmc *mmc)
 	if (cardtype & EXT_CSD_CARD_TYPE_52) {
 		if (cardtype & EXT_CSD_CARD_TYPE_DDR_1_8V)
 			mmc->card_caps |= MMC_MODE_DDR_52MHz;
+		/* Like DDR52, only the 1.8V I/O variants are used */
+		if (cardtype & EXT_CSD_CARD_TYPE_HS200_1_8V)
+			mmc->card_caps |= MMC_MODE_HS200;
+		if (cardtype & EXT_CSD_CARD_TYPE_HS400_1_8V)
+			mmc->card_caps |= MMC_MODE_HS400;
 		mmc->card_caps |= MMC_MODE_HS_52MHz | MMC_MODE_HS;
 	} else {
 		mmc->card_caps |= MMC_MODE_HS;
@@ -917,6 +989,16 @@ retry_scr:
 			break;
 	}
 
+	/* The UHS-I modes are only offered once the card is at 1.8V */
+	if (mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180) {
+		uint modes = __be32_to_cpu(switch_status[3]);
+
+		if (modes & SD_UHS_SDR104_SUPPORTED)
+			mmc->card_caps |= MMC_MODE_UHS_SDR104;
+		if (modes & SD_UHS_SDR50_SUPPORTED)
+			mmc->card_caps |= MMC_MODE_UHS_SDR50;
+	}
+
 	/* If high-speed isn't supported, we return */
 	if (!(__be32_to_cpu(switch_status[3]) & SD_HIGHSPEED_SUPPORTED))
 		return 0;
@@ -973,14 +1055,6 @@ static const u8 multipliers[] = {
 	80,
 };
 
-#ifndef CONFIG_DM_MMC_OPS
-static void mmc_set_ios(struct mmc *mmc)
-{
-	if (mmc->cfg->ops->set_ios)
-		mmc->cfg->ops->set_ios(mmc);
-}
-#endif
-
 void mmc_set_clock(struct mmc *mmc, uint clock)
 {
 	if (clock > mmc->cfg->f_max)
@@ -1001,6 +1075,160 @@ static void mmc_set_bus_width(struct mmc *mmc, uint width)
 	mmc_set_ios(mmc);
 }
 
+static void mmc_set_timing(struct mmc *mmc, enum mmc_timing timing,
+			   uint clock)
+{
+	mmc->timing = timing;
+	mmc_set_clock(mmc, clock);
+}
+
+/*
+ * Try the UHS-I modes that the card and host have in common, fastest first.
+ * Each needs a 4-bit bus and a successful tuning run. If none of them works
+ * the card is put back into SDR25 (high speed), and an error is returned so
+ * that the caller sets that up instead.
+ */
+static int sd_select_uhs(struct mmc *mmc)
+{
+	static const struct {
+		uint caps;
+		u8 access_mode;
+		enum mmc_timing timing;
+		uint clock;
+	} modes[] = {
+		{ MMC_MODE_UHS_SDR104, SD_ACCESS_MODE_SDR104,
+			MMC_TIMING_UHS_SDR104, SD_UHS_SDR104_MAX_DTR },
+		{ MMC_MODE_UHS_SDR50, SD_ACCESS_MODE_SDR50,
+			MMC_TIMING_UHS_SDR50, SD_UHS_SDR50_MAX_DTR },
+	};
+	ALLOC_CACHE_ALIGN_BUFFER(uint, switch_status, 16);
+	bool tried = false;
+	int err = -ENOTSUPP;
+	int i;
+
+	if (!(mmc->card_caps & MMC_MODE_UHS) || mmc->bus_width != 4)
+		return -ENOTSUPP;
+
+	for (i = 0; i < ARRAY_SIZE(modes); i++) {
+		if (!(mmc->card_caps & modes[i].caps))
+			continue;
+
+		tried = true;
+		err = sd_switch(mmc, SD_SWITCH_SWITCH, 0, modes[i].access_mode,
+				(u8 *)switch_status);
+		if (err)
+			continue;
+		if (((__be32_to_cpu(switch_status[4]) >> 24) & 0xf) !=
+		    modes[i].access_mode) {
+			err = SWITCH_ERR;
+			continue;
+		}
+
+		mmc_set_timing(mmc, modes[i].timing, modes[i].clock);
+		err = mmc_execute_tuning(mmc, MMC_CMD_SEND_TUNING_BLOCK);
+		if (!err) {
+			mmc->tran_speed = mmc->clock;
+			return 0;
+		}
+		debug("%s: tuning for SD access mode %d failed: %d\n",
+		      __func__, modes[i].access_mode, err);
+
+		/* Slow down, since the host cannot sample reliably */
+		mmc_set_timing(mmc, MMC_TIMING_SD_HS, 50000000);
+	}
+
+	if (tried)
+		sd_switch(mmc, SD_SWITCH_SWITCH, 0, SD_ACCESS_MODE_SDR25,
+			  (u8 *)switch_status);
+
+	return err;
+}
+
+/*
+ * Switch an eMMC card to HS200 on the widest bus both sides support and run
+ * the host's tuning procedure with CMD21. HS200 needs 1.8V I/O. If it fails,
+ * put the card back into high-speed timing at the old voltage so that the
+ * caller can pick a bus width again.
+ */
+static int mmc_select_hs200(struct mmc *mmc)
+{
+	enum mmc_signal_voltage old_voltage = mmc->signal_voltage;
+	uint width, extw;
+	int err;
+
+	if (!(mmc->card_caps & MMC_MODE_HS200))
+		return -ENOTSUPP;
+
+	if (mmc->card_caps & MMC_MODE_8BIT) {
+		width = 8;
+		extw = EXT_CSD_BUS_WIDTH_8;
+	} else if (mmc->card_caps & MMC_MODE_4BIT) {
+		width = 4;
+		extw = EXT_CSD_BUS_WIDTH_4;
+	} else {
+		return -ENOTSUPP;
+	}
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH, extw);
+	if (err)
+		return err;
+	mmc->ddr_mode = 0;
+	mmc_set_bus_width(mmc, width);
+
+	mmc->signal_voltage = MMC_SIGNAL_VOLTAGE_180;
+	mmc_set_ios(mmc);
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS200);
+	if (!err) {
+		mmc_set_timing(mmc, MMC_TIMING_MMC_HS200, MMC_HS200_MAX_DTR);
+		err = mmc_execute_tuning(mmc, MMC_CMD_SEND_TUNING_BLOCK_HS200);
+		if (!err) {
+			mmc->tran_speed = mmc->clock;
+			return 0;
+		}
+	}
+	debug("%s: HS200 failed: %d\n", __func__, err);
+
+	mmc->signal_voltage = old_voltage;
+	mmc_set_timing(mmc, MMC_TIMING_MMC_HS, 52000000);
+	mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+		   EXT_CSD_TIMING_HS);
+
+	return err;
+}
+
+/*
+ * HS400 is entered from a tuned HS200 state and keeps its tuning: drop to
+ * high-speed timing, move the card to an 8-bit DDR bus, then select HS400.
+ * If this fails the caller must select HS200 again.
+ */
+static int mmc_select_hs400(struct mmc *mmc)
+{
+	int err;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS);
+	if (err)
+		return err;
+	mmc_set_timing(mmc, MMC_TIMING_MMC_HS, 52000000);
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH,
+			 EXT_CSD_DDR_BUS_WIDTH_8);
+	if (err)
+		return err;
+	mmc->ddr_mode = 1;
+	mmc_set_bus_width(mmc, 8);
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS400);
+	if (err)
+		return err;
+	mmc_set_timing(mmc, MMC_TIMING_MMC_HS400, MMC_HS200_MAX_DTR);
+	mmc->tran_speed = mmc->clock;
+
+	return 0;
+}
+
 static int mmc_startup(struct mmc *mmc)
 {
 	int err, i;
@@ -1347,10 +1575,15 @@ static int mmc_startup(struct mmc *mmc)
 			mmc_set_bus_width(mmc, 4);
 		}
 
-		if (mmc->card_caps & MMC_MODE_HS)
-			mmc->tran_speed = 50000000;
-		else
-			mmc->tran_speed = 25000000;
+		/* Without a tuned UHS-I mode, use high speed if possible */
+		if (sd_select_uhs(mmc)) {
+			if (mmc->card_caps & MMC_MODE_HS) {
+				mmc->timing = MMC_TIMING_SD_HS;
+				mmc->tran_speed = 50000000;
+			} else {
+				mmc->tran_speed = 25000000;
+			}
+		}
 	} else if (mmc->version >= MMC_VERSION_4) {
 		/* Only version 4 of MMC supports wider bus widths */
 		int idx;
@@ -1379,7 +1612,16 @@ static int mmc_startup(struct mmc *mmc)
 			8, 4, 8, 4, 1,
 		};
 
-		for (idx=0; idx < ARRAY_SIZE(ext_csd_bits); idx++) {
+		/*
+		 * HS200 and HS400 select their own bus width. If neither can
+		 * be used, or tuning fails, fall back to the modes below.
+		 */
+		err = mmc_select_hs200(mmc);
+		if (!err && (mmc->card_caps & MMC_MODE_HS400) &&
+		    mmc->bus_width == 8 && mmc_select_hs400(mmc))
+			err = mmc_select_hs200(mmc);
+
+		for (idx = 0; err && idx < ARRAY_SIZE(ext_csd_bits); idx++) {
 			unsigned int extw = ext_csd_bits[idx];
 			unsigned int caps = ext_to_hostcaps[extw];
 
@@ -1435,7 +1677,11 @@ static int mmc_startup(struct mmc *mmc)
 		if (err)
 			return err;
 
-		if (mmc->card_caps & MMC_MODE_HS) {
+		/* HS200 and HS400 have set tran_speed already */
+		if ((mmc->card_caps & MMC_MODE_HS) &&
+		    mmc->timing < MMC_TIMING_MMC_HS200) {
+			mmc->timing = mmc->ddr_mode ? MMC_TIMING_MMC_DDR52 :
+				MMC_TIMING_MMC_HS;
 			if (mmc->card_caps & MMC_MODE_HS_52MHz)
 				mmc->tran_speed = 52000000;
 			else
@@ -1511,6 +1757,44 @@ __weak void board_mmc_power_init(void)
 {
 }
 
+/*
+ * Reset the card and agree its operating conditions, at the current signal
+ * voltage. Returns UNUSABLE_ERR if it answers neither as SD nor as MMC.
+ */
+static int mmc_reset_card(struct mmc *mmc)
+{
+	int err;
+
+	mmc->ddr_mode = 0;
+	mmc->timing = MMC_TIMING_LEGACY;
+	mmc_set_bus_width(mmc, 1);
+	mmc_set_clock(mmc, 1);
+
+	/* Reset the Card */
+	err = mmc_go_idle(mmc);
+
+	if (err)
+		return err;
+
+	/* The internal partition reset to user partition(0) at every CMD0*/
+	mmc_get_blk_desc(mmc)->hwpart = 0;
+
+	/* Test for SD version 2 */
+	err = mmc_send_if_cond(mmc);
+
+	/* Now try to get the SD card's operating condition */
+	err = sd_send_op_cond(mmc);
+
+	/* If the command timed out, we check for an MMC card */
+	if (err == TIMEOUT) {
+		err = mmc_send_op_cond(mmc);
+		if (err)
+			return UNUSABLE_ERR;
+	}
+
+	return err;
+}
+
 int mmc_start_init(struct mmc *mmc)
 {
 	bool no_card;
@@ -1545,35 +1829,23 @@ int mmc_start_init(struct mmc *mmc)
 	if (err)
 		return err;
 #endif
-	mmc->ddr_mode = 0;
-	mmc_set_bus_width(mmc, 1);
-	mmc_set_clock(mmc, 1);
-
-	/* Reset the Card */
-	err = mmc_go_idle(mmc);
-
-	if (err)
-		return err;
-
-	/* The internal partition reset to user partition(0) at every CMD0*/
-	mmc_get_blk_desc(mmc)->hwpart = 0;
-
-	/* Test for SD version 2 */
-	err = mmc_send_if_cond(mmc);
-
-	/* Now try to get the SD card's operating condition */
-	err = sd_send_op_cond(mmc);
-
-	/* If the command timed out, we check for an MMC card */
-	if (err == TIMEOUT) {
-		err = mmc_send_op_cond(mmc);
-
-		if (err) {
+	/*
+	 * Start at the current signal voltage, since CMD0 does not take a card
+	 * which switched to 1.8V back to 3.3V; only a power cycle does. If
+	 * that fails, the card may have been changed, so go back to 3.3V as a
+	 * power cycle would and try again.
+	 */
+	err = mmc_reset_card(mmc);
+	if (err && mmc->signal_voltage != MMC_SIGNAL_VOLTAGE_330) {
+		debug("%s: no card at 1.8V: %d\n", __func__, err);
+		mmc->signal_voltage = MMC_SIGNAL_VOLTAGE_330;
+		err = mmc_reset_card(mmc);
+	}
+	if (err == UNUSABLE_ERR) {
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
-			printf("Card did not respond to voltage select!\n");
+		printf("Card did not respond to voltage select!\n");
 #endif
-			return UNUSABLE_ERR;
-		}
+		return err;
 	}
 
 	if (!err)
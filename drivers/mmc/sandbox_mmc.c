@@ -14,45 +14,305 @@
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* Largest tuning block, used with an 8-bit bus */
+#define SANDBOX_MMC_TUNING_LEN	128
+
 struct sandbox_mmc_plat {
 	struct mmc_config cfg;
 	struct mmc mmc;
 };
 
 /**
- * sandbox_mmc_send_cmd() - Emulate SD commands
+ * struct sandbox_mmc_priv - State of the emulated card and host
+ *
+ * @emmc:		true to emulate an eMMC device instead of an SD card
+ * @app_cmd:		true if the last command was MMC_CMD_APP_CMD (SD)
+ * @s18r:		true if the card agreed to switch to 1.8V (SD)
+ * @volt_180:		true if the card uses 1.8V signalling (SD)
+ * @access_mode:	Access mode selected with CMD6, SD_ACCESS_MODE_... (SD)
+ * @switch_error:	true if the last CMD6 was rejected (eMMC)
+ * @ext_csd:		Extended CSD register (eMMC)
+ * @tuning_fail:	true to make the tuning procedure fail
+ * @hs400_fail:		true to make the card reject HS400 (eMMC)
+ * @cmd11_fail:		true to make the card reject CMD11 (SD)
+ * @tuned:		true if the host has been tuned since the card reset
+ * @tuning_count:	Number of times the tuning procedure has run
+ */
+struct sandbox_mmc_priv {
+	bool emmc;
+	bool app_cmd;
+	bool s18r;
+	bool volt_180;
+	int access_mode;
+	bool switch_error;
+	u8 ext_csd[MMC_MAX_BLOCK_LEN];
+	bool tuning_fail;
+	bool hs400_fail;
+	bool cmd11_fail;
+	bool tuned;
+	int tuning_count;
+};
+
+/* Fill in a tuning block. The real patterns are just as arbitrary */
+static void sandbox_mmc_tuning_block(u8 *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (i * 73) ^ 0xa5;
+}
+
+/* Work out the bus timing that the card is using */
+static enum mmc_timing sandbox_mmc_card_timing(struct sandbox_mmc_priv *priv)
+{
+	if (priv->emmc) {
+		switch (priv->ext_csd[EXT_CSD_HS_TIMING]) {
+		case EXT_CSD_TIMING_HS:
+			if (priv->ext_csd[EXT_CSD_BUS_WIDTH] >=
+			    EXT_CSD_DDR_BUS_WIDTH_4)
+				return MMC_TIMING_MMC_DDR52;
+			return MMC_TIMING_MMC_HS;
+		case EXT_CSD_TIMING_HS200:
+			return MMC_TIMING_MMC_HS200;
+		case EXT_CSD_TIMING_HS400:
+			return MMC_TIMING_MMC_HS400;
+		}
+	} else {
+		switch (priv->access_mode) {
+		case SD_ACCESS_MODE_SDR25:
+			return MMC_TIMING_SD_HS;
+		case SD_ACCESS_MODE_SDR50:
+			return MMC_TIMING_UHS_SDR50;
+		case SD_ACCESS_MODE_SDR104:
+			return MMC_TIMING_UHS_SDR104;
+		}
+	}
+
+	return MMC_TIMING_LEGACY;
+}
+
+static bool sandbox_mmc_needs_tuning(enum mmc_timing timing)
+{
+	switch (timing) {
+	case MMC_TIMING_UHS_SDR50:
+	case MMC_TIMING_UHS_SDR104:
+	case MMC_TIMING_MMC_HS200:
+	case MMC_TIMING_MMC_HS400:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Check that data can get through. Above high-speed clock rates the host
+ * must use the same timing as the card, and must have been tuned if that
+ * timing needs it. Slower transfers always work, as on real hardware where
+ * the card changes timing before the host does.
+ */
+static int sandbox_mmc_check_timing(struct udevice *dev)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	struct mmc *mmc = &plat->mmc;
+	enum mmc_timing timing = sandbox_mmc_card_timing(priv);
+
+	if (mmc->clock <= 52000000)
+		return 0;
+	if (timing != mmc->timing ||
+	    (sandbox_mmc_needs_tuning(timing) && !priv->tuned))
+		return -EIO;
+
+	return 0;
+}
+
+/*
+ * Handle CMD6 for eMMC, rejecting mode changes the card does not support.
+ * The HS200 and HS400 modes only work with 1.8V I/O.
+ */
+static void sandbox_emmc_switch(struct udevice *dev, uint arg)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	bool volt_180 = plat->mmc.signal_voltage == MMC_SIGNAL_VOLTAGE_180;
+	u8 *ext_csd = priv->ext_csd;
+	uint index = (arg >> 16) & 0xff;
+	uint value = (arg >> 8) & 0xff;
+	bool ok = true;
+
+	if ((arg >> 24) != MMC_SWITCH_MODE_WRITE_BYTE) {
+		ok = false;
+	} else if (index == EXT_CSD_HS_TIMING) {
+		if (value == EXT_CSD_TIMING_HS200)
+			ok = volt_180 && (ext_csd[EXT_CSD_CARD_TYPE] &
+					  EXT_CSD_CARD_TYPE_HS200_1_8V);
+		else if (value == EXT_CSD_TIMING_HS400)
+			ok = volt_180 && !priv->hs400_fail &&
+				(ext_csd[EXT_CSD_CARD_TYPE] &
+				 EXT_CSD_CARD_TYPE_HS400_1_8V) &&
+				ext_csd[EXT_CSD_BUS_WIDTH] ==
+				EXT_CSD_DDR_BUS_WIDTH_8;
+		else
+			ok = value <= EXT_CSD_TIMING_HS;
+	} else if (index == EXT_CSD_BUS_WIDTH) {
+		if (value == EXT_CSD_DDR_BUS_WIDTH_4 ||
+		    value == EXT_CSD_DDR_BUS_WIDTH_8)
+			ok = ext_csd[EXT_CSD_HS_TIMING] == EXT_CSD_TIMING_HS;
+		else
+			ok = value <= EXT_CSD_BUS_WIDTH_8;
+	}
+
+	priv->switch_error = !ok;
+	if (ok)
+		ext_csd[index] = value;
+}
+
+/* Handle CMD6 for SD, for access modes (function group 1) only */
+static void sandbox_sd_switch(struct sandbox_mmc_priv *priv, uint arg,
+			      u32 *resp)
+{
+	uint func = arg & 0xf;
+	uint supported = 1 << 0 | 1 << SD_ACCESS_MODE_SDR25;
+
+	if (priv->volt_180)
+		supported |= 1 << SD_ACCESS_MODE_SDR50 |
+			1 << SD_ACCESS_MODE_SDR104;
+	if (func == 0xf)
+		func = priv->access_mode;
+	else if (!(supported & 1 << func))
+		func = 0xf;
+	else if (arg & 1 << 31)
+		priv->access_mode = func;
+
+	memset(resp, '\0', 64);
+	resp[3] = cpu_to_be32(supported << 16);
+	resp[4] = cpu_to_be32(func << 24);
+}
+
+/* Return the tuning block, if the card is in a mode which is tuned */
+static int sandbox_mmc_tuning(struct udevice *dev, struct mmc_cmd *cmd,
+			      struct mmc_data *data)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	enum mmc_timing timing = sandbox_mmc_card_timing(priv);
+	uint bus_width = plat->mmc.bus_width;
+
+	if (priv->emmc != (cmd->cmdidx == MMC_CMD_SEND_TUNING_BLOCK_HS200))
+		return -EIO;
+	if (!sandbox_mmc_needs_tuning(timing) || timing != plat->mmc.timing)
+		return -EIO;
+	if ((bus_width != 4 && bus_width != 8) ||
+	    data->blocksize != bus_width * 16)
+		return -EIO;
+
+	sandbox_mmc_tuning_block((u8 *)data->dest, data->blocksize);
+	if (priv->tuning_fail)
+		data->dest[0] ^= 0xff;
+
+	return 0;
+}
+
+/*
+ * Reset the card with CMD0. As on a real card, 1.8V signalling is kept, since
+ * only a power cycle drops it and sandbox has no power control.
+ */
+static void sandbox_mmc_reset(struct sandbox_mmc_priv *priv)
+{
+	priv->app_cmd = false;
+	priv->s18r = false;
+	priv->access_mode = 0;
+	priv->tuned = false;
+	priv->ext_csd[EXT_CSD_HS_TIMING] = EXT_CSD_TIMING_LEGACY;
+	priv->ext_csd[EXT_CSD_BUS_WIDTH] = EXT_CSD_BUS_WIDTH_1;
+}
+
+/**
+ * sandbox_mmc_send_cmd() - Emulate SD and eMMC commands
  *
- * This emulate an SD card version 2. Single-block reads result in zero data.
- * Multiple-block reads return a test string.
+ * This emulates an SD card version 3 with UHS-I, or an eMMC 5.1 device with
+ * HS200 and HS400. Single-block reads result in zero data. Multiple-block
+ * reads return a test string.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
 {
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	bool app_cmd = priv->app_cmd;
+	int ret;
+
+	/* An SD card does not see commands sent at the wrong voltage */
+	if (!priv->emmc && priv->volt_180 !=
+	    (plat->mmc.signal_voltage == MMC_SIGNAL_VOLTAGE_180))
+		return cmd->resp_type == MMC_RSP_NONE ? 0 : TIMEOUT;
+
+	priv->app_cmd = false;
+	if (data && cmd->cmdidx != MMC_CMD_SEND_TUNING_BLOCK &&
+	    cmd->cmdidx != MMC_CMD_SEND_TUNING_BLOCK_HS200) {
+		ret = sandbox_mmc_check_timing(dev);
+		if (ret)
+			return ret;
+	}
+
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
 		break;
 	case SD_CMD_SEND_RELATIVE_ADDR:
 		cmd->response[0] = 0 << 16; /* mmc->rca */
+		break;
 	case MMC_CMD_GO_IDLE_STATE:
+		sandbox_mmc_reset(priv);
+		break;
+	case MMC_CMD_SEND_OP_COND:
+		if (!priv->emmc)
+			return TIMEOUT;
+		cmd->response[0] = OCR_BUSY | OCR_HCS | 0x00ff8080;
 		break;
 	case SD_CMD_SEND_IF_COND:
+		if (priv->emmc) {
+			/* This is MMC_CMD_SEND_EXT_CSD */
+			if (!data)
+				return TIMEOUT;
+			memcpy(data->dest, priv->ext_csd, MMC_MAX_BLOCK_LEN);
+			break;
+		}
 		cmd->response[0] = 0xaa;
 		break;
+	case SD_CMD_SWITCH_UHS18V:
+		if (!priv->s18r || priv->cmd11_fail)
+			return -EIO;
+		priv->volt_180 = true;
+		break;
 	case MMC_CMD_SEND_STATUS:
-		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
+		if (priv->switch_error)
+			cmd->response[0] = MMC_STATUS_SWITCH_ERROR;
+		else
+			cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
+		priv->switch_error = false;
 		break;
 	case MMC_CMD_SELECT_CARD:
 		break;
 	case MMC_CMD_SEND_CSD:
 		cmd->response[0] = 0;
 		cmd->response[1] = 10 << 16;	/* 1 << block_len */
+		cmd->response[3] = 0;
+		if (priv->emmc) {
+			cmd->response[0] = 4 << 26;	/* MMC version 4 */
+			cmd->response[3] = 9 << 22;	/* 1 << write_bl_len */
+		}
 		break;
-	case SD_CMD_SWITCH_FUNC: {
-		u32 *resp = (u32 *)data->dest;
-
-		resp[7] = cpu_to_be32(SD_HIGHSPEED_BUSY);
+	case SD_CMD_SWITCH_FUNC:
+		if (priv->emmc)
+			sandbox_emmc_switch(dev, cmd->cmdarg);
+		else if (!app_cmd)
+			sandbox_sd_switch(priv, cmd->cmdarg,
+					  (u32 *)data->dest);
+		/* else SD_CMD_APP_SET_BUS_WIDTH, where the host's width is used */
 		break;
-	}
+	case MMC_CMD_SEND_TUNING_BLOCK:
+	case MMC_CMD_SEND_TUNING_BLOCK_HS200:
+		return sandbox_mmc_tuning(dev, cmd, data);
 	case MMC_CMD_READ_SINGLE_BLOCK:
 		memset(data->dest, '\0', data->blocksize);
 		break;
@@ -65,8 +325,15 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 		cmd->response[0] = OCR_BUSY | OCR_HCS;
 		cmd->response[1] = 0;
 		cmd->response[2] = 0;
+		/* A card already at 1.8V does not offer the switch again */
+		priv->s18r = (cmd->cmdarg & OCR_S18R) && !priv->volt_180;
+		if (priv->s18r)
+			cmd->response[0] |= OCR_S18R;
 		break;
 	case MMC_CMD_APP_CMD:
+		if (priv->emmc)
+			return TIMEOUT;
+		priv->app_cmd = true;
 		break;
 	case MMC_CMD_SET_BLOCKLEN:
 		debug("block len %d\n", cmd->cmdarg);
@@ -74,7 +341,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case SD_CMD_APP_SEND_SCR: {
 		u32 *scr = (u32 *)data->dest;
 
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		/* SD version 3, 1- and 4-bit bus */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | 5 << 16);
 		break;
 	}
 	default:
@@ -95,15 +363,100 @@ static int sandbox_mmc_get_cd(struct udevice *dev)
 	return 1;
 }
 
+/* Read the tuning block once and check it, which real hosts do per phase */
+static int sandbox_mmc_execute_tuning(struct udevice *dev, uint opcode)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	u8 buf[SANDBOX_MMC_TUNING_LEN], expect[SANDBOX_MMC_TUNING_LEN];
+	struct mmc_data data;
+	struct mmc_cmd cmd;
+	int ret;
+
+	priv->tuning_count++;
+	priv->tuned = false;
+
+	cmd.cmdidx = opcode;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
+	data.dest = (char *)buf;
+	data.blocks = 1;
+	data.blocksize = plat->mmc.bus_width == 8 ? 128 : 64;
+	data.flags = MMC_DATA_READ;
+
+	ret = sandbox_mmc_send_cmd(dev, &cmd, &data);
+	if (ret)
+		return ret;
+
+	sandbox_mmc_tuning_block(expect, data.blocksize);
+	if (memcmp(buf, expect, data.blocksize))
+		return -EIO;
+	priv->tuned = true;
+
+	return 0;
+}
+
 static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.send_cmd = sandbox_mmc_send_cmd,
 	.set_ios = sandbox_mmc_set_ios,
 	.get_cd = sandbox_mmc_get_cd,
+	.execute_tuning = sandbox_mmc_execute_tuning,
 };
 
+void sandbox_mmc_set_tuning_fail(struct udevice *dev, bool fail)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->tuning_fail = fail;
+}
+
+void sandbox_mmc_set_hs400_fail(struct udevice *dev, bool fail)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->hs400_fail = fail;
+}
+
+void sandbox_mmc_set_cmd11_fail(struct udevice *dev, bool fail)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->cmd11_fail = fail;
+}
+
+void sandbox_mmc_power_cycle(struct udevice *dev)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	sandbox_mmc_reset(priv);
+	priv->volt_180 = false;
+}
+
+int sandbox_mmc_get_tuning_count(struct udevice *dev)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	return priv->tuning_count;
+}
+
 int sandbox_mmc_probe(struct udevice *dev)
 {
 	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	u8 *ext_csd = priv->ext_csd;
+
+	priv->emmc = fdtdec_get_bool(gd->fdt_blob, dev->of_offset,
+				     "sandbox,emmc");
+	if (priv->emmc) {
+		ext_csd[EXT_CSD_REV] = 8;	/* eMMC 5.1 */
+		ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+			EXT_CSD_CARD_TYPE_52 | EXT_CSD_CARD_TYPE_DDR_1_8V |
+			EXT_CSD_CARD_TYPE_HS200_1_8V |
+			EXT_CSD_CARD_TYPE_HS400_1_8V;
+		ext_csd[EXT_CSD_SEC_CNT + 1] = 2048 >> 8;	/* 1MB */
+		ext_csd[EXT_CSD_HC_ERASE_GRP_SIZE] = 1;
+		ext_csd[EXT_CSD_HC_WP_GRP_SIZE] = 1;
+	}
 
 	return mmc_init(&plat->mmc);
 }
@@ -115,10 +468,12 @@ int sandbox_mmc_bind(struct udevice *dev)
 	int ret;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_4BIT |
+		MMC_MODE_8BIT | MMC_MODE_DDR_52MHz | MMC_MODE_HS200 |
+		MMC_MODE_HS400 | MMC_MODE_UHS;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
-	cfg->f_max = 52000000;
+	cfg->f_max = SD_UHS_SDR104_MAX_DTR;
 	cfg->b_max = U32_MAX;
 
 	ret = mmc_bind(dev, &plat->mmc, cfg);
@@ -148,5 +503,6 @@ U_BOOT_DRIVER(mmc_sandbox) = {
 	.bind		= sandbox_mmc_bind,
 	.unbind		= sandbox_mmc_unbind,
 	.probe		= sandbox_mmc_probe,
+	.priv_auto_alloc_size = sizeof(struct sandbox_mmc_priv),
 	.platdata_auto_alloc_size = sizeof(struct sandbox_mmc_plat),
 };
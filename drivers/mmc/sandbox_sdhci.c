@@ -0,0 +1,541 @@
+/*
+ * Emulated SDHCI controller for sandbox
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <errno.h>
+#include <malloc.h>
+#include <mmc.h>
+#include <sdhci.h>
+#include <asm/test.h>
+#include <asm/unaligned.h>
+
+/*
+ * This emulates an SDHCI 3.0 controller with a 2MB high-capacity SD card
+ * attached. Register accesses go through the SDHCI I/O accessors. Data moves
+ * either by PIO through SDHCI_BUFFER or by ADMA2, using the descriptor table
+ * written by the driver, with 64-bit addresses unless a test turns them off.
+ * SDMA is not supported.
+ *
+ * Block n of the card initially holds the 32-bit little-endian byte offset of
+ * each word, so that tests can check where data came from.
+ */
+
+enum {
+	SANDBOX_SDHCI_BLOCKS	= 4096,
+	SANDBOX_SDHCI_RCA	= 0x1234,
+	SANDBOX_SDHCI_TRAN	= 4 << 9,	/* card state: transfer */
+	SANDBOX_SDHCI_MAX_DESCS	= 4096,	/* give up on a runaway table */
+};
+
+/**
+ * struct sandbox_sdhci_priv - private state for this driver
+ *
+ * @host:	SDHCI host, used by the generic driver
+ * @caps:	Capabilities reported by the controller
+ * @regs:	Register contents
+ * @card:	Card contents
+ * @app_cmd:	true if the last command was APP_CMD
+ * @buf:	Data for the current data command
+ * @len:	Length of @buf in bytes
+ * @pos:	Number of bytes moved through SDHCI_BUFFER so far
+ * @blksz:	Block size of the current data command
+ * @read:	true if the current data command reads from the card
+ * @pio:	true if @buf is being moved through SDHCI_BUFFER
+ * @write_addr:	Card byte offset for the current write
+ * @adma_descs:	Number of ADMA descriptors processed
+ * @pio_bytes:	Number of bytes moved by PIO
+ */
+struct sandbox_sdhci_priv {
+	struct sdhci_host host;
+	u32 caps;
+	u8 regs[0x100];
+	u8 *card;
+	bool app_cmd;
+	u8 *buf;
+	int len;
+	int pos;
+	int blksz;
+	bool read;
+	bool pio;
+	ulong write_addr;
+	int adma_descs;
+	int pio_bytes;
+};
+
+/**
+ * struct sandbox_sdhci_plat - platform data for this driver
+ *
+ * @cfg:	MMC configuration
+ * @mmc:	MMC device
+ * @no_64bit:	true to clear SDHCI_CAN_64BIT, so that only ADMA32 works. This
+ *		is kept here since it must survive the device being removed
+ */
+struct sandbox_sdhci_plat {
+	struct mmc_config cfg;
+	struct mmc mmc;
+	bool no_64bit;
+};
+
+static struct sandbox_sdhci_priv *host_to_priv(struct sdhci_host *host)
+{
+	return container_of(host, struct sandbox_sdhci_priv, host);
+}
+
+static u32 reg_get(struct sandbox_sdhci_priv *priv, int reg, int size)
+{
+	switch (size) {
+	case 4:
+		return get_unaligned_le32(&priv->regs[reg]);
+	case 2:
+		return get_unaligned_le16(&priv->regs[reg]);
+	default:
+		return priv->regs[reg];
+	}
+}
+
+static void reg_set(struct sandbox_sdhci_priv *priv, int reg, int size,
+		    u32 val)
+{
+	switch (size) {
+	case 4:
+		put_unaligned_le32(val, &priv->regs[reg]);
+		break;
+	case 2:
+		put_unaligned_le16(val, &priv->regs[reg]);
+		break;
+	default:
+		priv->regs[reg] = val;
+		break;
+	}
+}
+
+static void raise_int(struct sandbox_sdhci_priv *priv, u32 bits)
+{
+	u32 stat = reg_get(priv, SDHCI_INT_STATUS, 4) | bits;
+
+	if (bits & SDHCI_INT_ERROR_MASK)
+		stat |= SDHCI_INT_ERROR;
+	reg_set(priv, SDHCI_INT_STATUS, 4, stat);
+}
+
+static void reset_regs(struct sandbox_sdhci_priv *priv)
+{
+	memset(priv->regs, '\0', sizeof(priv->regs));
+	reg_set(priv, SDHCI_CAPABILITIES, 4, priv->caps);
+	reg_set(priv, SDHCI_HOST_VERSION, 2, SDHCI_SPEC_300);
+}
+
+/* Data transfer is complete: write data to the card and signal the end */
+static void end_data(struct sandbox_sdhci_priv *priv)
+{
+	if (!priv->read)
+		memcpy(priv->card + priv->write_addr, priv->buf, priv->len);
+	free(priv->buf);
+	priv->buf = NULL;
+	priv->pio = false;
+	raise_int(priv, SDHCI_INT_DATA_END);
+}
+
+/* Walk the ADMA2 descriptor table, moving data between memory and @buf */
+static int run_adma(struct sandbox_sdhci_priv *priv)
+{
+	u8 dma = reg_get(priv, SDHCI_HOST_CONTROL, 1) & SDHCI_CTRL_DMA_MASK;
+	bool is64 = dma == SDHCI_CTRL_ADMA64;
+	int desc_sz = is64 ? SDHCI_ADMA_DESC_64_SZ : SDHCI_ADMA_DESC_32_SZ;
+	ulong table;
+	int done = 0;
+	int i;
+
+	if (dma != SDHCI_CTRL_ADMA32 && !is64)
+		return -ENOSYS;
+	if (is64 && !(priv->caps & SDHCI_CAN_64BIT))
+		return -ENOSYS;
+	table = reg_get(priv, SDHCI_ADMA_ADDRESS, 4);
+	if (is64)
+		table |= (u64)reg_get(priv, SDHCI_ADMA_ADDRESS_HI, 4) << 32;
+
+	for (i = 0; i < SANDBOX_SDHCI_MAX_DESCS; i++) {
+		struct sdhci_adma_desc *desc = (void *)table;
+		u16 attr = le16_to_cpu(desc->attr);
+		int len = le16_to_cpu(desc->len) ?: 0x10000;
+		ulong addr = le32_to_cpu(desc->addr_lo);
+
+		if (is64)
+			addr |= (u64)le32_to_cpu(desc->addr_hi) << 32;
+		if (!(attr & SDHCI_ADMA_VALID))
+			return -EINVAL;
+		priv->adma_descs++;
+		switch (attr & SDHCI_ADMA_ACT_MASK) {
+		case SDHCI_ADMA_ACT_TRAN:
+			if ((addr & SDHCI_ADMA_ALIGN_MASK) ||
+			    done + len > priv->len)
+				return -EINVAL;
+			if (priv->read)
+				memcpy((void *)addr, priv->buf + done, len);
+			else
+				memcpy(priv->buf + done, (void *)addr, len);
+			done += len;
+			break;
+		case SDHCI_ADMA_ACT_LINK:
+			table = addr;
+			continue;
+		}
+		if (attr & SDHCI_ADMA_END)
+			return done == priv->len ? 0 : -EINVAL;
+		table += desc_sz;
+	}
+
+	return -E2BIG;
+}
+
+static void start_data(struct sandbox_sdhci_priv *priv, const void *src,
+		       ulong write_addr)
+{
+	u16 mode = reg_get(priv, SDHCI_TRANSFER_MODE, 2);
+	int blocks = reg_get(priv, SDHCI_BLOCK_COUNT, 2);
+
+	priv->blksz = reg_get(priv, SDHCI_BLOCK_SIZE, 2) & 0xfff;
+	if (!(mode & SDHCI_TRNS_MULTI))
+		blocks = 1;
+	priv->len = blocks * priv->blksz;
+	priv->read = mode & SDHCI_TRNS_READ;
+	priv->write_addr = write_addr;
+	priv->pos = 0;
+	priv->buf = calloc(1, priv->len);
+	if (src)
+		memcpy(priv->buf, src, priv->len);
+
+	if (mode & SDHCI_TRNS_DMA) {
+		if (run_adma(priv)) {
+			free(priv->buf);
+			priv->buf = NULL;
+			raise_int(priv, SDHCI_INT_ADMA_ERROR);
+			return;
+		}
+		end_data(priv);
+	} else {
+		priv->pio = true;
+		raise_int(priv, priv->read ? SDHCI_INT_DATA_AVAIL :
+			  SDHCI_INT_SPACE_AVAIL);
+	}
+}
+
+/* Set up the response registers, which omit the CRC byte of R2 */
+static void set_response(struct sandbox_sdhci_priv *priv, u32 flags,
+			 const u32 *resp)
+{
+	u8 raw[16];
+	int i;
+
+	if ((flags & SDHCI_CMD_RESP_MASK) == SDHCI_CMD_RESP_LONG) {
+		for (i = 0; i < 4; i++)
+			put_unaligned_be32(resp[i], &raw[i * 4]);
+		for (i = 0; i < 15; i++)
+			priv->regs[SDHCI_RESPONSE + i] = raw[14 - i];
+		priv->regs[SDHCI_RESPONSE + 15] = 0;
+	} else {
+		reg_set(priv, SDHCI_RESPONSE, 4, resp[0]);
+	}
+}
+
+static void do_command(struct sandbox_sdhci_priv *priv, u16 val)
+{
+	u32 arg = reg_get(priv, SDHCI_ARGUMENT, 4);
+	u32 flags = val & 0xff;
+	int cmd = SDHCI_GET_CMD(val);
+	bool app_cmd = priv->app_cmd;
+	u32 resp[4] = { 0 };
+	u8 data[64];
+	ulong offset = (ulong)arg * MMC_MAX_BLOCK_LEN;
+
+	priv->app_cmd = false;
+	memset(data, '\0', sizeof(data));
+	switch (cmd) {
+	case MMC_CMD_GO_IDLE_STATE:
+		break;
+	case SD_CMD_SEND_IF_COND:
+		resp[0] = arg & 0xfff;
+		break;
+	case MMC_CMD_APP_CMD:
+		resp[0] = 1 << 5;	/* APP_CMD status bit */
+		priv->app_cmd = true;
+		break;
+	case MMC_CMD_ALL_SEND_CID:
+		resp[0] = 0x03000000;
+		break;
+	case SD_CMD_SEND_RELATIVE_ADDR:
+		resp[0] = SANDBOX_SDHCI_RCA << 16;
+		break;
+	case MMC_CMD_SEND_CSD:
+		/* CSD version 2.0, 25MHz, 512-byte blocks */
+		resp[0] = 0x40000032;
+		resp[1] = 9 << 16;
+		resp[2] = (SANDBOX_SDHCI_BLOCKS / 1024 - 1) << 16;
+		break;
+	case MMC_CMD_SELECT_CARD:
+	case MMC_CMD_SET_BLOCKLEN:
+	case MMC_CMD_STOP_TRANSMISSION:
+	case MMC_CMD_SEND_STATUS:
+		resp[0] = MMC_STATUS_RDY_FOR_DATA | SANDBOX_SDHCI_TRAN;
+		break;
+	case MMC_CMD_READ_SINGLE_BLOCK:
+	case MMC_CMD_READ_MULTIPLE_BLOCK:
+	case MMC_CMD_WRITE_SINGLE_BLOCK:
+	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		resp[0] = MMC_STATUS_RDY_FOR_DATA;
+		break;
+	default:
+		if (app_cmd && cmd == SD_CMD_APP_SEND_OP_COND) {
+			resp[0] = OCR_BUSY | OCR_HCS | OCR_VOLTAGE_MASK;
+		} else if (app_cmd && cmd == SD_CMD_APP_SEND_SCR) {
+			/* SD version 3.00, 1- and 4-bit bus */
+			put_unaligned_be32(2 << 24 | 5 << 16 | 1 << 15, data);
+		} else if (app_cmd && cmd == SD_CMD_APP_SET_BUS_WIDTH) {
+			break;
+		} else if (cmd == SD_CMD_SWITCH_FUNC) {
+			break;
+		} else {
+			debug("%s: Unknown command %d\n", __func__, cmd);
+			raise_int(priv, SDHCI_INT_TIMEOUT);
+			return;
+		}
+		break;
+	}
+
+	set_response(priv, flags, resp);
+	raise_int(priv, SDHCI_INT_RESPONSE);
+	if ((flags & SDHCI_CMD_RESP_MASK) == SDHCI_CMD_RESP_SHORT_BUSY)
+		raise_int(priv, SDHCI_INT_DATA_END);
+	if (!(flags & SDHCI_CMD_DATA))
+		return;
+
+	switch (cmd) {
+	case MMC_CMD_READ_SINGLE_BLOCK:
+	case MMC_CMD_READ_MULTIPLE_BLOCK:
+	case MMC_CMD_WRITE_SINGLE_BLOCK:
+	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		if (arg >= SANDBOX_SDHCI_BLOCKS) {
+			raise_int(priv, SDHCI_INT_DATA_TIMEOUT);
+			return;
+		}
+		start_data(priv, priv->card + offset, offset);
+		break;
+	default:
+		start_data(priv, data, 0);
+		break;
+	}
+}
+
+/* Move a word through SDHCI_BUFFER */
+static void pio_word(struct sandbox_sdhci_priv *priv)
+{
+	priv->pos += 4;
+	priv->pio_bytes += 4;
+	if (priv->pos == priv->len)
+		end_data(priv);
+	else if (!(priv->pos % priv->blksz))
+		raise_int(priv, priv->read ? SDHCI_INT_DATA_AVAIL :
+			  SDHCI_INT_SPACE_AVAIL);
+}
+
+static u32 sandbox_sdhci_read(struct sdhci_host *host, int reg, int size)
+{
+	struct sandbox_sdhci_priv *priv = host_to_priv(host);
+	u32 val;
+
+	switch (reg) {
+	case SDHCI_BUFFER:
+		if (!priv->pio || !priv->read)
+			return 0;
+		val = get_unaligned_le32(priv->buf + priv->pos);
+		pio_word(priv);
+		return val;
+	case SDHCI_PRESENT_STATE:
+		val = SDHCI_CARD_PRESENT | SDHCI_CARD_STATE_STABLE |
+			SDHCI_CARD_DETECT_PIN_LEVEL;
+		if (priv->pio)
+			val |= priv->read ? SDHCI_DATA_AVAILABLE :
+				SDHCI_SPACE_AVAILABLE;
+		return val;
+	}
+
+	return reg_get(priv, reg, size);
+}
+
+static void sandbox_sdhci_write(struct sdhci_host *host, u32 val, int reg,
+				int size)
+{
+	struct sandbox_sdhci_priv *priv = host_to_priv(host);
+
+	switch (reg) {
+	case SDHCI_BUFFER:
+		if (priv->pio && !priv->read) {
+			put_unaligned_le32(val, priv->buf + priv->pos);
+			pio_word(priv);
+		}
+		return;
+	case SDHCI_INT_STATUS:
+		/* Write 1 to clear */
+		val = reg_get(priv, reg, 4) & ~val;
+		if (!(val & SDHCI_INT_ERROR_MASK & ~SDHCI_INT_ERROR))
+			val &= ~SDHCI_INT_ERROR;
+		reg_set(priv, reg, 4, val);
+		return;
+	case SDHCI_SOFTWARE_RESET:
+		if (val & SDHCI_RESET_ALL)
+			reset_regs(priv);
+		if (val & (SDHCI_RESET_ALL | SDHCI_RESET_DATA)) {
+			free(priv->buf);
+			priv->buf = NULL;
+			priv->pio = false;
+		}
+		return;
+	case SDHCI_CLOCK_CONTROL:
+		if (val & SDHCI_CLOCK_INT_EN)
+			val |= SDHCI_CLOCK_INT_STABLE;
+		break;
+	case SDHCI_CAPABILITIES:
+	case SDHCI_HOST_VERSION:
+		return;
+	}
+
+	reg_set(priv, reg, size, val);
+	if (reg == SDHCI_COMMAND)
+		do_command(priv, val);
+}
+
+static u32 sandbox_sdhci_read_l(struct sdhci_host *host, int reg)
+{
+	return sandbox_sdhci_read(host, reg, 4);
+}
+
+static u16 sandbox_sdhci_read_w(struct sdhci_host *host, int reg)
+{
+	return sandbox_sdhci_read(host, reg, 2);
+}
+
+static u8 sandbox_sdhci_read_b(struct sdhci_host *host, int reg)
+{
+	return sandbox_sdhci_read(host, reg, 1);
+}
+
+static void sandbox_sdhci_write_l(struct sdhci_host *host, u32 val, int reg)
+{
+	sandbox_sdhci_write(host, val, reg, 4);
+}
+
+static void sandbox_sdhci_write_w(struct sdhci_host *host, u16 val, int reg)
+{
+	sandbox_sdhci_write(host, val, reg, 2);
+}
+
+static void sandbox_sdhci_write_b(struct sdhci_host *host, u8 val, int reg)
+{
+	sandbox_sdhci_write(host, val, reg, 1);
+}
+
+static const struct sdhci_ops sandbox_sdhci_io_ops = {
+	.read_l		= sandbox_sdhci_read_l,
+	.read_w		= sandbox_sdhci_read_w,
+	.read_b		= sandbox_sdhci_read_b,
+	.write_l	= sandbox_sdhci_write_l,
+	.write_w	= sandbox_sdhci_write_w,
+	.write_b	= sandbox_sdhci_write_b,
+};
+
+void sandbox_sdhci_get_stats(struct udevice *dev, int *adma_descs,
+			     int *pio_bytes)
+{
+	struct sandbox_sdhci_priv *priv = dev_get_priv(dev);
+
+	*adma_descs = priv->adma_descs;
+	*pio_bytes = priv->pio_bytes;
+}
+
+void sandbox_sdhci_set_64bit(struct udevice *dev, bool can_64bit)
+{
+	struct sandbox_sdhci_plat *plat = dev_get_platdata(dev);
+
+	plat->no_64bit = !can_64bit;
+}
+
+static int sandbox_sdhci_probe(struct udevice *dev)
+{
+	struct mmc_uclass_priv *upriv = dev_get_uclass_priv(dev);
+	struct sandbox_sdhci_plat *plat = dev_get_platdata(dev);
+	struct sandbox_sdhci_priv *priv = dev_get_priv(dev);
+	struct sdhci_host *host = &priv->host;
+	u32 *card;
+	u32 caps;
+	int ret;
+	int i;
+
+	priv->card = malloc(SANDBOX_SDHCI_BLOCKS * MMC_MAX_BLOCK_LEN);
+	if (!priv->card)
+		return -ENOMEM;
+	card = (u32 *)priv->card;
+	for (i = 0; i < SANDBOX_SDHCI_BLOCKS * MMC_MAX_BLOCK_LEN / 4; i++)
+		card[i] = cpu_to_le32(i * 4);
+	priv->caps = SDHCI_CAN_DO_ADMA2 | SDHCI_CAN_DO_HISPD |
+		SDHCI_CAN_VDD_330 | 50 << SDHCI_CLOCK_BASE_SHIFT;
+	if (!plat->no_64bit)
+		priv->caps |= SDHCI_CAN_64BIT;
+	reset_regs(priv);
+
+	host->name = dev->name;
+	host->ops = &sandbox_sdhci_io_ops;
+	host->bus_width = 4;
+	host->version = sdhci_readw(host, SDHCI_HOST_VERSION);
+	caps = sdhci_readl(host, SDHCI_CAPABILITIES);
+	ret = sdhci_setup_cfg(&plat->cfg, dev->name, host->bus_width, caps,
+			      0, 0, host->version, host->quirks, 0);
+	if (ret)
+		return ret;
+	host->mmc = &plat->mmc;
+	host->mmc->priv = host;
+	host->mmc->dev = dev;
+	upriv->mmc = host->mmc;
+
+	return sdhci_probe(dev);
+}
+
+static int sandbox_sdhci_remove(struct udevice *dev)
+{
+	struct sandbox_sdhci_priv *priv = dev_get_priv(dev);
+
+	free(priv->host.adma_desc_table);
+	free(priv->buf);
+	free(priv->card);
+
+	return 0;
+}
+
+static int sandbox_sdhci_bind(struct udevice *dev)
+{
+	struct sandbox_sdhci_plat *plat = dev_get_platdata(dev);
+
+	return sdhci_bind(dev, &plat->mmc, &plat->cfg);
+}
+
+static const struct udevice_id sandbox_sdhci_ids[] = {
+	{ .compatible = "sandbox,sdhci" },
+	{ }
+};
+
+U_BOOT_DRIVER(sandbox_sdhci) = {
+	.name		= "sandbox_sdhci",
+	.id		= UCLASS_MMC,
+	.of_match	= sandbox_sdhci_ids,
+	.ops		= &sdhci_ops,
+	.bind		= sandbox_sdhci_bind,
+	.probe		= sandbox_sdhci_probe,
+	.remove		= sandbox_sdhci_remove,
+	.priv_auto_alloc_size = sizeof(struct sandbox_sdhci_priv),
+	.platdata_auto_alloc_size = sizeof(struct sandbox_sdhci_plat),
+};
@@ -72,12 +72,6 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 				unsigned int start_addr)
 {
 	unsigned int stat, rdy, mask, timeout, block = 0;
-#ifdef CONFIG_MMC_SDMA
-	unsigned char ctrl;
-	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
-	ctrl &= ~SDHCI_CTRL_DMA_MASK;
-	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
-#endif
 
 	timeout = 1000000;
 	rdy = SDHCI_INT_SPACE_AVAIL | SDHCI_INT_DATA_AVAIL;
@@ -116,6 +110,108 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 	return 0;
 }
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+static void sdhci_adma_write_desc(struct sdhci_host *host, void *desc,
+				  dma_addr_t addr, int len, bool end)
+{
+	struct sdhci_adma_desc *d = desc;
+	u16 attr = SDHCI_ADMA_VALID | SDHCI_ADMA_ACT_TRAN;
+
+	if (end)
+		attr |= SDHCI_ADMA_END;
+	d->attr = cpu_to_le16(attr);
+	d->len = cpu_to_le16(len);
+	d->addr_lo = cpu_to_le32(lower_32_bits(addr));
+	if (host->flags & SDHCI_USE_ADMA64)
+		d->addr_hi = cpu_to_le32(upper_32_bits(addr));
+}
+
+/*
+ * Describe the buffer at @addr to the controller as a list of ADMA2
+ * descriptors, so that the whole transfer runs without interrupts.
+ * Returns false if the buffer cannot be used with ADMA.
+ */
+static bool sdhci_adma_prepare(struct sdhci_host *host, dma_addr_t addr,
+			       int len)
+{
+	int desc_sz = host->flags & SDHCI_USE_ADMA64 ?
+		SDHCI_ADMA_DESC_64_SZ : SDHCI_ADMA_DESC_32_SZ;
+	void *desc = host->adma_desc_table;
+	dma_addr_t table = (ulong)desc;
+
+	if (!(host->flags & SDHCI_USE_ADMA) || (addr & SDHCI_ADMA_ALIGN_MASK))
+		return false;
+	if (DIV_ROUND_UP(len, SDHCI_ADMA_MAX_LEN) > SDHCI_ADMA_TABLE_ENTRIES)
+		return false;
+	/* Without 64-bit addressing, the table and data must be below 4GB */
+	if (!(host->flags & SDHCI_USE_ADMA64) &&
+	    (upper_32_bits((u64)addr + len - 1) || upper_32_bits(table)))
+		return false;
+
+	while (len) {
+		int n = min(len, SDHCI_ADMA_MAX_LEN);
+
+		sdhci_adma_write_desc(host, desc, addr, n, n == len);
+		desc += desc_sz;
+		addr += n;
+		len -= n;
+	}
+	flush_cache(table, ALIGN(desc - host->adma_desc_table,
+				 ARCH_DMA_MINALIGN));
+
+	sdhci_writel(host, lower_32_bits(table), SDHCI_ADMA_ADDRESS);
+	if (host->flags & SDHCI_USE_ADMA64)
+		sdhci_writel(host, upper_32_bits(table), SDHCI_ADMA_ADDRESS_HI);
+
+	return true;
+}
+#endif
+
+/*
+ * Set up DMA for @data, preferring ADMA2 and then SDMA. Returns the DMA mode
+ * for SDHCI_HOST_CONTROL, or -1 to transfer the data by PIO.
+ */
+static int sdhci_prepare_dma(struct sdhci_host *host, struct mmc_data *data,
+			     unsigned long *start_addr, int *is_aligned,
+			     int trans_bytes)
+{
+	if (data->flags == MMC_DATA_READ)
+		*start_addr = (unsigned long)data->dest;
+	else
+		*start_addr = (unsigned long)data->src;
+
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if (sdhci_adma_prepare(host, *start_addr, trans_bytes))
+		return host->flags & SDHCI_USE_ADMA64 ? SDHCI_CTRL_ADMA64 :
+			SDHCI_CTRL_ADMA32;
+#endif
+#ifdef CONFIG_MMC_SDMA
+	if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
+			(*start_addr & 0x7) != 0x0) {
+		*is_aligned = 0;
+		*start_addr = (unsigned long)aligned_buffer;
+		if (data->flags != MMC_DATA_READ)
+			memcpy(aligned_buffer, data->src, trans_bytes);
+	}
+
+#if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
+	/*
+	 * Always use this bounce-buffer when
+	 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
+	 */
+	*is_aligned = 0;
+	*start_addr = (unsigned long)aligned_buffer;
+	if (data->flags != MMC_DATA_READ)
+		memcpy(aligned_buffer, data->src, trans_bytes);
+#endif
+
+	sdhci_writel(host, *start_addr, SDHCI_DMA_ADDRESS);
+	return SDHCI_CTRL_SDMA;
+#else
+	return -1;
+#endif
+}
+
 /*
  * No command will be sent by driver if card is busy, so driver must wait
  * for card ready state.
@@ -145,8 +241,10 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	unsigned int stat = 0;
 	int ret = 0;
 	int trans_bytes = 0, is_aligned = 1;
-	u32 mask, flags, mode;
-	unsigned int time = 0, start_addr = 0;
+	u32 mask, flags, mode = 0;
+	unsigned int time = 0;
+	unsigned long start_addr = 0;
+	int dma;
 	int mmc_dev = mmc_get_blk_desc(mmc)->devnum;
 	unsigned start = get_timer(0);
 
@@ -206,33 +304,15 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 		if (data->flags == MMC_DATA_READ)
 			mode |= SDHCI_TRNS_READ;
 
-#ifdef CONFIG_MMC_SDMA
-		if (data->flags == MMC_DATA_READ)
-			start_addr = (unsigned long)data->dest;
-		else
-			start_addr = (unsigned long)data->src;
-		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
-				(start_addr & 0x7) != 0x0) {
-			is_aligned = 0;
-			start_addr = (unsigned long)aligned_buffer;
-			if (data->flags != MMC_DATA_READ)
-				memcpy(aligned_buffer, data->src, trans_bytes);
-		}
-
-#if defined(CONFIG_FIXED_SDHCI_ALIGNED_BUFFER)
-		/*
-		 * Always use this bounce-buffer when
-		 * CONFIG_FIXED_SDHCI_ALIGNED_BUFFER is defined
-		 */
-		is_aligned = 0;
-		start_addr = (unsigned long)aligned_buffer;
-		if (data->flags != MMC_DATA_READ)
-			memcpy(aligned_buffer, data->src, trans_bytes);
-#endif
+		dma = sdhci_prepare_dma(host, data, &start_addr, &is_aligned,
+					trans_bytes);
+		if (dma >= 0) {
+			u8 ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
 
-		sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
-		mode |= SDHCI_TRNS_DMA;
-#endif
+			ctrl &= ~SDHCI_CTRL_DMA_MASK;
+			sdhci_writeb(host, ctrl | dma, SDHCI_HOST_CONTROL);
+			mode |= SDHCI_TRNS_DMA;
+		}
 		sdhci_writew(host, SDHCI_MAKE_BLKSZ(SDHCI_DEFAULT_BOUNDARY_ARG,
 				data->blocksize),
 				SDHCI_BLOCK_SIZE);
@@ -243,9 +323,8 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	}
 
 	sdhci_writel(host, cmd->cmdarg, SDHCI_ARGUMENT);
-#ifdef CONFIG_MMC_SDMA
-	flush_cache(start_addr, trans_bytes);
-#endif
+	if (mode & SDHCI_TRNS_DMA)
+		flush_cache(start_addr, trans_bytes);
 	sdhci_writew(host, SDHCI_MAKE_CMD(cmd->cmdidx, flags), SDHCI_COMMAND);
 	start = get_timer(0);
 	do {
@@ -449,6 +528,21 @@ static void sdhci_set_ios(struct mmc *mmc)
 static int sdhci_init(struct mmc *mmc)
 {
 	struct sdhci_host *host = mmc->priv;
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	unsigned int caps = sdhci_readl(host, SDHCI_CAPABILITIES);
+
+	if ((caps & SDHCI_CAN_DO_ADMA2) && !host->adma_desc_table) {
+		host->adma_desc_table = memalign(ARCH_DMA_MINALIGN,
+				SDHCI_ADMA_TABLE_ENTRIES * SDHCI_ADMA_DESC_64_SZ);
+		if (!host->adma_desc_table) {
+			printf("%s: ADMA table alloc failed!!!\n", __func__);
+			return -1;
+		}
+		host->flags |= SDHCI_USE_ADMA;
+		if ((caps & SDHCI_CAN_64BIT) && sizeof(dma_addr_t) > 4)
+			host->flags |= SDHCI_USE_ADMA64;
+	}
+#endif
 
 	if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) && !aligned_buffer) {
 		aligned_buffer = memalign(8, 512*1024);
@@ -11,10 +11,40 @@
 #include <dm.h>
 #include <malloc.h>
 #include <net.h>
+#include <net/tcp.h>
+#include <asm/eth.h>
 #include <asm/test.h>
+#include <asm/unaligned.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* Offsets of BOOTP fields (RFC 951) */
+#define SB_BOOTP_XID	4
+#define SB_BOOTP_YIADDR	16
+#define SB_BOOTP_SIADDR	20
+#define SB_BOOTP_CHADDR	28
+#define SB_BOOTP_VEND	236
+/* Size of the BOOTP replies sent, with room for the DHCP options */
+#define SB_BOOTP_SIZE	(SB_BOOTP_VEND + 64)
+
+/* Largest number of READ calls the fake NFS server holds before replying */
+#define SB_NFS_MAX_READS	16
+
+/**
+ * struct sb_nfs_read - A READ call waiting for its reply
+ *
+ * xid: RPC transaction ID of the call
+ * vers: NFS version of the call
+ * offset: file offset to read from
+ * count: number of bytes asked for
+ */
+struct sb_nfs_read {
+	__be32 xid;
+	int vers;
+	int offset;
+	int count;
+};
+
 /**
  * struct eth_sandbox_priv - memory for sandbox mock driver
  *
@@ -22,16 +52,77 @@ DECLARE_GLOBAL_DATA_PTR;
  * fake_host_ipaddr: IP address of mocked machine
  * recv_packet_buffer: buffer of the packet returned as received
  * recv_packet_length: length of the packet returned as received
+ * tftp_base: offset in the file of the part being served over TFTP
+ * tftp_len: length of the part being served over TFTP
+ * tftp_req: headers of the last TFTP request, used to build replies
+ * tftp_window: number of TFTP blocks sent for each ACK
+ * tftp_block: next TFTP block to send
+ * tftp_last: last TFTP block to send before waiting for an ACK
+ * dhcp_req: start of the last DHCP discovery, used to build the offer
+ * dhcp_offer: number of polls until a DHCP offer is sent, or 0 if none
+ * nfs_req: headers of the last RPC call, used to build replies
+ * nfs_reads: NFS READ calls waiting for a reply, oldest first
+ * nfs_num_reads: number of NFS READ calls waiting
  */
 struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
 	struct in_addr fake_host_ipaddr;
 	uchar *recv_packet_buffer;
 	int recv_packet_length;
+	int tftp_base;
+	int tftp_len;
+	uchar tftp_req[ETHER_HDR_SIZE + IP_UDP_HDR_SIZE];
+	int tftp_window;
+	int tftp_block;
+	int tftp_last;
+	uchar dhcp_req[ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + SB_BOOTP_VEND];
+	int dhcp_offer;
+	uchar nfs_req[ETHER_HDR_SIZE + IP_UDP_HDR_SIZE];
+	struct sb_nfs_read nfs_reads[SB_NFS_MAX_READS];
+	int nfs_num_reads;
 };
 
 static bool disabled[8] = {false};
 static bool skip_timeout;
+static int tftp_file_size = -1;
+static int tftp_part_size;
+static int tftp_acks;
+static int tftp_drop_block;
+static int tftp_dup_block;
+static int arp_requests;
+static int http_file_size = -1;
+static int http_hdr_pad;
+static int nfs_file_size = -1;
+static int nfs_flags;
+static int nfs_max_reads;
+static int nfs_read_version;
+static struct in_addr dhcp_addr;
+static bool dhcp_rapid_commit;
+static int dhcp_replies[SB_DHCP_REPLY_COUNT];
+/* Packet returned over and over for the receive stress test */
+static uchar rx_flood_packet[PKTSIZE_ALIGN];
+static int rx_flood_length;
+static int rx_flood_count;
+
+/* Port used by the fake TFTP server for data transfers */
+#define SB_TFTP_PORT	1069
+/* Largest window size the fake TFTP server agrees to */
+#define SB_TFTP_MAX_WINDOW	16
+
+/* Address of the fake DHCP server */
+#define SB_DHCP_SERVER	"1.1.2.2"
+
+/* Ports used by the fake NFS server for the mount and NFS programs */
+#define SB_NFS_MOUNT_PORT	1070
+#define SB_NFS_PORT		2049
+/* Size of the file handles given out by the fake NFS server */
+#define SB_NFS_FHSIZE		32
+/* Largest READ size reported, so that each reply fits in one frame */
+#define SB_NFS_RTMAX		1024
+
+/* Fake HTTP server: initial sequence number and bytes per segment */
+#define SB_HTTP_ISS	1000
+#define SB_HTTP_MSS	1000
 
 /*
  * sandbox_eth_disable_response()
@@ -54,6 +145,807 @@ void sandbox_eth_skip_timeout(void)
 	skip_timeout = true;
 }
 
+/*
+ * sandbox_eth_set_tftp_file()
+ *
+ * size - Size of the file served to any TFTP read request, or -1 to ignore
+ *	  TFTP requests. Byte n of the file is sandbox_eth_file_byte(n)
+ */
+void sandbox_eth_set_tftp_file(int size)
+{
+	tftp_file_size = size;
+}
+
+/*
+ * sandbox_eth_set_tftp_part_size()
+ *
+ * size - If non-zero, serve the file in parts of this size, as used by
+ *	  tftpmulti: a request for <name>.<n> returns part n, and a request
+ *	  for a part beyond the end of the file fails with 'File not found'
+ */
+void sandbox_eth_set_tftp_part_size(int size)
+{
+	tftp_part_size = size;
+}
+
+/*
+ * sandbox_eth_get_tftp_acks()
+ *
+ * returns - Number of TFTP ACKs received since the last read request
+ */
+int sandbox_eth_get_tftp_acks(void)
+{
+	return tftp_acks;
+}
+
+/*
+ * sandbox_eth_drop_tftp_block()
+ *
+ * block - TFTP block to lose the next time it is sent, or 0 for none
+ */
+void sandbox_eth_drop_tftp_block(int block)
+{
+	tftp_drop_block = block;
+}
+
+/*
+ * sandbox_eth_dup_tftp_block()
+ *
+ * block - TFTP block to send twice the next time it is sent, or 0 for none
+ */
+void sandbox_eth_dup_tftp_block(int block)
+{
+	tftp_dup_block = block;
+}
+
+/*
+ * sandbox_eth_get_arp_requests()
+ *
+ * returns - Number of ARP requests answered so far by all devices
+ */
+int sandbox_eth_get_arp_requests(void)
+{
+	return arp_requests;
+}
+
+/*
+ * sandbox_eth_set_http_file()
+ *
+ * size - Size of the file served to any HTTP request on port 80, or -1 to
+ *	  ignore TCP packets. Byte n of the file is sandbox_eth_file_byte(n)
+ */
+void sandbox_eth_set_http_file(int size)
+{
+	http_file_size = size;
+}
+
+/*
+ * sandbox_eth_set_http_hdr_pad()
+ *
+ * pad - Number of bytes of padding header to add to each HTTP response, or 0
+ *	 for none
+ */
+void sandbox_eth_set_http_hdr_pad(int pad)
+{
+	http_hdr_pad = pad;
+}
+
+/*
+ * sandbox_eth_set_nfs_file()
+ *
+ * size - Size of the file served to any NFS READ, or -1 to ignore RPC calls.
+ *	  Byte n of the file is sandbox_eth_file_byte(n)
+ * flags - SB_NFS_... flags to change how the server behaves
+ *
+ * This also clears the NFS counts
+ */
+void sandbox_eth_set_nfs_file(int size, int flags)
+{
+	nfs_file_size = size;
+	nfs_flags = flags;
+	nfs_max_reads = 0;
+	nfs_read_version = 0;
+}
+
+/*
+ * sandbox_eth_get_nfs_max_reads()
+ *
+ * returns - Largest number of NFS READ calls which were waiting at once
+ */
+int sandbox_eth_get_nfs_max_reads(void)
+{
+	return nfs_max_reads;
+}
+
+/*
+ * sandbox_eth_get_nfs_version()
+ *
+ * returns - NFS version of the last READ answered, or 0 if none
+ */
+int sandbox_eth_get_nfs_version(void)
+{
+	return nfs_read_version;
+}
+
+/*
+ * sandbox_eth_set_dhcp()
+ *
+ * addr - Address handed out to any DHCP client, or NULL to ignore DHCP
+ * rapid_commit - true to agree to Rapid Commit (RFC 4039), skipping the offer
+ *
+ * This also clears the counts of DHCP replies sent
+ */
+void sandbox_eth_set_dhcp(const char *addr, bool rapid_commit)
+{
+	dhcp_addr.s_addr = addr ? string_to_ip(addr).s_addr : 0;
+	dhcp_rapid_commit = rapid_commit;
+	memset(dhcp_replies, '\0', sizeof(dhcp_replies));
+}
+
+/*
+ * sandbox_eth_get_dhcp_replies()
+ *
+ * reply - Type of reply
+ * returns - Number of replies of this type sent by the fake DHCP server
+ */
+int sandbox_eth_get_dhcp_replies(enum sandbox_dhcp_reply reply)
+{
+	return dhcp_replies[reply];
+}
+
+/*
+ * sandbox_eth_set_rx_flood()
+ *
+ * packet - Packet to receive, starting with the Ethernet header
+ * length - Length of the packet
+ * count - Number of copies to receive, as fast as they are polled for
+ */
+void sandbox_eth_set_rx_flood(const void *packet, int length, int count)
+{
+	if (count)
+		memcpy(rx_flood_packet, packet, length);
+	rx_flood_length = length;
+	rx_flood_count = count;
+}
+
+/*
+ * sb_eth_ip_reply()
+ *
+ * Set up the Ethernet and IP headers of a reply to an IP packet, in the
+ * buffer from net_get_rx_buffer() if there is one, as a DMA engine would.
+ *
+ * packet - Packet being replied to
+ * proto - IP protocol of the reply
+ * length - Length of the reply, from the Ethernet header
+ * returns the IP header of the reply
+ */
+static struct ip_udp_hdr *sb_eth_ip_reply(struct udevice *dev, void *packet,
+					  int proto, int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct ethernet_hdr *eth_recv;
+	struct ip_udp_hdr *ipr;
+	uchar *buf;
+
+	buf = IS_ENABLED(CONFIG_NET_RX_DIRECT) ? net_get_rx_buffer(length) :
+		NULL;
+	priv->recv_packet_buffer = buf ? buf : net_rx_packets[0];
+	priv->recv_packet_length = length;
+
+	eth_recv = (void *)priv->recv_packet_buffer;
+	memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_recv->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_recv->et_protlen = htons(PROT_IP);
+
+	ipr = (void *)priv->recv_packet_buffer + ETHER_HDR_SIZE;
+	memset(ipr, '\0', IP_HDR_SIZE);
+	ipr->ip_hl_v = 0x45;
+	ipr->ip_len = htons(length - ETHER_HDR_SIZE);
+	ipr->ip_ttl = 255;
+	ipr->ip_p = proto;
+	net_copy_ip((void *)&ipr->ip_dst, &ip->ip_src);
+	net_copy_ip((void *)&ipr->ip_src, &ip->ip_dst);
+	ipr->ip_sum = compute_ip_checksum(ipr, IP_HDR_SIZE);
+
+	return ipr;
+}
+
+/*
+ * sb_eth_tftp_packet()
+ *
+ * Set up a reply from the fake TFTP server to the last request received
+ *
+ * length - Length of the TFTP part of the reply
+ * returns the TFTP part of the reply
+ */
+static __be16 *sb_eth_tftp_packet(struct udevice *dev, int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ip_udp_hdr *ip = (void *)priv->tftp_req + ETHER_HDR_SIZE;
+	struct ip_udp_hdr *ipr;
+
+	length += ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	ipr = sb_eth_ip_reply(dev, priv->tftp_req, IPPROTO_UDP, length);
+	ipr->udp_src = htons(SB_TFTP_PORT);
+	ipr->udp_dst = ip->udp_src;
+	ipr->udp_len = htons(length - ETHER_HDR_SIZE - IP_HDR_SIZE);
+	ipr->udp_xsum = 0;
+
+	return (void *)ipr + IP_UDP_HDR_SIZE;
+}
+
+/*
+ * sb_eth_tftp_data()
+ *
+ * Send the next data block of the current window, if there is one. Blocks
+ * are sent one at a time as they are received, since only one packet can
+ * be waiting to be received.
+ */
+static void sb_eth_tftp_data(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	__be16 *tftpr;
+	uchar *data;
+	int block, offset, len, i;
+
+	while (priv->tftp_block <= priv->tftp_last) {
+		block = priv->tftp_block++;
+		offset = (block - 1) * 512;
+		if (offset > priv->tftp_len)
+			break;
+		len = min(priv->tftp_len - offset, 512);
+		/* The last block ends the transfer, even if it is lost */
+		if (len < 512)
+			priv->tftp_last = block;
+		if (block == tftp_drop_block) {
+			tftp_drop_block = 0;
+			continue;
+		}
+		if (block == tftp_dup_block) {
+			tftp_dup_block = 0;
+			priv->tftp_block = block;
+		}
+
+		tftpr = sb_eth_tftp_packet(dev, 4 + len);
+		tftpr[0] = htons(3);	/* DATA */
+		tftpr[1] = htons(block);
+		data = (uchar *)(tftpr + 2);
+		for (i = 0; i < len; i++) {
+			data[i] = sandbox_eth_file_byte(priv->tftp_base +
+							offset + i);
+		}
+		return;
+	}
+	priv->tftp_last = 0;
+}
+
+/*
+ * sb_eth_tftp_reply()
+ *
+ * Act as a basic TFTP server with 512-byte blocks. The only options
+ * supported are 'tsize' (RFC 2349) and 'windowsize' (RFC 7440), which is
+ * capped to SB_TFTP_MAX_WINDOW.
+ */
+static void sb_eth_tftp_reply(struct udevice *dev, void *packet, int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be16 *tftp = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	static const char not_found[] = "File not found";
+	char oack[40], *opt, *end, *ext;
+	bool tsize = false;
+	__be16 *tftpr;
+	int len, val, i;
+
+	if (ntohs(ip->udp_dst) == 69 && ntohs(tftp[0]) == 1) {
+		/* RRQ */
+		memcpy(priv->tftp_req, packet, sizeof(priv->tftp_req));
+		priv->tftp_base = 0;
+		priv->tftp_len = tftp_file_size;
+		priv->tftp_window = 1;
+		tftp_acks = 0;
+		ext = strrchr((char *)(tftp + 1), '.');
+		if (tftp_part_size && ext) {
+			priv->tftp_base = simple_strtoul(ext + 1, NULL, 10) *
+					  tftp_part_size;
+			priv->tftp_len = min(tftp_file_size - priv->tftp_base,
+					     tftp_part_size);
+		}
+
+		/* Only the first part exists in an empty file */
+		if (priv->tftp_base && priv->tftp_base >= tftp_file_size) {
+			tftpr = sb_eth_tftp_packet(dev, 4 + sizeof(not_found));
+			tftpr[0] = htons(5);	/* ERROR */
+			tftpr[1] = htons(1);
+			memcpy(tftpr + 2, not_found, sizeof(not_found));
+			return;
+		}
+
+		/* Skip the file name and mode to get to the option names */
+		end = (char *)tftp + ntohs(ip->udp_len) - UDP_HDR_SIZE;
+		opt = (char *)(tftp + 1);
+		for (i = 0; opt < end; i++, opt += strnlen(opt, end - opt) + 1) {
+			if (i >= 2 && !(i & 1) && !strcmp(opt, "windowsize")) {
+				val = simple_strtoul(opt + 11, NULL, 10);
+				priv->tftp_window = clamp(val, 1,
+							  SB_TFTP_MAX_WINDOW);
+			}
+			if (i >= 2 && !(i & 1) && !strcmp(opt, "tsize"))
+				tsize = true;
+		}
+		len = 0;
+		if (priv->tftp_window > 1)
+			len += sprintf(oack + len, "windowsize%c%d%c", 0,
+				       priv->tftp_window, 0);
+		if (tsize)
+			len += sprintf(oack + len, "tsize%c%d%c", 0,
+				       priv->tftp_len, 0);
+		if (len) {
+			tftpr = sb_eth_tftp_packet(dev, 2 + len);
+			tftpr[0] = htons(6);	/* OACK */
+			memcpy(tftpr + 1, oack, len);
+			return;
+		}
+		priv->tftp_block = 1;
+	} else if (ntohs(ip->udp_dst) == SB_TFTP_PORT && ntohs(tftp[0]) == 4) {
+		/* ACK: send the next window, or resend it after a loss */
+		tftp_acks++;
+		priv->tftp_block = ntohs(tftp[1]) + 1;
+	} else {
+		return;
+	}
+
+	priv->tftp_last = priv->tftp_block + priv->tftp_window - 1;
+	sb_eth_tftp_data(dev);
+}
+
+/*
+ * sb_eth_dhcp_option()
+ *
+ * Find a DHCP option in a BOOTP packet
+ *
+ * bp - BOOTP packet
+ * len - Length of the packet
+ * code - Option to look for
+ * returns a pointer to the option's length byte, or NULL if not found
+ */
+static uchar *sb_eth_dhcp_option(uchar *bp, int len, int code)
+{
+	uchar *opt = bp + SB_BOOTP_VEND + 4;
+	uchar *end = bp + len;
+
+	while (opt < end && *opt != 255) {
+		if (!*opt) {
+			opt++;	/* Pad */
+			continue;
+		}
+		if (*opt == code)
+			return opt + 1;
+		opt += 2 + opt[1];
+	}
+
+	return NULL;
+}
+
+/*
+ * sb_eth_dhcp_send()
+ *
+ * Send a reply from the fake DHCP server
+ *
+ * packet - Request, of which only the headers and BOOTP fields are used
+ * reply - Type of reply to send
+ * rapid - true to include the Rapid Commit option
+ */
+static void sb_eth_dhcp_send(struct udevice *dev, void *packet,
+			     enum sandbox_dhcp_reply reply, bool rapid)
+{
+	static const u8 types[] = {
+		[SB_DHCP_OFFER] = 2,
+		[SB_DHCP_ACK] = 5,
+		[SB_DHCP_NAK] = 6,
+	};
+	struct in_addr server = string_to_ip(SB_DHCP_SERVER);
+	uchar *bp = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	struct ip_udp_hdr *ipr;
+	uchar *bpr, *opt;
+	int length;
+
+	length = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + SB_BOOTP_SIZE;
+	ipr = sb_eth_ip_reply(dev, packet, IPPROTO_UDP, length);
+	net_write_ip(&ipr->ip_src, server);
+	net_write_ip(&ipr->ip_dst, string_to_ip("255.255.255.255"));
+	ipr->ip_sum = 0;
+	ipr->ip_sum = compute_ip_checksum(ipr, IP_HDR_SIZE);
+	ipr->udp_src = htons(67);
+	ipr->udp_dst = htons(68);
+	ipr->udp_len = htons(UDP_HDR_SIZE + SB_BOOTP_SIZE);
+	ipr->udp_xsum = 0;
+
+	bpr = (uchar *)ipr + IP_UDP_HDR_SIZE;
+	memset(bpr, '\0', SB_BOOTP_SIZE);
+	bpr[0] = 2;		/* BOOTREPLY */
+	bpr[1] = 1;		/* Ethernet */
+	bpr[2] = ARP_HLEN;
+	memcpy(bpr + SB_BOOTP_XID, bp + SB_BOOTP_XID, 4);
+	if (reply != SB_DHCP_NAK)
+		net_write_ip(bpr + SB_BOOTP_YIADDR, dhcp_addr);
+	net_write_ip(bpr + SB_BOOTP_SIADDR, server);
+	memcpy(bpr + SB_BOOTP_CHADDR, bp + SB_BOOTP_CHADDR, ARP_HLEN);
+
+	opt = bpr + SB_BOOTP_VEND;
+	*opt++ = 99;		/* Magic cookie */
+	*opt++ = 130;
+	*opt++ = 83;
+	*opt++ = 99;
+	*opt++ = 53;		/* Message type */
+	*opt++ = 1;
+	*opt++ = types[reply];
+	*opt++ = 54;		/* Server identifier */
+	*opt++ = 4;
+	net_write_ip(opt, server);
+	opt += 4;
+	if (reply != SB_DHCP_NAK) {
+		*opt++ = 1;	/* Subnet mask */
+		*opt++ = 4;
+		net_write_ip(opt, string_to_ip("255.255.255.0"));
+		opt += 4;
+		*opt++ = 51;	/* Lease time */
+		*opt++ = 4;
+		put_unaligned_be32(3600, opt);
+		opt += 4;
+	}
+	if (rapid) {
+		*opt++ = 80;	/* Rapid Commit */
+		*opt++ = 0;
+	}
+	*opt = 255;
+	dhcp_replies[reply]++;
+}
+
+/*
+ * sb_eth_dhcp_reply()
+ *
+ * Act as a DHCP server which hands out one address. An INIT-REBOOT request
+ * for any other address is refused. Offers are sent late, once a poll has
+ * found nothing to receive, as by a server which checks that the address
+ * is free. So an INIT-REBOOT request sent along with the discovery is
+ * answered first.
+ */
+static void sb_eth_dhcp_reply(struct udevice *dev, void *packet, int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	uchar *bp = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	int len = length - ETHER_HDR_SIZE - IP_UDP_HDR_SIZE;
+	struct in_addr addr;
+	uchar *opt;
+
+	opt = sb_eth_dhcp_option(bp, len, 53);
+	if (!opt || len < SB_BOOTP_VEND)
+		return;
+	if (opt[1] == 1) {
+		/* DISCOVER */
+		if (dhcp_rapid_commit && sb_eth_dhcp_option(bp, len, 80)) {
+			sb_eth_dhcp_send(dev, packet, SB_DHCP_ACK, true);
+		} else {
+			memcpy(priv->dhcp_req, packet, sizeof(priv->dhcp_req));
+			priv->dhcp_offer = 2;
+		}
+	} else if (opt[1] == 3) {
+		/* REQUEST */
+		opt = sb_eth_dhcp_option(bp, len, 50);
+		if (!opt)
+			return;
+		addr = net_read_ip(opt + 1);
+		sb_eth_dhcp_send(dev, packet, addr.s_addr == dhcp_addr.s_addr ?
+				 SB_DHCP_ACK : SB_DHCP_NAK, false);
+	}
+}
+
+/*
+ * sb_eth_rpc_reply()
+ *
+ * Set up a successful reply from the fake NFS server to the last RPC call
+ *
+ * xid - Transaction ID of the call
+ * len - Length of the reply data after the RPC header, in bytes
+ * returns the reply data
+ */
+static __be32 *sb_eth_rpc_reply(struct udevice *dev, __be32 xid, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ip_udp_hdr *ip = (void *)priv->nfs_req + ETHER_HDR_SIZE;
+	struct ip_udp_hdr *ipr;
+	__be32 *rpc;
+
+	len += 6 * 4 + IP_UDP_HDR_SIZE;
+	ipr = sb_eth_ip_reply(dev, priv->nfs_req, IPPROTO_UDP,
+			      ETHER_HDR_SIZE + len);
+	ipr->udp_src = ip->udp_dst;
+	ipr->udp_dst = ip->udp_src;
+	ipr->udp_len = htons(len - IP_HDR_SIZE);
+	ipr->udp_xsum = 0;
+
+	rpc = (void *)ipr + IP_UDP_HDR_SIZE;
+	rpc[0] = xid;
+	rpc[1] = htonl(1);	/* REPLY */
+	rpc[2] = 0;		/* MSG_ACCEPTED */
+	rpc[3] = 0;		/* AUTH_NONE verifier */
+	rpc[4] = 0;
+	rpc[5] = 0;		/* SUCCESS */
+
+	return rpc + 6;
+}
+
+/*
+ * sb_eth_nfs_fh()
+ *
+ * Add a file handle to an RPC reply
+ *
+ * p - Place to put the file handle
+ * vers - NFS version, since NFSv3 handles have a length
+ * id - Byte to fill the handle with
+ * returns the word after the handle
+ */
+static __be32 *sb_eth_nfs_fh(__be32 *p, int vers, int id)
+{
+	if (vers == 3)
+		*p++ = htonl(SB_NFS_FHSIZE);
+	memset(p, id, SB_NFS_FHSIZE);
+
+	return p + SB_NFS_FHSIZE / 4;
+}
+
+/*
+ * sb_eth_nfs_fattr()
+ *
+ * Add the attributes of the file to an RPC reply, leaving out all but the
+ * type and size
+ *
+ * p - Place to put the attributes
+ * vers - NFS version, since NFSv3 attributes are larger
+ * returns the word after the attributes
+ */
+static __be32 *sb_eth_nfs_fattr(__be32 *p, int vers)
+{
+	int words = vers == 3 ? 21 : 17;
+
+	memset(p, '\0', words * 4);
+	p[0] = htonl(1);	/* regular file */
+	p[vers == 3 ? 6 : 5] = htonl(nfs_file_size);
+
+	return p + words;
+}
+
+/*
+ * sb_eth_nfs_getport()
+ *
+ * Look up the port of a program for the fake portmapper
+ *
+ * returns the port, or 0 if the program or version is not supported
+ */
+static int sb_eth_nfs_getport(u32 prog, u32 vers)
+{
+	bool v3 = vers == 3 && !(nfs_flags & SB_NFS_V2_ONLY);
+
+	if (prog == 100005 && (vers == 1 || v3))	/* MOUNT */
+		return SB_NFS_MOUNT_PORT;
+	if (prog == 100003 && (vers == 2 || v3))	/* NFS */
+		return SB_NFS_PORT;
+
+	return 0;
+}
+
+/*
+ * sb_eth_nfs_data()
+ *
+ * Answer one of the waiting READ calls. Calls are held and answered one at
+ * a time as they are received, since only one packet can be waiting to be
+ * received. They are answered oldest first, unless SB_NFS_REORDER is set.
+ */
+static void sb_eth_nfs_data(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct sb_nfs_read *rd = priv->nfs_reads;
+	int words, count, i;
+	__be32 *p;
+	uchar *data;
+	bool eof;
+
+	if (nfs_flags & SB_NFS_REORDER)
+		rd += priv->nfs_num_reads - 1;
+	count = clamp(nfs_file_size - rd->offset, 0, rd->count);
+	if ((nfs_flags & SB_NFS_SHORT) && count > 1)
+		count /= 2;
+	eof = rd->offset + count >= nfs_file_size;
+
+	/* Status and file attributes, then the count and eof flag */
+	words = rd->vers == 3 ? 1 + 22 + 3 : 1 + 17 + 1;
+	p = sb_eth_rpc_reply(dev, rd->xid, words * 4 + ALIGN(count, 4));
+	*p++ = 0;
+	if (rd->vers == 3)
+		*p++ = htonl(1);	/* attributes follow */
+	p = sb_eth_nfs_fattr(p, rd->vers);
+	*p++ = htonl(count);
+	if (rd->vers == 3) {
+		*p++ = htonl(eof);
+		*p++ = htonl(count);
+	}
+	data = (uchar *)p;
+	for (i = 0; i < count; i++)
+		data[i] = sandbox_eth_file_byte(rd->offset + i);
+	memset(data + count, '\0', ALIGN(count, 4) - count);
+	nfs_read_version = rd->vers;
+
+	priv->nfs_num_reads--;
+	memmove(rd, rd + 1, (priv->nfs_reads + priv->nfs_num_reads - rd) *
+		sizeof(*rd));
+}
+
+/*
+ * sb_eth_nfs_reply()
+ *
+ * Act as a portmapper, mount daemon and NFS server (RFC 1094 and RFC 1813)
+ * serving one file. Only the calls U-Boot makes are supported, with the
+ * RPC credentials ignored. Any name is found by LOOKUP and READ replies are
+ * held, to be answered one by one by sb_eth_nfs_data().
+ */
+static void sb_eth_nfs_reply(struct udevice *dev, void *packet, int length)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be32 *call = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	int port = ntohs(ip->udp_dst);
+	struct sb_nfs_read *rd;
+	u32 prog, vers, proc;
+	__be32 res[40], *p;
+	int len;
+
+	if (ntohl(call[1]) != 0)	/* CALL */
+		return;
+	prog = ntohl(call[3]);
+	vers = ntohl(call[4]);
+	proc = ntohl(call[5]);
+	if (vers == 3 && (nfs_flags & SB_NFS_V2_ONLY))
+		return;
+	memcpy(priv->nfs_req, packet, sizeof(priv->nfs_req));
+
+	/* Skip the credential and verifier */
+	p = call + 6;
+	p += 2 + DIV_ROUND_UP(ntohl(p[1]), 4);
+	p += 2 + DIV_ROUND_UP(ntohl(p[1]), 4);
+
+	memset(res, '\0', sizeof(res));
+	if (port == 111 && prog == 100000 && proc == 3) {
+		/* GETPORT */
+		res[0] = htonl(sb_eth_nfs_getport(ntohl(p[0]), ntohl(p[1])));
+		len = 1;
+	} else if (port == SB_NFS_MOUNT_PORT && prog == 100005 && proc == 1) {
+		/* MNT: status and the handle of the directory */
+		len = sb_eth_nfs_fh(res + 1, vers, 'd') - res;
+	} else if (port == SB_NFS_MOUNT_PORT && prog == 100005 && proc == 4) {
+		/* UMNTALL */
+		len = 0;
+	} else if (port == SB_NFS_PORT && prog == 100003 &&
+		   proc == (vers == 3 ? 3 : 4)) {
+		/* LOOKUP: status, the handle and attributes of the file */
+		p = sb_eth_nfs_fh(res + 1, vers, 'f');
+		if (vers == 3)
+			*p++ = htonl(1);	/* attributes follow */
+		p = sb_eth_nfs_fattr(p, vers);
+		len = p - res;
+		if (vers == 3)
+			len++;		/* no directory attributes */
+	} else if (port == SB_NFS_PORT && prog == 100003 && vers == 3 &&
+		   proc == 19) {
+		/* FSINFO: status, no attributes, rtmax, rtpref, rtmult... */
+		res[2] = htonl(SB_NFS_RTMAX);
+		res[3] = htonl(SB_NFS_RTMAX);
+		res[4] = htonl(512);
+		len = 13;
+	} else if (port == SB_NFS_PORT && prog == 100003 && proc == 6) {
+		/* READ: hold it until the server is polled */
+		if (priv->nfs_num_reads == SB_NFS_MAX_READS)
+			return;
+		rd = &priv->nfs_reads[priv->nfs_num_reads++];
+		nfs_max_reads = max(nfs_max_reads, priv->nfs_num_reads);
+		rd->xid = call[0];
+		rd->vers = vers;
+		if (vers == 3)
+			p += 1 + DIV_ROUND_UP(ntohl(p[0]), 4) + 1;
+		else
+			p += SB_NFS_FHSIZE / 4;
+		rd->offset = ntohl(p[0]);
+		rd->count = ntohl(p[1]);
+		return;
+	} else {
+		return;
+	}
+
+	memcpy(sb_eth_rpc_reply(dev, call[0], len * 4), res, len * 4);
+}
+
+#ifdef CONFIG_PROT_TCP
+/*
+ * sb_eth_http_reply()
+ *
+ * Act as an HTTP server which sends the file in response to any request.
+ * Only one segment is sent for each one received, since only one packet
+ * can be waiting to be received.
+ */
+static void sb_eth_http_reply(struct udevice *dev, void *packet, int length)
+{
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct tcp_hdr *tcp = packet + ETHER_HDR_SIZE + IP_HDR_SIZE;
+	static bool requested;
+	const char *tail = http_hdr_pad ? "\r\n\r\n" : "\r\n";
+	struct ip_udp_hdr *ipr;
+	struct tcp_hdr *tcpr;
+	char hdr[80];
+	int pre_len, hdr_len, offset, plen, len, i;
+	u32 seq, ack;
+	u8 flags;
+	uchar *data;
+
+	if (ntohs(tcp->dst) != 80 || (tcp->flags & (TCP_FIN | TCP_RST)))
+		return;
+	/* The padding header is made up of http_hdr_pad x characters */
+	pre_len = snprintf(hdr, sizeof(hdr),
+			   "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n%s",
+			   http_file_size, http_hdr_pad ? "X-Pad: " : "");
+	hdr_len = pre_len + http_hdr_pad + strlen(tail);
+	plen = ntohs(ip->ip_len) - IP_HDR_SIZE - (tcp->hlen >> 4) * 4;
+	seq = ntohl(tcp->seq) + plen;
+	flags = TCP_ACK;
+	if (tcp->flags & TCP_SYN) {
+		/* Connection request */
+		requested = false;
+		flags |= TCP_SYN;
+		offset = -1;
+		len = 0;
+		seq++;
+	} else {
+		/* Send the next part of the response once asked for it */
+		if (plen)
+			requested = true;
+		if (!requested)
+			return;
+		offset = ntohl(tcp->ack) - SB_HTTP_ISS - 1;
+		if (offset >= hdr_len + http_file_size)
+			return;
+		len = min(hdr_len + http_file_size - offset, SB_HTTP_MSS);
+	}
+	ack = seq;
+	length = ETHER_HDR_SIZE + IP_HDR_SIZE + TCP_HDR_SIZE + len;
+
+	ipr = sb_eth_ip_reply(dev, packet, IPPROTO_TCP, length);
+	tcpr = (void *)ipr + IP_HDR_SIZE;
+	memset(tcpr, '\0', TCP_HDR_SIZE);
+	tcpr->src = tcp->dst;
+	tcpr->dst = tcp->src;
+	tcpr->seq = htonl(SB_HTTP_ISS + 1 + offset);
+	tcpr->ack = htonl(ack);
+	tcpr->hlen = (TCP_HDR_SIZE / 4) << 4;
+	tcpr->flags = flags;
+	tcpr->wnd = htons(0x8000);
+	data = (uchar *)(tcpr + 1);
+	for (i = 0; i < len; i++, offset++) {
+		if (offset < pre_len)
+			data[i] = hdr[offset];
+		else if (offset < pre_len + http_hdr_pad)
+			data[i] = 'x';
+		else if (offset < hdr_len)
+			data[i] = tail[offset - pre_len - http_hdr_pad];
+		else
+			data[i] = sandbox_eth_file_byte(offset - hdr_len);
+	}
+	tcpr->sum = tcp_checksum(net_read_ip(&ipr->ip_src),
+				 net_read_ip(&ipr->ip_dst), tcpr,
+				 TCP_HDR_SIZE + len);
+}
+#endif
+
 static int sb_eth_start(struct udevice *dev)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
@@ -77,6 +969,12 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 	    disabled[dev->seq])
 		return 0;
 
+	/* Any packet still waiting to be received is lost */
+	if (IS_ENABLED(CONFIG_NET_RX_DIRECT) && priv->recv_packet_length)
+		net_put_rx_buffer(priv->recv_packet_buffer);
+	priv->recv_packet_length = 0;
+	priv->recv_packet_buffer = net_rx_packets[0];
+
 	if (ntohs(eth->et_protlen) == PROT_ARP) {
 		struct arp_hdr *arp = packet + ETHER_HDR_SIZE;
 
@@ -86,6 +984,7 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 
 			/* store this as the assumed IP of the fake host */
 			priv->fake_host_ipaddr = net_read_ip(&arp->ar_tpa);
+			arp_requests++;
 			/* Formulate a fake response */
 			eth_recv = (void *)priv->recv_packet_buffer;
 			memcpy(eth_recv->et_dest, eth->et_src, ARP_HLEN);
@@ -146,36 +1045,74 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 
 				priv->recv_packet_length = length;
 			}
+		} else if (ip->ip_p == IPPROTO_UDP && dhcp_addr.s_addr &&
+			   ntohs(ip->udp_dst) == 67) {
+			sb_eth_dhcp_reply(dev, packet, length);
+		} else if (ip->ip_p == IPPROTO_UDP && nfs_file_size >= 0) {
+			sb_eth_nfs_reply(dev, packet, length);
+		} else if (ip->ip_p == IPPROTO_UDP && tftp_file_size >= 0) {
+			sb_eth_tftp_reply(dev, packet, length);
+#ifdef CONFIG_PROT_TCP
+		} else if (ip->ip_p == IPPROTO_TCP && http_file_size >= 0) {
+			sb_eth_http_reply(dev, packet, length);
+#endif
 		}
 	}
 
 	return 0;
 }
 
-static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
+static int sb_eth_recv_batch(struct udevice *dev, int flags,
+			     struct eth_pkt *pkts, int max)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int count = 0;
 
 	if (skip_timeout) {
 		sandbox_timer_add_offset(11000UL);
 		skip_timeout = false;
 	}
 
-	if (priv->recv_packet_length) {
-		int lcl_recv_packet_length = priv->recv_packet_length;
+	/* The rest of the TFTP window follows the first block */
+	if (!priv->recv_packet_length && priv->tftp_last)
+		sb_eth_tftp_data(dev);
+
+	if (!priv->recv_packet_length && priv->nfs_num_reads)
+		sb_eth_nfs_data(dev);
 
+	if (!priv->recv_packet_length && priv->dhcp_offer &&
+	    !--priv->dhcp_offer)
+		sb_eth_dhcp_send(dev, priv->dhcp_req, SB_DHCP_OFFER, false);
+
+	if (priv->recv_packet_length) {
 		debug("eth_sandbox: received packet %d\n",
 		      priv->recv_packet_length);
+		pkts[count].packet = priv->recv_packet_buffer;
+		pkts[count].length = priv->recv_packet_length;
 		priv->recv_packet_length = 0;
-		*packetp = priv->recv_packet_buffer;
-		return lcl_recv_packet_length;
+		count++;
 	}
-	return 0;
+
+	/* Like a receive ring which the other end keeps full */
+	for (; count < max && rx_flood_count; count++, rx_flood_count--) {
+		pkts[count].packet = rx_flood_packet;
+		pkts[count].length = rx_flood_length;
+	}
+
+	return count;
 }
 
 static void sb_eth_stop(struct udevice *dev)
 {
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
 	debug("eth_sandbox: Stop\n");
+	if (IS_ENABLED(CONFIG_NET_RX_DIRECT) && priv->recv_packet_length)
+		net_put_rx_buffer(priv->recv_packet_buffer);
+	priv->recv_packet_length = 0;
+	priv->tftp_last = 0;
+	priv->dhcp_offer = 0;
+	priv->nfs_num_reads = 0;
 }
 
 static int sb_eth_write_hwaddr(struct udevice *dev)
@@ -190,7 +1127,7 @@ static int sb_eth_write_hwaddr(struct udevice *dev)
 static const struct eth_ops sb_eth_ops = {
 	.start			= sb_eth_start,
 	.send			= sb_eth_send,
-	.recv			= sb_eth_recv,
+	.recv_batch		= sb_eth_recv_batch,
 	.stop			= sb_eth_stop,
 	.write_hwaddr		= sb_eth_write_hwaddr,
 };
@@ -67,9 +67,18 @@ struct sandbox_flash_priv {
 	u8 buff[512];
 };
 
+/**
+ * struct sandbox_flash_plat - platform data for this driver
+ *
+ * @pathname:	Name of backing file
+ * @flash_strings: USB string descriptors
+ * @inquiry_count: Number of INQUIRY commands received, for tests. This is
+ *		kept here since it must survive the device being removed
+ */
 struct sandbox_flash_plat {
 	const char *pathname;
 	struct usb_string flash_strings[STRINGID_COUNT];
+	int inquiry_count;
 };
 
 struct scsi_inquiry_resp {
@@ -250,6 +259,7 @@ static int handle_ufi_command(struct sandbox_flash_plat *plat,
 	case SCSI_INQUIRY: {
 		struct scsi_inquiry_resp *resp = (void *)priv->buff;
 
+		plat->inquiry_count++;
 		priv->alloc_len = req->cmd[4];
 		memset(resp, '\0', sizeof(*resp));
 		resp->data_format = 1;
@@ -379,6 +389,13 @@ static int sandbox_flash_ofdata_to_platdata(struct udevice *dev)
 	return 0;
 }
 
+int sandbox_flash_get_inquiry_count(struct udevice *dev)
+{
+	struct sandbox_flash_plat *plat = dev_get_platdata(dev);
+
+	return plat->inquiry_count;
+}
+
 static int sandbox_flash_bind(struct udevice *dev)
 {
 	struct sandbox_flash_plat *plat = dev_get_platdata(dev);
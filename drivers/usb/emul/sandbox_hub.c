@@ -8,6 +8,8 @@
 #include <common.h>
 #include <dm.h>
 #include <usb.h>
+#include <asm/state.h>
+#include <asm/test.h>
 #include <dm/device-internal.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -114,6 +116,9 @@ static void *hub_desc_list[] = {
 struct sandbox_hub_priv {
 	int status[SANDBOX_NUM_PORTS];
 	int change[SANDBOX_NUM_PORTS];
+	int resets;		/* port resets started */
+	int in_reset;		/* mask of ports reset and not yet C_RESET */
+	int max_in_reset;	/* most ports in reset at once */
 };
 
 static struct udevice *hub_find_device(struct udevice *hub, int port)
@@ -149,6 +154,11 @@ static int clrset_post_state(struct udevice *hub, int port, int clear, int set)
 				debug("%s: %s: power on, probed, ret=%d\n",
 				      __func__, dev->name, ret);
 				if (!ret) {
+					struct usb_dev_platdata *plat;
+
+					/* No answer, even at address 0, yet */
+					plat = dev_get_parent_platdata(dev);
+					plat->devnum = -1;
 					set |= USB_PORT_STAT_CONNECTION |
 						USB_PORT_STAT_ENABLE;
 				}
@@ -169,6 +179,39 @@ static int clrset_post_state(struct udevice *hub, int port, int clear, int set)
 	return ret;
 }
 
+/*
+ * Reset a port. The device on it then answers at address 0, which is why
+ * only one port on a bus should be reset until that device has an address.
+ */
+static void hub_reset_start(struct udevice *hub, int port)
+{
+	struct sandbox_hub_priv *priv = dev_get_priv(hub);
+	struct udevice *dev = hub_find_device(hub, port);
+
+	if (dev) {
+		struct usb_dev_platdata *plat = dev_get_parent_platdata(dev);
+
+		plat->devnum = 0;
+	}
+
+	/* The clock moves on by the reset time, even with delays skipped */
+	if (state_get_skip_delays())
+		sandbox_timer_add_offset(10);
+	priv->resets++;
+	priv->in_reset |= 1 << port;
+	priv->max_in_reset = max_t(int, priv->max_in_reset,
+				   hweight32(priv->in_reset));
+}
+
+void sandbox_hub_get_reset_stats(struct udevice *dev, int *resets,
+				 int *max_in_reset)
+{
+	struct sandbox_hub_priv *priv = dev_get_priv(dev);
+
+	*resets = priv->resets;
+	*max_in_reset = priv->max_in_reset;
+}
+
 static int sandbox_hub_submit_control_msg(struct udevice *bus,
 					  struct usb_device *udev,
 					  unsigned long pipe,
@@ -226,6 +269,8 @@ static int sandbox_hub_submit_control_msg(struct udevice *bus,
 				port = (setup->index & USB_HUB_PORT_MASK) - 1;
 				debug("set feature port=%x, feature=%x\n",
 				      port, setup->value);
+				if (setup->value == USB_PORT_FEAT_RESET)
+					hub_reset_start(bus, port);
 				if (setup->value < USB_PORT_FEAT_C_CONNECTION) {
 					ret = clrset_post_state(bus, port, 0,
 							1 << setup->value);
@@ -247,6 +292,8 @@ static int sandbox_hub_submit_control_msg(struct udevice *bus,
 					priv->change[port] &= 1 <<
 						(setup->value - 16);
 				}
+				if (setup->value == USB_PORT_FEAT_C_RESET)
+					priv->in_reset &= ~(1 << port);
 				udev->status = 0;
 				return 0;
 			}
@@ -107,7 +107,19 @@ static int usb_emul_get_descriptor(struct usb_dev_platdata *plat, int value,
 	return upto ? upto : length ? -EIO : 0;
 }
 
-static int usb_emul_find_devnum(int devnum, struct udevice **emulp)
+/* Check whether @dev sits somewhere below @bus in the device tree */
+static bool usb_emul_on_bus(struct udevice *dev, struct udevice *bus)
+{
+	for (; dev; dev = dev->parent) {
+		if (dev == bus)
+			return true;
+	}
+
+	return false;
+}
+
+static int usb_emul_find_devnum(struct udevice *bus, int devnum,
+				struct udevice **emulp)
 {
 	struct udevice *dev;
 	struct uclass *uc;
@@ -120,7 +132,7 @@ static int usb_emul_find_devnum(int devnum, struct udevice **emulp)
 	uclass_foreach_dev(dev, uc) {
 		struct usb_dev_platdata *udev = dev_get_parent_platdata(dev);
 
-		if (udev->devnum == devnum) {
+		if (udev->devnum == devnum && usb_emul_on_bus(dev, bus)) {
 			debug("%s: Found emulator '%s', addr %d\n", __func__,
 			      dev->name, udev->devnum);
 			*emulp = dev;
@@ -136,14 +148,18 @@ int usb_emul_find(struct udevice *bus, ulong pipe, struct udevice **emulp)
 {
 	int devnum = usb_pipedevice(pipe);
 
-	return usb_emul_find_devnum(devnum, emulp);
+	return usb_emul_find_devnum(bus, devnum, emulp);
 }
 
 int usb_emul_find_for_dev(struct udevice *dev, struct udevice **emulp)
 {
 	struct usb_dev_platdata *udev = dev_get_parent_platdata(dev);
+	struct udevice *bus;
+
+	for (bus = dev; bus && device_get_uclass_id(bus) != UCLASS_USB;)
+		bus = bus->parent;
 
-	return usb_emul_find_devnum(udev->devnum, emulp);
+	return usb_emul_find_devnum(bus, udev->devnum, emulp);
 }
 
 int usb_emul_control(struct udevice *emul, struct usb_device *udev,
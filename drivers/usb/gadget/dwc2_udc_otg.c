@@ -743,6 +743,7 @@ static struct dwc2_udc memory = {
 		.ops = &dwc2_udc_ops,
 		.ep0 = &memory.ep[0].ep,
 		.name = driver_name,
+		.direct_rx = 1,
 	},
 
 	/* control endpoint */
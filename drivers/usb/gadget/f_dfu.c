@@ -42,6 +42,9 @@ struct f_dfu {
 	/* Send/received block number is handy for data integrity check */
 	int                             blk_seq_num;
 	unsigned int                    poll_timeout;
+
+	/* ep0 buffer, while a block is received straight into the DFU one */
+	void				*ep0_buf;
 };
 
 struct dfu_entity *dfu_defer_flush;
@@ -160,6 +163,10 @@ static void dnload_request_complete(struct usb_ep *ep, struct usb_request *req)
 
 	ret = dfu_write(dfu_get_entity(f_dfu->altsetting), req->buf,
 			req->length, f_dfu->blk_seq_num);
+	if (f_dfu->ep0_buf) {
+		req->buf = f_dfu->ep0_buf;
+		f_dfu->ep0_buf = NULL;
+	}
 	if (ret) {
 		f_dfu->dfu_status = DFU_STATUS_errUNKNOWN;
 		f_dfu->dfu_state = DFU_STATE_dfuERROR;
@@ -248,10 +255,21 @@ static int handle_dnload(struct usb_gadget *gadget, u16 len)
 	struct usb_composite_dev *cdev = get_gadget_data(gadget);
 	struct usb_request *req = cdev->req;
 	struct f_dfu *f_dfu = req->context;
+	struct dfu_entity *dfu = dfu_get_entity(f_dfu->altsetting);
+	unsigned int room;
+	void *dest;
 
 	if (len == 0)
 		f_dfu->dfu_state = DFU_STATE_dfuMANIFEST_SYNC;
 
+	/* Receive the block where dfu_write() would otherwise copy it */
+	dest = dfu_write_dest(dfu, len, &room);
+	if (dest &&
+	    usb_ep_direct_rx_len(gadget, gadget->ep0, dest, len, room, len)) {
+		f_dfu->ep0_buf = req->buf;
+		req->buf = dest;
+	}
+
 	req->complete = dnload_request_complete;
 
 	return len;
@@ -734,6 +752,11 @@ static void dfu_unbind(struct usb_configuration *c, struct usb_function *f)
 	int alt_num = dfu_get_alt_number();
 	int i;
 
+	if (f_dfu->ep0_buf) {
+		c->cdev->req->buf = f_dfu->ep0_buf;
+		f_dfu->ep0_buf = NULL;
+	}
+
 	if (f_dfu->strings) {
 		i = alt_num;
 		while (i)
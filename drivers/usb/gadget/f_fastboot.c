@@ -27,6 +27,9 @@
 #ifdef CONFIG_FASTBOOT_FLASH_NAND_DEV
 #include <fb_nand.h>
 #endif
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+#include <image-sparse.h>
+#endif
 
 #define FASTBOOT_VERSION		"0.4"
 
@@ -45,12 +48,18 @@
  * that expect bulk OUT requests to be divisible by maxpacket size.
  */
 
+/* Largest OUT request received straight into the download buffer */
+#define RX_DIRECT_SIZE			0x100000
+
 struct f_fastboot {
 	struct usb_function usb_function;
 
 	/* IN/OUT EP's and corresponding requests */
 	struct usb_ep *in_ep, *out_ep;
 	struct usb_request *in_req, *out_req;
+
+	/* Command buffer of out_req, which may point elsewhere for downloads */
+	void *out_buf;
 };
 
 static inline struct f_fastboot *func_to_fastboot(struct usb_function *f)
@@ -62,6 +71,30 @@ static struct f_fastboot *fastboot_func;
 static unsigned int download_size;
 static unsigned int download_bytes;
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+#ifndef CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE
+#define CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE	0x100000
+#endif
+
+#if CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE * 2 > CONFIG_FASTBOOT_BUF_SIZE
+#error "CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE is too large"
+#endif
+#if CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE % EP_BUFFER_SIZE
+#error "CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE must be a multiple of 4KiB"
+#endif
+
+/*
+ * When streaming, the download is received into two halves of the download
+ * buffer in turn, and each half is written to flash while the other fills.
+ */
+static char stream_part[32];	/* partition to stream to */
+static bool stream_armed;	/* stream the next download */
+static struct sparse_stream stream;
+static int stream_half;
+static bool stream_active;	/* download in progress */
+static bool stream_done;	/* waiting for the flash command */
+#endif
+
 static struct usb_endpoint_descriptor fs_ep_in = {
 	.bLength            = USB_DT_ENDPOINT_SIZE,
 	.bDescriptorType    = USB_DT_ENDPOINT,
@@ -231,8 +264,18 @@ static void fastboot_disable(struct usb_function *f)
 	usb_ep_disable(f_fb->out_ep);
 	usb_ep_disable(f_fb->in_ep);
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	if (stream_active) {
+		stream_active = false;
+		stream_done = true;
+	}
+	if (stream_done) {
+		sparse_stream_abort(&stream);
+		stream_done = false;
+	}
+#endif
 	if (f_fb->out_req) {
-		free(f_fb->out_req->buf);
+		free(f_fb->out_buf);
 		usb_ep_free_request(f_fb->out_ep, f_fb->out_req);
 		f_fb->out_req = NULL;
 	}
@@ -288,6 +331,7 @@ static int fastboot_set_alt(struct usb_function *f,
 		goto err;
 	}
 	f_fb->out_req->complete = rx_handler_command;
+	f_fb->out_buf = f_fb->out_req->buf;
 
 	d = fb_ep_desc(gadget, &fs_ep_in, &hs_ep_in);
 	ret = usb_ep_enable(f_fb->in_ep, d);
@@ -422,8 +466,14 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 	} else if (!strcmp_l1("downloadsize", cmd) ||
 		!strcmp_l1("max-download-size", cmd)) {
 		char str_num[12];
+		unsigned int max_size = CONFIG_FASTBOOT_BUF_SIZE;
 
-		sprintf(str_num, "0x%08x", CONFIG_FASTBOOT_BUF_SIZE);
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+		/* A streamed download does not have to fit in the buffer */
+		if (stream_armed)
+			max_size = UINT_MAX;
+#endif
+		sprintf(str_num, "0x%08x", max_size);
 		strncat(response, str_num, chars_left);
 	} else if (!strcmp_l1("serialno", cmd)) {
 		s = getenv("serial#");
@@ -446,16 +496,16 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 	fastboot_tx_write_str(response);
 }
 
-static unsigned int rx_bytes_expected(struct usb_ep *ep)
+static unsigned int rx_bytes_expected(struct usb_ep *ep, unsigned int max)
 {
-	int rx_remain = download_size - download_bytes;
+	unsigned int rx_remain = download_size - download_bytes;
 	unsigned int rem;
 	unsigned int maxpacket = ep->maxpacket;
 
-	if (rx_remain <= 0)
+	if (download_bytes >= download_size)
 		return 0;
-	else if (rx_remain > EP_BUFFER_SIZE)
-		return EP_BUFFER_SIZE;
+	else if (rx_remain > max)
+		return max;
 
 	/*
 	 * Some controllers e.g. DWC3 don't like OUT transfers to be
@@ -471,13 +521,53 @@ static unsigned int rx_bytes_expected(struct usb_ep *ep)
 }
 
 #define BYTES_PER_DOT	0x20000
+static void rx_progress(unsigned int transfer_size)
+{
+	unsigned int pre_dot_num, now_dot_num;
+
+	pre_dot_num = download_bytes / BYTES_PER_DOT;
+	download_bytes += transfer_size;
+	now_dot_num = download_bytes / BYTES_PER_DOT;
+
+	/* A large request can cover several dots */
+	while (pre_dot_num++ != now_dot_num) {
+		putc('.');
+		if (!(pre_dot_num % 74))
+			putc('\n');
+	}
+}
+
+/*
+ * Set up the OUT request for the next part of a download. If the controller
+ * allows, the data is received straight into the download buffer.
+ */
+static void rx_setup_dl(struct usb_ep *ep, struct usb_request *req)
+{
+	struct f_fastboot *f_fb = fastboot_func;
+	struct usb_gadget *gadget = f_fb->usb_function.config->cdev->gadget;
+	void *dest = (void *)CONFIG_FASTBOOT_BUF_ADDR + download_bytes;
+	unsigned int len;
+
+	len = usb_ep_direct_rx_len(gadget, ep, dest,
+				   download_size - download_bytes,
+				   CONFIG_FASTBOOT_BUF_SIZE - download_bytes,
+				   RX_DIRECT_SIZE);
+	if (len) {
+		req->buf = dest;
+		req->length = len;
+	} else {
+		req->buf = f_fb->out_buf;
+		req->length = rx_bytes_expected(ep, EP_BUFFER_SIZE);
+	}
+}
+
 static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 {
 	char response[FASTBOOT_RESPONSE_LEN];
 	unsigned int transfer_size = download_size - download_bytes;
 	const unsigned char *buffer = req->buf;
 	unsigned int buffer_size = req->actual;
-	unsigned int pre_dot_num, now_dot_num;
+	void *dest = (void *)CONFIG_FASTBOOT_BUF_ADDR + download_bytes;
 
 	if (req->status != 0) {
 		printf("Bad status: %d\n", req->status);
@@ -487,18 +577,10 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 	if (buffer_size < transfer_size)
 		transfer_size = buffer_size;
 
-	memcpy((void *)CONFIG_FASTBOOT_BUF_ADDR + download_bytes,
-	       buffer, transfer_size);
+	if (buffer != dest)
+		memcpy(dest, buffer, transfer_size);
 
-	pre_dot_num = download_bytes / BYTES_PER_DOT;
-	download_bytes += transfer_size;
-	now_dot_num = download_bytes / BYTES_PER_DOT;
-
-	if (pre_dot_num != now_dot_num) {
-		putc('.');
-		if (!(now_dot_num % 74))
-			putc('\n');
-	}
+	rx_progress(transfer_size);
 
 	/* Check if transfer is done */
 	if (download_bytes >= download_size) {
@@ -508,6 +590,7 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 		 */
 		download_size = 0;
 		req->complete = rx_handler_command;
+		req->buf = fastboot_func->out_buf;
 		req->length = EP_BUFFER_SIZE;
 
 		strcpy(response, "OKAY");
@@ -515,13 +598,93 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 
 		printf("\ndownloading of %d bytes finished\n", download_bytes);
 	} else {
-		req->length = rx_bytes_expected(ep);
+		rx_setup_dl(ep, req);
 	}
 
 	req->actual = 0;
 	usb_ep_queue(ep, req, 0);
 }
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+static void *stream_buf(int half)
+{
+	return (void *)CONFIG_FASTBOOT_BUF_ADDR +
+		half * CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE;
+}
+
+static void rx_handler_dl_stream(struct usb_ep *ep, struct usb_request *req)
+{
+	unsigned int transfer_size = download_size - download_bytes;
+	const void *buffer = req->buf;
+
+	if (req->status != 0) {
+		printf("Bad status: %d\n", req->status);
+		return;
+	}
+
+	if (req->actual < transfer_size)
+		transfer_size = req->actual;
+
+	rx_progress(transfer_size);
+
+	if (download_bytes >= download_size) {
+		download_size = 0;
+		req->buf = fastboot_func->out_buf;
+		req->complete = rx_handler_command;
+		req->length = EP_BUFFER_SIZE;
+		stream_active = false;
+		stream_done = true;
+
+		fastboot_tx_write_str("OKAY");
+	} else {
+		/* Receive into the other half while this one is written */
+		stream_half ^= 1;
+		req->buf = stream_buf(stream_half);
+		req->length = rx_bytes_expected(ep,
+					CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE);
+	}
+
+	req->actual = 0;
+	usb_ep_queue(ep, req, 0);
+
+	sparse_stream_write(&stream, buffer, transfer_size);
+	if (stream_done)
+		printf("\ndownloading of %d bytes finished\n", download_bytes);
+}
+
+static int stream_start(struct usb_ep *ep, struct usb_request *req)
+{
+	struct usb_gadget *gadget =
+		fastboot_func->usb_function.config->cdev->gadget;
+	int ret = -ENODEV;
+
+	/* Each half of the buffer is filled by a single request */
+	if (!usb_ep_direct_rx_len(gadget, ep, stream_buf(0), download_size,
+				  CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE,
+				  CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE)) {
+		fastboot_fail("streaming not supported by this controller");
+		return -ENOSYS;
+	}
+
+	fastboot_fail("no flash device defined");
+#if defined(CONFIG_FASTBOOT_FLASH_MMC_DEV)
+	ret = fb_mmc_flash_stream_start(stream_part, &stream, download_size);
+#elif defined(CONFIG_FASTBOOT_FLASH_NAND_DEV)
+	ret = fb_nand_flash_stream_start(stream_part, &stream, download_size);
+#endif
+	if (ret)
+		return ret;
+
+	stream_active = true;
+	stream_half = 0;
+	req->buf = stream_buf(stream_half);
+	req->complete = rx_handler_dl_stream;
+	req->length = rx_bytes_expected(ep, CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE);
+
+	return 0;
+}
+#endif
+
 static void cb_download(struct usb_ep *ep, struct usb_request *req)
 {
 	char *cmd = req->buf;
@@ -533,6 +696,25 @@ static void cb_download(struct usb_ep *ep, struct usb_request *req)
 
 	printf("Starting download of %d bytes\n", download_size);
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	/* A previous streamed image that was never flashed is dropped */
+	if (stream_done) {
+		sparse_stream_abort(&stream);
+		stream_done = false;
+	}
+
+	if (stream_armed && download_size) {
+		fb_response_str = response;
+		if (stream_start(ep, req))
+			download_size = 0;
+		else
+			sprintf(response, "DATA%08x", download_size);
+		stream_armed = false;
+		fastboot_tx_write_str(response);
+		return;
+	}
+#endif
+
 	if (0 == download_size) {
 		strcpy(response, "FAILdata invalid size");
 	} else if (download_size > CONFIG_FASTBOOT_BUF_SIZE) {
@@ -541,7 +723,7 @@ static void cb_download(struct usb_ep *ep, struct usb_request *req)
 	} else {
 		sprintf(response, "DATA%08x", download_size);
 		req->complete = rx_handler_dl_image;
-		req->length = rx_bytes_expected(ep);
+		rx_setup_dl(ep, req);
 	}
 	fastboot_tx_write_str(response);
 }
@@ -593,6 +775,21 @@ static void cb_flash(struct usb_ep *ep, struct usb_request *req)
 	/* initialize the response buffer */
 	fb_response_str = response;
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	/* The image was written as it arrived, so just report how it went */
+	if (stream_done) {
+		stream_done = false;
+		if (sparse_stream_finish(&stream))
+			fastboot_fail(stream.error);
+		else if (strcmp(cmd, stream.part_name))
+			fastboot_fail("image was streamed to another partition");
+		else
+			fastboot_okay("");
+		fastboot_tx_write_str(response);
+		return;
+	}
+#endif
+
 	fastboot_fail("no flash device defined");
 #ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
 	fb_mmc_flash_write(cmd, (void *)CONFIG_FASTBOOT_BUF_ADDR,
@@ -620,6 +817,18 @@ static void cb_oem(struct usb_ep *ep, struct usb_request *req)
                 else
 			fastboot_tx_write_str("OKAY");
 	} else
+#endif
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	if (strncmp("stream ", cmd + 4, 7) == 0) {
+		/* Write the next download to this partition as it arrives */
+		if (stream_done) {
+			sparse_stream_abort(&stream);
+			stream_done = false;
+		}
+		strlcpy(stream_part, cmd + 11, sizeof(stream_part));
+		stream_armed = true;
+		fastboot_tx_write_str("OKAY");
+	} else
 #endif
 	if (strncmp("unlock", cmd + 4, 8) == 0) {
 		fastboot_tx_write_str("FAILnot implemented");
@@ -318,6 +318,19 @@ struct fsg_common {
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
 	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	void			*buffers;	/* one block for all of them */
+
+	/*
+	 * When a READ continues where the previous one ended, the next
+	 * FSG_BUFLEN bytes are read into ra_buf while waiting for the
+	 * following command.
+	 */
+	void			*ra_buf;
+	unsigned int		ra_lun;
+	u32			ra_lba;
+	u32			ra_blocks;	/* 0 if ra_buf is empty */
+	unsigned int		next_read_lun;
+	u32			next_read_lba;
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -343,6 +356,7 @@ struct fsg_common {
 	unsigned int		short_packet_received:1;
 	unsigned int		bad_lun_okay:1;
 	unsigned int		running:1;
+	unsigned int		ra_pending:1;
 
 	int			thread_wakeup_needed;
 	struct completion	thread_notifier;
@@ -699,6 +713,51 @@ static int sleep_thread(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+/* Read the blocks following a sequential READ before the next command */
+static void read_ahead(struct fsg_common *common)
+{
+	struct fsg_lun		*curlun = &common->luns[common->next_read_lun];
+	struct ums		*ums_dev = &ums[common->next_read_lun];
+	u32			lba = common->next_read_lba;
+	u32			count = FSG_BUFLEN / SECTOR_SIZE;
+
+	if (!common->ra_pending)
+		return;
+	common->ra_pending = 0;
+
+	if (lba >= curlun->num_sectors)
+		return;
+	if (count > curlun->num_sectors - lba)
+		count = curlun->num_sectors - lba;
+
+	if (ums_dev->read_sector(ums_dev, lba, count, common->ra_buf) != count)
+		return;
+
+	common->ra_lun = common->next_read_lun;
+	common->ra_lba = lba;
+	common->ra_blocks = count;
+}
+
+/* Hand the read-ahead buffer over to @bh if it holds what is wanted */
+static int use_read_ahead(struct fsg_common *common, struct fsg_buffhd *bh,
+			  loff_t file_offset, unsigned int amount)
+{
+	void			*buf;
+
+	if (!common->ra_blocks || common->ra_lun != common->lun ||
+	    file_offset != (loff_t)common->ra_lba << 9 ||
+	    amount > common->ra_blocks * SECTOR_SIZE)
+		return 0;
+
+	buf = bh->buf;
+	bh->buf = common->ra_buf;
+	bh->inreq->buf = bh->outreq->buf = bh->buf;
+	common->ra_buf = buf;
+	common->ra_blocks = 0;
+
+	return 1;
+}
+
 static int do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = &common->luns[common->lun];
@@ -710,6 +769,7 @@ static int do_read(struct fsg_common *common)
 	unsigned int		amount;
 	unsigned int		partial_page;
 	ssize_t			nread;
+	int			sequential;
 
 	/* Get the starting Logical Block Address and check that it's
 	 * not too big */
@@ -731,6 +791,8 @@ static int do_read(struct fsg_common *common)
 		return -EINVAL;
 	}
 	file_offset = ((loff_t) lba) << 9;
+	sequential = common->lun == common->next_read_lun &&
+		     lba == common->next_read_lba;
 
 	/* Carry out the file reads */
 	amount_left = common->data_size_from_cmnd;
@@ -773,10 +835,13 @@ static int do_read(struct fsg_common *common)
 		}
 
 		/* Perform the read */
-		rc = ums[common->lun].read_sector(&ums[common->lun],
-				      file_offset / SECTOR_SIZE,
-				      amount / SECTOR_SIZE,
-				      (char __user *)bh->buf);
+		if (use_read_ahead(common, bh, file_offset, amount))
+			rc = amount / SECTOR_SIZE;
+		else
+			rc = ums[common->lun].read_sector(&ums[common->lun],
+					      file_offset / SECTOR_SIZE,
+					      amount / SECTOR_SIZE,
+					      (char __user *)bh->buf);
 		if (!rc)
 			return -EIO;
 
@@ -821,6 +886,11 @@ static int do_read(struct fsg_common *common)
 		common->next_buffhd_to_fill = bh->next;
 	}
 
+	/* Read ahead once the host reads the same area in order */
+	common->next_read_lun = common->lun;
+	common->next_read_lba = file_offset >> 9;
+	common->ra_pending = FSG_READ_AHEAD && sequential && amount_left == 0;
+
 	return -EIO;		/* No default reply */
 }
 
@@ -830,7 +900,7 @@ static int do_write(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = &common->luns[common->lun];
 	u32			lba;
-	struct fsg_buffhd	*bh;
+	struct fsg_buffhd	*bh, *last;
 	int			get_some_more;
 	u32			amount_left_to_req, amount_left_to_write;
 	loff_t			usb_offset, file_offset;
@@ -865,6 +935,9 @@ static int do_write(struct fsg_common *common)
 		return -EINVAL;
 	}
 
+	/* The read-ahead data may be about to change */
+	common->ra_blocks = 0;
+
 	/* Carry out the file writes */
 	get_some_more = 1;
 	file_offset = usb_offset = ((loff_t) lba) << 9;
@@ -946,6 +1019,22 @@ static int do_write(struct fsg_common *common)
 
 			amount = bh->outreq->actual;
 
+			/*
+			 * Write the following buffers along with this one if
+			 * they have arrived and sit right after it in memory.
+			 */
+			last = bh;
+			while (last->outreq->actual == last->outreq->length &&
+			       last->next->state == BUF_STATE_FULL &&
+			       last->next->outreq->status == 0 &&
+			       last->next->buf ==
+					last->buf + last->outreq->actual) {
+				last = last->next;
+				last->state = BUF_STATE_EMPTY;
+				amount += last->outreq->actual;
+			}
+			common->next_buffhd_to_drain = last->next;
+
 			/* Perform the write */
 			rc = ums[common->lun].write_sector(&ums[common->lun],
 					       file_offset / SECTOR_SIZE,
@@ -983,7 +1072,7 @@ static int do_write(struct fsg_common *common)
 			}
 
 			/* Did the host decide to stop early? */
-			if (bh->outreq->actual != bh->outreq->length) {
+			if (last->outreq->actual != last->outreq->length) {
 				common->short_packet_received = 1;
 				break;
 			}
@@ -2147,6 +2236,9 @@ static int get_next_command(struct fsg_common *common)
 	 * can reuse it for the next filling.  No need to advance
 	 * next_buffhd_to_fill. */
 
+	/* Use the time until the CBW arrives */
+	read_ahead(common);
+
 	/* Wait for the CBW to arrive */
 	while (bh->state != BUF_STATE_FULL) {
 		rc = sleep_thread(common);
@@ -2196,6 +2288,9 @@ static int do_set_interface(struct fsg_common *common, struct fsg_dev *new_fsg)
 		DBG(common, "reset interface\n");
 
 reset:
+	common->ra_blocks = 0;
+	common->ra_pending = 0;
+
 	/* Deallocate the requests */
 	if (common->fsg) {
 		fsg = common->fsg;
@@ -2508,7 +2603,17 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	}
 	common->lun = 0;
 
-	/* Data buffers cyclic list */
+	/* Data buffers cyclic list, plus one for read-ahead if used */
+	common->buffers = memalign(CONFIG_SYS_CACHELINE_SIZE,
+				   (FSG_NUM_BUFFERS + FSG_READ_AHEAD) *
+				   FSG_BUFLEN);
+	if (unlikely(!common->buffers)) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
+	if (FSG_READ_AHEAD)
+		common->ra_buf = common->buffers + FSG_NUM_BUFFERS * FSG_BUFLEN;
+
 	bh = common->buffhds;
 
 	i = FSG_NUM_BUFFERS;
@@ -2519,11 +2624,7 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 buffhds_first_it:
 		bh->inreq_busy = 0;
 		bh->outreq_busy = 0;
-		bh->buf = memalign(CONFIG_SYS_CACHELINE_SIZE, FSG_BUFLEN);
-		if (unlikely(!bh->buf)) {
-			rc = -ENOMEM;
-			goto error_release;
-		}
+		bh->buf = common->buffers + (bh - common->buffhds) * FSG_BUFLEN;
 	} while (--i);
 	bh->next = common->buffhds;
 
@@ -2585,13 +2686,7 @@ static void fsg_common_release(struct kref *ref)
 		kfree(common->luns);
 	}
 
-	{
-		struct fsg_buffhd *bh = common->buffhds;
-		unsigned i = FSG_NUM_BUFFERS;
-		do {
-			kfree(bh->buf);
-		} while (++bh, --i);
-	}
+	kfree(common->buffers);
 
 	if (common->free_storage_on_release)
 		kfree(common);
@@ -305,11 +305,21 @@ static struct fsg_lun *fsg_lun_from_dev(struct device *dev)
 #define EP0_BUFSIZE	256
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
-/* Number of buffers we will use.  2 is enough for double-buffering */
+/*
+ * Number of buffers we will use and their size.  2 is enough for
+ * double-buffering.  With CONFIG_UMS_LARGE_BUFFERS more and larger ones
+ * keep the controller busy while the block device is accessed, and one
+ * more buffer is used to read ahead.
+ */
+#ifdef CONFIG_UMS_LARGE_BUFFERS
+#define FSG_NUM_BUFFERS	CONFIG_UMS_NUM_BUFFERS
+#define FSG_BUFLEN	((u32)CONFIG_UMS_BUF_SIZE)
+#define FSG_READ_AHEAD	1
+#else
 #define FSG_NUM_BUFFERS	2
-
-/* Default size of buffer length. */
 #define FSG_BUFLEN	((u32)16384)
+#define FSG_READ_AHEAD	0
+#endif
 
 /* Maximal number of LUNs supported in mass storage function */
 #define FSG_MAX_LUNS	8
@@ -296,14 +296,48 @@ static void ehci_update_endpt2_dev_n_port(struct usb_device *udev,
 				     QH_ENDPT2_HUBADDR(hubaddr));
 }
 
+static unsigned long ehci_token_status(uint32_t token)
+{
+	unsigned long status;
+
+	switch (QT_TOKEN_GET_STATUS(token) &
+		~(QT_TOKEN_STATUS_SPLITXSTATE | QT_TOKEN_STATUS_PERR)) {
+	case 0:
+		return 0;
+	case QT_TOKEN_STATUS_HALTED:
+		return USB_ST_STALLED;
+	case QT_TOKEN_STATUS_ACTIVE | QT_TOKEN_STATUS_DATBUFERR:
+	case QT_TOKEN_STATUS_DATBUFERR:
+		return USB_ST_BUF_ERR;
+	case QT_TOKEN_STATUS_HALTED | QT_TOKEN_STATUS_BABBLEDET:
+	case QT_TOKEN_STATUS_BABBLEDET:
+		return USB_ST_BABBLE_DET;
+	default:
+		status = USB_ST_CRC_ERR;
+		if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_HALTED)
+			status |= USB_ST_STALLED;
+		return status;
+	}
+}
+
+/* Most bulk transfers queued on the async schedule at once */
+#define EHCI_BULK_QUEUE_MAX	8
+
+/*
+ * Run a control transfer (@req set, @count is 1), or @count bulk transfers
+ * on one pipe. Several bulk transfers are chained on a single QH so that
+ * the controller goes from one to the next by itself.
+ */
 static int
-ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
-		   int length, struct devrequest *req)
+ehci_submit_async_queue(struct usb_device *dev, unsigned long pipe,
+			struct usb_bulk_xfer *xfer, int count,
+			struct devrequest *req)
 {
 	ALLOC_ALIGN_BUFFER(struct QH, qh, 1, USB_DMA_MINALIGN);
 	struct qTD *qtd;
 	int qtd_count = 0;
 	int qtd_counter = 0;
+	int first[EHCI_BULK_QUEUE_MAX + 1];
 	volatile struct qTD *vtd;
 	unsigned long ts;
 	uint32_t *tdp;
@@ -312,10 +346,18 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	uint32_t cmd;
 	int timeout;
 	int ret = 0;
+	int i, j;
+	void *buffer;
+	int length;
 	struct ehci_ctrl *ctrl = ehci_get_ctrl(dev);
 
-	debug("dev=%p, pipe=%lx, buffer=%p, length=%d, req=%p\n", dev, pipe,
-	      buffer, length, req);
+	if (count > EHCI_BULK_QUEUE_MAX)
+		return -EINVAL;
+
+	buffer = xfer[0].buffer;
+	length = xfer[0].length;
+	debug("dev=%p, pipe=%lx, buffer=%p, length=%d, count=%d, req=%p\n",
+	      dev, pipe, buffer, length, count, req);
 	if (req != NULL)
 		debug("req=%u (%#x), type=%u (%#x), value=%u (%#x), index=%u\n",
 		      req->request, req->request,
@@ -342,7 +384,11 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	if (req != NULL)
 		/* 1 qTD will be needed for SETUP, and 1 for ACK. */
 		qtd_count += 1 + 1;
-	if (length > 0 || req == NULL) {
+	for (i = 0; i < count; i++) {
+		buffer = xfer[i].buffer;
+		length = xfer[i].length;
+		if (length == 0 && req != NULL)
+			continue;
 		/*
 		 * Determine the qTD transfer size that will be used for the
 		 * data payload (not considering the first qTD transfer, which
@@ -406,9 +452,14 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	qh->qh_link = cpu_to_hc32(virt_to_phys(&ctrl->qh_list) | QH_LINK_TYPE_QH);
 	c = (dev->speed != USB_SPEED_HIGH) && !usb_pipeendpoint(pipe);
 	maxpacket = usb_maxpacket(dev, pipe);
+	/*
+	 * A short packet moves a queue on to the next transfer, so the toggle
+	 * of its qTDs is not known in advance. Let the QH keep track of it.
+	 */
 	endpt = QH_ENDPT1_RL(8) | QH_ENDPT1_C(c) |
 		QH_ENDPT1_MAXPKTLEN(maxpacket) | QH_ENDPT1_H(0) |
-		QH_ENDPT1_DTC(QH_ENDPT1_DTC_DT_FROM_QTD) |
+		QH_ENDPT1_DTC(count > 1 ? QH_ENDPT1_DTC_IGNORE_QTD_TD :
+			      QH_ENDPT1_DTC_DT_FROM_QTD) |
 		QH_ENDPT1_EPS(ehci_encode_speed(dev->speed)) |
 		QH_ENDPT1_ENDPT(usb_pipeendpoint(pipe)) | QH_ENDPT1_I(0) |
 		QH_ENDPT1_DEVADDR(usb_pipedevice(pipe));
@@ -418,6 +469,8 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	ehci_update_endpt2_dev_n_port(dev, qh);
 	qh->qh_overlay.qt_next = cpu_to_hc32(QT_NEXT_TERMINATE);
 	qh->qh_overlay.qt_altnext = cpu_to_hc32(QT_NEXT_TERMINATE);
+	if (count > 1)
+		qh->qh_overlay.qt_token = cpu_to_hc32(QT_TOKEN_DT(toggle));
 
 	tdp = &qh->qh_overlay.qt_next;
 	if (req != NULL) {
@@ -447,9 +500,13 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 		toggle = 1;
 	}
 
-	if (length > 0 || req == NULL) {
-		uint8_t *buf_ptr = buffer;
-		int left_length = length;
+	for (i = 0; i < count; i++) {
+		uint8_t *buf_ptr = xfer[i].buffer;
+		int left_length = xfer[i].length;
+
+		first[i] = qtd_counter;
+		if (left_length == 0 && req != NULL)
+			continue;
 
 		do {
 			/*
@@ -514,6 +571,15 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 			left_length -= xfr_bytes;
 		} while (left_length > 0);
 	}
+	first[count] = qtd_counter;
+
+	/* After a short packet, carry on with the next transfer's qTDs */
+	if (count > 1 && usb_pipein(pipe)) {
+		for (i = 0; i < count - 1; i++)
+			for (j = first[i]; j < first[i + 1]; j++)
+				qtd[j].qt_altnext = cpu_to_hc32(
+					virt_to_phys(&qtd[first[i + 1]]));
+	}
 
 	if (req != NULL) {
 		/*
@@ -579,6 +645,12 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 		token = hc32_to_cpu(vtd->qt_token);
 		if (!(QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_ACTIVE))
 			break;
+		/* A halted queue will not reach its last qTD */
+		if (count > 1) {
+			token = hc32_to_cpu(qh->qh_overlay.qt_token);
+			if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_HALTED)
+				break;
+		}
 		WATCHDOG_RESET();
 	} while (get_timer(ts) < timeout);
 
@@ -591,8 +663,13 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	 * dangerous operation, it's responsibility of the calling
 	 * code to make sure enough space is reserved.
 	 */
-	invalidate_dcache_range((unsigned long)buffer,
-		ALIGN((unsigned long)buffer + length, ARCH_DMA_MINALIGN));
+	for (i = 0; i < count; i++) {
+		buffer = xfer[i].buffer;
+		length = xfer[i].length;
+		invalidate_dcache_range((unsigned long)buffer,
+			ALIGN((unsigned long)buffer + length,
+			      ARCH_DMA_MINALIGN));
+	}
 
 	/* Check that the TD processing happened */
 	if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_ACTIVE)
@@ -611,32 +688,46 @@ ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
 	}
 
 	token = hc32_to_cpu(qh->qh_overlay.qt_token);
-	if (!(QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_ACTIVE)) {
+	if (count > 1) {
+		/*
+		 * Work out each transfer from its qTDs. Those skipped after a
+		 * short packet still hold their whole length.
+		 */
+		dev->status = 0;
+		dev->act_len = 0;
+		for (i = 0; i < count; i++) {
+			xfer[i].act_len = xfer[i].length;
+			xfer[i].status = dev->status ? USB_ST_NOT_PROC : 0;
+			for (j = first[i]; j < first[i + 1]; j++) {
+				uint32_t td_token = hc32_to_cpu(qtd[j].qt_token);
+
+				xfer[i].act_len -=
+					QT_TOKEN_GET_TOTALBYTES(td_token);
+				if (!xfer[i].status &&
+				    (QT_TOKEN_GET_STATUS(td_token) &
+				     QT_TOKEN_STATUS_HALTED))
+					xfer[i].status =
+						ehci_token_status(td_token);
+			}
+			if (!dev->status)
+				dev->status = xfer[i].status;
+			dev->act_len += xfer[i].act_len;
+		}
+		if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_ACTIVE) {
+			for (i = 0; i < count; i++)
+				xfer[i].status = USB_ST_NOT_PROC;
+			dev->status = USB_ST_NOT_PROC;
+		} else if (!dev->status)
+			usb_settoggle(dev, usb_pipeendpoint(pipe),
+				      usb_pipeout(pipe),
+				      QT_TOKEN_GET_DT(token));
+	} else if (!(QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_ACTIVE)) {
 		debug("TOKEN=%#x\n", token);
-		switch (QT_TOKEN_GET_STATUS(token) &
-			~(QT_TOKEN_STATUS_SPLITXSTATE | QT_TOKEN_STATUS_PERR)) {
-		case 0:
+		dev->status = ehci_token_status(token);
+		if (!dev->status) {
 			toggle = QT_TOKEN_GET_DT(token);
 			usb_settoggle(dev, usb_pipeendpoint(pipe),
 				       usb_pipeout(pipe), toggle);
-			dev->status = 0;
-			break;
-		case QT_TOKEN_STATUS_HALTED:
-			dev->status = USB_ST_STALLED;
-			break;
-		case QT_TOKEN_STATUS_ACTIVE | QT_TOKEN_STATUS_DATBUFERR:
-		case QT_TOKEN_STATUS_DATBUFERR:
-			dev->status = USB_ST_BUF_ERR;
-			break;
-		case QT_TOKEN_STATUS_HALTED | QT_TOKEN_STATUS_BABBLEDET:
-		case QT_TOKEN_STATUS_BABBLEDET:
-			dev->status = USB_ST_BABBLE_DET;
-			break;
-		default:
-			dev->status = USB_ST_CRC_ERR;
-			if (QT_TOKEN_GET_STATUS(token) & QT_TOKEN_STATUS_HALTED)
-				dev->status |= USB_ST_STALLED;
-			break;
 		}
 		dev->act_len = length - QT_TOKEN_GET_TOTALBYTES(token);
 	} else {
@@ -657,6 +748,18 @@ fail:
 	return -1;
 }
 
+static int
+ehci_submit_async(struct usb_device *dev, unsigned long pipe, void *buffer,
+		   int length, struct devrequest *req)
+{
+	struct usb_bulk_xfer xfer = {
+		.buffer = buffer,
+		.length = length,
+	};
+
+	return ehci_submit_async_queue(dev, pipe, &xfer, 1, req);
+}
+
 static int ehci_submit_root(struct usb_device *dev, unsigned long pipe,
 			    void *buffer, int length, struct devrequest *req)
 {
@@ -1145,6 +1248,28 @@ static int _ehci_submit_bulk_msg(struct usb_device *dev, unsigned long pipe,
 	return ehci_submit_async(dev, pipe, buffer, length, NULL);
 }
 
+static int _ehci_submit_bulk_queue(struct usb_device *dev, unsigned long pipe,
+				   struct usb_bulk_xfer *xfer, int count)
+{
+	int ret, n;
+
+	if (usb_pipetype(pipe) != PIPE_BULK) {
+		debug("non-bulk pipe (type=%lu)", usb_pipetype(pipe));
+		return -1;
+	}
+
+	while (count > 0) {
+		n = min(count, EHCI_BULK_QUEUE_MAX);
+		ret = ehci_submit_async_queue(dev, pipe, xfer, n, NULL);
+		if (ret || dev->status)
+			return ret;
+		xfer += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
 static int _ehci_submit_control_msg(struct usb_device *dev, unsigned long pipe,
 				    void *buffer, int length,
 				    struct devrequest *setup)
@@ -1512,6 +1637,12 @@ int submit_bulk_msg(struct usb_device *dev, unsigned long pipe,
 	return _ehci_submit_bulk_msg(dev, pipe, buffer, length);
 }
 
+int submit_bulk_queue(struct usb_device *dev, unsigned long pipe,
+		      struct usb_bulk_xfer *xfer, int count)
+{
+	return _ehci_submit_bulk_queue(dev, pipe, xfer, count);
+}
+
 int submit_control_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 		   int length, struct devrequest *setup)
 {
@@ -1561,6 +1692,14 @@ static int ehci_submit_bulk_msg(struct udevice *dev, struct usb_device *udev,
 	return _ehci_submit_bulk_msg(udev, pipe, buffer, length);
 }
 
+static int ehci_submit_bulk_queue(struct udevice *dev, struct usb_device *udev,
+				  unsigned long pipe,
+				  struct usb_bulk_xfer *xfer, int count)
+{
+	debug("%s: dev='%s', udev=%p\n", __func__, dev->name, udev);
+	return _ehci_submit_bulk_queue(udev, pipe, xfer, count);
+}
+
 static int ehci_submit_int_msg(struct udevice *dev, struct usb_device *udev,
 			       unsigned long pipe, void *buffer, int length,
 			       int interval)
@@ -1604,6 +1743,8 @@ int ehci_register(struct udevice *dev, struct ehci_hccr *hccr,
 	      dev->name, ctrl, hccr, hcor, init);
 
 	priv->desc_before_addr = true;
+	/* Any length will do, as long as there is enough heap for the qTDs */
+	priv->max_xfer_size = SIZE_MAX;
 
 	ehci_setup_ops(ctrl, ops);
 	ctrl->hccr = hccr;
@@ -1650,6 +1791,7 @@ int ehci_deregister(struct udevice *dev)
 struct dm_usb_ops ehci_usb_ops = {
 	.control = ehci_submit_control_msg,
 	.bulk = ehci_submit_bulk_msg,
+	.bulk_queue = ehci_submit_bulk_queue,
 	.interrupt = ehci_submit_int_msg,
 	.create_int_queue = ehci_create_int_queue,
 	.poll_int_queue = ehci_poll_int_queue,
@@ -267,9 +267,9 @@ static struct xhci_segment *xhci_segment_alloc(void)
 
 /**
  * Create a new ring with zero or more segments.
- * TODO: current code only uses one-time-allocated single-segment rings
- * of 1KB anyway, so we might as well get rid of all the segment and
- * linking code (and maybe increase the size a bit, e.g. 4KB).
+ * The command, event and control rings have a single segment of 1KB. Bulk
+ * endpoint rings have XHCI_BULK_RING_SEGS segments, so that large TDs, or
+ * several TDs for one doorbell, fit on them.
  *
  *
  * Link each segment together into a ring.
@@ -288,6 +288,7 @@ struct xhci_ring *xhci_ring_alloc(unsigned int num_segs, bool link_trbs)
 	ring = (struct xhci_ring *)malloc(sizeof(struct xhci_ring));
 	BUG_ON(!ring);
 
+	ring->num_segs = num_segs;
 	if (num_segs == 0)
 		return ring;
 
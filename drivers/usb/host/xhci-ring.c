@@ -467,6 +467,25 @@ union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected)
 	BUG();
 }
 
+/*
+ * Points the xHC's dequeue pointer for a stopped endpoint at our enqueue
+ * pointer, throwing away all the TRBs it has not processed yet.
+ */
+static void set_deq_to_enqueue(struct usb_device *udev, int ep_index)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_ring *ring =  ctrl->devs[udev->slot_id]->eps[ep_index].ring;
+	union xhci_trb *event;
+
+	xhci_queue_command(ctrl, (void *)((uintptr_t)ring->enqueue |
+		ring->cycle_state), udev->slot_id, ep_index, TRB_SET_DEQ);
+	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
+	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
+		!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
+		event->event_cmd.status)) != COMP_SUCCESS);
+	xhci_acknowledge_event(ctrl);
+}
+
 /*
  * Stops transfer processing for an endpoint and throws away all unprocessed
  * TRBs by setting the xHC's dequeue pointer to our enqueue pointer. The next
@@ -478,7 +497,6 @@ union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected)
 static void abort_td(struct usb_device *udev, int ep_index)
 {
 	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
-	struct xhci_ring *ring =  ctrl->devs[udev->slot_id]->eps[ep_index].ring;
 	union xhci_trb *event;
 	u32 field;
 
@@ -498,90 +516,100 @@ static void abort_td(struct usb_device *udev, int ep_index)
 		event->event_cmd.status)) != COMP_SUCCESS);
 	xhci_acknowledge_event(ctrl);
 
-	xhci_queue_command(ctrl, (void *)((uintptr_t)ring->enqueue |
-		ring->cycle_state), udev->slot_id, ep_index, TRB_SET_DEQ);
+	set_deq_to_enqueue(udev, ep_index);
+}
+
+/*
+ * Brings an endpoint that halted on an error back to the stopped state, and
+ * throws away any TDs that were queued behind the one that failed. The halt
+ * on the device side is still for the class driver to clear.
+ */
+static void reset_ep(struct usb_device *udev, int ep_index)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	union xhci_trb *event;
+
+	xhci_queue_command(ctrl, NULL, udev->slot_id, ep_index, TRB_RESET_EP);
 	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
 	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
 		!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
 		event->event_cmd.status)) != COMP_SUCCESS);
 	xhci_acknowledge_event(ctrl);
+
+	set_deq_to_enqueue(udev, ep_index);
 }
 
-static void record_transfer_result(struct usb_device *udev,
-				   union xhci_trb *event, int length)
+static unsigned long comp_code_to_status(int comp_code)
 {
-	udev->act_len = min(length, length -
-		(int)EVENT_TRB_LEN(le32_to_cpu(event->trans_event.transfer_len)));
-
-	switch (GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len))) {
+	switch (comp_code) {
 	case COMP_SUCCESS:
-		BUG_ON(udev->act_len != length);
-		/* fallthrough */
 	case COMP_SHORT_TX:
-		udev->status = 0;
-		break;
+		return 0;
 	case COMP_STALL:
-		udev->status = USB_ST_STALLED;
-		break;
+		return USB_ST_STALLED;
 	case COMP_DB_ERR:
 	case COMP_TRB_ERR:
-		udev->status = USB_ST_BUF_ERR;
-		break;
+		return USB_ST_BUF_ERR;
 	case COMP_BABBLE:
-		udev->status = USB_ST_BABBLE_DET;
-		break;
+		return USB_ST_BABBLE_DET;
 	default:
-		udev->status = 0x80;  /* USB_ST_TOO_LAZY_TO_MAKE_A_NEW_MACRO */
+		return 0x80;  /* USB_ST_TOO_LAZY_TO_MAKE_A_NEW_MACRO */
 	}
 }
 
+static void record_transfer_result(struct usb_device *udev,
+				   union xhci_trb *event, int length)
+{
+	int comp_code =
+		GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len));
+
+	udev->act_len = min(length, length -
+		(int)EVENT_TRB_LEN(le32_to_cpu(event->trans_event.transfer_len)));
+
+	BUG_ON(comp_code == COMP_SUCCESS && udev->act_len != length);
+	udev->status = comp_code_to_status(comp_code);
+}
+
+/*
+ * Fills in the result of one bulk TD from its transfer event. The event
+ * points at the TRB the TD ended on, so a short packet in any of its TRBs
+ * gives the right length.
+ */
+static void record_bulk_result(union xhci_trb *event,
+			       struct usb_bulk_xfer *xfer)
+{
+	u32 transfer_len = le32_to_cpu(event->trans_event.transfer_len);
+	union xhci_trb *trb;
+	u64 addr;
+	int offset, len;
+
+	trb = (union xhci_trb *)(uintptr_t)
+		le64_to_cpu(event->trans_event.buffer);
+	addr = le32_to_cpu(trb->generic.field[0]) |
+	       (u64)le32_to_cpu(trb->generic.field[1]) << 32;
+	offset = addr - (uintptr_t)xfer->buffer;
+	BUG_ON(offset < 0 || offset > xfer->length);
+
+	len = le32_to_cpu(trb->generic.field[2]) & TRB_LEN_MASK;
+	len -= min(len, (int)EVENT_TRB_LEN(transfer_len));
+	xfer->act_len = min(xfer->length, offset + len);
+	xfer->status = comp_code_to_status(GET_COMP_CODE(transfer_len));
+}
+
 /**** Bulk and Control transfer methods ****/
 /**
- * Queues up the BULK Request
+ * Finds out how many TRBs a bulk TD needs
  *
- * @param udev		pointer to the USB device structure
- * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param buffer	buffer to be read/written
  * @param length	length of the buffer
- * @param buffer	buffer to be read/written based on the request
- * @return returns 0 if successful else -1 on failure
+ * @return number of TRBs
  */
-int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
-			int length, void *buffer)
+static int bulk_td_num_trbs(void *buffer, int length)
 {
 	int num_trbs = 0;
-	struct xhci_generic_trb *start_trb;
-	bool first_trb = 0;
-	int start_cycle;
-	u32 field = 0;
-	u32 length_field = 0;
-	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
-	int slot_id = udev->slot_id;
-	int ep_index;
-	struct xhci_virt_device *virt_dev;
-	struct xhci_ep_ctx *ep_ctx;
-	struct xhci_ring *ring;		/* EP transfer ring */
-	union xhci_trb *event;
-
-	int running_total, trb_buff_len;
-	unsigned int total_packet_count;
-	int maxpacketsize;
-	u64 addr;
-	int ret;
-	u32 trb_fields[4];
+	int running_total;
 	u64 val_64 = (uintptr_t)buffer;
 
-	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
-		udev, pipe, buffer, length);
-
-	ep_index = usb_pipe_ep_index(pipe);
-	virt_dev = ctrl->devs[slot_id];
-
-	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
-			 virt_dev->out_ctx->size);
-
-	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
-
-	ring = virt_dev->eps[ep_index].ring;
 	/*
 	 * How much data is (potentially) left before the 64KB boundary?
 	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
@@ -590,7 +618,6 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	 */
 	running_total = TRB_MAX_BUFF_SIZE -
 			(lower_32_bits(val_64) & (TRB_MAX_BUFF_SIZE - 1));
-	trb_buff_len = running_total;
 	running_total &= TRB_MAX_BUFF_SIZE - 1;
 
 	/*
@@ -606,23 +633,35 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		running_total += TRB_MAX_BUFF_SIZE;
 	}
 
-	/*
-	 * XXX: Calling routine prepare_ring() called in place of
-	 * prepare_trasfer() as there in 'Linux' since we are not
-	 * maintaining multiple TDs/transfer at the same time.
-	 */
-	ret = prepare_ring(ctrl, ring,
-			   le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK);
-	if (ret < 0)
-		return ret;
+	return num_trbs;
+}
 
-	/*
-	 * Don't give the first TRB to the hardware (by toggling the cycle bit)
-	 * until we've finished creating all the other TRBs.  The ring's cycle
-	 * state may change as we enqueue the other TRBs, so save it too.
-	 */
-	start_trb = &ring->enqueue->generic;
-	start_cycle = ring->cycle_state;
+/**
+ * Queues the TRBs of one bulk TD on the ring
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param ring		EP transfer ring
+ * @param length	length of the buffer
+ * @param buffer	buffer to be read/written
+ * @param first		true if this TD starts the submission, so that its
+ *			first TRB is held back until giveback_first_trb()
+ * @param more_tds	true if another TD follows before the doorbell
+ * @return none
+ */
+static void queue_bulk_td(struct usb_device *udev, unsigned long pipe,
+			  struct xhci_ring *ring, int length, void *buffer,
+			  bool first, bool more_tds)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	int num_trbs = bulk_td_num_trbs(buffer, length);
+	u32 field = 0;
+	u32 length_field = 0;
+	int running_total, trb_buff_len;
+	unsigned int total_packet_count;
+	int maxpacketsize;
+	u64 addr;
+	u32 trb_fields[4];
 
 	running_total = 0;
 	maxpacketsize = usb_maxpacket(udev, pipe);
@@ -630,19 +669,12 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	total_packet_count = DIV_ROUND_UP(length, maxpacketsize);
 
 	/* How much data is in the first TRB? */
-	/*
-	 * How much data is (potentially) left before the 64KB boundary?
-	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
-	 * that the buffer should not span 64KB boundary. if so
-	 * we send request in more than 1 TRB by chaining them.
-	 */
-	addr = val_64;
-
+	addr = (uintptr_t)buffer;
+	trb_buff_len = TRB_MAX_BUFF_SIZE -
+		       (lower_32_bits(addr) & (TRB_MAX_BUFF_SIZE - 1));
 	if (trb_buff_len > length)
 		trb_buff_len = length;
 
-	first_trb = true;
-
 	/* flush the buffer before use */
 	xhci_flush_cache((uintptr_t)buffer, length);
 
@@ -651,9 +683,9 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		u32 remainder = 0;
 		field = 0;
 		/* Don't change the cycle bit of the first TRB until later */
-		if (first_trb) {
-			first_trb = false;
-			if (start_cycle == 0)
+		if (first) {
+			first = false;
+			if (ring->cycle_state == 0)
 				field |= TRB_CYCLE;
 		} else {
 			field |= ring->cycle_state;
@@ -692,7 +724,7 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		trb_fields[2] = length_field;
 		trb_fields[3] = field | (TRB_NORMAL << TRB_TYPE_SHIFT);
 
-		queue_trb(ctrl, ring, (num_trbs > 1), trb_fields);
+		queue_trb(ctrl, ring, (num_trbs > 1 || more_tds), trb_fields);
 
 		--num_trbs;
 
@@ -702,29 +734,195 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		addr += trb_buff_len;
 		trb_buff_len = min((length - running_total), TRB_MAX_BUFF_SIZE);
 	} while (running_total < length);
+}
+
+/**
+ * Queues up several BULK Requests, rings the doorbell once and waits for
+ * all of them. The TDs must fit on the ring together.
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param xfer		transfers to be read/written, in order
+ * @param count		number of transfers
+ * @return returns 0 if successful else error code on failure
+ */
+static int bulk_tx_queue(struct usb_device *udev, unsigned long pipe,
+			 struct usb_bulk_xfer *xfer, int count)
+{
+	struct xhci_generic_trb *start_trb;
+	int start_cycle;
+	u32 field = 0;
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	int slot_id = udev->slot_id;
+	int ep_index;
+	struct xhci_virt_device *virt_dev;
+	struct xhci_ep_ctx *ep_ctx;
+	struct xhci_ring *ring;		/* EP transfer ring */
+	union xhci_trb *event;
+	int ret = 0;
+	int i;
+
+	ep_index = usb_pipe_ep_index(pipe);
+	virt_dev = ctrl->devs[slot_id];
+
+	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+			 virt_dev->out_ctx->size);
+
+	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
+
+	ring = virt_dev->eps[ep_index].ring;
+
+	/*
+	 * XXX: Calling routine prepare_ring() called in place of
+	 * prepare_trasfer() as there in 'Linux' since the ring is always
+	 * empty here: every submission is waited for, and the caller has
+	 * checked that the TDs fit.
+	 */
+	ret = prepare_ring(ctrl, ring,
+			   le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK);
+	if (ret < 0)
+		return ret;
+
+	/*
+	 * Don't give the first TRB to the hardware (by toggling the cycle bit)
+	 * until we've finished creating all the other TRBs.  The ring's cycle
+	 * state may change as we enqueue the other TRBs, so save it too.
+	 */
+	start_trb = &ring->enqueue->generic;
+	start_cycle = ring->cycle_state;
+
+	for (i = 0; i < count; i++)
+		queue_bulk_td(udev, pipe, ring, xfer[i].length,
+			      xfer[i].buffer, i == 0, i < count - 1);
 
 	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
 
-	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
-	if (!event) {
-		debug("XHCI bulk transfer timed out, aborting...\n");
-		abort_td(udev, ep_index);
-		udev->status = USB_ST_NAK_REC;  /* closest thing to a timeout */
-		udev->act_len = 0;
-		return -ETIMEDOUT;
+	/* There is one transfer event for each TD, in order */
+	udev->status = 0;
+	udev->act_len = 0;
+	for (i = 0; i < count; i++) {
+		event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
+		if (!event) {
+			debug("XHCI bulk transfer timed out, aborting...\n");
+			abort_td(udev, ep_index);
+			/* closest thing to a timeout */
+			xfer[i].status = USB_ST_NAK_REC;
+			xfer[i].act_len = 0;
+			udev->status = USB_ST_NAK_REC;
+			udev->act_len = 0;
+			ret = -ETIMEDOUT;
+			break;
+		}
+		field = le32_to_cpu(event->trans_event.flags);
+
+		BUG_ON(TRB_TO_SLOT_ID(field) != slot_id);
+		BUG_ON(TRB_TO_EP_INDEX(field) != ep_index);
+
+		record_bulk_result(event, &xfer[i]);
+		xhci_acknowledge_event(ctrl);
+
+		udev->act_len += xfer[i].act_len;
+		if (xfer[i].status) {
+			udev->status = xfer[i].status;
+			break;
+		}
 	}
-	field = le32_to_cpu(event->trans_event.flags);
 
-	BUG_ON(TRB_TO_SLOT_ID(field) != slot_id);
-	BUG_ON(TRB_TO_EP_INDEX(field) != ep_index);
-	BUG_ON(*(void **)(uintptr_t)le64_to_cpu(event->trans_event.buffer) -
-		buffer > (size_t)length);
+	/*
+	 * An error stops the endpoint with the TDs after the failed one still
+	 * on the ring. Get it going again without them.
+	 */
+	if (udev->status && !ret) {
+		xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+				 virt_dev->out_ctx->size);
+		switch (le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK) {
+		case EP_STATE_HALTED:
+			reset_ep(udev, ep_index);
+			break;
+		case EP_STATE_ERROR:
+			set_deq_to_enqueue(udev, ep_index);
+			break;
+		}
+	}
 
-	record_transfer_result(udev, event, length);
-	xhci_acknowledge_event(ctrl);
-	xhci_inval_cache((uintptr_t)buffer, length);
+	for (i++; i < count; i++) {
+		xfer[i].status = USB_ST_NOT_PROC;
+		xfer[i].act_len = 0;
+	}
 
-	return (udev->status != USB_ST_NOT_PROC) ? 0 : -1;
+	for (i = 0; i < count; i++)
+		xhci_inval_cache((uintptr_t)xfer[i].buffer, xfer[i].length);
+
+	return ret;
+}
+
+/**
+ * Queues up several BULK Requests on one pipe, handing the xHC as many of
+ * them as fit on the ring with each doorbell
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param xfer		transfers to be read/written, in order
+ * @param count		number of transfers
+ * @return returns 0 if successful else error code on failure
+ */
+int xhci_bulk_queue(struct usb_device *udev, unsigned long pipe,
+		    struct usb_bulk_xfer *xfer, int count)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_ring *ring;
+	int max_trbs, num_trbs;
+	int ret, n;
+
+	debug("dev=%p, pipe=%lx, buffer=%p, length=%d, count=%d\n",
+		udev, pipe, xfer[0].buffer, xfer[0].length, count);
+
+	ring = ctrl->devs[udev->slot_id]->eps[usb_pipe_ep_index(pipe)].ring;
+	/* Every segment ends in a link TRB; keep one TRB free as well */
+	max_trbs = ring->num_segs * (TRBS_PER_SEGMENT - 1) - 1;
+
+	while (count > 0) {
+		num_trbs = 0;
+		for (n = 0; n < count; n++) {
+			num_trbs += bulk_td_num_trbs(xfer[n].buffer,
+						     xfer[n].length);
+			if (num_trbs > max_trbs)
+				break;
+		}
+		if (n == 0) {
+			printf("XHCI bulk transfer of %d bytes too large\n",
+			       xfer[0].length);
+			return -EINVAL;
+		}
+
+		ret = bulk_tx_queue(udev, pipe, xfer, n);
+		if (ret || udev->status)
+			return ret;
+		xfer += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
+/**
+ * Queues up the BULK Request
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param length	length of the buffer
+ * @param buffer	buffer to be read/written based on the request
+ * @return returns 0 if successful else -1 on failure
+ */
+int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
+			int length, void *buffer)
+{
+	struct usb_bulk_xfer xfer = {
+		.buffer = buffer,
+		.length = length,
+	};
+
+	return xhci_bulk_queue(udev, pipe, &xfer, 1);
 }
 
 /**
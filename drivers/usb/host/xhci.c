@@ -364,14 +364,19 @@ static int xhci_set_configuration(struct usb_device *udev)
 		ep_index = xhci_get_ep_index(endpt_desc);
 		ep_ctx[ep_index] = xhci_get_ep_ctx(ctrl, in_ctx, ep_index);
 
-		/* Allocate the ep rings */
-		virt_dev->eps[ep_index].ring = xhci_ring_alloc(1, true);
-		if (!virt_dev->eps[ep_index].ring)
-			return -ENOMEM;
-
 		/*NOTE: ep_desc[0] actually represents EP1 and so on */
 		dir = (((endpt_desc->bEndpointAddress) & (0x80)) >> 7);
 		ep_type = (((endpt_desc->bmAttributes) & (0x3)) | (dir << 2));
+
+		/*
+		 * Allocate the ep rings. Bulk rings are made large enough for
+		 * big transfers and for several of them queued at once.
+		 */
+		virt_dev->eps[ep_index].ring = xhci_ring_alloc(
+			usb_endpoint_xfer_bulk(endpt_desc) ?
+			XHCI_BULK_RING_SEGS : 1, true);
+		if (!virt_dev->eps[ep_index].ring)
+			return -ENOMEM;
 		ep_ctx[ep_index]->ep_info2 =
 			cpu_to_le32(ep_type << EP_TYPE_SHIFT);
 		ep_ctx[ep_index]->ep_info2 |=
@@ -915,6 +920,26 @@ static int _xhci_submit_bulk_msg(struct usb_device *udev, unsigned long pipe,
 	return xhci_bulk_tx(udev, pipe, length, buffer);
 }
 
+/**
+ * submit several BULK requests on one pipe at once
+ *
+ * @param udev	pointer to the USB device
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param xfer		transfers to be read/written, in order
+ * @param count		number of transfers
+ * @return returns 0 if successful else error code on failure
+ */
+static int _xhci_submit_bulk_queue(struct usb_device *udev, unsigned long pipe,
+				   struct usb_bulk_xfer *xfer, int count)
+{
+	if (usb_pipetype(pipe) != PIPE_BULK) {
+		printf("non-bulk pipe (type=%lu)", usb_pipetype(pipe));
+		return -EINVAL;
+	}
+
+	return xhci_bulk_queue(udev, pipe, xfer, count);
+}
+
 /**
  * submit the control type of request to the Root hub/Device based on the devnum
  *
@@ -1046,6 +1071,12 @@ int submit_bulk_msg(struct usb_device *udev, unsigned long pipe, void *buffer,
 	return _xhci_submit_bulk_msg(udev, pipe, buffer, length);
 }
 
+int submit_bulk_queue(struct usb_device *udev, unsigned long pipe,
+		      struct usb_bulk_xfer *xfer, int count)
+{
+	return _xhci_submit_bulk_queue(udev, pipe, xfer, count);
+}
+
 int submit_int_msg(struct usb_device *udev, unsigned long pipe, void *buffer,
 		   int length, int interval)
 {
@@ -1174,6 +1205,14 @@ static int xhci_submit_bulk_msg(struct udevice *dev, struct usb_device *udev,
 	return _xhci_submit_bulk_msg(udev, pipe, buffer, length);
 }
 
+static int xhci_submit_bulk_queue(struct udevice *dev, struct usb_device *udev,
+				  unsigned long pipe,
+				  struct usb_bulk_xfer *xfer, int count)
+{
+	debug("%s: dev='%s', udev=%p\n", __func__, dev->name, udev);
+	return _xhci_submit_bulk_queue(udev, pipe, xfer, count);
+}
+
 static int xhci_submit_int_msg(struct udevice *dev, struct usb_device *udev,
 			       unsigned long pipe, void *buffer, int length,
 			       int interval)
@@ -1207,6 +1246,7 @@ int xhci_register(struct udevice *dev, struct xhci_hccr *hccr,
 	 * of that is done for XHCI unlike EHCI.
 	 */
 	priv->desc_before_addr = false;
+	priv->max_xfer_size = XHCI_MAX_BULK_XFER;
 
 	ret = xhci_reset(hcor);
 	if (ret)
@@ -1238,6 +1278,7 @@ int xhci_deregister(struct udevice *dev)
 struct dm_usb_ops xhci_usb_ops = {
 	.control = xhci_submit_control_msg,
 	.bulk = xhci_submit_bulk_msg,
+	.bulk_queue = xhci_submit_bulk_queue,
 	.interrupt = xhci_submit_int_msg,
 	.alloc_device = xhci_alloc_device,
 };
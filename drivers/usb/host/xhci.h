@@ -1001,6 +1001,18 @@ typedef enum {
 /* TRB buffer pointers can't cross 64KB boundaries */
 #define TRB_MAX_BUFF_SHIFT	16
 #define TRB_MAX_BUFF_SIZE	(1 << TRB_MAX_BUFF_SHIFT)
+/*
+ * Segments in a bulk endpoint ring. Each holds TRBS_PER_SEGMENT - 1 TRBs of
+ * up to 64KB, so 16 segments take a TD of more than 60MB, or several smaller
+ * TDs for one doorbell.
+ */
+#define XHCI_BULK_RING_SEGS	16
+
+/*
+ * Largest bulk transfer reported to class drivers. The ring takes more, but
+ * 4MB keeps a USB 3.0 stick busy and a slow device well within XHCI_TIMEOUT.
+ */
+#define XHCI_MAX_BULK_XFER	(4 << 20)
 
 struct xhci_segment {
 	union xhci_trb		*trbs;
@@ -1252,6 +1264,8 @@ void xhci_acknowledge_event(struct xhci_ctrl *ctrl);
 union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected);
 int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		 int length, void *buffer);
+int xhci_bulk_queue(struct usb_device *udev, unsigned long pipe,
+		    struct usb_bulk_xfer *xfer, int count);
 int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 		 struct devrequest *req, int length, void *buffer);
 int xhci_check_maxpacket(struct usb_device *udev);
@@ -199,6 +199,8 @@ enum bootstage_id {
 	BOOTSTAGE_ID_ACCUM_SPI,
 	BOOTSTAGE_ID_ACCUM_DECOMP,
 	BOOTSTAGE_ID_FPGA_INIT,
+	BOOTSTAGE_ID_DHCP_OFFER,
+	BOOTSTAGE_ID_ACCUM_USB_SCAN,
 
 	/* a few spare for the user, from here */
 	BOOTSTAGE_ID_USER,
@@ -299,6 +301,16 @@ uint32_t bootstage_start(enum bootstage_id id, const char *name);
  */
 uint32_t bootstage_accum(enum bootstage_id id);
 
+/**
+ * Get the time recorded for a bootstage id
+ *
+ * For an accumulator this is the total time spent in the activity so far.
+ *
+ * @param id	Bootstage id to look up
+ * @return time in microseconds, or 0 if nothing was recorded
+ */
+uint32_t bootstage_get_time(enum bootstage_id id);
+
 /* Print a report about boot time */
 void bootstage_report(void);
 
@@ -381,6 +393,11 @@ static inline uint32_t bootstage_accum(enum bootstage_id id)
 	return 0;
 }
 
+static inline uint32_t bootstage_get_time(enum bootstage_id id)
+{
+	return 0;
+}
+
 static inline int bootstage_stash(void *base, int size)
 {
 	return 0;	/* Pretend to succeed */
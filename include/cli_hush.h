@@ -17,6 +17,18 @@ extern int u_boot_hush_start(void);
 extern int parse_string_outer(const char *, int);
 extern int parse_file_outer(void);
 
+/**
+ * parse_string_cached() - Run a script from an environment variable
+ *
+ * The parsed script is cached and reused next time, as long as the
+ * variable has not changed.
+ *
+ * @name:	Name of environment variable
+ * @s:		Value of environment variable (the script to run)
+ * @return 0 if OK, 1 on error
+ */
+int parse_string_cached(const char *name, const char *s);
+
 int set_local_var(const char *s, int flg_export);
 void unset_local_var(const char *name);
 char *get_local_var(const char *s);
@@ -59,6 +59,9 @@
 #define CONFIG_ISO_PARTITION
 #define CONFIG_MAC_PARTITION
 
+/* Build the sparse image stream writer so that ut_sparse can test it */
+#define CONFIG_FASTBOOT_FLASH_STREAM
+
 /*
  * Size of malloc() pool, before and after relocation
  */
@@ -126,6 +129,7 @@
 #define CONFIG_BOOTP_SEND_HOSTNAME
 #define CONFIG_BOOTP_SERVERIP
 #define CONFIG_IP_DEFRAG
+#define CONFIG_TFTP_TSIZE
 
 /* Can't boot elf images */
 
@@ -222,5 +226,7 @@
 #define CONFIG_SYS_SYSTEMACE_BASE	0
 
 #define CONFIG_GENERIC_MMC
+#define CONFIG_SDHCI
+#define CONFIG_MMC_SDHCI_IO_ACCESSORS
 
 #endif
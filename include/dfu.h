@@ -85,6 +85,12 @@ struct sf_internal_data {
 #ifndef CONFIG_SYS_DFU_DATA_BUF_SIZE
 #define CONFIG_SYS_DFU_DATA_BUF_SIZE		(1024*1024*8)	/* 8 MiB */
 #endif
+#ifndef CONFIG_SYS_DFU_DATA_BUF_COUNT
+#define CONFIG_SYS_DFU_DATA_BUF_COUNT		1
+#endif
+#ifndef CONFIG_SYS_DFU_WRITE_SLICE
+#define CONFIG_SYS_DFU_WRITE_SLICE		(128 * 1024)
+#endif
 #ifndef CONFIG_SYS_DFU_MAX_FILE_SIZE
 #define CONFIG_SYS_DFU_MAX_FILE_SIZE CONFIG_SYS_DFU_DATA_BUF_SIZE
 #endif
@@ -102,6 +108,8 @@ struct dfu_entity {
 	enum dfu_device_type    dev_type;
 	enum dfu_layout         layout;
 	unsigned long           max_buf_size;
+	unsigned long		buf_size;	/* size of each write buffer */
+	unsigned long		write_slice;	/* 0 to write whole buffers */
 
 	union {
 		struct mmc_internal_data mmc;
@@ -137,6 +145,18 @@ struct dfu_entity {
 
 	u32 bad_skip;	/* for nand use */
 
+	/* full buffers waiting to be written */
+	long w_len[CONFIG_SYS_DFU_DATA_BUF_COUNT];
+	int w_head;
+	int w_count;
+	long w_done;	/* bytes of the first one written so far */
+	int w_error;
+
+	/* statistics */
+	ulong stat_start;
+	ulong stat_write_ms;
+	u64 stat_bytes;
+
 	unsigned int inited:1;
 };
 
@@ -161,7 +181,10 @@ bool dfu_usb_get_reset(void);
 
 int dfu_read(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 int dfu_write(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
+void *dfu_write_dest(struct dfu_entity *de, int size, unsigned int *room);
 int dfu_flush(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
+void dfu_set_write_queue(bool enable);
+void dfu_write_poll(void);
 
 /*
  * dfu_defer_flush - pointer to store dfu_entity for deferred flashing.
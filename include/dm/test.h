@@ -136,6 +136,7 @@ extern struct unit_test_state global_dm_test_state;
  * @force_fail_alloc: Force all memory allocs to fail
  * @skip_post_probe: Skip uclass post-probe processing
  * @removed: Used to keep track of a device that was removed
+ * @op_delay_ms: Time taken to bind, probe or remove a manual test device
  */
 struct dm_test_state {
 	struct udevice *root;
@@ -143,6 +144,7 @@ struct dm_test_state {
 	int force_fail_alloc;
 	int skip_post_probe;
 	struct udevice *removed;
+	int op_delay_ms;
 };
 
 /* Test flags for each test */
@@ -0,0 +1,128 @@
+/*
+ * Per-device timing for driver model
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _DM_TIMING_H
+#define _DM_TIMING_H
+
+struct udevice;
+
+/* Operations which are timed for each device */
+enum dm_timing_op {
+	DM_TIMING_BIND,
+	DM_TIMING_PROBE,
+	DM_TIMING_REMOVE,
+
+	DM_TIMING_OP_COUNT,
+};
+
+/**
+ * struct dm_timing_ctx - State held while a device operation is timed
+ *
+ * Operations nest (probing a device probes its parent first, binding a
+ * bus binds its children) so we record the time spent in nested
+ * operations and subtract it, giving the time taken by each device itself.
+ *
+ * @start_us:	Time when the operation started, or 0 if not timed
+ * @outer_us:	Nested time accumulated by the enclosing operation
+ */
+struct dm_timing_ctx {
+	ulong start_us;
+	ulong outer_us;
+};
+
+#if CONFIG_IS_ENABLED(DM_TIMING)
+/**
+ * dm_timing_start() - Start timing a device operation
+ *
+ * @ctx:	Context to fill in, which must be passed to dm_timing_end()
+ */
+void dm_timing_start(struct dm_timing_ctx *ctx);
+
+/**
+ * dm_timing_end() - Finish timing a device operation and record it
+ *
+ * The time is only recorded if @dev is not NULL, so that failed
+ * operations are not counted.
+ *
+ * @ctx:	Context passed to dm_timing_start()
+ * @dev:	Device which was operated on, or NULL if the operation failed
+ * @op:	Operation which was performed
+ */
+void dm_timing_end(struct dm_timing_ctx *ctx, struct udevice *dev,
+		   enum dm_timing_op op);
+
+/**
+ * dm_timing_drop() - Discard the timing record for a device
+ *
+ * This must be called before a device is freed, since records are looked
+ * up by device pointer and a new device may be allocated at the same place.
+ *
+ * @dev:	Device being unbound
+ */
+void dm_timing_drop(struct udevice *dev);
+
+/**
+ * dm_timing_show() - Show a table of device timings, most costly first
+ */
+void dm_timing_show(void);
+
+/**
+ * dm_timing_clear() - Discard all recorded device timings
+ */
+void dm_timing_clear(void);
+
+/**
+ * dm_timing_get() - Get the time recorded for a device
+ *
+ * @dev:	Device to look up
+ * @op:	Operation to look up
+ * @return total time spent in this operation in microseconds, or -ENOENT
+ *	if the device has no record
+ */
+long dm_timing_get(struct udevice *dev, enum dm_timing_op op);
+
+/**
+ * dm_timing_fdt_add() - Add device timings to a device tree
+ *
+ * This adds a 'dm-timing' subnode to the given node, with one subnode
+ * for each device containing its name, uclass and bind/probe/remove times.
+ *
+ * @blob:	Device tree blob
+ * @parent:	Offset of parent node (normally /bootstage)
+ * @return 0 if OK, -ve FDT error on failure
+ */
+int dm_timing_fdt_add(void *blob, int parent);
+#else
+static inline void dm_timing_start(struct dm_timing_ctx *ctx)
+{
+}
+
+static inline void dm_timing_end(struct dm_timing_ctx *ctx,
+				 struct udevice *dev, enum dm_timing_op op)
+{
+}
+
+static inline void dm_timing_drop(struct udevice *dev)
+{
+}
+
+static inline void dm_timing_show(void)
+{
+}
+
+static inline void dm_timing_clear(void)
+{
+}
+
+static inline int dm_timing_fdt_add(void *blob, int parent)
+{
+	return 0;
+}
+#endif
+
+#endif
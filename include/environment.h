@@ -223,6 +223,52 @@ int env_import(const char *buf, int check);
 /* Export from hash table into binary representation */
 int env_export(env_t *env_out);
 
+/**
+ * struct env_journal_ops - Access to the environment journal area
+ *
+ * Offsets are in bytes from the start of the journal area.
+ *
+ * @read:	Read from the journal, returning 0 if OK
+ * @write:	Write to the journal, returning 0 if OK
+ * @erase:	Erase the whole journal (at least the first record header must
+ *		read back as 0xff afterwards), returning 0 if OK
+ */
+struct env_journal_ops {
+	int (*read)(ulong offset, ulong size, void *buf);
+	int (*write)(ulong offset, ulong size, const void *buf);
+	int (*erase)(void);
+};
+
+/**
+ * env_journal_load() - Apply the journal to the environment just imported
+ *
+ * @ops:	Access to the journal
+ * @base_crc:	CRC of the environment which was imported
+ */
+void env_journal_load(const struct env_journal_ops *ops, uint32_t base_crc);
+
+/**
+ * env_journal_save() - Save environment changes to the journal
+ *
+ * @ops:	Access to the journal
+ * @env_new:	Exported environment to save
+ * @return 0 if saved, -ve on error, in which case the caller should save
+ *	the full environment and call env_journal_reset()
+ */
+int env_journal_save(const struct env_journal_ops *ops, env_t *env_new);
+
+/**
+ * env_journal_reset() - Erase the journal after saving the full environment
+ *
+ * If this fails, the stale records are ignored since they hold the CRC of
+ * the previous environment, and the erase is retried on the next save.
+ *
+ * @ops:	Access to the journal
+ * @env_new:	Exported environment which was saved
+ * @return 0 if OK, -ve on error
+ */
+int env_journal_reset(const struct env_journal_ops *ops, env_t *env_new);
+
 #endif /* DO_DEPS_ONLY */
 
 #endif /* _ENVIRONMENT_H_ */
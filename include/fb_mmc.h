@@ -7,3 +7,7 @@
 void fb_mmc_flash_write(const char *cmd, void *download_buffer,
 			unsigned int download_bytes);
 void fb_mmc_erase(const char *cmd);
+
+struct sparse_stream;
+int fb_mmc_flash_stream_start(const char *cmd, struct sparse_stream *stream,
+			      unsigned int download_bytes);
@@ -38,3 +38,39 @@ static inline int is_sparse_image(void *buf)
 
 void write_sparse_image(struct sparse_storage *info, const char *part_name,
 			void *data, unsigned sz);
+
+/*
+ * A sparse (or raw) image can also be written as it arrives, a piece at a
+ * time, instead of from one buffer that holds all of it. The pieces may be
+ * split anywhere, including in the middle of a header. Nothing is reported
+ * to the fastboot host here: when a call fails, @error gives the reason.
+ */
+struct sparse_stream {
+	struct sparse_storage	*info;
+	const char		*part_name;
+	unsigned int		size;		/* total bytes of the image */
+	int			state;
+	const char		*error;		/* reason, if the write failed */
+
+	sparse_header_t		sparse_header;
+	chunk_header_t		chunk_header;
+	u8			hdr_buf[32];	/* header being collected */
+	unsigned int		hdr_len;	/* bytes of it seen so far */
+	unsigned int		remaining;	/* bytes left in this state */
+	unsigned int		chunks_left;
+
+	lbaint_t		blk;		/* next block to write */
+	uint32_t		total_blocks;
+	u64			bytes_written;
+
+	void			*blk_buf;	/* partial block of raw data */
+	unsigned int		blk_len;
+	uint32_t		*fill_buf;
+};
+
+int sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info,
+			const char *part_name, unsigned int size);
+int sparse_stream_write(struct sparse_stream *ss, const void *data,
+			unsigned int len);
+int sparse_stream_finish(struct sparse_stream *ss);
+void sparse_stream_abort(struct sparse_stream *ss);
@@ -475,6 +475,9 @@ struct usb_gadget_ops {
  * @dev: Driver model state for this abstract device.
  * @quirk_ep_out_aligned_size: epout requires buffer size to be aligned to
  *	MaxPacketSize.
+ * @direct_rx: OUT requests of any length that is a multiple of MaxPacketSize
+ *	are received by DMA straight into a cache-aligned buf, with no bounce
+ *	buffer. See usb_ep_direct_rx_len().
  *
  * Gadgets have a mostly-portable "gadget driver" implementing device
  * functions, handling all usb configurations and interfaces.  Gadget
@@ -511,6 +514,7 @@ struct usb_gadget {
 	const char			*name;
 	struct device			dev;
 	unsigned			quirk_ep_out_aligned_size:1;
+	unsigned			direct_rx:1;
 };
 
 static inline void set_gadget_data(struct usb_gadget *gadget, void *data)
@@ -528,6 +532,45 @@ static inline struct usb_gadget *dev_to_usb_gadget(struct device *dev)
 	return container_of(dev, struct usb_gadget, dev);
 }
 
+/**
+ * usb_ep_direct_rx_len - length of an OUT request received in place
+ * @gadget: the controller
+ * @ep: the OUT endpoint
+ * @dest: where the next data should go
+ * @remain: number of bytes still expected
+ * @room: number of bytes which may be written at @dest
+ * @max: largest request wanted, a multiple of MaxPacketSize
+ *
+ * A gadget function may point an OUT request's buf straight at the final
+ * destination of the data, so that it is written to memory only once. This
+ * needs a controller with @direct_rx set and a cache-aligned @dest. The
+ * request is rounded up to MaxPacketSize and the controller may invalidate
+ * whole cache lines, so @room must allow for that.
+ *
+ * Returns the request length to use, or 0 if the data must be received
+ * into a separate buffer and copied.
+ */
+static inline unsigned int usb_ep_direct_rx_len(struct usb_gadget *gadget,
+						struct usb_ep *ep, void *dest,
+						unsigned int remain,
+						unsigned int room,
+						unsigned int max)
+{
+	unsigned int maxpacket = ep->maxpacket;
+	unsigned int len = min(remain, max);
+
+	if (!gadget->direct_rx || !len)
+		return 0;
+	if ((unsigned long)dest & (ARCH_DMA_MINALIGN - 1))
+		return 0;
+
+	len = roundup(len, maxpacket);
+	if (roundup(len, ARCH_DMA_MINALIGN) > room)
+		return 0;
+
+	return len;
+}
+
 /* iterates the non-control endpoints; 'tmp' is a struct usb_ep pointer */
 #define gadget_for_each_ep(tmp, gadget) \
 	list_for_each_entry(tmp, &(gadget)->ep_list, ep_list)
@@ -57,6 +57,12 @@
 #define MMC_MODE_8BIT		(1 << 3)
 #define MMC_MODE_SPI		(1 << 4)
 #define MMC_MODE_DDR_52MHz	(1 << 5)
+#define MMC_MODE_HS200		(1 << 6)
+#define MMC_MODE_HS400		(1 << 7)
+#define MMC_MODE_UHS_SDR50	(1 << 8)
+#define MMC_MODE_UHS_SDR104	(1 << 9)
+
+#define MMC_MODE_UHS		(MMC_MODE_UHS_SDR50 | MMC_MODE_UHS_SDR104)
 
 #define SD_DATA_4BIT	0x00040000
 
@@ -87,6 +93,8 @@
 #define MMC_CMD_SET_BLOCKLEN		16
 #define MMC_CMD_READ_SINGLE_BLOCK	17
 #define MMC_CMD_READ_MULTIPLE_BLOCK	18
+#define MMC_CMD_SEND_TUNING_BLOCK	19
+#define MMC_CMD_SEND_TUNING_BLOCK_HS200	21
 #define MMC_CMD_SET_BLOCK_COUNT         23
 #define MMC_CMD_WRITE_SINGLE_BLOCK	24
 #define MMC_CMD_WRITE_MULTIPLE_BLOCK	25
@@ -116,9 +124,17 @@
 /* SCR definitions in different words */
 #define SD_HIGHSPEED_BUSY	0x00020000
 #define SD_HIGHSPEED_SUPPORTED	0x00020000
+#define SD_UHS_SDR50_SUPPORTED	0x00040000
+#define SD_UHS_SDR104_SUPPORTED	0x00080000
+
+/* Access mode (function group 1) values for SD_CMD_SWITCH_FUNC */
+#define SD_ACCESS_MODE_SDR25	1	/* also high speed at 3.3V */
+#define SD_ACCESS_MODE_SDR50	2
+#define SD_ACCESS_MODE_SDR104	3
 
 #define OCR_BUSY		0x80000000
 #define OCR_HCS			0x40000000
+#define OCR_S18R		0x01000000	/* S18A in the response */
 #define OCR_VOLTAGE_MASK	0x007FFF80
 #define OCR_ACCESS_MODE		0x60000000
 
@@ -207,6 +223,15 @@
 #define EXT_CSD_CARD_TYPE_DDR_1_2V	(1 << 3)
 #define EXT_CSD_CARD_TYPE_DDR_52	(EXT_CSD_CARD_TYPE_DDR_1_8V \
 					| EXT_CSD_CARD_TYPE_DDR_1_2V)
+#define EXT_CSD_CARD_TYPE_HS200_1_8V	(1 << 4)
+#define EXT_CSD_CARD_TYPE_HS200_1_2V	(1 << 5)
+#define EXT_CSD_CARD_TYPE_HS400_1_8V	(1 << 6)
+#define EXT_CSD_CARD_TYPE_HS400_1_2V	(1 << 7)
+
+#define EXT_CSD_TIMING_LEGACY	0	/* Backwards compatible timing */
+#define EXT_CSD_TIMING_HS	1	/* High speed (26/52MHz, DDR52) */
+#define EXT_CSD_TIMING_HS200	2	/* HS200, needs tuning */
+#define EXT_CSD_TIMING_HS400	3	/* HS400, uses the HS200 tuning */
 
 #define EXT_CSD_BUS_WIDTH_1	0	/* Card is in 1 bit mode */
 #define EXT_CSD_BUS_WIDTH_4	1	/* Card is in 4 bit mode */
@@ -266,6 +291,36 @@
 /* Maximum block size for MMC */
 #define MMC_MAX_BLOCK_LEN	512
 
+/* Maximum clock rates for the tuned bus speed modes */
+#define MMC_HS200_MAX_DTR	200000000
+#define SD_UHS_SDR50_MAX_DTR	100000000
+#define SD_UHS_SDR104_MAX_DTR	208000000
+
+/**
+ * enum mmc_timing - Bus timing selected on the card
+ *
+ * This is set by the MMC core before it calls set_ios(), so that the host
+ * can program its sampling/drive settings to match the card. The modes from
+ * MMC_TIMING_UHS_SDR50 upwards (apart from DDR52) need a tuning procedure,
+ * see execute_tuning() in struct dm_mmc_ops.
+ */
+enum mmc_timing {
+	MMC_TIMING_LEGACY,
+	MMC_TIMING_MMC_HS,
+	MMC_TIMING_SD_HS,
+	MMC_TIMING_UHS_SDR50,
+	MMC_TIMING_UHS_SDR104,
+	MMC_TIMING_MMC_DDR52,
+	MMC_TIMING_MMC_HS200,
+	MMC_TIMING_MMC_HS400,
+};
+
+/* I/O signalling voltage, also passed to the host through set_ios() */
+enum mmc_signal_voltage {
+	MMC_SIGNAL_VOLTAGE_330,
+	MMC_SIGNAL_VOLTAGE_180,
+};
+
 /* The number of MMC physical partitions.  These consist of:
  * boot partitions (2), general purpose partitions (4) in MMC v4.4.
  */
@@ -359,6 +414,20 @@ struct dm_mmc_ops {
 	 * @return 0 if write-enabled, 1 if write-protected, -ve on error
 	 */
 	int (*get_wp)(struct udevice *dev);
+
+	/**
+	 * execute_tuning() - Find the sampling point for a tuned bus mode
+	 *
+	 * This is called once the card and host are both set to a timing
+	 * which needs tuning (HS200, UHS-I SDR50/SDR104). The host should
+	 * read the tuning block with @opcode as often as it needs to.
+	 *
+	 * @dev:	Device to tune
+	 * @opcode:	MMC_CMD_SEND_TUNING_BLOCK(_HS200)
+	 * @return 0 if OK, -ve on error, in which case the core selects a
+	 * slower mode
+	 */
+	int (*execute_tuning)(struct udevice *dev, uint opcode);
 };
 
 #define mmc_get_ops(dev)        ((struct dm_mmc_ops *)(dev)->driver->ops)
@@ -368,11 +437,13 @@ int dm_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 int dm_mmc_set_ios(struct udevice *dev);
 int dm_mmc_get_cd(struct udevice *dev);
 int dm_mmc_get_wp(struct udevice *dev);
+int dm_mmc_execute_tuning(struct udevice *dev, uint opcode);
 
 /* Transition functions for compatibility */
 int mmc_set_ios(struct mmc *mmc);
 int mmc_getcd(struct mmc *mmc);
 int mmc_getwp(struct mmc *mmc);
+int mmc_execute_tuning(struct mmc *mmc, uint opcode);
 
 #else
 struct mmc_ops {
@@ -446,6 +517,8 @@ struct mmc {
 	char init_in_progress;	/* 1 if we have done mmc_start_init() */
 	char preinit;		/* start init as early as possible */
 	int ddr_mode;
+	enum mmc_timing timing;
+	enum mmc_signal_voltage signal_voltage;
 #ifdef CONFIG_DM_MMC
 	struct udevice *dev;	/* Device for this MMC controller */
 #endif
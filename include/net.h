@@ -16,6 +16,7 @@
 #include <commproc.h>
 #endif	/* CONFIG_8xx */
 
+#include <errno.h>
 #include <asm/cache.h>
 #include <asm/byteorder.h>	/* for nton* / ntoh* stuff */
 
@@ -103,6 +104,20 @@ enum eth_recv_flags {
 	ETH_RECV_CHECK_DEVICE		= 1 << 0,
 };
 
+/* Most packets passed to the recv_batch() method at once */
+#define ETH_RX_BATCH	32
+
+/**
+ * struct eth_pkt - A received packet, as returned by recv_batch()
+ *
+ * @packet:	Packet data, starting with the Ethernet header
+ * @length:	Length of the packet in bytes
+ */
+struct eth_pkt {
+	uchar *packet;
+	int length;
+};
+
 /**
  * struct eth_ops - functions of Ethernet MAC controllers
  *
@@ -113,9 +128,18 @@ enum eth_recv_flags {
  *	 indicate that the hardware receive FIFO is empty. If 0 is returned, the
  *	 network stack will not process the empty packet, but free_pkt() will be
  *	 called if supplied
+ *	 Drivers which fill one buffer at a time may receive into the buffer
+ *	 from net_get_rx_buffer(), if any, to avoid the data being copied later
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
  *	     called when no error was returned from recv - optional
+ * recv_batch: Like recv, but return up to "max" packets at once, e.g. all
+ *	       the full descriptors in a receive ring, filling in "pkts".
+ *	       Return the number of packets, 0 if there are none, or an error.
+ *	       If supplied, this is used instead of recv - optional
+ * free_batch: Like free_pkt, but for all the packets returned by one call to
+ *	       recv_batch, in the same order. If not supplied, free_pkt is
+ *	       called for each packet instead - optional
  * stop: Stop the hardware from looking for packets - may be called even if
  *	 state == PASSIVE
  * mcast: Join or leave a multicast group (for TFTP) - optional
@@ -134,6 +158,10 @@ struct eth_ops {
 	int (*send)(struct udevice *dev, void *packet, int length);
 	int (*recv)(struct udevice *dev, int flags, uchar **packetp);
 	int (*free_pkt)(struct udevice *dev, uchar *packet, int length);
+	int (*recv_batch)(struct udevice *dev, int flags, struct eth_pkt *pkts,
+			  int max);
+	void (*free_batch)(struct udevice *dev, struct eth_pkt *pkts,
+			   int count);
 	void (*stop)(struct udevice *dev);
 #ifdef CONFIG_MCAST_TFTP
 	int (*mcast)(struct udevice *dev, const u8 *enetaddr, int join);
@@ -152,6 +180,13 @@ struct udevice *eth_get_dev(void); /* get the current device */
 struct udevice *eth_get_dev_by_name(const char *devname);
 unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 
+/*
+ * Start or stop a device other than the current one, e.g. to use several
+ * at once. eth_start_dev() returns 0 if OK, -ve on error.
+ */
+int eth_start_dev(struct udevice *dev);
+void eth_stop_dev(struct udevice *dev);
+
 /* Used only when NetConsole is enabled */
 int eth_is_active(struct udevice *dev); /* Test device for active state */
 int eth_init_state_only(void); /* Set active state */
@@ -273,7 +308,11 @@ int eth_send(void *packet, int length);	   /* Send a packet */
 int eth_receive(void *packet, int length); /* Receive a packet*/
 extern void (*push_packet)(void *packet, int length);
 #endif
-int eth_rx(void);			/* Check for received packets */
+/*
+ * Check for received packets; with CONFIG_DM_ETH this returns the number
+ * processed, else the length of the last one
+ */
+int eth_rx(void);
 void eth_halt(void);			/* stop SCC */
 const char *eth_get_name(void);		/* get name of current device */
 
@@ -527,7 +566,7 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL
+	TFTPSRV, TFTPPUT, LINKLOCAL, WGET, TFTPMULTI
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -570,6 +609,88 @@ extern int net_ntp_time_offset;			/* offset time from UTC */
 extern struct in_addr net_mcast_addr;
 #endif
 
+#ifdef CONFIG_IP_DEFRAG
+/* Largest datagram we can reassemble, not counting NFS/TFTP headers */
+#ifndef CONFIG_NET_MAXDEFRAG
+#define CONFIG_NET_MAXDEFRAG	16384
+#endif
+
+/**
+ * struct net_defrag_stats - IP fragment reassembly statistics
+ *
+ * These are cleared at the start of each net_loop().
+ *
+ * @fragments:	Number of fragments received
+ * @datagrams:	Number of datagrams reassembled
+ * @dropped:	Number of fragments dropped, either invalid (too large or
+ *		duplicate) or part of a datagram which was never completed
+ * @evicted:	Number of incomplete datagrams discarded to make room
+ */
+struct net_defrag_stats {
+	ulong fragments;
+	ulong datagrams;
+	ulong dropped;
+	ulong evicted;
+};
+
+extern struct net_defrag_stats net_defrag_stats;
+#endif
+
+#ifdef CONFIG_NET_RX_DIRECT
+/**
+ * struct net_rx_stats - Receive statistics for file data
+ *
+ * These are cleared at the start of each net_loop().
+ *
+ * @payload:	Bytes of file data received (e.g. by TFTP or NFS)
+ * @copied:	Bytes of that data which had to be copied to its destination,
+ *		rather than being received in place
+ */
+struct net_rx_stats {
+	ulong payload;
+	ulong copied;
+};
+
+extern struct net_rx_stats net_rx_stats;
+
+/**
+ * net_set_rx_dest() - Say where the data in the next packet should go
+ *
+ * A protocol which knows where the payload of the next packet will be
+ * stored (e.g. the next TFTP block in the load area) can call this so that
+ * the packet is received with its payload already in place. The headers
+ * land just before @buf and the bytes there are restored once the packet
+ * has been processed. Packets other than the one expected may also land
+ * here, so the area from @buf onwards must not yet hold anything useful.
+ *
+ * @buf:	Destination for the payload, or NULL to receive normally
+ * @hdr_len:	Number of bytes before the payload, from the Ethernet header
+ * @size:	Maximum payload size
+ */
+void net_set_rx_dest(void *buf, int hdr_len, int size);
+
+/**
+ * net_get_rx_buffer() - Get a buffer to receive the next packet into
+ *
+ * This is for drivers which fill one receive buffer at a time. The
+ * buffer is used for a single packet and must be passed to
+ * net_put_rx_buffer() once the packet has been processed.
+ *
+ * @len:	Maximum number of bytes the driver will write
+ * @return buffer to use, or NULL to use the driver's own buffer
+ */
+uchar *net_get_rx_buffer(int len);
+
+/**
+ * net_put_rx_buffer() - Finish with a received packet
+ *
+ * This does nothing unless @pkt came from net_get_rx_buffer().
+ *
+ * @pkt:	Packet which has been processed
+ */
+void net_put_rx_buffer(uchar *pkt);
+#endif
+
 /* Initialize the network adapter */
 void net_init(void);
 int net_loop(enum proto_t);
@@ -598,6 +719,20 @@ void net_set_udp_header(uchar *pkt, struct in_addr dest, int dport,
  */
 unsigned compute_ip_checksum(const void *addr, unsigned nbytes);
 
+/**
+ * compute_ip_checksum_copy() - Copy data and compute its IP checksum
+ *
+ * This is the same as memcpy() followed by compute_ip_checksum(), but only
+ * reads the data once.
+ *
+ * @dest:	Destination address (must be 16-bit aligned)
+ * @src:	Source address (must be 16-bit aligned)
+ * @nbytes:	Number of bytes to copy (normally a multiple of 2)
+ * @return 16-bit IP checksum of the data
+ */
+unsigned compute_ip_checksum_copy(void *dest, const void *src,
+				  unsigned nbytes);
+
 /**
  * add_ip_checksums() - add two IP checksums
  *
@@ -662,6 +797,41 @@ static inline void net_send_packet(uchar *pkt, int len)
 int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport,
 			int sport, int payload_len);
 
+/*
+ * Transmit "net_tx_packet" as an IP packet, performing ARP request if needed
+ *  (ether will be populated). The IP header and payload must already be in
+ *  place after the ethernet header, i.e. at net_tx_packet + net_eth_hdr_size()
+ *
+ * @param ether Raw packet buffer
+ * @param dest IP address to send the packet to
+ * @param ip_len Length of the IP packet, including the IP header
+ */
+int net_send_ip_packet(uchar *ether, struct in_addr dest, int ip_len);
+
+#ifdef CONFIG_NET_ARP_CACHE
+/*
+ * Look up the MAC address to send a packet to @dest over the current device,
+ * which is that of the gateway if @dest is on another subnet. Entries are
+ * added from ARP replies and requests, and are kept across net_loop() calls
+ * for CONFIG_NET_ARP_CACHE_TIMEOUT seconds.
+ *
+ * @param dest IP address to send to
+ * @param ethaddr Returns the MAC address if found
+ * @return 0 if found, -ENOENT if not known, -ETIMEDOUT if it has expired
+ */
+int arp_cache_lookup(struct in_addr dest, uchar *ethaddr);
+
+/* Forget all cached MAC addresses, e.g. if one may be stale */
+void arp_cache_flush(void);
+#else
+static inline int arp_cache_lookup(struct in_addr dest, uchar *ethaddr)
+{
+	return -ENOENT;
+}
+
+static inline void arp_cache_flush(void) {}
+#endif
+
 /* Processes a received packet */
 void net_process_received_packet(uchar *in_packet, int len);
 
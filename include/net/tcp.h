@@ -0,0 +1,130 @@
+/*
+ * Minimal TCP client
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#define IPPROTO_TCP	6	/* Transmission Control Protocol	*/
+
+/* TCP header flags */
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
+/* TCP options */
+#define TCP_OPT_END	0
+#define TCP_OPT_NOP	1
+#define TCP_OPT_MSS	2
+
+#define TCP_HDR_SIZE	20	/* TCP header without options */
+
+/* Largest segment which fits an Ethernet frame without fragmentation */
+#define TCP_MSS		(1500 - IP_HDR_SIZE - TCP_HDR_SIZE)
+
+/**
+ * struct tcp_hdr - TCP header, as it is on the wire
+ *
+ * @src:	Source port
+ * @dst:	Destination port
+ * @seq:	Sequence number of the first data byte (or of the SYN/FIN)
+ * @ack:	Next sequence number expected from the other end, if TCP_ACK
+ * @hlen:	Header length in 32-bit words, in the upper 4 bits
+ * @flags:	TCP_... flags
+ * @wnd:	Receive window: bytes which may be sent beyond @ack
+ * @sum:	Checksum, including a pseudo-header with the IP addresses
+ * @urp:	Urgent pointer (not used)
+ */
+struct tcp_hdr {
+	__be16 src;
+	__be16 dst;
+	__be32 seq;
+	__be32 ack;
+	u8 hlen;
+	u8 flags;
+	__be16 wnd;
+	__be16 sum;
+	__be16 urp;
+} __attribute__((packed));
+
+/**
+ * struct tcp_ops - Callbacks from the TCP connection to its user
+ *
+ * These are called from the packet handler. Any of them may call
+ * tcp_send() or tcp_close().
+ *
+ * @connected:	Called when the connection is set up, so data can be sent
+ * @recv:	Called with each new piece of data in the order it was sent.
+ *		@offset is the position of @data in the stream, starting at 0
+ * @closed:	Called when the connection ends: with 0 if the other end
+ *		closed it after sending all its data, else -ECONNREFUSED,
+ *		-ECONNRESET or -ETIMEDOUT
+ */
+struct tcp_ops {
+	void (*connected)(void);
+	void (*recv)(const uchar *data, ulong offset, int len);
+	void (*closed)(int err);
+};
+
+/**
+ * tcp_connect() - Open a connection
+ *
+ * Only one connection is supported; any previous one is forgotten. This
+ * must be called from within net_loop(), since it uses the net_loop()
+ * timeout handler for retransmission.
+ *
+ * @dest:	IP address to connect to
+ * @dport:	Port to connect to
+ * @ops:	Callbacks for the connection
+ */
+void tcp_connect(struct in_addr dest, int dport, const struct tcp_ops *ops);
+
+/**
+ * tcp_send() - Send data on the connection
+ *
+ * The data is sent as a single segment and is retransmitted until it is
+ * acknowledged. Only one segment may be outstanding at a time.
+ *
+ * @data:	Data to send
+ * @len:	Number of bytes to send
+ * @return 0 if OK, -ENOTCONN if not connected, -EBUSY if earlier data is
+ *	not yet acknowledged, -E2BIG if @len is larger than the segment size
+ */
+int tcp_send(const void *data, int len);
+
+/**
+ * tcp_close() - Close the connection
+ *
+ * This sends a FIN and forgets the connection, without waiting for the
+ * other end to acknowledge it.
+ */
+void tcp_close(void);
+
+/**
+ * tcp_receive() - Process a received TCP segment
+ *
+ * @ip:		IP header of the packet, followed by the TCP segment
+ * @len:	Length of the IP packet in bytes
+ */
+void tcp_receive(struct ip_udp_hdr *ip, int len);
+
+/**
+ * tcp_checksum() - Work out the checksum of a TCP segment
+ *
+ * @src:	Source IP address
+ * @dest:	Destination IP address
+ * @tcp:	TCP segment, with its checksum field set to 0
+ * @len:	Length of the segment including the header
+ * @return checksum to put in the header, or 0 if checking a received
+ *	segment (with its checksum in place) which is correct
+ */
+u16 tcp_checksum(struct in_addr src, struct in_addr dest,
+		 const struct tcp_hdr *tcp, int len);
+
+#endif /* __TCP_H__ */
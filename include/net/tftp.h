@@ -10,6 +10,36 @@
 #ifndef __TFTP_H__
 #define __TFTP_H__
 
+/* Well known TFTP port # */
+#define WELL_KNOWN_PORT	69
+
+/*
+ *	TFTP operations.
+ */
+#define TFTP_RRQ	1
+#define TFTP_WRQ	2
+#define TFTP_DATA	3
+#define TFTP_ACK	4
+#define TFTP_ERROR	5
+#define TFTP_OACK	6
+
+enum {
+	TFTP_ERR_UNDEFINED           = 0,
+	TFTP_ERR_FILE_NOT_FOUND      = 1,
+	TFTP_ERR_ACCESS_DENIED       = 2,
+	TFTP_ERR_DISK_FULL           = 3,
+	TFTP_ERR_UNEXPECTED_OPCODE   = 4,
+	TFTP_ERR_UNKNOWN_TRANSFER_ID  = 5,
+	TFTP_ERR_FILE_ALREADY_EXISTS = 6,
+};
+
+/* default TFTP block size, used if the server ignores our options */
+#define TFTP_BLOCK_SIZE		512
+/* largest block which fits an Ethernet frame without fragmenting */
+#define TFTP_NOFRAG_BLOCKSIZE	1468
+/* largest block size allowed by RFC 2348 */
+#define TFTP_MAX_BLOCKSIZE	65464
+
 /**********************************************************************/
 /*
  *	Global functions and variables.
@@ -127,6 +127,17 @@ void os_fd_restore(void);
  */
 void *os_malloc(size_t length);
 
+/**
+ * Acquires some memory from the underlying os, below 4GB if possible
+ *
+ * This is used for sandbox RAM, so that emulated devices which can only
+ * address 32 bits for DMA can reach it, as they can on most boards.
+ *
+ * \param length	Number of bytes to be allocated
+ * \return Pointer to length bytes or NULL on error
+ */
+void *os_malloc_low(size_t length);
+
 /**
  * Free memory previous allocated with os_malloc()/os_realloc()
  *
@@ -179,6 +179,7 @@
 /* 55-57 reserved */
 
 #define SDHCI_ADMA_ADDRESS	0x58
+#define SDHCI_ADMA_ADDRESS_HI	0x5C
 
 /* 60-FB reserved */
 
@@ -215,6 +216,12 @@
 #define SDHCI_QUIRK_NO_SIMULT_VDD_AND_POWER (1 << 7)
 #define SDHCI_QUIRK_USE_WIDE8		(1 << 8)
 
+/*
+ * host flags
+ */
+#define SDHCI_USE_ADMA		(1 << 0)	/* ADMA2 descriptors are used */
+#define SDHCI_USE_ADMA64	(1 << 1)	/* ... with 64-bit addresses */
+
 /* to make gcc happy */
 struct sdhci_host;
 
@@ -223,6 +230,35 @@ struct sdhci_host;
  */
 #define SDHCI_DEFAULT_BOUNDARY_SIZE	(512 * 1024)
 #define SDHCI_DEFAULT_BOUNDARY_ARG	(7)
+
+/*
+ * ADMA2 descriptor. The 32-bit form is the first 8 bytes of this, the 64-bit
+ * form all 12. Each descriptor moves up to SDHCI_ADMA_MAX_LEN bytes, which
+ * must start on a 4-byte boundary.
+ */
+struct sdhci_adma_desc {
+	__le16 attr;
+	__le16 len;
+	__le32 addr_lo;
+	__le32 addr_hi;
+} __packed;
+
+#define SDHCI_ADMA_DESC_32_SZ	8
+#define SDHCI_ADMA_DESC_64_SZ	12
+#define SDHCI_ADMA_MAX_LEN	65532
+#define SDHCI_ADMA_ALIGN_MASK	0x3
+#define SDHCI_ADMA_TABLE_ENTRIES	\
+	DIV_ROUND_UP(CONFIG_SYS_MMC_MAX_BLK_COUNT * MMC_MAX_BLOCK_LEN, \
+		     SDHCI_ADMA_MAX_LEN)
+
+#define  SDHCI_ADMA_VALID	0x0001
+#define  SDHCI_ADMA_END		0x0002
+#define  SDHCI_ADMA_INT		0x0004
+#define  SDHCI_ADMA_ACT_MASK	0x0030
+#define  SDHCI_ADMA_ACT_NOP	0x0000
+#define  SDHCI_ADMA_ACT_TRAN	0x0020
+#define  SDHCI_ADMA_ACT_LINK	0x0030
+
 struct sdhci_ops {
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
 	u32             (*read_l)(struct sdhci_host *host, int reg);
@@ -238,6 +274,7 @@ struct sdhci_host {
 	const char *name;
 	void *ioaddr;
 	unsigned int quirks;
+	unsigned int flags;
 	unsigned int host_caps;
 	unsigned int version;
 	unsigned int clock;
@@ -252,6 +289,7 @@ struct sdhci_host {
 	void (*set_control_reg)(struct sdhci_host *host);
 	void (*set_clock)(int dev_index, unsigned int div);
 	uint	voltages;
+	void	*adma_desc_table;	/* ADMA2 descriptors, if SDHCI_USE_ADMA */
 
 	struct mmc_config cfg;
 };
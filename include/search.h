@@ -53,6 +53,9 @@ struct hsearch_data {
 	struct _ENTRY *table;
 	unsigned int size;
 	unsigned int filled;
+	/* Entries sorted by key, kept by hexport_r() for next time */
+	ENTRY **sorted;
+	unsigned int sorted_count;
 /*
  * Callback function which will check whether the given change for variable
  * "item" to "newval" may be applied or not, and possibly apply such change.
@@ -64,7 +67,10 @@ struct hsearch_data {
 		int flag);
 };
 
-/* Create a new hashing table which will at most contain NEL elements.  */
+/*
+ * Create a new hashing table with room for at least NEL elements. The table
+ * grows automatically as entries are added.
+ */
 extern int hcreate_r(size_t __nel, struct hsearch_data *__htab);
 
 /* Destroy current internal hashing table.  */
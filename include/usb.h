@@ -187,6 +187,24 @@ int submit_control_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 int submit_int_msg(struct usb_device *dev, unsigned long pipe, void *buffer,
 			int transfer_len, int interval);
 
+/**
+ * struct usb_bulk_xfer - one of several bulk transfers queued together
+ *
+ * @buffer:	Buffer to send or receive, DMA-aligned
+ * @length:	Length of @buffer in bytes
+ * @act_len:	Number of bytes transferred, set on completion
+ * @status:	USB_ST_... status, USB_ST_NOT_PROC if it was not carried out
+ */
+struct usb_bulk_xfer {
+	void *buffer;
+	int length;
+	int act_len;
+	unsigned long status;
+};
+
+int submit_bulk_queue(struct usb_device *dev, unsigned long pipe,
+		      struct usb_bulk_xfer *xfer, int count);
+
 #if defined CONFIG_USB_EHCI || defined CONFIG_USB_MUSB_HOST || defined(CONFIG_DM_USB)
 struct int_queue *create_int_queue(struct usb_device *dev, unsigned long pipe,
 	int queuesize, int elementsize, void *buffer, int interval);
@@ -231,6 +249,15 @@ int board_usb_cleanup(int index, enum usb_init_type init);
 int usb_stor_scan(int mode);
 int usb_stor_info(void);
 
+/**
+ * usb_stor_cache_invalidate() - Forget the USB storage devices seen so far
+ *
+ * With CONFIG_USB_STORAGE_CACHE, details of each storage device are kept
+ * across scans so that they need not be read again. This drops them, so
+ * that the next scan reads everything from the devices.
+ */
+void usb_stor_cache_invalidate(void);
+
 #endif
 
 #ifdef CONFIG_USB_HOST_ETHER
@@ -261,6 +288,8 @@ int usb_control_msg(struct usb_device *dev, unsigned int pipe,
 			void *data, unsigned short size, int timeout);
 int usb_bulk_msg(struct usb_device *dev, unsigned int pipe,
 			void *data, int len, int *actual_length, int timeout);
+int usb_bulk_queue(struct usb_device *dev, unsigned int pipe,
+		   struct usb_bulk_xfer *xfer, int count, int timeout);
 int usb_submit_int_msg(struct usb_device *dev, unsigned long pipe,
 			void *buffer, int transfer_len, int interval);
 int usb_disable_asynch(int disable);
@@ -617,11 +646,17 @@ struct usb_dev_platdata {
  *		so this will be false.
  * @companion:  True if this is a companion controller to another USB
  *		controller
+ * @scan_err:	Error from setting up the root hub in the last scan
+ * @max_xfer_size:	Largest transfer, in bytes, that the controller takes
+ *		on a bulk endpoint at once. 0 if it does not say, in which
+ *		case class drivers keep their transfers small
  */
 struct usb_bus_priv {
 	int next_addr;
 	bool desc_before_addr;
 	bool companion;
+	int scan_err;
+	size_t max_xfer_size;
 };
 
 /**
@@ -660,6 +695,20 @@ struct dm_usb_ops {
 	 */
 	int (*bulk)(struct udevice *bus, struct usb_device *udev,
 		    unsigned long pipe, void *buffer, int length);
+	/**
+	 * bulk_queue() - Send several bulk messages back to back
+	 *
+	 * Queue @count transfers on one pipe so that the controller moves
+	 * from one to the next without waiting for software. A short
+	 * transfer only ends that transfer. The act_len and status of each
+	 * are filled in, and udev->status is set to the first error.
+	 *
+	 * This is optional. Without it the transfers are sent one by one
+	 * with bulk().
+	 */
+	int (*bulk_queue)(struct udevice *bus, struct usb_device *udev,
+			  unsigned long pipe, struct usb_bulk_xfer *xfer,
+			  int count);
 	/**
 	 * interrupt() - Send an interrupt message
 	 *
@@ -860,6 +909,25 @@ bool usb_device_has_child_on_port(struct usb_device *parent, int port);
 int usb_hub_probe(struct usb_device *dev, int ifnum);
 void usb_hub_reset(void);
 
+/**
+ * usb_hub_scan_begin() - Hold back the scan of new hub ports
+ *
+ * Hubs configured after this only power their ports and add them to the scan
+ * list. This lets the ports of the root hubs of all controllers wait for
+ * power and connection at the same time.
+ */
+void usb_hub_scan_begin(void);
+
+/**
+ * usb_hub_scan_end() - Scan the ports held back since usb_hub_scan_begin()
+ *
+ * Ports are scanned together: ports on different buses are reset at the same
+ * time, and hubs that are found add their ports to the same scan.
+ *
+ * @return 0 if OK, -ve on error
+ */
+int usb_hub_scan_end(void);
+
 /**
  * legacy_hub_port_reset() - reset a port given its usb_device pointer
  *
@@ -967,7 +1035,8 @@ int usb_emul_int(struct udevice *emul, struct usb_device *udev,
 /**
  * usb_emul_find() - Find an emulator for a particular device
  *
- * Check @pipe to find a device number on bus @bus and return it.
+ * Check @pipe to find a device number on bus @bus and return it. Only
+ * emulators attached below @bus are considered.
  *
  * @bus:	USB bus (controller)
  * @pipe:	Describes pipe being used, and includes the device number
@@ -65,6 +65,9 @@ typedef struct _ENTRY {
 
 static void _hdelete(const char *key, struct hsearch_data *htab, ENTRY *ep,
 	int idx);
+static void hsort_invalidate(struct hsearch_data *htab);
+static void hsort_insert(struct hsearch_data *htab, ENTRY *ep);
+static void hsort_delete(struct hsearch_data *htab, ENTRY *ep);
 
 /*
  * hcreate()
@@ -95,6 +98,9 @@ static int isprime(unsigned int number)
  * indexing as explained in the comment for the hsearch function.
  * The contents of the table is zeroed, especially the field used
  * becomes zero.
+ *
+ * The table grows as needed (see hresize_r()), so nel is only the
+ * initial size.
  */
 
 int hcreate_r(size_t nel, struct hsearch_data *htab)
@@ -116,6 +122,8 @@ int hcreate_r(size_t nel, struct hsearch_data *htab)
 
 	htab->size = nel;
 	htab->filled = 0;
+	htab->sorted = NULL;
+	htab->sorted_count = 0;
 
 	/* allocate memory and zero out */
 	htab->table = (_ENTRY *) calloc(htab->size + 1, sizeof(_ENTRY));
@@ -156,11 +164,87 @@ void hdestroy_r(struct hsearch_data *htab)
 		}
 	}
 	free(htab->table);
+	hsort_invalidate(htab);
 
 	/* the sign for an existing table is an value != NULL in htable */
 	htab->table = NULL;
 }
 
+/*
+ * hresize()
+ */
+
+/*
+ * Compute the first hash index for a key: simply take the modul but
+ * prevent zero.
+ */
+static unsigned int hhash(const char *key, unsigned int size)
+{
+	unsigned int len = strlen(key);
+	unsigned int hval = len;
+	unsigned int count = len;
+
+	/* Compute an value for the given string. Perhaps use a better method. */
+	while (count-- > 0) {
+		hval <<= 4;
+		hval += key[count];
+	}
+
+	hval %= size;
+	if (hval == 0)
+		++hval;
+
+	return hval;
+}
+
+/*
+ * Move all entries to a new table which can hold at least nel entries.
+ * Double hashing slows down badly as the table fills up, so this is done
+ * when the table becomes three-quarters full. Since entries are re-hashed
+ * into an empty table, this also drops the markers left by deleted
+ * entries.
+ *
+ * Any ENTRY pointers into the old table become invalid.
+ */
+static int hresize_r(struct hsearch_data *htab, size_t nel)
+{
+	struct hsearch_data new = { .table = NULL };
+	unsigned int i;
+
+	debug("hresize: %d entries, size %d -> %lu\n", htab->filled,
+	      htab->size, (ulong)nel);
+	if (hcreate_r(nel, &new) == 0)
+		return 0;
+
+	for (i = 1; i <= htab->size; ++i) {
+		_ENTRY *old = &htab->table[i];
+		unsigned int hval, hval2, idx;
+
+		if (old->used <= 0)
+			continue;
+
+		/* Same probe sequence as hsearch_r(), but no need to compare */
+		hval = hhash(old->entry.key, new.size);
+		hval2 = 1 + hval % (new.size - 2);
+		idx = hval;
+		while (new.table[idx].used) {
+			if (idx <= hval2)
+				idx = new.size + idx - hval2;
+			else
+				idx -= hval2;
+		}
+		new.table[idx].used = hval;
+		new.table[idx].entry = old->entry;
+	}
+
+	free(htab->table);
+	hsort_invalidate(htab);
+	htab->table = new.table;
+	htab->size = new.size;
+
+	return 1;
+}
+
 /*
  * hsearch()
  */
@@ -242,14 +326,25 @@ static inline int _compare_and_overwrite_entry(ENTRY item, ACTION action,
 			}
 
 			/* If there is a callback, call it */
-			if (htab->table[idx].entry.callback &&
-			    htab->table[idx].entry.callback(item.key,
-			    item.data, env_op_overwrite, flag)) {
-				debug("callback() rejected setting variable "
-					"%s, skipping it!\n", item.key);
-				__set_errno(EINVAL);
-				*retval = NULL;
-				return 0;
+			if (htab->table[idx].entry.callback) {
+				_ENTRY *table = htab->table;
+				int ret;
+
+				ret = htab->table[idx].entry.callback(item.key,
+					item.data, env_op_overwrite, flag);
+
+				/* It may have added variables, moving ours */
+				if (htab->table != table)
+					idx = hsearch_r(item, FIND, retval,
+							htab, 0);
+				if (ret) {
+					debug("callback() rejected setting "
+					      "variable %s, skipping it!\n",
+					      item.key);
+					__set_errno(EINVAL);
+					*retval = NULL;
+					return 0;
+				}
 			}
 
 			free(htab->table[idx].entry.data);
@@ -272,27 +367,17 @@ int hsearch_r(ENTRY item, ACTION action, ENTRY ** retval,
 	      struct hsearch_data *htab, int flag)
 {
 	unsigned int hval;
-	unsigned int count;
-	unsigned int len = strlen(item.key);
 	unsigned int idx;
 	unsigned int first_deleted = 0;
+	_ENTRY *table;
 	int ret;
 
-	/* Compute an value for the given string. Perhaps use a better method. */
-	hval = len;
-	count = len;
-	while (count-- > 0) {
-		hval <<= 4;
-		hval += item.key[count];
-	}
+	/* Make room before the table gets too full; carry on if we can't */
+	if (action == ENTER && htab->filled >= htab->size / 4 * 3)
+		hresize_r(htab, htab->size * 2);
 
-	/*
-	 * First hash function:
-	 * simply take the modul but prevent zero.
-	 */
-	hval %= htab->size;
-	if (hval == 0)
-		++hval;
+	/* First hash function */
+	hval = hhash(item.key, htab->size);
 
 	/* The first index tried. */
 	idx = hval;
@@ -393,19 +478,28 @@ int hsearch_r(ENTRY item, ACTION action, ENTRY ** retval,
 		}
 
 		/* If there is a callback, call it */
-		if (htab->table[idx].entry.callback &&
-		    htab->table[idx].entry.callback(item.key, item.data,
-		    env_op_create, flag)) {
-			debug("callback() rejected setting variable "
-				"%s, skipping it!\n", item.key);
-			_hdelete(item.key, htab, &htab->table[idx].entry, idx);
-			__set_errno(EINVAL);
-			*retval = NULL;
-			return 0;
+		if (htab->table[idx].entry.callback) {
+			table = htab->table;
+			ret = htab->table[idx].entry.callback(item.key,
+				item.data, env_op_create, flag);
+
+			/* It may have added variables, moving ours */
+			if (htab->table != table)
+				idx = hsearch_r(item, FIND, retval, htab, 0);
+			if (ret) {
+				debug("callback() rejected setting variable "
+					"%s, skipping it!\n", item.key);
+				_hdelete(item.key, htab,
+					 &htab->table[idx].entry, idx);
+				__set_errno(EINVAL);
+				*retval = NULL;
+				return 0;
+			}
 		}
 
 		/* return new entry */
 		*retval = &htab->table[idx].entry;
+		hsort_insert(htab, *retval);
 		return 1;
 	}
 
@@ -430,6 +524,7 @@ static void _hdelete(const char *key, struct hsearch_data *htab, ENTRY *ep,
 {
 	/* free used ENTRY */
 	debug("hdelete: DELETING key \"%s\"\n", key);
+	hsort_delete(htab, ep);
 	free((void *)ep->key);
 	free(ep->data);
 	ep->callback = NULL;
@@ -477,6 +572,73 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
 	return 1;
 }
 
+/*
+ * hsort()
+ */
+
+/*
+ * A list of all entries sorted by key is built by hexport_r() and kept
+ * for next time, since the environment is usually exported (saveenv,
+ * printenv) many more times than variables are created or deleted. The
+ * list is updated as entries are added and deleted, and is dropped when
+ * the table is resized, since that moves the entries.
+ */
+
+static void hsort_invalidate(struct hsearch_data *htab)
+{
+	free(htab->sorted);
+	htab->sorted = NULL;
+	htab->sorted_count = 0;
+}
+
+/* Find the position of a key in the sorted list, or where it would go */
+static unsigned int hsort_find(struct hsearch_data *htab, const char *key)
+{
+	unsigned int low = 0, high = htab->sorted_count;
+
+	while (low < high) {
+		unsigned int mid = (low + high) / 2;
+
+		if (strcmp(htab->sorted[mid]->key, key) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static void hsort_insert(struct hsearch_data *htab, ENTRY *ep)
+{
+	unsigned int pos;
+
+	if (!htab->sorted)
+		return;
+
+	/* The list has room for every slot in the table */
+	pos = hsort_find(htab, ep->key);
+	memmove(&htab->sorted[pos + 1], &htab->sorted[pos],
+		(htab->sorted_count - pos) * sizeof(ENTRY *));
+	htab->sorted[pos] = ep;
+	htab->sorted_count++;
+}
+
+static void hsort_delete(struct hsearch_data *htab, ENTRY *ep)
+{
+	unsigned int pos;
+
+	if (!htab->sorted)
+		return;
+
+	/* A rejected new entry is deleted before it is added to the list */
+	pos = hsort_find(htab, ep->key);
+	if (pos == htab->sorted_count || htab->sorted[pos] != ep)
+		return;
+	htab->sorted_count--;
+	memmove(&htab->sorted[pos], &htab->sorted[pos + 1],
+		(htab->sorted_count - pos) * sizeof(ENTRY *));
+}
+
 /*
  * hexport()
  */
@@ -587,11 +749,32 @@ static int match_entry(ENTRY *ep, int flag,
 	return 0;
 }
 
+/* Build the sorted list of entries, if we do not already have it */
+static int hsort_build(struct hsearch_data *htab)
+{
+	int i, n;
+
+	if (htab->sorted)
+		return 0;
+
+	htab->sorted = malloc(htab->size * sizeof(ENTRY *));
+	if (!htab->sorted)
+		return -ENOMEM;
+	for (i = 1, n = 0; i <= htab->size; ++i) {
+		if (htab->table[i].used > 0)
+			htab->sorted[n++] = &htab->table[i].entry;
+	}
+	qsort(htab->sorted, n, sizeof(ENTRY *), cmpkey);
+	htab->sorted_count = n;
+
+	return 0;
+}
+
 ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		 char **resp, size_t size,
 		 int argc, char * const argv[])
 {
-	ENTRY *list[htab->size];
+	ENTRY **list;
 	char *res, *p;
 	size_t totlen;
 	int i, n;
@@ -604,61 +787,67 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 
 	debug("EXPORT  table = %p, htab.size = %d, htab.filled = %d, size = %lu\n",
 	      htab, htab->size, htab->filled, (ulong)size);
+
+	if (hsort_build(htab)) {
+		__set_errno(ENOMEM);
+		return (-1);
+	}
+	list = malloc((htab->sorted_count + 1) * sizeof(ENTRY *));
+	if (!list) {
+		__set_errno(ENOMEM);
+		return (-1);
+	}
+
 	/*
 	 * Pass 1:
-	 * search used entries,
+	 * search used entries (already sorted by key),
 	 * save addresses and compute total length
 	 */
-	for (i = 1, n = 0, totlen = 0; i <= htab->size; ++i) {
+	for (i = 0, n = 0, totlen = 0; i < htab->sorted_count; ++i) {
+		ENTRY *ep = htab->sorted[i];
+		int found = match_entry(ep, flag, argc, argv);
 
-		if (htab->table[i].used > 0) {
-			ENTRY *ep = &htab->table[i].entry;
-			int found = match_entry(ep, flag, argc, argv);
-
-			if ((argc > 0) && (found == 0))
-				continue;
+		if ((argc > 0) && (found == 0))
+			continue;
 
-			if ((flag & H_HIDE_DOT) && ep->key[0] == '.')
-				continue;
+		if ((flag & H_HIDE_DOT) && ep->key[0] == '.')
+			continue;
 
-			list[n++] = ep;
+		list[n++] = ep;
 
-			totlen += strlen(ep->key) + 2;
+		totlen += strlen(ep->key) + 2;
 
-			if (sep == '\0') {
-				totlen += strlen(ep->data);
-			} else {	/* check if escapes are needed */
-				char *s = ep->data;
+		if (sep == '\0') {
+			totlen += strlen(ep->data);
+		} else {	/* check if escapes are needed */
+			char *s = ep->data;
 
-				while (*s) {
+			while (*s) {
+				++totlen;
+				/* add room for needed escape chars */
+				if ((*s == sep) || (*s == '\\'))
 					++totlen;
-					/* add room for needed escape chars */
-					if ((*s == sep) || (*s == '\\'))
-						++totlen;
-					++s;
-				}
+				++s;
 			}
-			totlen += 2;	/* for '=' and 'sep' char */
 		}
+		totlen += 2;	/* for '=' and 'sep' char */
 	}
 
 #ifdef DEBUG
-	/* Pass 1a: print unsorted list */
-	printf("Unsorted: n=%d\n", n);
+	/* Pass 1a: print sorted list */
+	printf("Sorted: n=%d\n", n);
 	for (i = 0; i < n; ++i) {
 		printf("\t%3d: %p ==> %-10s => %s\n",
 		       i, list[i], list[i]->key, list[i]->data);
 	}
 #endif
 
-	/* Sort list by keys */
-	qsort(list, n, sizeof(ENTRY *), cmpkey);
-
 	/* Check if the user supplied buffer size is sufficient */
 	if (size) {
 		if (size < totlen + 1) {	/* provided buffer too small */
 			printf("Env export buffer too small: %lu, but need %lu\n",
 			       (ulong)size, (ulong)totlen + 1);
+			free(list);
 			__set_errno(ENOMEM);
 			return (-1);
 		}
@@ -675,6 +864,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		/* no, allocate and clear one */
 		*resp = res = calloc(1, size);
 		if (res == NULL) {
+			free(list);
 			__set_errno(ENOMEM);
 			return (-1);
 		}
@@ -701,6 +891,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		*p++ = sep;
 	}
 	*p = '\0';		/* terminate result */
+	free(list);
 
 	return size;
 }
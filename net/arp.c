@@ -38,6 +38,25 @@ int		arp_wait_try;
 static uchar   *arp_tx_packet;	/* THE ARP transmit packet */
 static uchar	arp_tx_packet_buf[PKTSIZE_ALIGN + PKTALIGN];
 
+#ifdef CONFIG_NET_ARP_CACHE
+/**
+ * struct arp_entry - a MAC address learned from ARP
+ *
+ * @ip:		IP address, or 0 if the entry is not in use
+ * @ethaddr:	MAC address for @ip
+ * @dev_index:	Ethernet device over which it was learned
+ * @time:	When it was last confirmed (from get_timer())
+ */
+struct arp_entry {
+	struct in_addr ip;
+	uchar ethaddr[ARP_HLEN];
+	int dev_index;
+	ulong time;
+};
+
+static struct arp_entry arp_cache[CONFIG_NET_ARP_CACHE_SIZE];
+#endif
+
 void arp_init(void)
 {
 	/* XXX problem with bss workaround */
@@ -79,10 +98,16 @@ void arp_raw_request(struct in_addr source_ip, const uchar *target_ethaddr,
 	net_send_packet(arp_tx_packet, eth_hdr_size + ARP_HDR_SIZE);
 }
 
+/* Check whether @ip must be reached through the gateway */
+static bool arp_is_remote(struct in_addr ip)
+{
+	return (ip.s_addr & net_netmask.s_addr) !=
+		(net_ip.s_addr & net_netmask.s_addr);
+}
+
 void arp_request(void)
 {
-	if ((net_arp_wait_packet_ip.s_addr & net_netmask.s_addr) !=
-	    (net_ip.s_addr & net_netmask.s_addr)) {
+	if (arp_is_remote(net_arp_wait_packet_ip)) {
 		if (net_gateway.s_addr == 0) {
 			puts("## Warning: gatewayip needed but not set\n");
 			net_arp_wait_reply_ip = net_arp_wait_packet_ip;
@@ -96,6 +121,73 @@ void arp_request(void)
 	arp_raw_request(net_ip, net_null_ethaddr, net_arp_wait_reply_ip);
 }
 
+#ifdef CONFIG_NET_ARP_CACHE
+static struct arp_entry *arp_cache_find(struct in_addr ip)
+{
+	int dev_index = eth_get_dev_index();
+	int i;
+
+	for (i = 0; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+		if (arp_cache[i].ip.s_addr == ip.s_addr &&
+		    arp_cache[i].dev_index == dev_index)
+			return &arp_cache[i];
+	}
+
+	return NULL;
+}
+
+/* Remember @ethaddr for @ip, replacing the oldest entry if full */
+static void arp_cache_add(struct in_addr ip, const uchar *ethaddr)
+{
+	struct arp_entry *entry;
+	int i;
+
+	if (!ip.s_addr || !is_valid_ethaddr(ethaddr))
+		return;
+	entry = arp_cache_find(ip);
+	if (!entry) {
+		/* An unused entry has a time of 0, so is oldest of all */
+		entry = &arp_cache[0];
+		for (i = 1; i < CONFIG_NET_ARP_CACHE_SIZE; i++) {
+			if (get_timer(arp_cache[i].time) >
+			    get_timer(entry->time))
+				entry = &arp_cache[i];
+		}
+	}
+	debug_cond(DEBUG_DEV_PKT, "ARP cache: %pI4 is %pM\n", &ip, ethaddr);
+
+	entry->ip = ip;
+	memcpy(entry->ethaddr, ethaddr, ARP_HLEN);
+	entry->dev_index = eth_get_dev_index();
+	entry->time = get_timer(0);
+}
+
+int arp_cache_lookup(struct in_addr dest, uchar *ethaddr)
+{
+	struct arp_entry *entry;
+
+	if (arp_is_remote(dest) && net_gateway.s_addr)
+		dest = net_gateway;
+	entry = arp_cache_find(dest);
+	if (!entry)
+		return -ENOENT;
+	if (get_timer(entry->time) > CONFIG_NET_ARP_CACHE_TIMEOUT * 1000UL) {
+		entry->ip.s_addr = 0;
+		return -ETIMEDOUT;
+	}
+	memcpy(ethaddr, entry->ethaddr, ARP_HLEN);
+
+	return 0;
+}
+
+void arp_cache_flush(void)
+{
+	memset(arp_cache, '\0', sizeof(arp_cache));
+}
+#else
+static inline void arp_cache_add(struct in_addr ip, const uchar *ethaddr) {}
+#endif
+
 int arp_timeout_check(void)
 {
 	ulong t;
@@ -161,6 +253,9 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 
 	switch (ntohs(arp->ar_op)) {
 	case ARPOP_REQUEST:
+		/* the sender will probably talk to us next (RFC 826) */
+		arp_cache_add(net_read_ip(&arp->ar_spa), &arp->ar_sha);
+
 		/* reply with our IP address */
 		debug_cond(DEBUG_DEV_PKT, "Got ARP REQUEST, return our IP\n");
 		pkt = (uchar *)et;
@@ -213,6 +308,7 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 			if (arp_wait_packet_ethaddr != NULL)
 				memcpy(arp_wait_packet_ethaddr,
 				       &arp->ar_sha, ARP_HLEN);
+			arp_cache_add(reply_ip_addr, &arp->ar_sha);
 
 			net_get_arp_handler()((uchar *)arp, 0, reply_ip_addr,
 					      0, len);
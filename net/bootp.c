@@ -41,6 +41,14 @@
 #endif
 #define TIMEOUT_MS	((3 + (TIMEOUT_COUNT * 5)) * 1000)
 
+/*
+ * Limits on the time to wait before resending a request. The first wait is
+ * based on how long the server took to reply last time, if known.
+ */
+#define BOOTP_TIMEOUT_MIN	50
+#define BOOTP_TIMEOUT_INITIAL	250
+#define BOOTP_TIMEOUT_MAX	2000
+
 #define PORT_BOOTPS	67		/* BOOTP server UDP port */
 #define PORT_BOOTPC	68		/* BOOTP client UDP port */
 
@@ -62,16 +70,23 @@ char net_hostname[32] = {0,}; /* Our hostname */
 char net_root_path[64] = {0,}; /* Our bootpath */
 
 static ulong time_taken_max;
+/* When the last request was sent, and how long the last reply took */
+static ulong bootp_sent;
+static ulong bootp_rtt;
 
 #if defined(CONFIG_CMD_DHCP)
 static dhcp_state_t dhcp_state = INIT;
 static u32 dhcp_leasetime;
+/* Address from the last lease, requested again with DHCP INIT-REBOOT */
+static struct in_addr dhcp_lease_ip;
 static struct in_addr dhcp_server_ip;
 static u8 dhcp_option_overload;
 #define OVERLOAD_FILE 1
 #define OVERLOAD_SNAME 2
 static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			unsigned src, unsigned len);
+static void dhcp_send_request_packet(u32 *id, struct in_addr server_ip,
+				     struct in_addr requested_ip);
 
 /* For Debug */
 #if 0
@@ -115,6 +130,14 @@ static bool bootp_match_id(ulong id)
 	return false;
 }
 
+/* Note how long the server took to reply, to speed up retries next time */
+static void bootp_got_reply(void)
+{
+	if (bootp_sent)
+		bootp_rtt = get_timer(bootp_sent);
+	bootp_sent = 0;
+}
+
 static int check_reply_packet(uchar *pkt, unsigned dest, unsigned src,
 			      unsigned len)
 {
@@ -369,6 +392,7 @@ static void bootp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	if (net_read_u32((u32 *)&bp->bp_vend[0]) == htonl(BOOTP_VENDOR_MAGIC))
 		bootp_process_vendor((uchar *)&bp->bp_vend[4], len);
 
+	bootp_got_reply();
 	net_set_timeout_handler(0, (thand_f *)0);
 	bootstage_mark_name(BOOTSTAGE_ID_BOOTP_STOP, "bootp_stop");
 
@@ -395,8 +419,8 @@ static void bootp_timeout_handler(void)
 #endif
 	} else {
 		bootp_timeout *= 2;
-		if (bootp_timeout > 2000)
-			bootp_timeout = 2000;
+		if (bootp_timeout > BOOTP_TIMEOUT_MAX)
+			bootp_timeout = BOOTP_TIMEOUT_MAX;
 		net_set_timeout_handler(bootp_timeout, bootp_timeout_handler);
 		bootp_request();
 	}
@@ -487,6 +511,12 @@ static int dhcp_extended(u8 *e, int message_type, struct in_addr server_ip,
 		*e++ = tmp >> 8;
 		*e++ = tmp & 0xff;
 	}
+#if defined(CONFIG_DHCP_RAPID_COMMIT)
+	if (message_type == DHCP_DISCOVER) {
+		*e++ = 80;	/* Rapid Commit (RFC 4039) */
+		*e++ = 0;
+	}
+#endif
 #if defined(CONFIG_BOOTP_SEND_HOSTNAME)
 	hostname = getenv("hostname");
 	if (hostname) {
@@ -691,7 +721,12 @@ void bootp_reset(void)
 	bootp_num_ids = 0;
 	bootp_try = 0;
 	bootp_start = get_timer(0);
-	bootp_timeout = 250;
+	bootp_timeout = BOOTP_TIMEOUT_INITIAL;
+	/* Allow for a server which is slower than last time */
+	if (bootp_rtt)
+		bootp_timeout = clamp_t(ulong, bootp_rtt * 4,
+					BOOTP_TIMEOUT_MIN,
+					BOOTP_TIMEOUT_INITIAL);
 }
 
 void bootp_request(void)
@@ -708,7 +743,8 @@ void bootp_request(void)
 	struct in_addr bcast_ip;
 	char *ep;  /* Environment pointer */
 
-	bootstage_mark_name(BOOTSTAGE_ID_BOOTP_START, "bootp_start");
+	if (!bootp_try)
+		bootstage_mark_name(BOOTSTAGE_ID_BOOTP_START, "bootp_start");
 #if defined(CONFIG_CMD_DHCP)
 	dhcp_state = INIT;
 #endif
@@ -808,6 +844,20 @@ void bootp_request(void)
 	net_set_udp_handler(bootp_handler);
 #endif
 	net_send_packet(net_tx_packet, pktlen);
+	bootp_sent = get_timer(0);
+
+#if defined(CONFIG_CMD_DHCP) && defined(CONFIG_DHCP_LEASE_REUSE)
+	/*
+	 * Ask for our previous address at the same time (INIT-REBOOT). If
+	 * the server agrees, the offer is not needed; if it refuses or does
+	 * not reply, the discovery is already under way.
+	 */
+	dhcp_lease_ip = getenv_ip("dhcplease");
+	if (dhcp_lease_ip.s_addr) {
+		dhcp_send_request_packet(&bootp_id, zero_ip, dhcp_lease_ip);
+		dhcp_state = REBOOTING;
+	}
+#endif
 }
 
 #if defined(CONFIG_CMD_DHCP)
@@ -882,6 +932,8 @@ static void dhcp_process_options(uchar *popt, uchar *end)
 			break;
 		case 66:	/* Ignore TFTP server name */
 			break;
+		case 80:	/* Ignore Rapid Commit */
+			break;
 		case 67:	/* Bootfile option */
 			size = truncate_sz("Bootfile",
 					   sizeof(net_boot_file_name), oplen);
@@ -930,15 +982,16 @@ static void dhcp_packet_process_options(struct bootp_hdr *bp)
 	}
 }
 
-static int dhcp_message_type(unsigned char *popt)
+/* Find a DHCP option in the vendor area, returning NULL if not present */
+static unsigned char *dhcp_find_option(unsigned char *popt, int code)
 {
 	if (net_read_u32((u32 *)popt) != htonl(BOOTP_VENDOR_MAGIC))
-		return -1;
+		return NULL;
 
 	popt += 4;
 	while (*popt != 0xff) {
-		if (*popt == 53)	/* DHCP Message Type */
-			return *(popt + 2);
+		if (*popt == code)
+			return popt;
 		if (*popt == 0)	{
 			/* Pad */
 			popt += 1;
@@ -947,16 +1000,28 @@ static int dhcp_message_type(unsigned char *popt)
 			popt += *(popt + 1) + 2;
 		}
 	}
-	return -1;
+	return NULL;
 }
 
-static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
+static int dhcp_message_type(unsigned char *popt)
+{
+	popt = dhcp_find_option(popt, 53);	/* DHCP Message Type */
+
+	return popt ? *(popt + 2) : -1;
+}
+
+/*
+ * Send a DHCPREQUEST for @requested_ip with transaction ID @id. The server ID
+ * is given when accepting an offer, but not when asking for the address from
+ * an earlier lease.
+ */
+static void dhcp_send_request_packet(u32 *id, struct in_addr server_ip,
+				     struct in_addr requested_ip)
 {
 	uchar *pkt, *iphdr;
 	struct bootp_hdr *bp;
 	int pktlen, iplen, extlen;
 	int eth_hdr_size;
-	struct in_addr offered_ip;
 	struct in_addr zero_ip;
 	struct in_addr bcast_ip;
 
@@ -989,20 +1054,9 @@ static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
 	memcpy(bp->bp_chaddr, net_ethaddr, 6);
 	copy_filename(bp->bp_file, net_boot_file_name, sizeof(bp->bp_file));
 
-	/*
-	 * ID is the id of the OFFER packet
-	 */
-
-	net_copy_u32(&bp->bp_id, &bp_offer->bp_id);
-
-	/*
-	 * Copy options from OFFER packet if present
-	 */
-
-	/* Copy offered IP into the parameters request list */
-	net_copy_ip(&offered_ip, &bp_offer->bp_yiaddr);
+	net_copy_u32(&bp->bp_id, id);
 	extlen = dhcp_extended((u8 *)bp->bp_vend, DHCP_REQUEST,
-		dhcp_server_ip, offered_ip);
+		server_ip, requested_ip);
 
 	iplen = BOOTP_HDR_SIZE - OPT_FIELD_SIZE + extlen;
 	pktlen = eth_hdr_size + IP_UDP_HDR_SIZE + iplen;
@@ -1016,6 +1070,29 @@ static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
 	net_send_packet(net_tx_packet, pktlen);
 }
 
+static void dhcp_bound(struct bootp_hdr *bp)
+{
+	bootp_got_reply();
+	dhcp_packet_process_options(bp);
+	/* Store net params from reply */
+	store_net_params(bp);
+	dhcp_state = BOUND;
+	printf("DHCP client bound to address %pI4 (%lu ms)\n",
+	       &net_ip, get_timer(bootp_start));
+	net_set_timeout_handler(0, (thand_f *)0);
+	bootstage_mark_name(BOOTSTAGE_ID_BOOTP_STOP, "bootp_stop");
+#if defined(CONFIG_DHCP_LEASE_REUSE)
+	if (net_ip.s_addr != dhcp_lease_ip.s_addr) {
+		char buf[16];
+
+		sprintf(buf, "%pI4", &net_ip);
+		setenv("dhcplease", buf);
+	}
+#endif
+
+	net_auto_load();
+}
+
 /*
  *	Handle DHCP received packets.
  */
@@ -1023,6 +1100,8 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
 	struct bootp_hdr *bp = (struct bootp_hdr *)pkt;
+	struct in_addr offered_ip;
+	int msg_type;
 
 	debug("DHCPHandler: got packet: (src=%d, dst=%d, len=%d) state: %d\n",
 	      src, dest, len, dhcp_state);
@@ -1034,11 +1113,41 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	debug("DHCPHandler: got DHCP packet: (src=%d, dst=%d, len=%d) state: "
 	      "%d\n", src, dest, len, dhcp_state);
 
+	msg_type = dhcp_message_type((u8 *)bp->bp_vend);
+	if (msg_type == DHCP_NAK && dhcp_state == REBOOTING) {
+		/* Our old address is no good here; wait for an offer */
+		debug("DHCP: Previous address %pI4 refused\n", &dhcp_lease_ip);
+		setenv("dhcplease", NULL);
+		dhcp_lease_ip.s_addr = 0;
+		dhcp_state = SELECTING;
+		return;
+	}
+
 	if (net_read_ip(&bp->bp_yiaddr).s_addr == 0)
 		return;
 
 	switch (dhcp_state) {
+	case REBOOTING:
+		debug("DHCP State: REBOOTING\n");
+
+		/* The server agreed that we can keep our old address */
+		if (msg_type == DHCP_ACK) {
+			efi_net_set_dhcp_ack(pkt, len);
+			dhcp_bound(bp);
+			return;
+		}
+		/* Otherwise this is an offer in reply to the discovery */
+		/* Fall through */
 	case SELECTING:
+#if defined(CONFIG_DHCP_RAPID_COMMIT)
+		/* The server skipped the offer (RFC 4039) */
+		if (msg_type == DHCP_ACK &&
+		    dhcp_find_option((u8 *)bp->bp_vend, 80)) {
+			efi_net_set_dhcp_ack(pkt, len);
+			dhcp_bound(bp);
+			return;
+		}
+#endif
 		/*
 		 * Wait an appropriate time for any potential DHCPOFFER packets
 		 * to arrive.  Then select one, and generate DHCPREQUEST
@@ -1056,9 +1165,14 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 			debug("TRANSITIONING TO REQUESTING STATE\n");
 			dhcp_state = REQUESTING;
+			bootp_got_reply();
+			bootstage_mark_name(BOOTSTAGE_ID_DHCP_OFFER,
+					    "dhcp_offer");
 
 			net_set_timeout_handler(5000, bootp_timeout_handler);
-			dhcp_send_request_packet(bp);
+			net_copy_ip(&offered_ip, &bp->bp_yiaddr);
+			dhcp_send_request_packet(&bp->bp_id, dhcp_server_ip,
+						 offered_ip);
 #ifdef CONFIG_SYS_BOOTFILE_PREFIX
 		}
 #endif	/* CONFIG_SYS_BOOTFILE_PREFIX */
@@ -1068,18 +1182,8 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	case REQUESTING:
 		debug("DHCP State: REQUESTING\n");
 
-		if (dhcp_message_type((u8 *)bp->bp_vend) == DHCP_ACK) {
-			dhcp_packet_process_options(bp);
-			/* Store net params from reply */
-			store_net_params(bp);
-			dhcp_state = BOUND;
-			printf("DHCP client bound to address %pI4 (%lu ms)\n",
-			       &net_ip, get_timer(bootp_start));
-			net_set_timeout_handler(0, (thand_f *)0);
-			bootstage_mark_name(BOOTSTAGE_ID_BOOTP_STOP,
-					    "bootp_stop");
-
-			net_auto_load();
+		if (msg_type == DHCP_ACK) {
+			dhcp_bound(bp);
 			return;
 		}
 		break;
@@ -11,27 +11,116 @@
 #include <common.h>
 #include <net.h>
 
+/*
+ * The one's complement sum does not depend on the order in which words are
+ * added, nor on their size, as long as carries are added back in at the
+ * end. So add 32-bit words into a 64-bit accumulator, which cannot
+ * overflow for any packet, and fold it down to 16 bits afterwards. Words
+ * are added in memory order, so the result works on either endianness.
+ */
+static unsigned ip_checksum_fold(u64 sum)
+{
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum & 0xffff;
+}
+
+/* Add the final odd byte, as if it were followed by a zero byte */
+static u64 ip_checksum_odd(u64 sum, u8 byte)
+{
+	union {
+		u8 b[2];
+		u16 h;
+	} odd = { .b = { byte, 0 } };
+
+	return sum + odd.h;
+}
+
 unsigned compute_ip_checksum(const void *vptr, unsigned nbytes)
 {
-	int sum, oddbyte;
-	const unsigned short *ptr = vptr;
+	const u8 *ptr = vptr;
+	const u32 *p32;
+	u64 sum = 0;
 
-	sum = 0;
-	while (nbytes > 1) {
-		sum += *ptr++;
+	if (nbytes >= 2 && ((ulong)ptr & 2)) {
+		sum += *(const u16 *)ptr;
+		ptr += 2;
 		nbytes -= 2;
 	}
-	if (nbytes == 1) {
-		oddbyte = 0;
-		((u8 *)&oddbyte)[0] = *(u8 *)ptr;
-		((u8 *)&oddbyte)[1] = 0;
-		sum += oddbyte;
+	for (p32 = (const u32 *)ptr; nbytes >= 16; p32 += 4, nbytes -= 16) {
+		sum += p32[0];
+		sum += p32[1];
+		sum += p32[2];
+		sum += p32[3];
+	}
+	for (; nbytes >= 4; nbytes -= 4)
+		sum += *p32++;
+	ptr = (const u8 *)p32;
+	if (nbytes >= 2) {
+		sum += *(const u16 *)ptr;
+		ptr += 2;
+		nbytes -= 2;
+	}
+	if (nbytes)
+		sum = ip_checksum_odd(sum, *ptr);
+
+	return ip_checksum_fold(sum);
+}
+
+unsigned compute_ip_checksum_copy(void *vdest, const void *vsrc,
+				  unsigned nbytes)
+{
+	const u16 *src = vsrc;
+	u16 *dest = vdest;
+	u32 *d32;
+	u64 sum = 0;
+
+	if (nbytes >= 2 && ((ulong)dest & 2)) {
+		sum += *dest++ = *src++;
+		nbytes -= 2;
+	}
+
+	/* Stores are now aligned; loads are too if src is in step */
+	d32 = (u32 *)dest;
+	if (!((ulong)src & 2)) {
+		const u32 *s32 = (const u32 *)src;
+
+		for (; nbytes >= 16; nbytes -= 16, d32 += 4, s32 += 4) {
+			sum += d32[0] = s32[0];
+			sum += d32[1] = s32[1];
+			sum += d32[2] = s32[2];
+			sum += d32[3] = s32[3];
+		}
+		for (; nbytes >= 4; nbytes -= 4)
+			sum += *d32++ = *s32++;
+		src = (const u16 *)s32;
+	} else {
+		union {
+			u16 h[2];
+			u32 w;
+		} val;
+
+		for (; nbytes >= 4; nbytes -= 4, src += 2) {
+			val.h[0] = src[0];
+			val.h[1] = src[1];
+			sum += *d32++ = val.w;
+		}
+	}
+	dest = (u16 *)d32;
+
+	if (nbytes >= 2) {
+		sum += *dest++ = *src++;
+		nbytes -= 2;
+	}
+	if (nbytes) {
+		*(u8 *)dest = *(const u8 *)src;
+		sum = ip_checksum_odd(sum, *(const u8 *)src);
 	}
-	sum = (sum >> 16) + (sum & 0xffff);
-	sum += (sum >> 16);
-	sum = ~sum & 0xffff;
 
-	return sum;
+	return ip_checksum_fold(sum);
 }
 
 unsigned add_ip_checksums(unsigned offset, unsigned sum, unsigned new)
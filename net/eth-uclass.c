@@ -303,14 +303,37 @@ int eth_init(void)
 void eth_halt(void)
 {
 	struct udevice *current;
-	struct eth_device_priv *priv;
 
 	current = eth_get_dev();
 	if (!current || !device_active(current))
 		return;
 
-	eth_get_ops(current)->stop(current);
-	priv = current->uclass_priv;
+	eth_stop_dev(current);
+}
+
+int eth_start_dev(struct udevice *dev)
+{
+	struct eth_device_priv *priv;
+	int ret;
+
+	ret = device_probe(dev);
+	if (ret)
+		return ret;
+	ret = eth_get_ops(dev)->start(dev);
+	if (ret < 0)
+		return ret;
+	priv = dev->uclass_priv;
+	priv->state = ETH_STATE_ACTIVE;
+
+	return 0;
+}
+
+void eth_stop_dev(struct udevice *dev)
+{
+	struct eth_device_priv *priv;
+
+	eth_get_ops(dev)->stop(dev);
+	priv = dev->uclass_priv;
 	priv->state = ETH_STATE_PASSIVE;
 }
 
@@ -345,14 +368,76 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
-int eth_rx(void)
+/* Receive packets one at a time with recv() */
+static int eth_rx_single(struct udevice *current, int budget)
 {
-	struct udevice *current;
+	struct eth_ops *ops = eth_get_ops(current);
 	uchar *packet;
 	int flags;
 	int ret;
 	int i;
 
+	flags = ETH_RECV_CHECK_DEVICE;
+	for (i = 0; i < budget; i++) {
+		ret = ops->recv(current, flags, &packet);
+		flags = 0;
+		if (ret > 0)
+			net_process_received_packet(packet, ret);
+		if (ret >= 0 && ops->free_pkt)
+			ops->free_pkt(current, packet, ret);
+#ifdef CONFIG_NET_RX_DIRECT
+		if (ret > 0)
+			net_put_rx_buffer(packet);
+#endif
+		if (ret <= 0)
+			return ret < 0 ? ret : i;
+	}
+
+	return i;
+}
+
+/* Receive packets in batches with recv_batch() */
+static int eth_rx_batch(struct udevice *current, int budget)
+{
+	struct eth_ops *ops = eth_get_ops(current);
+	struct eth_pkt pkts[ETH_RX_BATCH];
+	int flags;
+	int count;
+	int ret;
+	int i;
+
+	flags = ETH_RECV_CHECK_DEVICE;
+	for (count = 0; count < budget; count += ret) {
+		ret = ops->recv_batch(current, flags, pkts,
+				      min(budget - count, ETH_RX_BATCH));
+		flags = 0;
+		if (ret <= 0)
+			return ret < 0 ? ret : count;
+
+		for (i = 0; i < ret; i++)
+			net_process_received_packet(pkts[i].packet,
+						    pkts[i].length);
+		if (ops->free_batch) {
+			ops->free_batch(current, pkts, ret);
+		} else if (ops->free_pkt) {
+			for (i = 0; i < ret; i++)
+				ops->free_pkt(current, pkts[i].packet,
+					      pkts[i].length);
+		}
+#ifdef CONFIG_NET_RX_DIRECT
+		for (i = 0; i < ret; i++)
+			net_put_rx_buffer(pkts[i].packet);
+#endif
+	}
+
+	return count;
+}
+
+int eth_rx(void)
+{
+	struct udevice *current;
+	int ret;
+
 	current = eth_get_dev();
 	if (!current)
 		return -ENODEV;
@@ -360,18 +445,11 @@ int eth_rx(void)
 	if (!device_active(current))
 		return -EINVAL;
 
-	/* Process up to 32 packets at one time */
-	flags = ETH_RECV_CHECK_DEVICE;
-	for (i = 0; i < 32; i++) {
-		ret = eth_get_ops(current)->recv(current, flags, &packet);
-		flags = 0;
-		if (ret > 0)
-			net_process_received_packet(packet, ret);
-		if (ret >= 0 && eth_get_ops(current)->free_pkt)
-			eth_get_ops(current)->free_pkt(current, packet, ret);
-		if (ret <= 0)
-			break;
-	}
+	/* Process whatever has arrived, up to CONFIG_NET_RX_BUDGET packets */
+	if (eth_get_ops(current)->recv_batch)
+		ret = eth_rx_batch(current, CONFIG_NET_RX_BUDGET);
+	else
+		ret = eth_rx_single(current, CONFIG_NET_RX_BUDGET);
 	if (ret == -EAGAIN)
 		ret = 0;
 	if (ret < 0) {
@@ -472,6 +550,10 @@ static int eth_post_probe(struct udevice *dev)
 			ops->recv += gd->reloc_off;
 		if (ops->free_pkt)
 			ops->free_pkt += gd->reloc_off;
+		if (ops->recv_batch)
+			ops->recv_batch += gd->reloc_off;
+		if (ops->free_batch)
+			ops->free_batch += gd->reloc_off;
 		if (ops->stop)
 			ops->stop += gd->reloc_off;
 #ifdef CONFIG_MCAST_TFTP
@@ -535,6 +617,9 @@ static int eth_pre_remove(struct udevice *dev)
 	/* clear the MAC address */
 	memset(pdata->enetaddr, 0, 6);
 
+	/* cached entries are for this device's index, which may be reused */
+	arp_cache_flush();
+
 	return 0;
 }
 
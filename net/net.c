@@ -87,6 +87,7 @@
 #include <environment.h>
 #include <errno.h>
 #include <net.h>
+#include <net/tcp.h>
 #include <net/tftp.h>
 #if defined(CONFIG_STATUS_LED)
 #include <miiphy.h>
@@ -107,9 +108,18 @@
 #if defined(CONFIG_CMD_SNTP)
 #include "sntp.h"
 #endif
+#if defined(CONFIG_CMD_WGET)
+#include "wget.h"
+#endif
+#if defined(CONFIG_CMD_TFTPMULTI)
+#include "tftp_multi.h"
+#endif
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* How often to check for ctrl-c while packets are being received */
+#define NET_CTRLC_POLLS		16
+
 /** BOOTP EXTENTIONS **/
 
 /* Our subnet mask (0=unknown) */
@@ -358,6 +368,12 @@ static void net_clear_handlers(void)
 static void net_cleanup_loop(void)
 {
 	net_clear_handlers();
+#ifdef CONFIG_NET_RX_DIRECT
+	net_set_rx_dest(NULL, 0, 0);
+#endif
+#if defined(CONFIG_CMD_TFTPMULTI)
+	tftp_multi_stop();
+#endif
 }
 
 void net_init(void)
@@ -394,10 +410,18 @@ void net_init(void)
 int net_loop(enum proto_t protocol)
 {
 	int ret = -EINVAL;
+	int busy_polls = 0;
+	int rx;
 
 	net_restarted = 0;
 	net_dev_exists = 0;
 	net_try_count = 1;
+#ifdef CONFIG_IP_DEFRAG
+	memset(&net_defrag_stats, '\0', sizeof(net_defrag_stats));
+#endif
+#ifdef CONFIG_NET_RX_DIRECT
+	memset(&net_rx_stats, '\0', sizeof(net_rx_stats));
+#endif
 	debug_cond(DEBUG_INT_STATE, "--- net_loop Entry\n");
 
 	bootstage_mark_name(BOOTSTAGE_ID_ETH_START, "eth_start");
@@ -508,6 +532,16 @@ restart:
 		case LINKLOCAL:
 			link_local_start();
 			break;
+#endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
+#endif
+#if defined(CONFIG_CMD_TFTPMULTI)
+		case TFTPMULTI:
+			tftp_multi_start();
+			break;
 #endif
 		default:
 			break;
@@ -546,17 +580,24 @@ restart:
 			time_start = get_timer(0);
 
 		/*
-		 *	Check the ethernet for a new packet.  The ethernet
-		 *	receive routine will process it.
-		 *	Most drivers return the most recent packet size, but not
-		 *	errors that may have happened.
+		 *	Check the ethernet for new packets.  The ethernet
+		 *	receive routine will process them.
+		 *	This returns a positive value if anything was received,
+		 *	but not errors that may have happened.
 		 */
-		eth_rx();
+#if defined(CONFIG_CMD_TFTPMULTI)
+		if (protocol == TFTPMULTI)
+			rx = tftp_multi_rx();
+		else
+#endif
+			rx = eth_rx();
 
 		/*
-		 *	Abort if ctrl-c was pressed.
+		 *	Abort if ctrl-c was pressed. Checking the console can be
+		 *	slow, so while packets keep arriving this is only done
+		 *	every NET_CTRLC_POLLS times round the loop.
 		 */
-		if (ctrlc()) {
+		if ((rx <= 0 || !(++busy_polls % NET_CTRLC_POLLS)) && ctrlc()) {
 			/* cancel any ARP that may not have completed */
 			net_arp_wait_packet_ip.s_addr = 0;
 
@@ -666,6 +707,9 @@ int net_start_again(void)
 	unsigned long retrycnt = 0;
 	int ret;
 
+	/* In case a cached MAC address is why we are starting again */
+	arp_cache_flush();
+
 	nretry = getenv("netretry");
 	if (nretry) {
 		if (!strcmp(nretry, "yes"))
@@ -777,10 +821,6 @@ void net_set_timeout_handler(ulong iv, thand_f *f)
 int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		int payload_len)
 {
-	uchar *pkt;
-	int eth_hdr_size;
-	int pkt_hdr_size;
-
 	/* make sure the net_tx_packet is initialized (net_init() was called) */
 	assert(net_tx_packet != NULL);
 	if (net_tx_packet == NULL)
@@ -790,16 +830,32 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	if (dest.s_addr == 0)
 		dest.s_addr = 0xFFFFFFFF;
 
+	net_set_udp_header(net_tx_packet + net_eth_hdr_size(), dest, dport,
+			   sport, payload_len);
+
+	return net_send_ip_packet(ether, dest, IP_UDP_HDR_SIZE + payload_len);
+}
+
+int net_send_ip_packet(uchar *ether, struct in_addr dest, int ip_len)
+{
+	uchar *pkt;
+	int eth_hdr_size;
+
+	/* make sure the net_tx_packet is initialized (net_init() was called) */
+	assert(net_tx_packet != NULL);
+	if (net_tx_packet == NULL)
+		return -1;
+
 	/* if broadcast, make the ether address a broadcast and don't do ARP */
 	if (dest.s_addr == 0xFFFFFFFF)
 		ether = (uchar *)net_bcast_ethaddr;
+	/* otherwise we may already know the MAC address from earlier */
+	else if (memcmp(ether, net_null_ethaddr, 6) == 0)
+		arp_cache_lookup(dest, ether);
 
 	pkt = (uchar *)net_tx_packet;
 
 	eth_hdr_size = net_set_ether(pkt, ether, PROT_IP);
-	pkt += eth_hdr_size;
-	net_set_udp_header(pkt, dest, dport, sport, payload_len);
-	pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
 
 	/* if MAC address was not discovered yet, do an ARP request */
 	if (memcmp(ether, net_null_ethaddr, 6) == 0) {
@@ -810,7 +866,7 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		arp_wait_packet_ethaddr = ether;
 
 		/* size of the waiting packet */
-		arp_wait_tx_packet_size = pkt_hdr_size + payload_len;
+		arp_wait_tx_packet_size = eth_hdr_size + ip_len;
 
 		/* and do the ARP request */
 		arp_wait_try = 1;
@@ -818,31 +874,31 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		arp_request();
 		return 1;	/* waiting */
 	} else {
-		debug_cond(DEBUG_DEV_PKT, "sending UDP to %pI4/%pM\n",
+		debug_cond(DEBUG_DEV_PKT, "sending IP to %pI4/%pM\n",
 			   &dest, ether);
-		net_send_packet(net_tx_packet, pkt_hdr_size + payload_len);
+		net_send_packet(net_tx_packet, eth_hdr_size + ip_len);
 		return 0;	/* transmitted */
 	}
 }
 
 #ifdef CONFIG_IP_DEFRAG
 /*
- * This function collects fragments in a single packet, according
- * to the algorithm in RFC815. It returns NULL or the pointer to
- * a complete packet, in static storage
+ * These functions collect fragments into complete packets, according
+ * to the algorithm in RFC815. Several packets can be reassembled at once,
+ * so that fragments arriving out of order or after a lost fragment do not
+ * throw away other partial packets.
  */
-#ifndef CONFIG_NET_MAXDEFRAG
-#define CONFIG_NET_MAXDEFRAG 16384
-#endif
+
 /*
- * MAXDEFRAG, above, is chosen in the config file and  is real data
+ * MAXDEFRAG is chosen in the config file and is real data
  * so we need to add the NFS overhead, which is more than TFTP.
  * To use sizeof in the internal unnamed structures, we need a real
  * instance (can't do "sizeof(struct rpc_t.u.reply))", unfortunately).
  * The compiler doesn't complain nor allocates the actual structure
  */
 static struct rpc_t rpc_specimen;
-#define IP_PKTSIZE (CONFIG_NET_MAXDEFRAG + sizeof(rpc_specimen.u.reply))
+#define IP_PKTSIZE (CONFIG_NET_MAXDEFRAG + IP_UDP_HDR_SIZE + \
+		    sizeof(rpc_specimen.u.reply))
 
 #define IP_MAXUDP (IP_PKTSIZE - IP_HDR_SIZE)
 
@@ -858,37 +914,96 @@ struct hole {
 	u16 unused;
 };
 
-static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
+/**
+ * struct defrag_slot - A packet being reassembled
+ *
+ * @pkt_buff:	IP header of the first fragment received, then the payload
+ *		(holding the hole list until it is filled in)
+ * @first_hole:	Index of the first hole in the payload
+ * @total_len:	Payload length if known, 0xffff if not, 0 if slot is free
+ * @fragments:	Number of fragments stored so far
+ * @last_used:	Sequence number of the last fragment stored, for eviction
+ * @sum:	IP checksum of the payload bytes stored so far
+ * @sum_len:	Number of bytes included in @sum
+ */
+struct defrag_slot {
+	uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
+	u16 first_hole;
+	u16 total_len;
+	u16 fragments;
+	ulong last_used;
+	u16 sum;
+	u16 sum_len;
+};
+
+static struct defrag_slot defrag_slots[CONFIG_NET_DEFRAG_SLOTS];
+static ulong defrag_seq;
+struct net_defrag_stats net_defrag_stats;
+
+/* Find the slot for a fragment, starting a new packet if needed */
+static struct defrag_slot *defrag_find_slot(struct ip_udp_hdr *ip)
 {
-	static uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
-	static u16 first_hole, total_len;
+	struct defrag_slot *slot, *victim = NULL;
+	struct ip_udp_hdr *localip;
+
+	for (slot = defrag_slots;
+	     slot < defrag_slots + CONFIG_NET_DEFRAG_SLOTS; slot++) {
+		localip = (struct ip_udp_hdr *)slot->pkt_buff;
+		if (slot->total_len && localip->ip_id == ip->ip_id &&
+		    localip->ip_src.s_addr == ip->ip_src.s_addr &&
+		    localip->ip_p == ip->ip_p)
+			return slot;
+		if (!victim || !slot->total_len ||
+		    (victim->total_len && slot->last_used < victim->last_used))
+			victim = slot;
+	}
+
+	/* new packet: use a free slot, or the one idle for longest */
+	if (victim->total_len) {
+		net_defrag_stats.evicted++;
+		net_defrag_stats.dropped += victim->fragments;
+	}
+	slot = victim;
+	slot->total_len = 0xffff;
+	slot->first_hole = 0;
+	slot->fragments = 0;
+	slot->sum = 0xffff;	/* the checksum of no data */
+	slot->sum_len = 0;
+	((struct hole *)(slot->pkt_buff + IP_HDR_SIZE))[0] = (struct hole) {
+		.last_byte = ~0,
+	};
+	/* any IP header will work, copy the first we received */
+	memcpy(slot->pkt_buff, ip, IP_HDR_SIZE);
+
+	return slot;
+}
+
+static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp,
+					    int *sump)
+{
+	struct defrag_slot *slot;
 	struct hole *payload, *thisfrag, *h, *newh;
-	struct ip_udp_hdr *localip = (struct ip_udp_hdr *)pkt_buff;
+	struct ip_udp_hdr *localip;
 	uchar *indata = (uchar *)ip;
 	int offset8, start, len, done = 0;
 	u16 ip_off = ntohs(ip->ip_off);
 
-	/* payload starts after IP header, this fragment is in there */
-	payload = (struct hole *)(pkt_buff + IP_HDR_SIZE);
+	net_defrag_stats.fragments++;
 	offset8 =  (ip_off & IP_OFFS);
-	thisfrag = payload + offset8;
 	start = offset8 * 8;
 	len = ntohs(ip->ip_len) - IP_HDR_SIZE;
 
-	if (start + len > IP_MAXUDP) /* fragment extends too far */
+	if (start + len > IP_MAXUDP) { /* fragment extends too far */
+		net_defrag_stats.dropped++;
 		return NULL;
-
-	if (!total_len || localip->ip_id != ip->ip_id) {
-		/* new (or different) packet, reset structs */
-		total_len = 0xffff;
-		payload[0].last_byte = ~0;
-		payload[0].next_hole = 0;
-		payload[0].prev_hole = 0;
-		first_hole = 0;
-		/* any IP header will work, copy the first we received */
-		memcpy(localip, ip, IP_HDR_SIZE);
 	}
 
+	slot = defrag_find_slot(ip);
+	localip = (struct ip_udp_hdr *)slot->pkt_buff;
+	/* payload starts after IP header, this fragment is in there */
+	payload = (struct hole *)(slot->pkt_buff + IP_HDR_SIZE);
+	thisfrag = payload + offset8;
+
 	/*
 	 * What follows is the reassembly algorithm. We use the payload
 	 * array as a linked list of hole descriptors, as each hole starts
@@ -896,10 +1011,11 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	 * so it is represented as byte count, not as 8-byte blocks.
 	 */
 
-	h = payload + first_hole;
+	h = payload + slot->first_hole;
 	while (h->last_byte < start) {
 		if (!h->next_hole) {
 			/* no hole that far away */
+			net_defrag_stats.dropped++;
 			return NULL;
 		}
 		h = payload + h->next_hole;
@@ -908,12 +1024,13 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	/* last fragment may be 1..7 bytes, the "+7" forces acceptance */
 	if (offset8 + ((len + 7) / 8) <= h - payload) {
 		/* no overlap with holes (dup fragment?) */
+		net_defrag_stats.dropped++;
 		return NULL;
 	}
 
 	if (!(ip_off & IP_FLAGS_MFRAG)) {
 		/* no more fragmentss: truncate this (last) hole */
-		total_len = start + len;
+		slot->total_len = start + len;
 		h->last_byte = start + len;
 	}
 
@@ -930,7 +1047,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 			done = 1;
 		} else if (!h->prev_hole) {
 			/* first hole */
-			first_hole = h->next_hole;
+			slot->first_hole = h->next_hole;
 			payload[h->next_hole].prev_hole = 0;
 		} else if (!h->next_hole) {
 			/* last hole */
@@ -955,7 +1072,7 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 		if (h->prev_hole)
 			payload[h->prev_hole].next_hole = (h - payload);
 		else
-			first_hole = (h - payload);
+			slot->first_hole = (h - payload);
 
 	} else {
 		/* fragment sits in the middle: split the hole */
@@ -968,29 +1085,49 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 			payload[newh->next_hole].prev_hole = (newh - payload);
 	}
 
-	/* finally copy this fragment and possibly return whole packet */
+	/*
+	 * finally copy this fragment and possibly return whole packet. The
+	 * payload checksum is worked out as it is copied, so that a UDP
+	 * checksum does not need another pass over the data.
+	 */
+#ifdef CONFIG_UDP_CHECKSUM
+	slot->sum = add_ip_checksums(start, slot->sum,
+			compute_ip_checksum_copy(thisfrag, indata + IP_HDR_SIZE,
+						 len));
+	slot->sum_len += len;
+#else
 	memcpy((uchar *)thisfrag, indata + IP_HDR_SIZE, len);
+#endif
+	slot->fragments++;
+	slot->last_used = ++defrag_seq;
 	if (!done)
 		return NULL;
 
-	localip->ip_len = htons(total_len);
-	*lenp = total_len + IP_HDR_SIZE;
+	/* free the slot; its contents stay valid while the packet is handled */
+	localip->ip_len = htons(slot->total_len + IP_HDR_SIZE);
+	*lenp = slot->total_len + IP_HDR_SIZE;
+	/* overlapping fragments are counted twice, so the sum is no use */
+	if (slot->sum_len == slot->total_len)
+		*sump = slot->sum;
+	slot->total_len = 0;
+	net_defrag_stats.datagrams++;
+
 	return localip;
 }
 
 static inline struct ip_udp_hdr *net_defragment(struct ip_udp_hdr *ip,
-	int *lenp)
+	int *lenp, int *sump)
 {
 	u16 ip_off = ntohs(ip->ip_off);
 	if (!(ip_off & (IP_OFFS | IP_FLAGS_MFRAG)))
 		return ip; /* not a fragment */
-	return __net_defragment(ip, lenp);
+	return __net_defragment(ip, lenp, sump);
 }
 
 #else /* !CONFIG_IP_DEFRAG */
 
 static inline struct ip_udp_hdr *net_defragment(struct ip_udp_hdr *ip,
-	int *lenp)
+	int *lenp, int *sump)
 {
 	u16 ip_off = ntohs(ip->ip_off);
 	if (!(ip_off & (IP_OFFS | IP_FLAGS_MFRAG)))
@@ -999,6 +1136,84 @@ static inline struct ip_udp_hdr *net_defragment(struct ip_udp_hdr *ip,
 }
 #endif
 
+#ifdef CONFIG_NET_RX_DIRECT
+/* Headers before the payload; NFSv3 has the most */
+#define NET_RX_STASH_SIZE	192
+/* Number of buffers which can be handed out at once */
+#define NET_RX_STASH_COUNT	2
+
+static struct net_rx_dest {
+	uchar *buf;
+	int hdr_len;
+	int size;
+} net_rx_dest;
+
+/* Bytes overwritten by the headers of a packet received in place */
+static struct net_rx_stash {
+	uchar *pkt;
+	int len;
+	uchar save[NET_RX_STASH_SIZE];
+} net_rx_stash[NET_RX_STASH_COUNT];
+
+struct net_rx_stats net_rx_stats;
+
+void net_set_rx_dest(void *buf, int hdr_len, int size)
+{
+	if (hdr_len > NET_RX_STASH_SIZE)
+		buf = NULL;
+	net_rx_dest.buf = buf;
+	net_rx_dest.hdr_len = hdr_len;
+	net_rx_dest.size = size;
+}
+
+uchar *net_get_rx_buffer(int len)
+{
+	struct net_rx_stash *stash, *slot = NULL;
+	uchar *pkt;
+	int i;
+
+	if (!net_rx_dest.buf || len > net_rx_dest.hdr_len + net_rx_dest.size)
+		return NULL;
+	pkt = net_rx_dest.buf - net_rx_dest.hdr_len;
+	for (i = 0, stash = net_rx_stash; i < NET_RX_STASH_COUNT;
+	     i++, stash++) {
+		/*
+		 * A packet still being processed may sit in the same place,
+		 * e.g. a reply which carried no data. Its saved bytes would
+		 * be restored over the new packet, so don't reuse it.
+		 */
+		if (stash->pkt == pkt)
+			return NULL;
+		if (!stash->pkt && !slot)
+			slot = stash;
+	}
+	if (!slot)
+		return NULL;
+
+	slot->pkt = pkt;
+	slot->len = net_rx_dest.hdr_len;
+	memcpy(slot->save, pkt, slot->len);
+	/* each destination is good for one packet */
+	net_rx_dest.buf = NULL;
+
+	return pkt;
+}
+
+void net_put_rx_buffer(uchar *pkt)
+{
+	struct net_rx_stash *stash;
+	int i;
+
+	for (i = 0, stash = net_rx_stash; i < NET_RX_STASH_COUNT;
+	     i++, stash++) {
+		if (stash->pkt == pkt) {
+			memcpy(pkt, stash->save, stash->len);
+			stash->pkt = NULL;
+		}
+	}
+}
+#endif
+
 /**
  * Receive an ICMP packet. We deal with REDIRECT and PING here, and silently
  * drop others.
@@ -1032,6 +1247,44 @@ static void receive_icmp(struct ip_udp_hdr *ip, int len,
 	}
 }
 
+#ifdef CONFIG_UDP_CHECKSUM
+/*
+ * Check the UDP checksum of a received datagram. @sum is the checksum of
+ * the UDP header and data if it was worked out while reassembling the
+ * datagram, else -1.
+ */
+static bool udp_checksum_ok(struct ip_udp_hdr *ip, int sum)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dest;
+		u8 zero;
+		u8 proto;
+		__be16 len;
+	} __attribute__((packed)) pseudo;
+	int ip_len = ntohs(ip->ip_len) - IP_HDR_SIZE;
+	int len = ntohs(ip->udp_len);
+	unsigned total;
+
+	if (len < UDP_HDR_SIZE || len > ip_len)
+		return false;
+	if (sum < 0 || len != ip_len)
+		sum = compute_ip_checksum(&ip->udp_src, len);
+
+	pseudo.src = net_read_ip(&ip->ip_src);
+	pseudo.dest = net_read_ip(&ip->ip_dst);
+	pseudo.zero = 0;
+	pseudo.proto = IPPROTO_UDP;
+	pseudo.len = ip->udp_len;
+	total = add_ip_checksums(sizeof(pseudo),
+				 compute_ip_checksum(&pseudo, sizeof(pseudo)),
+				 sum);
+
+	/* The sum including the checksum itself must be zero */
+	return total == 0 || total == 0xffff;
+}
+#endif
+
 void net_process_received_packet(uchar *in_packet, int len)
 {
 	struct ethernet_hdr *et;
@@ -1039,6 +1292,7 @@ void net_process_received_packet(uchar *in_packet, int len)
 	struct in_addr dst_ip;
 	struct in_addr src_ip;
 	int eth_proto;
+	int udp_sum = -1;
 #if defined(CONFIG_CMD_CDP)
 	int iscdp;
 #endif
@@ -1187,7 +1441,7 @@ void net_process_received_packet(uchar *in_packet, int len)
 		 * a fragment, and either the complete packet or NULL if
 		 * it is a fragment (if !CONFIG_IP_DEFRAG, it returns NULL)
 		 */
-		ip = net_defragment(ip, &len);
+		ip = net_defragment(ip, &len, &udp_sum);
 		if (!ip)
 			return;
 		/*
@@ -1214,6 +1468,11 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#ifdef CONFIG_PROT_TCP
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive(ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1223,44 +1482,10 @@ void net_process_received_packet(uchar *in_packet, int len)
 			   &dst_ip, &src_ip, len);
 
 #ifdef CONFIG_UDP_CHECKSUM
-		if (ip->udp_xsum != 0) {
-			ulong   xsum;
-			ushort *sumptr;
-			ushort  sumlen;
-
-			xsum  = ip->ip_p;
-			xsum += (ntohs(ip->udp_len));
-			xsum += (ntohl(ip->ip_src.s_addr) >> 16) & 0x0000ffff;
-			xsum += (ntohl(ip->ip_src.s_addr) >>  0) & 0x0000ffff;
-			xsum += (ntohl(ip->ip_dst.s_addr) >> 16) & 0x0000ffff;
-			xsum += (ntohl(ip->ip_dst.s_addr) >>  0) & 0x0000ffff;
-
-			sumlen = ntohs(ip->udp_len);
-			sumptr = (ushort *)&(ip->udp_src);
-
-			while (sumlen > 1) {
-				ushort sumdata;
-
-				sumdata = *sumptr++;
-				xsum += ntohs(sumdata);
-				sumlen -= 2;
-			}
-			if (sumlen > 0) {
-				ushort sumdata;
-
-				sumdata = *(unsigned char *)sumptr;
-				sumdata = (sumdata << 8) & 0xff00;
-				xsum += sumdata;
-			}
-			while ((xsum >> 16) != 0) {
-				xsum = (xsum & 0x0000ffff) +
-				       ((xsum >> 16) & 0x0000ffff);
-			}
-			if ((xsum != 0x00000000) && (xsum != 0x0000ffff)) {
-				printf(" UDP wrong checksum %08lx %08x\n",
-				       xsum, ntohs(ip->udp_xsum));
-				return;
-			}
+		if (ip->udp_xsum != 0 && !udp_checksum_ok(ip, udp_sum)) {
+			printf(" UDP wrong checksum %04x\n",
+			       ntohs(ip->udp_xsum));
+			return;
 		}
 #endif
 
@@ -1315,6 +1540,12 @@ static int net_check_prereq(enum proto_t protocol)
 #endif
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
+#endif
+#if defined(CONFIG_CMD_TFTPMULTI)
+	case TFTPMULTI:
 #endif
 		/* Fall through */
 	case TFTPGET:
@@ -1491,7 +1722,9 @@ void copy_filename(char *dst, const char *src, int size)
 
 #if	defined(CONFIG_CMD_NFS)		|| \
 	defined(CONFIG_CMD_SNTP)	|| \
-	defined(CONFIG_CMD_DNS)
+	defined(CONFIG_CMD_DNS)		|| \
+	defined(CONFIG_CMD_TFTPMULTI)	|| \
+	defined(CONFIG_PROT_TCP)
 /*
  * make port a little random (1024-17407)
  * This keeps the math somewhat trivial to compute, and seems to work with
@@ -31,6 +31,7 @@
 #include "bootp.h"
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
+#define HASH_BYTES	(NFS_READ_SIZE / 2 * 10)	/* Bytes per hash */
 #define NFS_RETRY_COUNT 30
 #ifndef CONFIG_NFS_TIMEOUT
 # define NFS_TIMEOUT 2000UL
@@ -43,12 +44,39 @@
 
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static ulong nfs_timeout = NFS_TIMEOUT;
 
-static char dirfh[NFS_FHSIZE];	/* file handle of directory */
-static char filefh[NFS_FHSIZE]; /* file handle of kernel image */
+static int nfs_version;		/* NFS_V2 or NFS_V3 */
+static char dirfh[NFS3_FHSIZE];	/* file handle of directory */
+static int dirfh_len;
+static char filefh[NFS3_FHSIZE]; /* file handle of kernel image */
+static int filefh_len;
+
+/**
+ * struct nfs_read - A READ request waiting for its reply
+ *
+ * @id:		RPC transaction ID of the request
+ * @offset:	File offset to read from
+ * @len:	Number of bytes requested, 0 if this slot is free
+ */
+struct nfs_read {
+	unsigned long id;
+	ulong offset;
+	int len;
+};
+
+/*
+ * Several READ requests are kept in flight, so that we are not waiting a
+ * round trip for each block. Replies are matched to requests by their
+ * transaction ID, so they may arrive in any order.
+ */
+static struct nfs_read nfs_reads[CONFIG_NFS_READ_WINDOW];
+static int nfs_read_size;	/* bytes to ask for in each READ */
+static ulong nfs_next_offset;	/* offset of the next READ to send */
+static ulong nfs_eof;		/* file size, once the end has been seen */
+static ulong nfs_attr_size;	/* file size from LOOKUP, or ULONG_MAX */
+static ulong nfs_rcvd;		/* bytes received so far */
+static int nfs_num_hash;
 
 static enum net_loop_state nfs_download_state;
 static struct in_addr nfs_server_ip;
@@ -64,6 +92,7 @@ static int nfs_state;
 #define STATE_LOOKUP_REQ		5
 #define STATE_READ_REQ			6
 #define STATE_READLINK_REQ		7
+#define STATE_FSINFO_REQ		8
 
 static char default_filename[64];
 static char *nfs_filename;
@@ -95,7 +124,16 @@ static inline int store_block(uchar *src, unsigned offset, unsigned len)
 	{
 		void *ptr = map_sysmem(load_addr + offset, len);
 
+#ifdef CONFIG_NET_RX_DIRECT
+		/* nothing to do if the data was received in place */
+		net_rx_stats.payload += len;
+		if (ptr != src) {
+			memmove(ptr, src, len);
+			net_rx_stats.copied += len;
+		}
+#else
 		memcpy(ptr, src, len);
+#endif
 		unmap_sysmem(ptr);
 	}
 
@@ -172,23 +210,51 @@ static uint32_t *rpc_add_credentials(uint32_t *p)
 	return p;
 }
 
+/* Add a file handle, which has a length in NFSv3 */
+static uint32_t *rpc_add_fh(uint32_t *p, const char *fh, int fh_len)
+{
+	if (nfs_version == NFS_V3)
+		*p++ = htonl(fh_len);
+	if (fh_len & 3)
+		*(p + fh_len / 4) = 0; /* add zero padding */
+	memcpy(p, fh, fh_len);
+
+	return p + (fh_len + 3) / 4;
+}
+
+/* Get a file handle from a reply; returns the next word, or NULL if bad */
+static uint32_t *rpc_get_fh(uint32_t *p, char *fh, int *fh_lenp)
+{
+	int fh_len = NFS_FHSIZE;
+
+	if (nfs_version == NFS_V3) {
+		fh_len = ntohl(*p++);
+		if (fh_len > NFS3_FHSIZE)
+			return NULL;
+	}
+	memcpy(fh, p, fh_len);
+	*fh_lenp = fh_len;
+
+	return p + (fh_len + 3) / 4;
+}
+
 /**************************************************************************
-RPC_LOOKUP - Lookup RPC Port numbers
+RPC_SEND - Send an RPC call with a given transaction ID
 **************************************************************************/
-static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+static void rpc_send(unsigned long id, int rpc_prog, int rpc_proc,
+		     uint32_t *data, int datalen)
 {
 	struct rpc_t pkt;
-	unsigned long id;
 	uint32_t *p;
 	int pktlen;
 	int sport;
 
-	id = ++rpc_id;
 	pkt.u.call.id = htonl(id);
 	pkt.u.call.type = htonl(MSG_CALL);
 	pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
 	pkt.u.call.prog = htonl(rpc_prog);
-	pkt.u.call.vers = htonl(2);	/* portmapper is version 2 */
+	/* portmapper is version 2; mount and NFS follow the NFS version */
+	pkt.u.call.vers = htonl(rpc_prog == PROG_PORTMAP ? 2 : nfs_version);
 	pkt.u.call.proc = htonl(rpc_proc);
 	p = (uint32_t *)&(pkt.u.call.data);
 
@@ -211,6 +277,14 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 			    nfs_our_port, pktlen);
 }
 
+/**************************************************************************
+RPC_REQ - Send an RPC call with a new transaction ID
+**************************************************************************/
+static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+{
+	rpc_send(++rpc_id, rpc_prog, rpc_proc, data, datalen);
+}
+
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
@@ -291,8 +365,7 @@ static void nfs_readlink_req(void)
 	p = &(data[0]);
 	p = rpc_add_credentials(p);
 
-	memcpy(p, filefh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = rpc_add_fh(p, filefh, filefh_len);
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
@@ -314,8 +387,7 @@ static void nfs_lookup_req(char *fname)
 	p = &(data[0]);
 	p = rpc_add_credentials(p);
 
-	memcpy(p, dirfh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
+	p = rpc_add_fh(p, dirfh, dirfh_len);
 	*p++ = htonl(fnamelen);
 	if (fnamelen & 3)
 		*(p + fnamelen / 4) = 0;
@@ -324,13 +396,33 @@ static void nfs_lookup_req(char *fname)
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_LOOKUP, data, len);
+	rpc_req(PROG_NFS, nfs_version == NFS_V3 ? NFS3_LOOKUP : NFS_LOOKUP,
+		data, len);
+}
+
+/**************************************************************************
+NFS3_FSINFO - Get the preferred and largest read size
+**************************************************************************/
+static void nfs_fsinfo_req(void)
+{
+	uint32_t data[1024];
+	uint32_t *p;
+	int len;
+
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	p = rpc_add_fh(p, dirfh, dirfh_len);
+
+	len = (uint32_t *)p - (uint32_t *)&(data[0]);
+
+	rpc_req(PROG_NFS, NFS3_FSINFO, data, len);
 }
 
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void nfs_read_req(int offset, int readlen)
+static void nfs_read_req(struct nfs_read *rd)
 {
 	uint32_t data[1024];
 	uint32_t *p;
@@ -339,15 +431,115 @@ static void nfs_read_req(int offset, int readlen)
 	p = &(data[0]);
 	p = rpc_add_credentials(p);
 
-	memcpy(p, filefh, NFS_FHSIZE);
-	p += (NFS_FHSIZE / 4);
-	*p++ = htonl(offset);
-	*p++ = htonl(readlen);
-	*p++ = 0;
+	p = rpc_add_fh(p, filefh, filefh_len);
+	if (nfs_version == NFS_V3)
+		*p++ = 0;	/* upper 32 bits of offset */
+	*p++ = htonl(rd->offset);
+	*p++ = htonl(rd->len);
+	if (nfs_version == NFS_V2)
+		*p++ = 0;	/* totalcount (unused) */
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	rpc_send(rd->id, PROG_NFS, NFS_READ, data, len);
+}
+
+#if defined(CONFIG_NET_RX_DIRECT) && !defined(CONFIG_SYS_DIRECT_FLASH_NFS)
+/* Receive the reply to the oldest READ straight into the load area */
+static void nfs_post_rx_dest(void)
+{
+	struct nfs_read *rd, *oldest = NULL;
+	int words, len;
+	void *ptr;
+
+	for (rd = nfs_reads; rd < nfs_reads + CONFIG_NFS_READ_WINDOW; rd++) {
+		if (rd->len && (!oldest || rd->offset < oldest->offset))
+			oldest = rd;
+	}
+	/*
+	 * A read may reach past the end of the file. Don't let XDR padding,
+	 * or a reply to another read, land there.
+	 */
+	if (!oldest || oldest->offset >= nfs_attr_size) {
+		net_set_rx_dest(NULL, 0, 0);
+		return;
+	}
+	len = min_t(ulong, oldest->len, nfs_attr_size - oldest->offset);
+
+	/* NFSv3 servers normally include the file attributes */
+	words = nfs_version == NFS_V3 ? NFS3_READ_REPLY_WORDS :
+		NFS_READ_REPLY_WORDS;
+	ptr = map_sysmem(load_addr + oldest->offset, len);
+	net_set_rx_dest(ptr, net_eth_hdr_size() + IP_UDP_HDR_SIZE +
+			offsetof(struct rpc_t, u.reply.data) + words * 4, len);
+	unmap_sysmem(ptr);
+}
+#else
+static inline void nfs_post_rx_dest(void)
+{
+}
+#endif
+
+/* Send READ requests until the window is full or the end is reached */
+static void nfs_read_fill(void)
+{
+	struct nfs_read *rd;
+
+	for (rd = nfs_reads; rd < nfs_reads + CONFIG_NFS_READ_WINDOW; rd++) {
+		if (nfs_next_offset >= nfs_eof)
+			break;
+		if (rd->len)
+			continue;
+		rd->id = ++rpc_id;
+		rd->offset = nfs_next_offset;
+		rd->len = nfs_read_size;
+		nfs_next_offset += nfs_read_size;
+		nfs_read_req(rd);
+	}
+	nfs_post_rx_dest();
+}
+
+static void nfs_read_start(void)
+{
+	memset(nfs_reads, '\0', sizeof(nfs_reads));
+	nfs_next_offset = 0;
+	nfs_eof = ULONG_MAX;
+	nfs_rcvd = 0;
+	nfs_num_hash = 0;
+	nfs_read_fill();
+}
+
+/* Forget any outstanding READ requests */
+static void nfs_read_stop(void)
+{
+	memset(nfs_reads, '\0', sizeof(nfs_reads));
+	nfs_post_rx_dest();
+}
+
+/* Send all outstanding READ requests again, e.g. after a timeout */
+static void nfs_read_resend(void)
+{
+	struct nfs_read *rd;
+
+	for (rd = nfs_reads; rd < nfs_reads + CONFIG_NFS_READ_WINDOW; rd++) {
+		if (rd->len)
+			nfs_read_req(rd);
+	}
+	nfs_post_rx_dest();
+}
+
+static bool nfs_read_done(void)
+{
+	struct nfs_read *rd;
+
+	if (nfs_eof == ULONG_MAX)
+		return false;
+	for (rd = nfs_reads; rd < nfs_reads + CONFIG_NFS_READ_WINDOW; rd++) {
+		if (rd->len)
+			return false;
+	}
+
+	return true;
 }
 
 /**************************************************************************
@@ -359,10 +551,10 @@ static void nfs_send(void)
 
 	switch (nfs_state) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
-		rpc_lookup_req(PROG_MOUNT, 1);
+		rpc_lookup_req(PROG_MOUNT, nfs_version == NFS_V3 ? 3 : 1);
 		break;
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
-		rpc_lookup_req(PROG_NFS, 2);
+		rpc_lookup_req(PROG_NFS, nfs_version);
 		break;
 	case STATE_MOUNT_REQ:
 		nfs_mount_req(nfs_path);
@@ -374,11 +566,14 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_resend();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
 		break;
+	case STATE_FSINFO_REQ:
+		nfs_fsinfo_req();
+		break;
 	}
 }
 
@@ -436,7 +631,8 @@ static int nfs_mount_reply(uchar *pkt, unsigned len)
 		return -1;
 
 	fs_mounted = 1;
-	memcpy(dirfh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	if (!rpc_get_fh(rpc_pkt.u.reply.data + 1, dirfh, &dirfh_len))
+		return -1;
 
 	return 0;
 }
@@ -461,6 +657,7 @@ static int nfs_umountall_reply(uchar *pkt, unsigned len)
 
 	fs_mounted = 0;
 	memset(dirfh, 0, sizeof(dirfh));
+	dirfh_len = 0;
 
 	return 0;
 }
@@ -468,6 +665,7 @@ static int nfs_umountall_reply(uchar *pkt, unsigned len)
 static int nfs_lookup_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
+	uint32_t *p, *end;
 
 	debug("%s\n", __func__);
 
@@ -487,7 +685,7 @@ static int nfs_lookup_reply(uchar *pkt, unsigned len)
 			break;
 		case 2: /* Remote can't support NFS version */
 			printf("*** ERROR: NFS version not supported: Requested: V%d, accepted: min V%d - max V%d\n",
-			       2,
+			       nfs_version,
 			       ntohl(rpc_pkt.u.reply.data[0]),
 			       ntohl(rpc_pkt.u.reply.data[1]));
 			break;
@@ -499,7 +697,54 @@ static int nfs_lookup_reply(uchar *pkt, unsigned len)
 		return -1;
 	}
 
-	memcpy(filefh, rpc_pkt.u.reply.data + 1, NFS_FHSIZE);
+	p = rpc_get_fh(rpc_pkt.u.reply.data + 1, filefh, &filefh_len);
+	if (!p)
+		return -1;
+
+	/* Note the size from the attributes, which NFSv3 may leave out */
+	end = (uint32_t *)((uchar *)&rpc_pkt + len);
+	nfs_attr_size = ULONG_MAX;
+	if (nfs_version == NFS_V3 && p + 8 <= end && ntohl(*p++)) {
+		if (!p[5])
+			nfs_attr_size = ntohl(p[6]);
+	} else if (nfs_version == NFS_V2 && p + 6 <= end) {
+		nfs_attr_size = ntohl(p[5]);
+	}
+
+	return 0;
+}
+
+static int nfs_fsinfo_reply(uchar *pkt, unsigned len)
+{
+	struct rpc_t rpc_pkt;
+	uint32_t *p;
+	ulong rtmax;
+
+	debug("%s\n", __func__);
+
+	memcpy((unsigned char *)&rpc_pkt, pkt, len);
+
+	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
+		return -NFS_RPC_ERR;
+	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+		return -NFS_RPC_DROP;
+
+	if (rpc_pkt.u.reply.rstatus  ||
+	    rpc_pkt.u.reply.verifier ||
+	    rpc_pkt.u.reply.astatus  ||
+	    rpc_pkt.u.reply.data[0])
+		return -1;
+
+	p = rpc_pkt.u.reply.data + 1;
+	if (ntohl(*p++))
+		p += 21;	/* skip post_op_attr */
+	rtmax = ntohl(*p);
+
+	/* Servers are normally optimized for a power of 2 */
+	nfs_read_size = NFS3_READ_SIZE_MAX;
+	while (nfs_read_size > rtmax && nfs_read_size > 512)
+		nfs_read_size /= 2;
+	debug("NFS read size %d (server max %lu)\n", nfs_read_size, rtmax);
 
 	return 0;
 }
@@ -507,6 +752,7 @@ static int nfs_lookup_reply(uchar *pkt, unsigned len)
 static int nfs_readlink_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
+	uint32_t *p;
 	int rlen;
 
 	debug("%s\n", __func__);
@@ -524,34 +770,62 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	    rpc_pkt.u.reply.data[0])
 		return -1;
 
-	rlen = ntohl(rpc_pkt.u.reply.data[1]); /* new path length */
+	p = rpc_pkt.u.reply.data + 1;
+	if (nfs_version == NFS_V3 && ntohl(*p++))
+		p += 21;	/* skip post_op_attr */
+	rlen = ntohl(*p++); /* new path length */
 
-	if (*((char *)&(rpc_pkt.u.reply.data[2])) != '/') {
+	if (*((char *)p) != '/') {
 		int pathlen;
 		strcat(nfs_path, "/");
 		pathlen = strlen(nfs_path);
-		memcpy(nfs_path + pathlen, (uchar *)&(rpc_pkt.u.reply.data[2]),
-		       rlen);
+		memcpy(nfs_path + pathlen, (uchar *)p, rlen);
 		nfs_path[pathlen + rlen] = 0;
 	} else {
-		memcpy(nfs_path, (uchar *)&(rpc_pkt.u.reply.data[2]), rlen);
+		memcpy(nfs_path, (uchar *)p, rlen);
 		nfs_path[rlen] = 0;
 	}
 	return 0;
 }
 
+static struct nfs_read *nfs_find_read(unsigned long id)
+{
+	struct nfs_read *rd;
+
+	for (rd = nfs_reads; rd < nfs_reads + CONFIG_NFS_READ_WINDOW; rd++) {
+		if (rd->len && rd->id == id)
+			return rd;
+	}
+
+	return NULL;
+}
+
+static void nfs_show_progress(int rlen)
+{
+	nfs_rcvd += rlen;
+	while (nfs_num_hash < nfs_rcvd / HASH_BYTES) {
+		if (nfs_num_hash && !(nfs_num_hash % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+		nfs_num_hash++;
+	}
+}
+
 static int nfs_read_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
+	struct nfs_read *rd;
+	uint32_t *p;
+	uchar *data;
 	int rlen;
+	bool eof;
 
 	debug("%s\n", __func__);
 
 	memcpy((uchar *)&rpc_pkt, pkt, sizeof(rpc_pkt.u.reply));
 
-	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
-		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+	rd = nfs_find_read(ntohl(rpc_pkt.u.reply.id));
+	if (!rd)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -565,16 +839,41 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
+	p = rpc_pkt.u.reply.data + 1;
+	if (nfs_version == NFS_V3) {
+		if (ntohl(*p++))
+			p += 21;	/* skip post_op_attr */
+		rlen = ntohl(*p++);
+		eof = ntohl(*p++);
+		p++;		/* length of data */
+	} else {
+		p += 17;	/* skip fattr */
+		rlen = ntohl(*p++);
+		/* NFSv2 only returns less than asked for at the end */
+		eof = rlen < rd->len;
+	}
+	data = pkt + ((uchar *)p - (uchar *)&rpc_pkt);
+	if (rlen < 0 || rlen > rd->len || data + rlen > pkt + len)
+		return -NFS_RPC_DROP;
 
-	rlen = ntohl(rpc_pkt.u.reply.data[18]);
-	if (store_block((uchar *)pkt + sizeof(rpc_pkt.u.reply),
-			nfs_offset, rlen))
+	/* A READ past the end returns nothing, which must not set the size */
+	if (rlen && store_block(data, rd->offset, rlen))
 		return -9999;
+	nfs_show_progress(rlen);
+
+	if (eof) {
+		if (rd->offset + rlen < nfs_eof)
+			nfs_eof = rd->offset + rlen;
+		rd->len = 0;
+	} else if (rlen < rd->len) {
+		/* A short read: ask for the rest */
+		rd->id = ++rpc_id;
+		rd->offset += rlen;
+		rd->len -= rlen;
+		nfs_read_req(rd);
+	} else {
+		rd->len = 0;
+	}
 
 	return rlen;
 }
@@ -618,6 +917,15 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
 		if (rpc_lookup_reply(PROG_NFS, pkt, len) == -NFS_RPC_DROP)
 			break;
+		if (nfs_version == NFS_V3 &&
+		    (!nfs_server_mount_port || !nfs_server_port)) {
+			/* The server does not have NFSv3; use NFSv2 instead */
+			debug("NFSv3 not supported, trying NFSv2\n");
+			nfs_version = NFS_V2;
+			nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
+			nfs_send();
+			break;
+		}
 		nfs_state = STATE_MOUNT_REQ;
 		nfs_send();
 		break;
@@ -632,11 +940,23 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else {
-			nfs_state = STATE_LOOKUP_REQ;
+			nfs_read_size = NFS_READ_SIZE;
+			if (nfs_version == NFS_V3)
+				nfs_state = STATE_FSINFO_REQ;
+			else
+				nfs_state = STATE_LOOKUP_REQ;
 			nfs_send();
 		}
 		break;
 
+	case STATE_FSINFO_REQ:
+		/* Without FSINFO, just use the default read size */
+		if (nfs_fsinfo_reply(pkt, len) == -NFS_RPC_DROP)
+			break;
+		nfs_state = STATE_LOOKUP_REQ;
+		nfs_send();
+		break;
+
 	case STATE_UMOUNT_REQ:
 		reply = nfs_umountall_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP) {
@@ -660,9 +980,7 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
-			nfs_send();
+			nfs_read_start();
 		}
 		break;
 
@@ -686,20 +1004,27 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 	case STATE_READ_REQ:
 		rlen = nfs_read_reply(pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
-			nfs_send();
+		if (rlen >= 0) {
+			if (nfs_read_done()) {
+				nfs_download_state = NETLOOP_SUCCESS;
+				nfs_state = STATE_UMOUNT_REQ;
+				nfs_send();
+			} else {
+				nfs_read_fill();
+			}
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
+		if (nfs_state != STATE_READ_REQ)
+			nfs_read_stop();
 		break;
 	}
 }
@@ -776,6 +1101,9 @@ void nfs_start(void)
 	net_set_udp_handler(nfs_handler);
 
 	nfs_timeout_count = 0;
+	nfs_version = NFS_V3;
+	nfs_server_mount_port = 0;
+	nfs_server_port = 0;
 	nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 
 	/*nfs_our_port = 4096 + (get_ticks() % 3072);*/
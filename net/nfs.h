@@ -25,7 +25,15 @@
 #define NFS_READLINK    5
 #define NFS_READ        6
 
+/* NFSv3 procedures which differ from NFSv2 */
+#define NFS3_LOOKUP     3
+#define NFS3_FSINFO     19
+
+#define NFS_V2          2
+#define NFS_V3          3
+
 #define NFS_FHSIZE      32
+#define NFS3_FHSIZE     64
 
 #define NFSERR_PERM     1
 #define NFSERR_NOENT    2
@@ -44,6 +52,22 @@
 #define NFS_READ_SIZE 1024 /* biggest power of two that fits Ether frame */
 #endif
 
+/*
+ * Largest NFSv3 read size. Reads bigger than an Ethernet frame need
+ * CONFIG_IP_DEFRAG, with CONFIG_NET_MAXDEFRAG large enough for the data.
+ */
+#if !defined(CONFIG_IP_DEFRAG)
+#define NFS3_READ_SIZE_MAX NFS_READ_SIZE
+#elif CONFIG_NET_MAXDEFRAG < 32768
+#define NFS3_READ_SIZE_MAX CONFIG_NET_MAXDEFRAG
+#else
+#define NFS3_READ_SIZE_MAX 32768
+#endif
+
+/* Words in a READ reply before the data, after the RPC reply header */
+#define NFS_READ_REPLY_WORDS	19	/* status, fattr, count */
+#define NFS3_READ_REPLY_WORDS	26	/* status, post_op_attr, count, eof, count */
+
 #define NFS_MAXLINKDEPTH 16
 
 struct rpc_t {
@@ -65,7 +89,7 @@ struct rpc_t {
 			uint32_t verifier;
 			uint32_t v2;
 			uint32_t astatus;
-			uint32_t data[19];
+			uint32_t data[NFS3_READ_REPLY_WORDS];
 		} reply;
 	} u;
 };
@@ -10,9 +10,10 @@
  */
 
 #include "ping.h"
-#include "arp.h"
 
 static ushort ping_seq_number;
+/* MAC address to send to, filled in from the ARP cache or an ARP reply */
+static uchar ping_ethaddr[ARP_HLEN];
 
 /* The ip address to ping */
 struct in_addr net_ping_ip;
@@ -41,28 +42,11 @@ static void set_icmp_header(uchar *pkt, struct in_addr dest)
 
 static int ping_send(void)
 {
-	uchar *pkt;
-	int eth_hdr_size;
-
-	/* XXX always send arp request */
-
-	debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &net_ping_ip);
-
-	net_arp_wait_packet_ip = net_ping_ip;
-
-	eth_hdr_size = net_set_ether(net_tx_packet, net_null_ethaddr, PROT_IP);
-	pkt = (uchar *)net_tx_packet + eth_hdr_size;
-
-	set_icmp_header(pkt, net_ping_ip);
-
-	/* size of the waiting packet */
-	arp_wait_tx_packet_size = eth_hdr_size + IP_ICMP_HDR_SIZE;
+	set_icmp_header(net_tx_packet + net_eth_hdr_size(), net_ping_ip);
 
-	/* and do the ARP request */
-	arp_wait_try = 1;
-	arp_wait_timer_start = get_timer(0);
-	arp_request();
-	return 1;	/* waiting */
+	/* send ARP first, unless the MAC address is cached */
+	memset(ping_ethaddr, '\0', ARP_HLEN);
+	return net_send_ip_packet(ping_ethaddr, net_ping_ip, IP_ICMP_HDR_SIZE);
 }
 
 static void ping_timeout_handler(void)
@@ -0,0 +1,326 @@
+/*
+ * Minimal TCP client
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+/*
+ * This supports a single outgoing connection, which is enough to download
+ * a file over HTTP. Data is only accepted in order: a segment which
+ * arrives after a lost one is dropped and the last acknowledgement is
+ * repeated, so that the sender retransmits the missing data (there is no
+ * SACK). Since received data is passed straight to the user rather than
+ * being buffered, a large window can be advertised, so the sender does
+ * not have to wait for each segment to be acknowledged as with TFTP.
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <net.h>
+#include <net/tcp.h>
+
+/* Initial retransmission timeout; this doubles on each retry */
+#define TCP_RTO_MS		500
+#define TCP_RTO_MAX_MS		8000
+/* Give up after this many timeouts in a row */
+#define TCP_RETRIES		10
+/* Segment size to use if the other end does not say */
+#define TCP_DEFAULT_MSS		536
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+};
+
+static enum tcp_state tcp_state;
+static const struct tcp_ops *tcp_ops;
+static struct in_addr tcp_dest;
+static uchar tcp_dest_ethaddr[ARP_HLEN];
+static int tcp_dport;
+static int tcp_sport;
+/* Oldest unacknowledged and next sequence number to send */
+static u32 tcp_snd_una;
+static u32 tcp_snd_nxt;
+/* Initial and next expected sequence number from the other end */
+static u32 tcp_irs;
+static u32 tcp_rcv_nxt;
+/* Largest segment the other end will accept */
+static int tcp_snd_mss;
+/* Data which has been sent but not acknowledged */
+static uchar tcp_snd_buf[TCP_MSS];
+static int tcp_snd_len;
+static int tcp_retries;
+
+u16 tcp_checksum(struct in_addr src, struct in_addr dest,
+		 const struct tcp_hdr *tcp, int len)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dest;
+		u8 zero;
+		u8 proto;
+		__be16 len;
+	} __attribute__((packed)) pseudo;
+
+	pseudo.src = src;
+	pseudo.dest = dest;
+	pseudo.zero = 0;
+	pseudo.proto = IPPROTO_TCP;
+	pseudo.len = htons(len);
+
+	return add_ip_checksums(sizeof(pseudo),
+				compute_ip_checksum(&pseudo, sizeof(pseudo)),
+				compute_ip_checksum(tcp, len));
+}
+
+static void tcp_send_segment(u8 flags, u32 seq, const void *data, int len)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size();
+	struct ip_udp_hdr *ip = (struct ip_udp_hdr *)pkt;
+	struct tcp_hdr *tcp = (struct tcp_hdr *)(pkt + IP_HDR_SIZE);
+	uchar *opt = (uchar *)(tcp + 1);
+	int hlen = TCP_HDR_SIZE;
+
+	/* Tell the other end how much we can receive in one segment */
+	if (flags & TCP_SYN) {
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = 4;
+		opt[2] = TCP_MSS >> 8;
+		opt[3] = TCP_MSS & 0xff;
+		hlen += 4;
+	}
+	memcpy((uchar *)tcp + hlen, data, len);
+
+	net_set_ip_header(pkt, tcp_dest, net_ip);
+	ip->ip_len = htons(IP_HDR_SIZE + hlen + len);
+	ip->ip_p = IPPROTO_TCP;
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+
+	tcp->src = htons(tcp_sport);
+	tcp->dst = htons(tcp_dport);
+	tcp->seq = htonl(seq);
+	tcp->ack = htonl(flags & TCP_ACK ? tcp_rcv_nxt : 0);
+	tcp->hlen = (hlen / 4) << 4;
+	tcp->flags = flags;
+	tcp->wnd = htons(CONFIG_TCP_WINDOW);
+	tcp->sum = 0;
+	tcp->urp = 0;
+	tcp->sum = tcp_checksum(net_ip, tcp_dest, tcp, hlen + len);
+
+	net_send_ip_packet(tcp_dest_ethaddr, tcp_dest,
+			   IP_HDR_SIZE + hlen + len);
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, tcp_snd_nxt, NULL, 0);
+}
+
+static void tcp_timeout(void);
+
+static void tcp_set_timer(void)
+{
+	ulong rto = TCP_RTO_MS << min(tcp_retries, 5);
+
+	net_set_timeout_handler(min_t(ulong, rto, TCP_RTO_MAX_MS),
+				tcp_timeout);
+}
+
+static void tcp_closed(int err)
+{
+	tcp_state = TCP_CLOSED;
+	tcp_ops->closed(err);
+}
+
+static void tcp_timeout(void)
+{
+	if (tcp_state == TCP_CLOSED)
+		return;
+	if (++tcp_retries > TCP_RETRIES) {
+		puts("\nTCP: Connection timed out\n");
+		tcp_closed(-ETIMEDOUT);
+		return;
+	}
+	puts("T ");
+
+	if (tcp_state == TCP_SYN_SENT) {
+		tcp_send_segment(TCP_SYN, tcp_snd_una, NULL, 0);
+	} else if (tcp_snd_len) {
+		tcp_send_segment(TCP_ACK | TCP_PSH, tcp_snd_una, tcp_snd_buf,
+				 tcp_snd_len);
+	} else {
+		/* In case our last acknowledgement was lost */
+		tcp_send_ack();
+	}
+	tcp_set_timer();
+}
+
+void tcp_connect(struct in_addr dest, int dport, const struct tcp_ops *ops)
+{
+	tcp_ops = ops;
+	tcp_dest = dest;
+	memset(tcp_dest_ethaddr, '\0', sizeof(tcp_dest_ethaddr));
+	tcp_dport = dport;
+	tcp_sport = random_port();
+	tcp_snd_una = (u32)get_ticks() ^ (tcp_sport << 16);
+	tcp_snd_nxt = tcp_snd_una + 1;
+	tcp_snd_mss = TCP_DEFAULT_MSS;
+	tcp_snd_len = 0;
+	tcp_retries = 0;
+	tcp_state = TCP_SYN_SENT;
+
+	debug("TCP: Connecting to %pI4:%d from port %d\n", &dest, dport,
+	      tcp_sport);
+	tcp_send_segment(TCP_SYN, tcp_snd_una, NULL, 0);
+	tcp_set_timer();
+}
+
+int tcp_send(const void *data, int len)
+{
+	if (tcp_state != TCP_ESTABLISHED)
+		return -ENOTCONN;
+	if (tcp_snd_len)
+		return -EBUSY;
+	if (len > tcp_snd_mss)
+		return -E2BIG;
+
+	memcpy(tcp_snd_buf, data, len);
+	tcp_snd_len = len;
+	tcp_snd_nxt = tcp_snd_una + len;
+	tcp_retries = 0;
+	tcp_send_segment(TCP_ACK | TCP_PSH, tcp_snd_una, data, len);
+	tcp_set_timer();
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	if (tcp_state == TCP_ESTABLISHED)
+		tcp_send_segment(TCP_FIN | TCP_ACK, tcp_snd_nxt, NULL, 0);
+	tcp_state = TCP_CLOSED;
+}
+
+static void tcp_parse_options(const struct tcp_hdr *tcp, int hlen)
+{
+	const uchar *opt = (const uchar *)(tcp + 1);
+	const uchar *end = (const uchar *)tcp + hlen;
+
+	while (opt < end && *opt != TCP_OPT_END) {
+		if (*opt == TCP_OPT_NOP) {
+			opt++;
+			continue;
+		}
+		if (opt + 1 >= end || opt[1] < 2 || opt + opt[1] > end)
+			break;
+		if (*opt == TCP_OPT_MSS && opt[1] == 4) {
+			tcp_snd_mss = min_t(int, (opt[2] << 8) | opt[3],
+					    TCP_MSS);
+		}
+		opt += opt[1];
+	}
+}
+
+void tcp_receive(struct ip_udp_hdr *ip, int len)
+{
+	struct tcp_hdr *tcp = (struct tcp_hdr *)((uchar *)ip + IP_HDR_SIZE);
+	struct in_addr src = net_read_ip(&ip->ip_src);
+	struct in_addr dest = net_read_ip(&ip->ip_dst);
+	bool progress = false;
+	int hlen, plen;
+	u32 seq, ack;
+	uchar *data;
+	u32 skip;
+
+	len -= IP_HDR_SIZE;
+	if (tcp_state == TCP_CLOSED || len < TCP_HDR_SIZE)
+		return;
+	hlen = (tcp->hlen >> 4) * 4;
+	if (hlen < TCP_HDR_SIZE || hlen > len)
+		return;
+	if (src.s_addr != tcp_dest.s_addr || ntohs(tcp->src) != tcp_dport ||
+	    ntohs(tcp->dst) != tcp_sport)
+		return;
+	if (tcp_checksum(src, dest, tcp, len)) {
+		debug("TCP: Bad checksum\n");
+		return;
+	}
+	seq = ntohl(tcp->seq);
+	ack = ntohl(tcp->ack);
+	data = (uchar *)tcp + hlen;
+	plen = len - hlen;
+
+	if (tcp_state == TCP_SYN_SENT) {
+		if (!(tcp->flags & TCP_ACK) || ack != tcp_snd_nxt)
+			return;
+		if (tcp->flags & TCP_RST) {
+			tcp_closed(-ECONNREFUSED);
+			return;
+		}
+		if (!(tcp->flags & TCP_SYN))
+			return;
+		tcp_parse_options(tcp, hlen);
+		tcp_irs = seq;
+		tcp_rcv_nxt = seq + 1;
+		tcp_snd_una = ack;
+		tcp_state = TCP_ESTABLISHED;
+		tcp_retries = 0;
+		debug("TCP: Connected, MSS %d\n", tcp_snd_mss);
+		tcp_send_ack();
+		tcp_set_timer();
+		tcp_ops->connected();
+		return;
+	}
+
+	if (tcp->flags & TCP_RST) {
+		/* Ignore resets which are not for this connection */
+		if (seq - tcp_rcv_nxt < CONFIG_TCP_WINDOW)
+			tcp_closed(-ECONNRESET);
+		return;
+	}
+	if ((tcp->flags & TCP_ACK) && (s32)(ack - tcp_snd_una) > 0 &&
+	    (s32)(ack - tcp_snd_nxt) <= 0) {
+		tcp_snd_una = ack;
+		if (tcp_snd_una == tcp_snd_nxt)
+			tcp_snd_len = 0;
+		progress = true;
+	}
+
+	/* The SYN uses a sequence number, e.g. in a repeated SYN-ACK */
+	if (tcp->flags & TCP_SYN)
+		seq++;
+	if ((s32)(seq - tcp_rcv_nxt) > 0) {
+		/* Something was lost: say what we are still waiting for */
+		tcp_send_ack();
+		return;
+	}
+
+	/* Pass on any data we have not seen before */
+	skip = tcp_rcv_nxt - seq;
+	if (skip < plen) {
+		ulong offset = tcp_rcv_nxt - tcp_irs - 1;
+
+		progress = true;
+		tcp_rcv_nxt += plen - skip;
+		tcp_ops->recv(data + skip, offset, plen - skip);
+		/* The user may have closed the connection */
+		if (tcp_state != TCP_ESTABLISHED)
+			return;
+	}
+
+	if ((tcp->flags & TCP_FIN) && seq + plen == tcp_rcv_nxt) {
+		tcp_rcv_nxt++;
+		tcp_send_segment(TCP_FIN | TCP_ACK, tcp_snd_nxt, NULL, 0);
+		tcp_closed(0);
+		return;
+	}
+	if (plen || (tcp->flags & TCP_FIN))
+		tcp_send_ack();
+	if (progress) {
+		tcp_retries = 0;
+		tcp_set_timer();
+	}
+}
@@ -17,8 +17,6 @@
 #include <flash.h>
 #endif
 
-/* Well known TFTP port # */
-#define WELL_KNOWN_PORT	69
 /* Millisecs to timeout for lost pkt */
 #define TIMEOUT		5000UL
 #ifndef	CONFIG_NET_RETRY_COUNT
@@ -30,16 +28,6 @@
 /* Number of "loading" hashes per line (for checking the image size) */
 #define HASHES_PER_LINE	65
 
-/*
- *	TFTP operations.
- */
-#define TFTP_RRQ	1
-#define TFTP_WRQ	2
-#define TFTP_DATA	3
-#define TFTP_ACK	4
-#define TFTP_ERROR	5
-#define TFTP_OACK	6
-
 static ulong timeout_ms = TIMEOUT;
 static int timeout_count_max = TIMEOUT_COUNT;
 static ulong time_start;   /* Record time we started tftp */
@@ -56,16 +44,6 @@ static ulong time_start;   /* Record time we started tftp */
 ulong tftp_timeout_ms = TIMEOUT;
 int tftp_timeout_count_max = TIMEOUT_COUNT;
 
-enum {
-	TFTP_ERR_UNDEFINED           = 0,
-	TFTP_ERR_FILE_NOT_FOUND      = 1,
-	TFTP_ERR_ACCESS_DENIED       = 2,
-	TFTP_ERR_DISK_FULL           = 3,
-	TFTP_ERR_UNEXPECTED_OPCODE   = 4,
-	TFTP_ERR_UNKNOWN_TRANSFER_ID  = 5,
-	TFTP_ERR_FILE_ALREADY_EXISTS = 6,
-};
-
 static struct in_addr tftp_remote_ip;
 /* The UDP port at their end */
 static int	tftp_remote_port;
@@ -104,8 +82,6 @@ static int	tftp_put_final_block_sent;
 #define STATE_RECV_WRQ	6
 #define STATE_SEND_WRQ	7
 
-/* default TFTP block size */
-#define TFTP_BLOCK_SIZE		512
 /* sequence number is 16 bit */
 #define TFTP_SEQUENCE_SIZE	((ulong)(1<<16))
 
@@ -123,16 +99,39 @@ static char tftp_filename[MAX_LEN];
 /* 512 is poor choice for ethernet, MTU is typically 1500.
  * Minus eth.hdrs thats 1468.  Can get 2x better throughput with
  * almost-MTU block sizes.  At least try... fall back to 512 if need be.
- * (but those using CONFIG_IP_DEFRAG may want to set a larger block in cfg file)
+ * With CONFIG_IP_DEFRAG we can go much further: blocks as large as we can
+ * reassemble need an ACK only every dozen or so packets. If the fragments
+ * do not make it through, we fall back to almost-MTU blocks.
  */
 #ifdef CONFIG_TFTP_BLOCKSIZE
 #define TFTP_MTU_BLOCKSIZE CONFIG_TFTP_BLOCKSIZE
+#elif defined(CONFIG_IP_DEFRAG) && CONFIG_NET_MAXDEFRAG < TFTP_MAX_BLOCKSIZE
+#define TFTP_MTU_BLOCKSIZE CONFIG_NET_MAXDEFRAG
+#elif defined(CONFIG_IP_DEFRAG)
+#define TFTP_MTU_BLOCKSIZE TFTP_MAX_BLOCKSIZE
 #else
-#define TFTP_MTU_BLOCKSIZE 1468
+#define TFTP_MTU_BLOCKSIZE TFTP_NOFRAG_BLOCKSIZE
 #endif
 
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = TFTP_MTU_BLOCKSIZE;
+#ifdef CONFIG_IP_DEFRAG
+/* fragmented blocks never arrived, so stick to unfragmented ones */
+static bool tftp_frag_failed;
+/* The UDP port the read request was sent to */
+static int	tftp_request_port;
+#endif
+
+/*
+ * With a window size (RFC 7440) the server sends this many blocks before
+ * waiting for an ACK, so we are not limited to one block per round trip.
+ */
+static unsigned short tftp_window_size = 1;
+static unsigned short tftp_window_size_option = CONFIG_TFTP_WINDOWSIZE;
+/* block number after which we next send an ACK */
+static ulong	tftp_next_ack;
+/* block we last asked to be resent after a loss, or -1 */
+static ulong	tftp_last_nack;
 
 #ifdef CONFIG_MCAST_TFTP
 #include <malloc.h>
@@ -193,7 +192,16 @@ static inline void store_block(int block, uchar *src, unsigned len)
 	{
 		void *ptr = map_sysmem(load_addr + offset, len);
 
+#ifdef CONFIG_NET_RX_DIRECT
+		/* nothing to do if the block was received in place */
+		net_rx_stats.payload += len;
+		if (ptr != src) {
+			memmove(ptr, src, len);
+			net_rx_stats.copied += len;
+		}
+#else
 		memcpy(ptr, src, len);
+#endif
 		unmap_sysmem(ptr);
 	}
 #ifdef CONFIG_MCAST_TFTP
@@ -209,6 +217,7 @@ static inline void store_block(int block, uchar *src, unsigned len)
 static void new_transfer(void)
 {
 	tftp_prev_block = 0;
+	tftp_last_nack = -1UL;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
 #ifdef CONFIG_CMD_TFTPPUT
@@ -242,6 +251,39 @@ static int load_block(unsigned block, uchar *dst, unsigned len)
 static void tftp_send(void);
 static void tftp_timeout_handler(void);
 
+#if defined(CONFIG_NET_RX_DIRECT) && defined(CONFIG_TFTP_TSIZE) && \
+	!defined(CONFIG_SYS_DIRECT_FLASH_TFTP)
+/*
+ * Ask for the next block to be received straight into the load area. This
+ * is only done when the server told us the size of the file, so that a
+ * packet which is not the block we expect (such as a duplicate of the last
+ * full one) cannot land past the end of the file.
+ */
+static void tftp_post_next_block(void)
+{
+	ulong offset = tftp_cur_block * tftp_block_size +
+		tftp_block_wrap_offset;
+	void *ptr;
+	int size;
+
+	net_set_rx_dest(NULL, 0, 0);
+#ifdef CONFIG_MCAST_TFTP
+	if (tftp_mcast_active)
+		return;
+#endif
+	if (offset >= tftp_tsize)
+		return;
+	size = min_t(ulong, tftp_block_size, tftp_tsize - offset);
+	ptr = map_sysmem(load_addr + offset, size);
+	net_set_rx_dest(ptr, net_eth_hdr_size() + IP_UDP_HDR_SIZE + 4, size);
+	unmap_sysmem(ptr);
+}
+#else
+static inline void tftp_post_next_block(void)
+{
+}
+#endif
+
 /**********************************************************************/
 
 static void show_block_marker(void)
@@ -321,6 +363,13 @@ static void tftp_complete(void)
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
 	}
+#ifdef CONFIG_IP_DEFRAG
+	if (net_defrag_stats.dropped || net_defrag_stats.evicted) {
+		printf("\n\t %lu of %lu IP fragments dropped, %lu packets lost",
+		       net_defrag_stats.dropped, net_defrag_stats.fragments,
+		       net_defrag_stats.evicted);
+	}
+#endif
 	puts("\ndone\n");
 	net_set_state(NETLOOP_SUCCESS);
 }
@@ -356,6 +405,8 @@ static void tftp_send(void)
 		*s++ = htons(TFTP_RRQ);
 #endif
 		pkt = (uchar *)s;
+		if (!tftp_put_active)
+			tftp_post_next_block();
 		strcpy((char *)pkt, tftp_filename);
 		pkt += strlen(tftp_filename) + 1;
 		strcpy((char *)pkt, "octet");
@@ -372,6 +423,9 @@ static void tftp_send(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, tftp_block_size_option, 0);
+		if (tftp_window_size_option > 1 && !tftp_put_active)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+					0, tftp_window_size_option, 0);
 #ifdef CONFIG_MCAST_TFTP
 		/* Check all preconditions before even trying the option */
 		if (!tftp_mcast_disabled) {
@@ -404,6 +458,10 @@ static void tftp_send(void)
 		s[0] = htons(TFTP_ACK);
 		s[1] = htons(tftp_cur_block);
 		pkt = (uchar *)(s + 2);
+		tftp_next_ack = (unsigned short)(tftp_cur_block +
+						 tftp_window_size);
+		if (tftp_state == STATE_OACK && !tftp_put_active)
+			tftp_post_next_block();
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active) {
 			int toload = tftp_block_size;
@@ -457,6 +515,37 @@ static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 }
 #endif
 
+/**
+ * Check that a data block is the next one expected in the window
+ *
+ * If a block was lost, the rest of the window is no use since we store
+ * blocks in order. ACK the last block received (once per loss) so that the
+ * server sends the window again from the missing block.
+ *
+ * @param block	Block number received
+ * @return true if this block should be stored, false to drop it
+ */
+static bool tftp_window_check(ulong block)
+{
+	ulong expect = 1;
+
+	if (tftp_state == STATE_DATA)
+		expect = (unsigned short)(tftp_prev_block + 1);
+	if (block == expect)
+		return true;
+
+	/* Blocks before the one expected are duplicates; just drop them */
+	if ((unsigned short)(block - expect) < tftp_window_size &&
+	    tftp_last_nack != expect) {
+		debug("Lost block %ld (got %ld)\n", expect, block);
+		tftp_last_nack = expect;
+		tftp_post_next_block();
+		tftp_send();
+	}
+
+	return false;
+}
+
 static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
@@ -540,6 +629,13 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("Blocksize ack: %s, %d\n",
 				      (char *)pkt + i + 8, tftp_block_size);
 			}
+			if (strcmp((char *)pkt + i, "windowsize") == 0) {
+				tftp_window_size = (unsigned short)
+					simple_strtoul((char *)pkt + i + 11,
+						       NULL, 10);
+				debug("Windowsize ack: %s, %d\n",
+				      (char *)pkt + i + 11, tftp_window_size);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				tftp_tsize = simple_strtoul((char *)pkt + i + 6,
@@ -549,8 +645,13 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			}
 #endif
 		}
+		if (!tftp_window_size ||
+		    tftp_window_size > tftp_window_size_option)
+			tftp_window_size = 1;
 #ifdef CONFIG_MCAST_TFTP
 		parse_multicast_oack((char *)pkt, len - 1);
+		if (tftp_mcast_active)
+			tftp_window_size = 1;
 		if ((tftp_mcast_active) && (!tftp_mcast_master_client))
 			tftp_state = STATE_DATA;	/* passive.. */
 		else
@@ -568,6 +669,9 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (len < 2)
 			return;
 		len -= 2;
+		if (tftp_window_size > 1 &&
+		    !tftp_window_check(ntohs(*(__be16 *)pkt)))
+			break;
 		tftp_cur_block = ntohs(*(__be16 *)pkt);
 
 		update_block_number();
@@ -607,6 +711,13 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
 		store_block(tftp_cur_block - 1, pkt + 2, len);
+		if (len == tftp_block_size)
+			tftp_post_next_block();
+
+		/* Within a window, only the last block is acknowledged */
+		if (tftp_window_size > 1 && len == tftp_block_size &&
+		    tftp_cur_block != tftp_next_ack)
+			break;
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
@@ -685,6 +796,28 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+#ifdef CONFIG_IP_DEFRAG
+	/*
+	 * If the server agreed to large blocks but none has arrived, some
+	 * router on the way is probably dropping fragments
+	 */
+	if (tftp_state == STATE_OACK && !tftp_put_active &&
+	    tftp_block_size > TFTP_NOFRAG_BLOCKSIZE && timeout_count) {
+		puts("\nFragmented blocks lost; asking for smaller blocks\n");
+		tftp_frag_failed = true;
+		tftp_block_size_option = TFTP_NOFRAG_BLOCKSIZE;
+		tftp_block_size = TFTP_BLOCK_SIZE;
+		tftp_window_size = 1;
+		tftp_state = STATE_SEND_RRQ;
+		tftp_remote_port = tftp_request_port;
+		/* Ignore anything still on its way for the first request */
+		tftp_our_port = 1024 + (tftp_our_port - 1024 + 1) % 3072;
+		timeout_count = 0;
+		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		tftp_send();
+		return;
+	}
+#endif
 	if (++timeout_count > timeout_count_max) {
 		restart("Retry count exceeded");
 	} else {
@@ -708,7 +841,12 @@ void tftp_start(enum proto_t protocol)
 
 	ep = getenv("tftpblocksize");
 	if (ep != NULL)
-		tftp_block_size_option = simple_strtol(ep, NULL, 10);
+		tftp_block_size_option = min(simple_strtoul(ep, NULL, 10),
+					     (ulong)TFTP_MAX_BLOCKSIZE);
+
+	ep = getenv("tftpwindowsize");
+	if (ep != NULL)
+		tftp_window_size_option = simple_strtol(ep, NULL, 10);
 
 	ep = getenv("tftptimeout");
 	if (ep != NULL)
@@ -731,8 +869,13 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-	      tftp_block_size_option, timeout_ms);
+#ifdef CONFIG_IP_DEFRAG
+	if (tftp_frag_failed && tftp_block_size_option > TFTP_NOFRAG_BLOCKSIZE)
+		tftp_block_size_option = TFTP_NOFRAG_BLOCKSIZE;
+#endif
+
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
 	if (net_boot_file_name[0] == '\0') {
@@ -828,6 +971,9 @@ void tftp_start(enum proto_t protocol)
 	ep = getenv("tftpsrcp");
 	if (ep != NULL)
 		tftp_our_port = simple_strtol(ep, NULL, 10);
+#endif
+#ifdef CONFIG_IP_DEFRAG
+	tftp_request_port = tftp_remote_port;
 #endif
 	tftp_cur_block = 0;
 
@@ -835,6 +981,8 @@ void tftp_start(enum proto_t protocol)
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_window_size = 1;
+	tftp_last_nack = -1UL;
 #ifdef CONFIG_MCAST_TFTP
 	mcast_cleanup();
 #endif
@@ -864,6 +1012,7 @@ void tftp_start_server(void)
 
 	/* Revert tftp_block_size to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_window_size = 1;
 	tftp_cur_block = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
 
@@ -0,0 +1,528 @@
+/*
+ * Download a file over several network interfaces at once with TFTP
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+/*
+ * TFTP has no way to ask for part of a file, so the file must be split into
+ * parts on the server, named <file>.0, <file>.1 and so on, each of
+ * 'tftppartsize' bytes except the last (e.g. with 'split -b <size> -d -a 1
+ * <file> <file>.'). Each interface listed in 'tftpdevs' fetches one part at
+ * a time and moves on to the next part not yet requested when it finishes,
+ * so faster links fetch more of the file. Each part is stored at its place
+ * in the file, which ends up in one piece at the load address. The end of
+ * the file is found from a short part, or from the first missing one.
+ *
+ * The interfaces share our IP address. Only one ARP request can be
+ * outstanding and it holds on to net_tx_packet, so while one is in
+ * progress, other transfers wait before sending.
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tftp.h>
+#include "arp.h"
+#include "eth_internal.h"
+#include "tftp_multi.h"
+
+/* Most interfaces which can be used at once */
+#define TFTP_MULTI_MAX_DEVS	8
+/* How often to look for transfers which have timed out */
+#define TFTP_MULTI_TICK_MS	100
+
+#define HASHES_PER_LINE		65	/* "Loading" hashes per line */
+#define HASH_BYTES		0x8000	/* Bytes per hash mark */
+
+/**
+ * struct tftp_multi_xfer - The transfer over one interface
+ *
+ * @dev:		Ethernet device to use
+ * @server_ip:		TFTP server to fetch parts from
+ * @server_ethaddr:	MAC address of the server, or zero until known
+ * @our_port:		Our UDP port for the current part
+ * @remote_port:	Server's UDP port for the current part
+ * @part:		Part being fetched, or -1 if none
+ * @started:		true once the server has replied to the request
+ * @block_size:		Block size agreed with the server
+ * @blocks:		Number of blocks of the part received so far
+ * @len:		Number of bytes of the part received so far
+ * @send_pending:	true to send a packet once ARP has finished
+ * @time_sent:		When the last packet was sent, for retries
+ * @retries:		Number of retries since the server last replied
+ * @total:		Bytes received over this interface
+ */
+struct tftp_multi_xfer {
+	struct udevice *dev;
+	struct in_addr server_ip;
+	uchar server_ethaddr[ARP_HLEN];
+	int our_port;
+	int remote_port;
+	int part;
+	bool started;
+	int block_size;
+	ulong blocks;
+	ulong len;
+	bool send_pending;
+	ulong time_sent;
+	int retries;
+	ulong total;
+};
+
+static struct tftp_multi_xfer tftp_multi_xfers[TFTP_MULTI_MAX_DEVS];
+static int tftp_multi_num_xfers;
+/* Device to go back to when switching between them */
+static struct udevice *tftp_multi_home;
+/* Devices which we started, and must stop */
+static struct udevice *tftp_multi_started[TFTP_MULTI_MAX_DEVS];
+static int tftp_multi_num_started;
+
+static char tftp_multi_filename[128];
+static ulong tftp_multi_part_size;
+static int tftp_multi_block_size;
+static int tftp_multi_next_port;
+/* Next part to request, and number of parts once the end has been seen */
+static int tftp_multi_next_part;
+static int tftp_multi_num_parts;
+static int tftp_multi_parts_done;
+static ulong tftp_multi_rcvd;
+static int tftp_multi_num_hash;
+static ulong tftp_multi_time_start;
+
+/* Make @dev the current device, for sending and receiving */
+static void tftp_multi_set_dev(struct udevice *dev)
+{
+	eth_set_dev(dev);
+	memcpy(net_ethaddr, eth_get_ethaddr(), ARP_HLEN);
+}
+
+static void tftp_multi_fail(const char *msg)
+{
+	printf("\n%s\n", msg);
+	tftp_multi_set_dev(tftp_multi_home);
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void tftp_multi_send(struct tftp_multi_xfer *xfer)
+{
+	uchar *pkt, *xp;
+	__be16 *s;
+
+	/* The packet waiting for an ARP reply is in net_tx_packet */
+	if (net_arp_wait_packet_ip.s_addr) {
+		xfer->send_pending = true;
+		return;
+	}
+	xfer->send_pending = false;
+	xfer->time_sent = get_timer(0);
+	tftp_multi_set_dev(xfer->dev);
+
+	pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+	xp = pkt;
+	s = (__be16 *)pkt;
+	if (xfer->started) {
+		*s++ = htons(TFTP_ACK);
+		*s++ = htons(xfer->blocks);
+		pkt = (uchar *)s;
+	} else {
+		*s++ = htons(TFTP_RRQ);
+		pkt = (uchar *)s;
+		pkt += sprintf((char *)pkt, "%s.%d", tftp_multi_filename,
+			       xfer->part) + 1;
+		pkt += sprintf((char *)pkt, "octet%cblksize%c%d", 0, 0,
+			       tftp_multi_block_size) + 1;
+	}
+
+	net_send_udp_packet(xfer->server_ethaddr, xfer->server_ip,
+			    xfer->remote_port, xfer->our_port, pkt - xp);
+}
+
+static void tftp_multi_complete(void)
+{
+	struct tftp_multi_xfer *xfer;
+	ulong time_taken;
+
+	time_taken = get_timer(tftp_multi_time_start);
+	if (time_taken > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(tftp_multi_rcvd / time_taken * 1000, "/s");
+	}
+	for (xfer = tftp_multi_xfers;
+	     xfer < tftp_multi_xfers + tftp_multi_num_xfers; xfer++) {
+		printf("\n\t %s: ", xfer->dev->name);
+		print_size(xfer->total, "");
+	}
+	puts("\ndone\n");
+	tftp_multi_set_dev(tftp_multi_home);
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+/* Give an idle transfer the next part, or finish if there are none left */
+static void tftp_multi_next(struct tftp_multi_xfer *xfer)
+{
+	int i;
+
+	xfer->part = -1;
+	if (tftp_multi_next_part < tftp_multi_num_parts) {
+		xfer->part = tftp_multi_next_part++;
+		xfer->started = false;
+		xfer->our_port = tftp_multi_next_port++;
+		xfer->remote_port = WELL_KNOWN_PORT;
+		xfer->block_size = TFTP_BLOCK_SIZE;
+		xfer->blocks = 0;
+		xfer->len = 0;
+		xfer->retries = 0;
+		tftp_multi_send(xfer);
+		return;
+	}
+
+	for (i = 0; i < tftp_multi_num_xfers; i++) {
+		if (tftp_multi_xfers[i].part != -1)
+			return;
+	}
+	if (tftp_multi_parts_done == tftp_multi_num_parts)
+		tftp_multi_complete();
+}
+
+/* Note that the file has @num_parts parts */
+static void tftp_multi_set_end(int num_parts)
+{
+	int i;
+
+	if (num_parts >= tftp_multi_num_parts)
+		return;
+	tftp_multi_num_parts = num_parts;
+	debug("TFTP: File has %d parts\n", num_parts);
+
+	/* Parts beyond the end cannot exist */
+	for (i = 0; i < tftp_multi_num_xfers; i++) {
+		if (tftp_multi_xfers[i].part >= num_parts) {
+			tftp_multi_xfers[i].part = -1;
+			tftp_multi_xfers[i].send_pending = false;
+		}
+	}
+}
+
+static void tftp_multi_store(struct tftp_multi_xfer *xfer, const uchar *src,
+			     ulong len)
+{
+	ulong offset = xfer->part * tftp_multi_part_size + xfer->len;
+	void *ptr = map_sysmem(load_addr + offset, len);
+
+	memcpy(ptr, src, len);
+	unmap_sysmem(ptr);
+	if (net_boot_file_size < offset + len)
+		net_boot_file_size = offset + len;
+
+	xfer->len += len;
+	xfer->total += len;
+	tftp_multi_rcvd += len;
+	while (tftp_multi_num_hash < tftp_multi_rcvd / HASH_BYTES) {
+		putc('#');
+		if (!(++tftp_multi_num_hash % HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+}
+
+static void tftp_multi_data(struct tftp_multi_xfer *xfer, const uchar *pkt,
+			    unsigned len)
+{
+	ushort block = ntohs(*(__be16 *)pkt);
+
+	if (block != (ushort)(xfer->blocks + 1)) {
+		/* Perhaps our ACK was lost; send it again */
+		if (block == (ushort)xfer->blocks)
+			tftp_multi_send(xfer);
+		return;
+	}
+	pkt += 2;
+	len -= 2;
+	if (len > xfer->block_size)
+		return;
+	if (xfer->len + len > tftp_multi_part_size) {
+		tftp_multi_fail("TFTP: Part is larger than tftppartsize");
+		return;
+	}
+
+	tftp_multi_store(xfer, pkt, len);
+	xfer->blocks++;
+	xfer->retries = 0;
+	tftp_multi_send(xfer);
+
+	if (len == xfer->block_size)
+		return;
+
+	/* The part is complete; a short one is the last */
+	if (xfer->len < tftp_multi_part_size)
+		tftp_multi_set_end(xfer->part + 1);
+	if (xfer->part != -1 && xfer->part < tftp_multi_num_parts)
+		tftp_multi_parts_done++;
+	tftp_multi_next(xfer);
+}
+
+static void tftp_multi_handler(uchar *pkt, unsigned dest, struct in_addr sip,
+			       unsigned src, unsigned len)
+{
+	struct tftp_multi_xfer *xfer;
+	__be16 *s = (__be16 *)pkt;
+	ushort code;
+	int i;
+
+	for (xfer = tftp_multi_xfers;
+	     xfer < tftp_multi_xfers + tftp_multi_num_xfers; xfer++) {
+		if (xfer->part != -1 && xfer->our_port == dest)
+			break;
+	}
+	if (xfer == tftp_multi_xfers + tftp_multi_num_xfers)
+		return;
+	if (xfer->started && src != xfer->remote_port)
+		return;
+	if (len < 4)
+		return;
+
+	switch (ntohs(s[0])) {
+	case TFTP_OACK:
+		if (xfer->started)
+			break;
+		xfer->started = true;
+		xfer->remote_port = src;
+		for (i = 2; i + 8 < len; i++) {
+			if (!strcmp((char *)pkt + i, "blksize")) {
+				xfer->block_size = simple_strtoul(
+					(char *)pkt + i + 8, NULL, 10);
+			}
+		}
+		if (xfer->block_size < 1 ||
+		    xfer->block_size > tftp_multi_block_size) {
+			tftp_multi_fail("TFTP: Bad block size from server");
+			break;
+		}
+		tftp_multi_send(xfer);	/* ACK block 0 */
+		break;
+
+	case TFTP_DATA:
+		if (!xfer->started) {
+			/* The server ignored our options */
+			xfer->started = true;
+			xfer->remote_port = src;
+		}
+		tftp_multi_data(xfer, pkt + 2, len - 2);
+		break;
+
+	case TFTP_ERROR:
+		code = ntohs(s[1]);
+		if (code == TFTP_ERR_FILE_NOT_FOUND && xfer->part > 0 &&
+		    !xfer->started) {
+			/* There are no more parts */
+			tftp_multi_set_end(xfer->part);
+			tftp_multi_next(xfer);
+			break;
+		}
+		printf("\nTFTP error: '%s' (%d) for part %d\n",
+		       (char *)pkt + 4, code, xfer->part);
+		tftp_multi_fail("Not retrying...");
+		break;
+	}
+}
+
+static void tftp_multi_timeout(void)
+{
+	struct tftp_multi_xfer *xfer;
+
+	for (xfer = tftp_multi_xfers;
+	     xfer < tftp_multi_xfers + tftp_multi_num_xfers; xfer++) {
+		if (xfer->part == -1 || xfer->send_pending ||
+		    get_timer(xfer->time_sent) < tftp_timeout_ms)
+			continue;
+		if (++xfer->retries > tftp_timeout_count_max) {
+			printf("\nTFTP: No reply from %pI4 on %s",
+			       &xfer->server_ip, xfer->dev->name);
+			tftp_multi_fail("; giving up");
+			return;
+		}
+		puts("T ");
+		tftp_multi_send(xfer);
+	}
+	net_set_timeout_handler(TFTP_MULTI_TICK_MS, tftp_multi_timeout);
+}
+
+int tftp_multi_rx(void)
+{
+	struct tftp_multi_xfer *xfer, *other;
+	struct udevice *dev = tftp_multi_home;
+	int count = 0;
+	int ret;
+
+	for (xfer = tftp_multi_xfers;
+	     xfer < tftp_multi_xfers + tftp_multi_num_xfers &&
+	     net_state == NETLOOP_CONTINUE; xfer++) {
+		/* Poll each device once, even if it is used twice */
+		for (other = tftp_multi_xfers; other->dev != xfer->dev; other++)
+			;
+		if (other != xfer)
+			continue;
+		tftp_multi_set_dev(xfer->dev);
+		ret = eth_rx();
+		if (ret > 0)
+			count += ret;
+	}
+	if (net_state != NETLOOP_CONTINUE)
+		return count;
+
+	for (xfer = tftp_multi_xfers;
+	     xfer < tftp_multi_xfers + tftp_multi_num_xfers; xfer++) {
+		if (xfer->send_pending)
+			tftp_multi_send(xfer);
+		/* ARP requests are repeated on the current device */
+		if (arp_wait_packet_ethaddr == xfer->server_ethaddr)
+			dev = xfer->dev;
+	}
+	tftp_multi_set_dev(dev);
+
+	return count;
+}
+
+void tftp_multi_stop(void)
+{
+	int i;
+
+	if (!tftp_multi_home)
+		return;
+	for (i = 0; i < tftp_multi_num_started; i++)
+		eth_stop_dev(tftp_multi_started[i]);
+	tftp_multi_num_started = 0;
+	tftp_multi_num_xfers = 0;
+	tftp_multi_set_dev(tftp_multi_home);
+	tftp_multi_home = NULL;
+}
+
+/* Set up a transfer for each interface listed in 'tftpdevs' */
+static int tftp_multi_add_devs(struct in_addr server_ip)
+{
+	struct tftp_multi_xfer *xfer;
+	struct eth_pdata *pdata;
+	char buf[256], *name, *next, *p;
+	struct udevice *dev;
+	int ret, i;
+
+	p = getenv("tftpdevs");
+	strlcpy(buf, p ? p : eth_get_name(), sizeof(buf));
+	for (name = buf; *name; name = next) {
+		next = strchr(name, ' ');
+		if (next)
+			*next++ = '\0';
+		else
+			next = name + strlen(name);
+		if (!*name)
+			continue;
+		if (tftp_multi_num_xfers == TFTP_MULTI_MAX_DEVS) {
+			puts("Too many devices in tftpdevs\n");
+			return -E2BIG;
+		}
+
+		xfer = &tftp_multi_xfers[tftp_multi_num_xfers];
+		memset(xfer, '\0', sizeof(*xfer));
+		xfer->server_ip = server_ip;
+		p = strchr(name, ':');
+		if (p) {
+			*p = '\0';
+			xfer->server_ip = string_to_ip(p + 1);
+		}
+		dev = eth_get_dev_by_name(name);
+		if (!dev) {
+			printf("No such device '%s'\n", name);
+			return -ENODEV;
+		}
+		xfer->dev = dev;
+		xfer->part = -1;
+		tftp_multi_num_xfers++;
+
+		/* The current device is already running */
+		for (i = 0; i < tftp_multi_num_started; i++) {
+			if (tftp_multi_started[i] == dev)
+				break;
+		}
+		if (dev == tftp_multi_home || i < tftp_multi_num_started)
+			continue;
+		ret = eth_start_dev(dev);
+		if (ret) {
+			printf("Cannot start %s (err=%d)\n", dev->name, ret);
+			return ret;
+		}
+		tftp_multi_started[tftp_multi_num_started++] = dev;
+
+		/* Probing reads the MAC address from the environment */
+		pdata = dev_get_platdata(dev);
+		if (!is_valid_ethaddr(pdata->enetaddr)) {
+			printf("No MAC address for %s\n", dev->name);
+			return -EADDRNOTAVAIL;
+		}
+	}
+	if (!tftp_multi_num_xfers) {
+		puts("No devices in tftpdevs\n");
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+void tftp_multi_start(void)
+{
+	struct in_addr server_ip = net_server_ip;
+	const char *name = net_boot_file_name;
+	char *p;
+	int i;
+
+	tftp_multi_stop();
+	tftp_multi_home = eth_get_dev();
+
+	p = strchr(net_boot_file_name, ':');
+	if (p) {
+		server_ip = string_to_ip(net_boot_file_name);
+		name = p + 1;
+	}
+	strlcpy(tftp_multi_filename, name, sizeof(tftp_multi_filename));
+
+	tftp_multi_part_size = getenv_hex("tftppartsize", 0);
+	if (!tftp_multi_part_size) {
+		tftp_multi_fail("tftppartsize not set");
+		return;
+	}
+	tftp_multi_block_size = min(getenv_ulong("tftpblocksize", 10,
+						 TFTP_NOFRAG_BLOCKSIZE),
+				    (ulong)TFTP_MAX_BLOCKSIZE);
+
+	if (tftp_multi_add_devs(server_ip)) {
+		tftp_multi_fail("Cannot set up devices");
+		return;
+	}
+
+	printf("Using");
+	for (i = 0; i < tftp_multi_num_xfers; i++) {
+		printf("%s %s (server %pI4)", i ? "," : "",
+		       tftp_multi_xfers[i].dev->name,
+		       &tftp_multi_xfers[i].server_ip);
+	}
+	printf("\nOur IP address is %pI4\n", &net_ip);
+	printf("Filename '%s.*' in parts of 0x%lx bytes.",
+	       tftp_multi_filename, tftp_multi_part_size);
+	printf(" Load address: 0x%lx\n", load_addr);
+	puts("Loading: *\b");
+
+	tftp_multi_next_port = random_port();
+	tftp_multi_next_part = 0;
+	tftp_multi_num_parts = INT_MAX;
+	tftp_multi_parts_done = 0;
+	tftp_multi_rcvd = 0;
+	tftp_multi_num_hash = 0;
+	tftp_multi_time_start = get_timer(0);
+
+	net_set_udp_handler(tftp_multi_handler);
+	net_set_timeout_handler(TFTP_MULTI_TICK_MS, tftp_multi_timeout);
+	for (i = 0; i < tftp_multi_num_xfers; i++)
+		tftp_multi_next(&tftp_multi_xfers[i]);
+}
@@ -0,0 +1,28 @@
+/*
+ * Download a file over several network interfaces at once with TFTP
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __TFTP_MULTI_H__
+#define __TFTP_MULTI_H__
+
+/*
+ * Initialize the download (beginning of netloop)
+ */
+void tftp_multi_start(void);
+
+/*
+ * Check all the interfaces in use for received packets, in place of
+ * eth_rx(). Returns the number of packets received.
+ */
+int tftp_multi_rx(void);
+
+/*
+ * Stop using the extra interfaces (end of netloop)
+ */
+void tftp_multi_stop(void);
+
+#endif /* __TFTP_MULTI_H__ */
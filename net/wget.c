@@ -0,0 +1,215 @@
+/*
+ * HTTP download over TCP
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+/*
+ * This fetches a single file with an HTTP/1.1 GET request and writes the
+ * body to load_addr as it arrives. Chunked transfer encoding is not
+ * supported, so the server must send a Content-Length or close the
+ * connection at the end of the file, as is normal for static files.
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/tcp.h>
+#include "wget.h"
+
+#define HTTP_PORT		80
+/* Largest response header we accept */
+#define WGET_HDR_MAX		2048
+#define HASHES_PER_LINE		65	/* "Loading" hashes per line */
+#define HASH_BYTES		0x8000	/* Bytes per hash mark */
+
+static struct in_addr wget_server_ip;
+static int wget_server_port;
+static const char *wget_path;
+/* Response header, until it is complete */
+static char wget_hdr[WGET_HDR_MAX + 1];
+/* Size of the response header, or 0 if not yet received */
+static ulong wget_hdr_size;
+/* Length of the body from Content-Length, or -1 if not given */
+static long wget_content_len;
+static ulong wget_time_start;
+static int wget_num_hash;
+
+static void wget_fail(const char *msg)
+{
+	printf("\nwget: %s\n", msg);
+	tcp_close();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void wget_complete(void)
+{
+	ulong time_taken;
+
+	time_taken = get_timer(wget_time_start);
+	if (time_taken > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(net_boot_file_size / time_taken * 1000, "/s");
+	}
+	puts("\ndone\n");
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static void wget_connected(void)
+{
+	char req[TCP_MSS];
+	int len, ret;
+
+	len = snprintf(req, sizeof(req),
+		       "GET /%s HTTP/1.1\r\nHost: %pI4\r\nConnection: close\r\n\r\n",
+		       wget_path, &wget_server_ip);
+	ret = len < sizeof(req) ? tcp_send(req, len) : -E2BIG;
+	if (ret)
+		wget_fail("File name too long");
+}
+
+/* Check the response header, returning an error message if unusable */
+static const char *wget_parse_hdr(void)
+{
+	char *line, *next;
+
+	if (strncmp(wget_hdr, "HTTP/1.", 7) || wget_hdr[8] != ' ')
+		return "Invalid response";
+	if (simple_strtoul(wget_hdr + 9, NULL, 10) != 200) {
+		*strchr(wget_hdr, '\r') = '\0';
+		printf("\n%s", wget_hdr);
+		return "Server did not return the file";
+	}
+
+	wget_content_len = -1;
+	for (line = strchr(wget_hdr, '\n') + 1; *line; line = next + 1) {
+		next = strchr(line, '\n');
+		if (!next)
+			break;
+		if (!strncasecmp(line, "Content-Length:", 15))
+			wget_content_len = simple_strtoul(skip_spaces(line + 15),
+							  NULL, 10);
+		else if (!strncasecmp(line, "Transfer-Encoding:", 18) &&
+			 strncasecmp(line + 18, " identity", 9))
+			return "Transfer encoding not supported";
+	}
+
+	return NULL;
+}
+
+static void wget_store(const uchar *data, ulong offset, int len)
+{
+	void *ptr = map_sysmem(load_addr + offset, len);
+
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+
+	net_boot_file_size = offset + len;
+	while (wget_num_hash < net_boot_file_size / HASH_BYTES) {
+		putc('#');
+		if (!(++wget_num_hash % HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+}
+
+static void wget_recv(const uchar *data, ulong offset, int len)
+{
+	const char *err;
+	char *end;
+	int skip, n;
+
+	if (!wget_hdr_size) {
+		/* The segment ending the header may also carry body data */
+		n = min_t(int, len, WGET_HDR_MAX - offset);
+		memcpy(wget_hdr + offset, data, n);
+		wget_hdr[offset + n] = '\0';
+		end = strstr(wget_hdr, "\r\n\r\n");
+		if (!end) {
+			if (offset + n >= WGET_HDR_MAX)
+				wget_fail("Response header too long");
+			return;
+		}
+		end[2] = '\0';
+		wget_hdr_size = end + 4 - wget_hdr;
+		err = wget_parse_hdr();
+		if (err) {
+			wget_fail(err);
+			return;
+		}
+		debug("wget: Header %lu bytes, content length %ld\n",
+		      wget_hdr_size, wget_content_len);
+
+		/* The rest of this segment is the start of the body */
+		skip = wget_hdr_size - offset;
+		data += skip;
+		offset += skip;
+		len -= skip;
+	}
+
+	if (len)
+		wget_store(data, offset - wget_hdr_size, len);
+	if (wget_content_len >= 0 && net_boot_file_size >= wget_content_len) {
+		tcp_close();
+		wget_complete();
+	}
+}
+
+static void wget_closed(int err)
+{
+	if (err == -ECONNREFUSED)
+		wget_fail("Connection refused");
+	else if (err == -ECONNRESET)
+		wget_fail("Connection reset");
+	else if (err)
+		wget_fail("Connection timed out");
+	else if (!wget_hdr_size)
+		wget_fail("Connection closed before response");
+	else if (wget_content_len >= 0)
+		wget_fail("Connection closed before end of file");
+	else
+		wget_complete();
+}
+
+static const struct tcp_ops wget_ops = {
+	.connected	= wget_connected,
+	.recv		= wget_recv,
+	.closed		= wget_closed,
+};
+
+void wget_start(void)
+{
+	char *p;
+
+	wget_server_ip = net_server_ip;
+	p = strchr(net_boot_file_name, ':');
+	if (p) {
+		wget_server_ip = string_to_ip(net_boot_file_name);
+		wget_path = p + 1;
+	} else {
+		wget_path = net_boot_file_name;
+	}
+	/* The path is always sent with a leading '/' */
+	if (*wget_path == '/')
+		wget_path++;
+
+	wget_server_port = HTTP_PORT;
+	p = getenv("httpdstp");
+	if (p)
+		wget_server_port = simple_strtoul(p, NULL, 10);
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4:%d; our IP address is %pI4\n",
+	       &wget_server_ip, wget_server_port, &net_ip);
+	printf("Filename '/%s'.", wget_path);
+	printf(" Load address: 0x%lx\n", load_addr);
+	puts("Loading: *\b");
+
+	wget_hdr_size = 0;
+	wget_content_len = -1;
+	wget_num_hash = 0;
+	wget_time_start = get_timer(0);
+	tcp_connect(wget_server_ip, wget_server_port, &wget_ops);
+}
@@ -0,0 +1,17 @@
+/*
+ * HTTP download over TCP
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __WGET_H__
+#define __WGET_H__
+
+/*
+ * Initialize wget (beginning of netloop)
+ */
+void wget_start(void);
+
+#endif /* __WGET_H__ */
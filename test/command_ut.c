@@ -12,9 +12,51 @@ static const char test_cmd[] = "setenv list 1\n setenv list ${list}2; "
 		"setenv list ${list}3\0"
 		"setenv list ${list}4";
 
+#define LOOKUP_LOOPS	10000
+
+/* Check that find_cmd() agrees with find_cmd_tbl() and time them */
+static void ut_cmd_lookup(void)
+{
+	cmd_tbl_t *start = ll_entry_start(cmd_tbl_t, cmd);
+	const int count = ll_entry_count(cmd_tbl_t, cmd);
+	static const char *const names[] = {
+		"setenv", "test", "if", "echo", "run", "md.b", "printenv",
+	};
+	cmd_tbl_t *cmdtp;
+	char name[32];
+	ulong start_us, index_us, linear_us;
+	int i, len;
+
+	/* Every command, and every abbreviation of it, must match */
+	for (cmdtp = start; cmdtp != start + count; cmdtp++) {
+		strlcpy(name, cmdtp->name, sizeof(name));
+		for (len = strlen(name); len > 0; len--) {
+			name[len] = '\0';
+			assert(find_cmd(name) == find_cmd_tbl(name, start, count));
+		}
+	}
+	assert(find_cmd("cp.b") == find_cmd_tbl("cp.b", start, count));
+	assert(!find_cmd("no-such-command"));
+	assert(!find_cmd(""));
+
+	start_us = timer_get_us();
+	for (i = 0; i < LOOKUP_LOOPS; i++)
+		find_cmd(names[i % ARRAY_SIZE(names)]);
+	index_us = timer_get_us() - start_us;
+
+	start_us = timer_get_us();
+	for (i = 0; i < LOOKUP_LOOPS; i++)
+		find_cmd_tbl(names[i % ARRAY_SIZE(names)], start, count);
+	linear_us = timer_get_us() - start_us;
+
+	printf("%s: %d lookups in %d commands: find_cmd() %lu us, linear %lu us\n",
+	       __func__, LOOKUP_LOOPS, count, index_us, linear_us);
+}
+
 static int do_ut_cmd(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
 	printf("%s: Testing commands\n", __func__);
+	ut_cmd_lookup();
 	run_command("env default -f -a", 0);
 
 	/* commands separated by \n */
@@ -50,6 +92,16 @@ static int do_ut_cmd(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	assert(!strcmp("1", getenv("black")));
 	assert(getenv("adder") != NULL);
 	assert(!strcmp("2", getenv("adder")));
+
+	/* running a variable again must see changes to it and its inputs */
+	run_command("setenv foo 'for i in a b; do setenv list ${list}${i}; done'",
+		    0);
+	run_command("setenv list; run foo; run foo", 0);
+	assert(!strcmp("abab", getenv("list")));
+	run_command("setenv foo 'setenv list ${list}c'; run foo", 0);
+	assert(!strcmp("ababc", getenv("list")));
+	assert(run_command("setenv foo 'if true; then'; run foo", 0) == 1);
+	assert(run_command("setenv foo true; run foo", 0) == 0);
 #endif
 
 	assert(run_command("", 0) == 0);
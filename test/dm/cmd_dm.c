@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <asm/io.h>
 #include <dm/root.h>
+#include <dm/timing.h>
 #include <dm/util.h>
 
 static int do_dm_dump_all(cmd_tbl_t *cmdtp, int flag, int argc,
@@ -41,10 +42,26 @@ static int do_dm_dump_devres(cmd_tbl_t *cmdtp, int flag, int argc,
 	return 0;
 }
 
+#ifdef CONFIG_DM_TIMING
+static int do_dm_timing(cmd_tbl_t *cmdtp, int flag, int argc,
+			char * const argv[])
+{
+	if (argc > 0 && !strcmp(argv[0], "clear"))
+		dm_timing_clear();
+	else
+		dm_timing_show();
+
+	return 0;
+}
+#endif
+
 static cmd_tbl_t test_commands[] = {
 	U_BOOT_CMD_MKENT(tree, 0, 1, do_dm_dump_all, "", ""),
 	U_BOOT_CMD_MKENT(uclass, 1, 1, do_dm_dump_uclass, "", ""),
 	U_BOOT_CMD_MKENT(devres, 1, 1, do_dm_dump_devres, "", ""),
+#ifdef CONFIG_DM_TIMING
+	U_BOOT_CMD_MKENT(timing, 1, 1, do_dm_timing, "", ""),
+#endif
 };
 
 static __maybe_unused void dm_reloc(void)
@@ -86,4 +103,7 @@ U_BOOT_CMD(
 	"tree         Dump driver model tree ('*' = activated)\n"
 	"dm uclass        Dump list of instances for each uclass\n"
 	"dm devres        Dump list of device resources for each device"
+#ifdef CONFIG_DM_TIMING
+	"\ndm timing [clear] Show bind/probe/remove time per device, or clear"
+#endif
 );
@@ -15,6 +15,7 @@
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
+#include <dm/timing.h>
 #include <dm/uclass-internal.h>
 #include <test/ut.h>
 
@@ -796,3 +797,39 @@ static int dm_test_device_get_uclass_id(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_device_get_uclass_id, DM_TESTF_SCAN_PDATA);
+
+#ifdef CONFIG_DM_TIMING
+/* Test that bind, probe and remove times are recorded for a device */
+static int dm_test_device_timing(struct unit_test_state *uts)
+{
+	struct dm_test_state *dms = uts->priv;
+	struct udevice *dev;
+
+	/* Each operation on the device takes 2ms */
+	dms->op_delay_ms = 2;
+	ut_assertok(device_bind_by_name(dms->root, false, &driver_info_manual,
+					&dev));
+	ut_assert(dm_timing_get(dev, DM_TIMING_BIND) >= 2000);
+	ut_asserteq(0, dm_timing_get(dev, DM_TIMING_PROBE));
+
+	ut_assertok(device_probe(dev));
+	ut_assert(dm_timing_get(dev, DM_TIMING_PROBE) >= 2000);
+	ut_asserteq(0, dm_timing_get(dev, DM_TIMING_REMOVE));
+
+	ut_assertok(device_remove(dev));
+	ut_assert(dm_timing_get(dev, DM_TIMING_REMOVE) >= 2000);
+
+	/* The record goes when the device does */
+	ut_assertok(device_unbind(dev));
+	ut_asserteq(-ENOENT, dm_timing_get(dev, DM_TIMING_BIND));
+
+	/* Devices from the platform data have records too, until cleared */
+	ut_assertok(uclass_find_device(UCLASS_TEST, 0, &dev));
+	ut_assert(dm_timing_get(dev, DM_TIMING_BIND) != -ENOENT);
+	dm_timing_clear();
+	ut_asserteq(-ENOENT, dm_timing_get(dev, DM_TIMING_PROBE));
+
+	return 0;
+}
+DM_TEST(dm_test_device_timing, DM_TESTF_SCAN_PDATA | DM_TESTF_PROBE_TEST);
+#endif
@@ -11,11 +11,13 @@
 #include <dm.h>
 #include <fdtdec.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
 #include <asm/eth.h>
+#include <asm/test.h>
 #include <test/ut.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -259,3 +261,680 @@ static int dm_test_net_retry(struct unit_test_state *uts)
 	return retval;
 }
 DM_TEST(dm_test_net_retry, DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_NET_ARP_CACHE
+/* Test that ARP replies are remembered between commands */
+static int dm_test_net_arp_cache(struct unit_test_state *uts)
+{
+	uchar ethaddr[ARP_HLEN];
+	int arps;
+
+	net_ping_ip = string_to_ip("1.1.2.2");
+	setenv("ethact", "eth@10002000");
+	arp_cache_flush();
+	ut_asserteq(-ENOENT, arp_cache_lookup(net_ping_ip, ethaddr));
+
+	arps = sandbox_eth_get_arp_requests();
+	ut_assertok(net_loop(PING));
+	ut_asserteq(arps + 1, sandbox_eth_get_arp_requests());
+	ut_assertok(arp_cache_lookup(net_ping_ip, ethaddr));
+	ut_assert(is_valid_ethaddr(ethaddr));
+
+	/* The second ping needs no ARP request */
+	ut_assertok(net_loop(PING));
+	ut_asserteq(arps + 1, sandbox_eth_get_arp_requests());
+
+	/* Another device has its own entries */
+	setenv("ethact", "eth@10003000");
+	ut_assertok(net_loop(PING));
+	ut_asserteq(arps + 2, sandbox_eth_get_arp_requests());
+
+	/* Starting again, e.g. after a protocol timeout, forgets them */
+	net_start_again();
+	ut_asserteq(-ENOENT, arp_cache_lookup(net_ping_ip, ethaddr));
+	ut_assertok(net_loop(PING));
+	ut_asserteq(arps + 3, sandbox_eth_get_arp_requests());
+
+	/* Entries expire */
+	sandbox_timer_add_offset(CONFIG_NET_ARP_CACHE_TIMEOUT * 1000UL + 1);
+	ut_asserteq(-ETIMEDOUT, arp_cache_lookup(net_ping_ip, ethaddr));
+	ut_assertok(net_loop(PING));
+	ut_asserteq(arps + 4, sandbox_eth_get_arp_requests());
+
+	setenv("ethact", NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_net_arp_cache, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_IP_DEFRAG
+#define DEFRAG_TEST_SIZE	4000	/* UDP datagram, making 3 fragments */
+#define DEFRAG_TEST_FRAG	1480	/* fragment payload size */
+
+static int defrag_test_id;
+static int defrag_test_len;
+/* Set to send datagrams with a bad UDP checksum */
+static bool defrag_test_bad_sum;
+
+static void defrag_test_handler(uchar *pkt, unsigned dport,
+				struct in_addr sip, unsigned sport,
+				unsigned len)
+{
+	int i;
+
+	defrag_test_id = dport;
+	defrag_test_len = len;
+	for (i = 0; i < len; i++) {
+		if (pkt[i] != (uchar)(dport + i))
+			defrag_test_len = -1;
+	}
+}
+
+/* Receive one fragment of test datagram @id, starting at byte @start */
+static void defrag_test_recv(int id, int start)
+{
+	uchar dgram[DEFRAG_TEST_SIZE];
+	uchar pkt[ETHER_HDR_SIZE + IP_HDR_SIZE + DEFRAG_TEST_FRAG];
+	struct ethernet_hdr *et = (struct ethernet_hdr *)pkt;
+	struct ip_udp_hdr *ip = (struct ip_udp_hdr *)(pkt + ETHER_HDR_SIZE);
+	int len = min(DEFRAG_TEST_SIZE - start, DEFRAG_TEST_FRAG);
+	__be16 *udp = (__be16 *)dgram;
+	struct {
+		struct in_addr src;
+		struct in_addr dest;
+		u8 zero;
+		u8 proto;
+		__be16 len;
+	} __attribute__((packed)) pseudo;
+	int i;
+
+	/* The datagram is sent to port @id, and its data depends on @id */
+	udp[0] = htons(1234);
+	udp[1] = htons(id);
+	udp[2] = htons(DEFRAG_TEST_SIZE);
+	udp[3] = 0;
+	for (i = UDP_HDR_SIZE; i < DEFRAG_TEST_SIZE; i++)
+		dgram[i] = id + i - UDP_HDR_SIZE;
+
+	pseudo.src = string_to_ip("1.1.2.3");
+	pseudo.dest = net_ip;
+	pseudo.zero = 0;
+	pseudo.proto = IPPROTO_UDP;
+	pseudo.len = htons(DEFRAG_TEST_SIZE);
+	udp[3] = add_ip_checksums(sizeof(pseudo),
+				  compute_ip_checksum(&pseudo, sizeof(pseudo)),
+				  compute_ip_checksum(dgram, DEFRAG_TEST_SIZE));
+	if (defrag_test_bad_sum)
+		udp[3] ^= 1;
+
+	memset(pkt, '\0', sizeof(pkt));
+	et->et_protlen = htons(PROT_IP);
+	ip->ip_hl_v = 0x45;
+	ip->ip_len = htons(IP_HDR_SIZE + len);
+	ip->ip_id = htons(id);
+	ip->ip_off = htons(start / 8 | (start + len < DEFRAG_TEST_SIZE ?
+					IP_FLAGS_MFRAG : 0));
+	ip->ip_ttl = 255;
+	ip->ip_p = IPPROTO_UDP;
+	net_write_ip(&ip->ip_src, string_to_ip("1.1.2.3"));
+	net_write_ip(&ip->ip_dst, net_ip);
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+	memcpy(pkt + ETHER_HDR_SIZE + IP_HDR_SIZE, dgram + start, len);
+
+	defrag_test_id = 0;
+	net_process_received_packet(pkt, ETHER_HDR_SIZE + IP_HDR_SIZE + len);
+}
+
+/* Test reassembly of several interleaved fragmented datagrams */
+static int dm_test_net_defrag(struct unit_test_state *uts)
+{
+	struct in_addr old_ip = net_ip;
+	int i;
+
+	net_ip = string_to_ip("1.1.2.2");
+	net_set_udp_handler(defrag_test_handler);
+	memset(&net_defrag_stats, '\0', sizeof(net_defrag_stats));
+
+	/* Two datagrams at once, with fragments out of order */
+	defrag_test_recv(100, 0);
+	defrag_test_recv(200, 0);
+	defrag_test_recv(200, 2 * DEFRAG_TEST_FRAG);
+	defrag_test_recv(100, 2 * DEFRAG_TEST_FRAG);
+	ut_asserteq(0, defrag_test_id);
+	defrag_test_recv(100, DEFRAG_TEST_FRAG);
+	ut_asserteq(100, defrag_test_id);
+	ut_asserteq(DEFRAG_TEST_SIZE - UDP_HDR_SIZE, defrag_test_len);
+	defrag_test_recv(200, DEFRAG_TEST_FRAG);
+	ut_asserteq(200, defrag_test_id);
+	ut_asserteq(DEFRAG_TEST_SIZE - UDP_HDR_SIZE, defrag_test_len);
+	ut_asserteq(6, net_defrag_stats.fragments);
+	ut_asserteq(2, net_defrag_stats.datagrams);
+	ut_asserteq(0, net_defrag_stats.dropped);
+
+	/* A duplicate fragment is dropped */
+	defrag_test_recv(300, 0);
+	defrag_test_recv(300, 0);
+	ut_asserteq(1, net_defrag_stats.dropped);
+
+	/* Too many partial datagrams: the oldest one is discarded */
+	for (i = 1; i <= CONFIG_NET_DEFRAG_SLOTS; i++)
+		defrag_test_recv(300 + i, 0);
+	ut_asserteq(1, net_defrag_stats.evicted);
+	ut_asserteq(2, net_defrag_stats.dropped);
+
+	/* ...but the others can still be completed */
+	defrag_test_recv(301, DEFRAG_TEST_FRAG);
+	defrag_test_recv(301, 2 * DEFRAG_TEST_FRAG);
+	ut_asserteq(301, defrag_test_id);
+	ut_asserteq(DEFRAG_TEST_SIZE - UDP_HDR_SIZE, defrag_test_len);
+
+#ifdef CONFIG_UDP_CHECKSUM
+	/* A datagram which was corrupted is dropped once reassembled */
+	defrag_test_bad_sum = true;
+	defrag_test_recv(400, 0);
+	defrag_test_recv(400, DEFRAG_TEST_FRAG);
+	defrag_test_recv(400, 2 * DEFRAG_TEST_FRAG);
+	ut_asserteq(0, defrag_test_id);
+	defrag_test_bad_sum = false;
+#endif
+
+	net_set_udp_handler(NULL);
+	net_ip = old_ip;
+
+	return 0;
+}
+DM_TEST(dm_test_net_defrag, 0);
+#endif
+
+#define RX_BATCH_TEST_COUNT	100000
+#define RX_BATCH_TEST_PORT	4321
+
+static int rx_batch_test_count;
+
+static void rx_batch_test_handler(uchar *pkt, unsigned dport,
+				  struct in_addr sip, unsigned sport,
+				  unsigned len)
+{
+	if (dport == RX_BATCH_TEST_PORT)
+		rx_batch_test_count++;
+}
+
+/* Stress test: receive a flood of UDP packets and measure the rate */
+static int dm_test_net_rx_batch(struct unit_test_state *uts)
+{
+	uchar pkt[ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + 64];
+	struct ethernet_hdr *et = (struct ethernet_hdr *)pkt;
+	struct ip_udp_hdr *ip = (struct ip_udp_hdr *)(pkt + ETHER_HDR_SIZE);
+	struct in_addr old_ip = net_ip;
+	ulong start, elapsed;
+	int polls;
+
+	net_ip = string_to_ip("1.1.2.2");
+	memset(pkt, '\0', sizeof(pkt));
+	et->et_protlen = htons(PROT_IP);
+	net_set_udp_header((uchar *)ip, net_ip, RX_BATCH_TEST_PORT, 1234, 64);
+
+	setenv("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	net_set_udp_handler(rx_batch_test_handler);
+	rx_batch_test_count = 0;
+	sandbox_eth_set_rx_flood(pkt, sizeof(pkt), RX_BATCH_TEST_COUNT);
+
+	start = timer_get_us();
+	for (polls = 0; rx_batch_test_count < RX_BATCH_TEST_COUNT &&
+	     polls < RX_BATCH_TEST_COUNT; polls++)
+		ut_assert(eth_rx() > 0);
+	elapsed = max(timer_get_us() - start, 1UL);
+	printf("%d packets in %lu us: %lu packets/s\n", rx_batch_test_count,
+	       elapsed, (ulong)((u64)rx_batch_test_count * 1000000 / elapsed));
+
+	/* Each poll should take as many packets as it is allowed */
+	ut_asserteq(RX_BATCH_TEST_COUNT, rx_batch_test_count);
+	ut_asserteq(DIV_ROUND_UP(RX_BATCH_TEST_COUNT, CONFIG_NET_RX_BUDGET),
+		    polls);
+	ut_asserteq(0, eth_rx());
+
+	sandbox_eth_set_rx_flood(NULL, 0, 0);
+	net_set_udp_handler(NULL);
+	eth_halt();
+	setenv("ethact", NULL);
+	net_ip = old_ip;
+
+	return 0;
+}
+DM_TEST(dm_test_net_rx_batch, DM_TESTF_SCAN_FDT);
+
+/* Test the checksum functions against a simple 16-bit sum */
+static int dm_test_net_checksum(struct unit_test_state *uts)
+{
+	u16 src[512], dest[516];
+	int align, len, i;
+	u32 sum;
+
+	for (i = 0; i < ARRAY_SIZE(src); i++)
+		src[i] = i * 0x9e37;
+
+	for (align = 0; align < 4; align++) {
+		for (len = 0; len <= 2 * (ARRAY_SIZE(src) - 2); len++) {
+			const uchar *bytes = (uchar *)(src + align % 2);
+
+			sum = 0;
+			for (i = 0; i < len / 2; i++)
+				sum += src[align % 2 + i];
+			if (len & 1)
+				sum += be16_to_cpu(bytes[len - 1] << 8);
+			while (sum >> 16)
+				sum = (sum & 0xffff) + (sum >> 16);
+			sum = ~sum & 0xffff;
+
+			ut_asserteq(sum, compute_ip_checksum(bytes, len));
+
+			/* Try each source and destination alignment */
+			memset(dest, '\0', sizeof(dest));
+			ut_asserteq(sum, compute_ip_checksum_copy(
+					dest + align / 2, bytes, len));
+			ut_assertok(memcmp(dest + align / 2, bytes, len));
+			ut_asserteq(0, ((uchar *)(dest + align / 2))[len]);
+		}
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_net_checksum, 0);
+
+#ifdef CONFIG_NET_RX_DIRECT
+#define RX_DIRECT_TEST_ADDR	0x100000
+#define RX_DIRECT_TEST_SIZE	3000
+
+/* Load the file and check that memory around it is untouched */
+static int check_rx_direct(struct unit_test_state *uts)
+{
+	uchar *buf;
+	int i;
+
+	buf = map_sysmem(RX_DIRECT_TEST_ADDR - 0x100, 0x100 +
+			 RX_DIRECT_TEST_SIZE + 0x100);
+	memset(buf, 0xa5, 0x100 + RX_DIRECT_TEST_SIZE + 0x100);
+
+	sandbox_eth_set_tftp_file(RX_DIRECT_TEST_SIZE);
+	ut_asserteq(RX_DIRECT_TEST_SIZE, net_loop(TFTPGET));
+	sandbox_eth_set_tftp_file(-1);
+
+	for (i = 0; i < RX_DIRECT_TEST_SIZE; i++)
+		ut_asserteq(sandbox_eth_file_byte(i), buf[0x100 + i]);
+
+	/* Memory overwritten by packet headers must be restored */
+	for (i = 0; i < 0x100; i++) {
+		ut_asserteq(0xa5, buf[i]);
+		ut_asserteq(0xa5, buf[0x100 + RX_DIRECT_TEST_SIZE + i]);
+	}
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+/* Test that TFTP data is received straight into the load area */
+static int dm_test_net_rx_direct(struct unit_test_state *uts)
+{
+	ulong old_load_addr = load_addr;
+
+	setenv("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+	strcpy(net_boot_file_name, "rx_direct.bin");
+	load_addr = RX_DIRECT_TEST_ADDR;
+	ut_assertok(check_rx_direct(uts));
+
+	/* At most the first block is copied, depending on ARP timing */
+	ut_asserteq(RX_DIRECT_TEST_SIZE, net_rx_stats.payload);
+	ut_assert(net_rx_stats.copied <= 512);
+
+	/*
+	 * A duplicate of the last full block arrives where the short final
+	 * block is expected. It does not fit, so must not be received there.
+	 */
+	setenv("tftpwindowsize", "4");
+	sandbox_eth_dup_tftp_block(RX_DIRECT_TEST_SIZE / 512);
+	ut_assertok(check_rx_direct(uts));
+
+	load_addr = old_load_addr;
+	setenv("tftpwindowsize", NULL);
+	setenv("ethact", NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_net_rx_direct, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_NET_TFTP_VARS
+#define TFTP_WINDOW_TEST_ADDR	0x100000
+#define TFTP_WINDOW_TEST_SIZE	10000
+#define TFTP_WINDOW_TEST_BLOCKS	DIV_ROUND_UP(TFTP_WINDOW_TEST_SIZE, 512)
+
+static int check_tftp_window(struct unit_test_state *uts, int acks)
+{
+	uchar *buf;
+	int i;
+
+	buf = map_sysmem(TFTP_WINDOW_TEST_ADDR, TFTP_WINDOW_TEST_SIZE + 0x100);
+	memset(buf, 0xa5, TFTP_WINDOW_TEST_SIZE + 0x100);
+
+	sandbox_eth_set_tftp_file(TFTP_WINDOW_TEST_SIZE);
+	ut_asserteq(TFTP_WINDOW_TEST_SIZE, net_loop(TFTPGET));
+	sandbox_eth_set_tftp_file(-1);
+	ut_asserteq(acks, sandbox_eth_get_tftp_acks());
+
+	for (i = 0; i < TFTP_WINDOW_TEST_SIZE; i++)
+		ut_asserteq(sandbox_eth_file_byte(i), buf[i]);
+	ut_asserteq(0xa5, buf[TFTP_WINDOW_TEST_SIZE]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+/* Test that TFTP uses the window size agreed with the server */
+static int dm_test_net_tftp_window(struct unit_test_state *uts)
+{
+	ulong old_load_addr = load_addr;
+	int windows = DIV_ROUND_UP(TFTP_WINDOW_TEST_BLOCKS, 4);
+
+	setenv("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+	strcpy(net_boot_file_name, "window.bin");
+	load_addr = TFTP_WINDOW_TEST_ADDR;
+
+	/* One ACK for the OACK, then one at the end of each window */
+	setenv("tftpwindowsize", "4");
+	ut_assertok(check_tftp_window(uts, 1 + windows));
+
+	/*
+	 * A lost block is acknowledged as soon as the next one arrives, so
+	 * the server sends the window again starting with the lost block
+	 */
+	sandbox_eth_drop_tftp_block(6);
+	ut_assertok(check_tftp_window(uts, 2 + windows));
+
+	/* Without the option, every block (and the OACK) is acknowledged */
+	setenv("tftpwindowsize", "1");
+	ut_assertok(check_tftp_window(uts, 1 + TFTP_WINDOW_TEST_BLOCKS));
+
+	load_addr = old_load_addr;
+	setenv("tftpwindowsize", NULL);
+	setenv("ethact", NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_net_tftp_window, DM_TESTF_SCAN_FDT);
+#endif
+
+#if defined(CONFIG_DHCP_RAPID_COMMIT) || defined(CONFIG_DHCP_LEASE_REUSE)
+#define DHCP_TEST_ADDR		"1.2.3.10"
+
+/* Get an address with DHCP, checking the replies the server sent */
+static int check_dhcp(struct unit_test_state *uts, int offers, int acks,
+		      int naks)
+{
+	ut_assertok(net_loop(DHCP));
+	ut_asserteq(string_to_ip(DHCP_TEST_ADDR).s_addr, net_ip.s_addr);
+	ut_asserteq(offers, sandbox_eth_get_dhcp_replies(SB_DHCP_OFFER));
+	ut_asserteq(acks, sandbox_eth_get_dhcp_replies(SB_DHCP_ACK));
+	ut_asserteq(naks, sandbox_eth_get_dhcp_replies(SB_DHCP_NAK));
+
+	return 0;
+}
+
+static void dhcp_test_setup(struct in_addr *old_ip, struct in_addr *old_server,
+			    struct in_addr *old_mask)
+{
+	*old_ip = net_ip;
+	*old_server = net_server_ip;
+	*old_mask = net_netmask;
+	setenv("ethact", "eth@10002000");
+	setenv("autoload", "no");
+	setenv("dhcplease", NULL);
+}
+
+static void dhcp_test_cleanup(struct in_addr old_ip, struct in_addr old_server,
+			      struct in_addr old_mask)
+{
+	sandbox_eth_set_dhcp(NULL, false);
+	setenv("dhcplease", NULL);
+	setenv("autoload", NULL);
+	setenv("ethact", NULL);
+	net_ip = old_ip;
+	net_server_ip = old_server;
+	net_netmask = old_mask;
+}
+#endif
+
+#ifdef CONFIG_DHCP_RAPID_COMMIT
+/* Test that DHCP uses Rapid Commit if the server supports it */
+static int dm_test_net_dhcp_rapid(struct unit_test_state *uts)
+{
+	struct in_addr old_ip, old_server, old_mask;
+
+	dhcp_test_setup(&old_ip, &old_server, &old_mask);
+
+	/* The server ACKs the discovery straight away */
+	sandbox_eth_set_dhcp(DHCP_TEST_ADDR, true);
+	ut_assertok(check_dhcp(uts, 0, 1, 0));
+
+	/* Otherwise it makes an offer which must be requested */
+	setenv("dhcplease", NULL);
+	sandbox_eth_set_dhcp(DHCP_TEST_ADDR, false);
+	ut_assertok(check_dhcp(uts, 1, 1, 0));
+
+	dhcp_test_cleanup(old_ip, old_server, old_mask);
+
+	return 0;
+}
+DM_TEST(dm_test_net_dhcp_rapid, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_DHCP_LEASE_REUSE
+/* Test that DHCP asks for the previous address first (INIT-REBOOT) */
+static int dm_test_net_dhcp_lease(struct unit_test_state *uts)
+{
+	struct in_addr old_ip, old_server, old_mask;
+
+	dhcp_test_setup(&old_ip, &old_server, &old_mask);
+	sandbox_eth_set_dhcp(DHCP_TEST_ADDR, false);
+
+	/* The first time, the address is saved once bound */
+	ut_assertok(check_dhcp(uts, 1, 1, 0));
+	ut_asserteq_str(DHCP_TEST_ADDR, getenv("dhcplease"));
+
+	/* Next time the request is ACKed without waiting for an offer */
+	sandbox_eth_set_dhcp(DHCP_TEST_ADDR, false);
+	ut_assertok(check_dhcp(uts, 0, 1, 0));
+	ut_asserteq_str(DHCP_TEST_ADDR, getenv("dhcplease"));
+
+	/* An address which the server refuses is dropped for the offer */
+	setenv("dhcplease", "1.2.3.99");
+	sandbox_eth_set_dhcp(DHCP_TEST_ADDR, false);
+	ut_assertok(check_dhcp(uts, 1, 1, 1));
+	ut_asserteq_str(DHCP_TEST_ADDR, getenv("dhcplease"));
+
+	dhcp_test_cleanup(old_ip, old_server, old_mask);
+
+	return 0;
+}
+DM_TEST(dm_test_net_dhcp_lease, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_CMD_WGET
+#define WGET_TEST_ADDR		0x100000
+#define WGET_TEST_SIZE		5000
+/* Padding which makes the header end just after the second segment */
+#define WGET_TEST_HDR_PAD	1960
+
+static int check_wget(struct unit_test_state *uts, int hdr_pad)
+{
+	uchar *buf;
+	int i;
+
+	buf = map_sysmem(WGET_TEST_ADDR, WGET_TEST_SIZE + 0x100);
+	memset(buf, 0xa5, WGET_TEST_SIZE + 0x100);
+
+	sandbox_eth_set_http_file(WGET_TEST_SIZE);
+	sandbox_eth_set_http_hdr_pad(hdr_pad);
+	ut_asserteq(WGET_TEST_SIZE, net_loop(WGET));
+	sandbox_eth_set_http_hdr_pad(0);
+	sandbox_eth_set_http_file(-1);
+
+	for (i = 0; i < WGET_TEST_SIZE; i++)
+		ut_asserteq(sandbox_eth_file_byte(i), buf[i]);
+	ut_asserteq(0xa5, buf[WGET_TEST_SIZE]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+/* Test downloading a file over HTTP */
+static int dm_test_net_wget(struct unit_test_state *uts)
+{
+	ulong old_load_addr = load_addr;
+
+	setenv("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+	strcpy(net_boot_file_name, "wget.bin");
+	load_addr = WGET_TEST_ADDR;
+	ut_assertok(check_wget(uts, 0));
+
+	/* A long header ending in a segment which also carries the body */
+	ut_assertok(check_wget(uts, WGET_TEST_HDR_PAD));
+
+	/* A header which does not fit is refused */
+	sandbox_eth_set_http_file(WGET_TEST_SIZE);
+	sandbox_eth_set_http_hdr_pad(WGET_TEST_HDR_PAD * 2);
+	ut_assert(net_loop(WGET) < 0);
+	sandbox_eth_set_http_hdr_pad(0);
+	sandbox_eth_set_http_file(-1);
+
+	load_addr = old_load_addr;
+	setenv("ethact", NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_net_wget, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_CMD_NFS
+#define NFS_TEST_ADDR		0x100000
+#define NFS_TEST_SIZE		10000
+
+static int check_nfs(struct unit_test_state *uts, int flags, int version)
+{
+	uchar *buf;
+	int i;
+
+	buf = map_sysmem(NFS_TEST_ADDR - 0x100, 0x100 + NFS_TEST_SIZE + 0x100);
+	memset(buf, 0xa5, 0x100 + NFS_TEST_SIZE + 0x100);
+
+	sandbox_eth_set_nfs_file(NFS_TEST_SIZE, flags);
+	ut_asserteq(NFS_TEST_SIZE, net_loop(NFS));
+	ut_asserteq(version, sandbox_eth_get_nfs_version());
+	ut_asserteq(CONFIG_NFS_READ_WINDOW, sandbox_eth_get_nfs_max_reads());
+	sandbox_eth_set_nfs_file(-1, 0);
+
+	for (i = 0; i < NFS_TEST_SIZE; i++)
+		ut_asserteq(sandbox_eth_file_byte(i), buf[0x100 + i]);
+
+	/* Memory overwritten by packet headers must be restored */
+	for (i = 0; i < 0x100; i++) {
+		ut_asserteq(0xa5, buf[i]);
+		ut_asserteq(0xa5, buf[0x100 + NFS_TEST_SIZE + i]);
+	}
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+/* Test NFS with several READs in flight, answered in various ways */
+static int dm_test_net_nfs(struct unit_test_state *uts)
+{
+	ulong old_load_addr = load_addr;
+
+	setenv("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+	strcpy(net_boot_file_name, "/export/nfs.bin");
+	load_addr = NFS_TEST_ADDR;
+	ut_assertok(check_nfs(uts, 0, 3));
+#ifdef CONFIG_NET_RX_DIRECT
+	/* Replies arrive in order, so all data is received in place */
+	ut_asserteq(NFS_TEST_SIZE, net_rx_stats.payload);
+	ut_asserteq(0, net_rx_stats.copied);
+#endif
+
+	/* Replies to later READs arrive first */
+	ut_assertok(check_nfs(uts, SB_NFS_REORDER, 3));
+
+	/* Each reply is short, so the rest must be asked for again */
+	ut_assertok(check_nfs(uts, SB_NFS_SHORT, 3));
+	ut_assertok(check_nfs(uts, SB_NFS_SHORT | SB_NFS_REORDER, 3));
+
+	/* Without NFSv3 the server is used with NFSv2 */
+	ut_assertok(check_nfs(uts, SB_NFS_V2_ONLY, 2));
+	ut_assertok(check_nfs(uts, SB_NFS_V2_ONLY | SB_NFS_REORDER, 2));
+
+	load_addr = old_load_addr;
+	setenv("ethact", NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_net_nfs, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_CMD_TFTPMULTI
+#define TFTPMULTI_TEST_ADDR	0x100000
+#define TFTPMULTI_TEST_PART	3000
+
+static int check_tftpmulti(struct unit_test_state *uts, int size)
+{
+	uchar *buf;
+	int i;
+
+	buf = map_sysmem(TFTPMULTI_TEST_ADDR, size + 0x100);
+	memset(buf, 0xa5, size + 0x100);
+
+	sandbox_eth_set_tftp_file(size);
+	ut_asserteq(size, net_loop(TFTPMULTI));
+	sandbox_eth_set_tftp_file(-1);
+
+	for (i = 0; i < size; i++)
+		ut_asserteq(sandbox_eth_file_byte(i), buf[i]);
+	ut_asserteq(0xa5, buf[size]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+/* Test downloading a file in parts over two interfaces */
+static int dm_test_net_tftpmulti(struct unit_test_state *uts)
+{
+	ulong old_load_addr = load_addr;
+
+	setenv("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+	setenv("tftpdevs", "eth@10002000 eth@10003000");
+	setenv_hex("tftppartsize", TFTPMULTI_TEST_PART);
+	strcpy(net_boot_file_name, "multi.bin");
+	load_addr = TFTPMULTI_TEST_ADDR;
+	sandbox_eth_set_tftp_part_size(TFTPMULTI_TEST_PART);
+
+	/* The last part is short */
+	ut_assertok(check_tftpmulti(uts, 10000));
+	/* The end is found when the part after the last one is missing */
+	ut_assertok(check_tftpmulti(uts, 3 * TFTPMULTI_TEST_PART));
+	ut_asserteq_str("eth@10002000", eth_get_name());
+
+	sandbox_eth_set_tftp_part_size(0);
+	load_addr = old_load_addr;
+	setenv("tftppartsize", NULL);
+	setenv("tftpdevs", NULL);
+	setenv("ethact", NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_net_tftpmulti, DM_TESTF_SCAN_FDT);
+#endif
@@ -6,7 +6,11 @@
 
 #include <common.h>
 #include <dm.h>
+#include <malloc.h>
 #include <mmc.h>
+#include <asm/test.h>
+#include <asm/unaligned.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
@@ -44,3 +48,225 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Read from an MMC device and look for the string we expect */
+static int check_mmc_read(struct unit_test_state *uts, const char *devnum)
+{
+	struct blk_desc *dev_desc;
+	char cmp[1024];
+
+	ut_asserteq(simple_strtoul(devnum, NULL, 10),
+		    blk_get_device_by_str("mmc", devnum, &dev_desc));
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(dev_desc, 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+
+	return 0;
+}
+
+/* Test selecting HS400 on eMMC, and falling back when it or tuning fails */
+static int dm_test_mmc_hs400(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct mmc *mmc;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 2, &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_asserteq(MMC_TIMING_MMC_HS400, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq(8, mmc->bus_width);
+	ut_asserteq(1, mmc->ddr_mode);
+	ut_asserteq(MMC_HS200_MAX_DTR, mmc->clock);
+	ut_asserteq(1, sandbox_mmc_get_tuning_count(dev));
+	ut_assertok(check_mmc_read(uts, "2"));
+
+	/* If the card rejects HS400, HS200 is selected and tuned again */
+	sandbox_mmc_set_hs400_fail(dev, true);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(MMC_TIMING_MMC_HS200, mmc->timing);
+	ut_asserteq(8, mmc->bus_width);
+	ut_asserteq(0, mmc->ddr_mode);
+	ut_asserteq(MMC_HS200_MAX_DTR, mmc->clock);
+	ut_asserteq(3, sandbox_mmc_get_tuning_count(dev));
+	ut_assertok(check_mmc_read(uts, "2"));
+	sandbox_mmc_set_hs400_fail(dev, false);
+
+	/* Without HS200 tuning the best mode left is DDR52 */
+	sandbox_mmc_set_tuning_fail(dev, true);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(MMC_TIMING_MMC_DDR52, mmc->timing);
+	ut_asserteq(8, mmc->bus_width);
+	ut_asserteq(1, mmc->ddr_mode);
+	ut_asserteq(52000000, mmc->clock);
+	ut_asserteq(4, sandbox_mmc_get_tuning_count(dev));
+	ut_assertok(check_mmc_read(uts, "2"));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_hs400, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/*
+ * Test selecting UHS-I SDR104 on SD, and falling back when tuning or the
+ * switch to 1.8V fails
+ */
+static int dm_test_mmc_uhs(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct mmc *mmc;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_asserteq(MMC_TIMING_UHS_SDR104, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq(4, mmc->bus_width);
+	ut_asserteq(SD_UHS_SDR104_MAX_DTR, mmc->clock);
+	ut_asserteq(1, sandbox_mmc_get_tuning_count(dev));
+	ut_assertok(check_mmc_read(uts, "0"));
+
+	/*
+	 * Without a power cycle the card stays at 1.8V. It does not offer the
+	 * switch again, so CMD11 (which it would reject) is not sent.
+	 */
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(MMC_TIMING_UHS_SDR104, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq(2, sandbox_mmc_get_tuning_count(dev));
+	ut_assertok(check_mmc_read(uts, "0"));
+
+	/* SDR104 and SDR50 both fail to tune, leaving high speed */
+	sandbox_mmc_set_tuning_fail(dev, true);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(MMC_TIMING_SD_HS, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq(4, mmc->bus_width);
+	ut_asserteq(50000000, mmc->clock);
+	ut_asserteq(4, sandbox_mmc_get_tuning_count(dev));
+	ut_assertok(check_mmc_read(uts, "0"));
+	sandbox_mmc_set_tuning_fail(dev, false);
+
+	/*
+	 * A card put in afterwards starts at 3.3V and does not answer at 1.8V,
+	 * so the host goes back to 3.3V and switches the card to 1.8V again
+	 */
+	sandbox_mmc_power_cycle(dev);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(MMC_TIMING_UHS_SDR104, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq(5, sandbox_mmc_get_tuning_count(dev));
+	ut_assertok(check_mmc_read(uts, "0"));
+
+	/* A card which fails to switch to 1.8V is used at 3.3V instead */
+	sandbox_mmc_power_cycle(dev);
+	sandbox_mmc_set_cmd11_fail(dev, true);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(MMC_TIMING_SD_HS, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_330, mmc->signal_voltage);
+	ut_asserteq(50000000, mmc->clock);
+	ut_asserteq(5, sandbox_mmc_get_tuning_count(dev));
+	ut_assertok(check_mmc_read(uts, "0"));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_uhs, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_MMC_SDHCI_ADMA
+/* Check that @buf holds blocks from @start onwards of the emulated card */
+static int check_sdhci_data(struct unit_test_state *uts, const u8 *buf,
+			    int start, int count)
+{
+	int i;
+
+	for (i = 0; i < count * 512; i += 4)
+		ut_asserteq(start * 512 + i, get_unaligned_le32(buf + i));
+
+	return 0;
+}
+
+/*
+ * Check SDHCI transfers with ADMA2 descriptors, and the fallback to PIO. The
+ * descriptor counts are the same for ADMA32 and ADMA64.
+ */
+static int check_sdhci_adma(struct unit_test_state *uts, struct udevice *dev)
+{
+	int descs, pio_bytes, old_descs, old_pio_bytes;
+	struct blk_desc *dev_desc;
+	struct mmc *mmc;
+	u8 *buf;
+
+	mmc = mmc_get_mmc_dev(dev);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(1, blk_get_device_by_str("mmc", "1", &dev_desc));
+	ut_asserteq(4096, dev_desc->lba);
+	buf = memalign(ARCH_DMA_MINALIGN, 2048 * 512 + 4);
+	ut_assertnonnull(buf);
+
+	/* 1MB needs 17 descriptors, and no PIO */
+	sandbox_sdhci_get_stats(dev, &old_descs, &old_pio_bytes);
+	ut_asserteq(2048, blk_dread(dev_desc, 100, 2048, buf));
+	ut_assertok(check_sdhci_data(uts, buf, 100, 2048));
+	sandbox_sdhci_get_stats(dev, &descs, &pio_bytes);
+	ut_asserteq(17, descs - old_descs);
+	ut_asserteq(old_pio_bytes, pio_bytes);
+
+	/* Write some blocks back elsewhere and read them again */
+	ut_asserteq(8, blk_dwrite(dev_desc, 1000, 8, buf));
+	memset(buf, '\0', 8 * 512);
+	ut_asserteq(8, blk_dread(dev_desc, 1000, 8, buf));
+	ut_assertok(check_sdhci_data(uts, buf, 100, 8));
+	sandbox_sdhci_get_stats(dev, &descs, &pio_bytes);
+	ut_asserteq(old_pio_bytes, pio_bytes);
+
+	/* A buffer which is not 4-byte aligned must use PIO */
+	sandbox_sdhci_get_stats(dev, &old_descs, &old_pio_bytes);
+	ut_asserteq(4, blk_dread(dev_desc, 20, 4, buf + 2));
+	ut_assertok(check_sdhci_data(uts, buf + 2, 20, 4));
+	sandbox_sdhci_get_stats(dev, &descs, &pio_bytes);
+	ut_asserteq(old_descs, descs);
+	ut_asserteq(4 * 512, pio_bytes - old_pio_bytes);
+
+	free(buf);
+
+	return 0;
+}
+
+/* Test SDHCI transfers with ADMA64 and ADMA32 */
+static int dm_test_mmc_sdhci_adma(struct unit_test_state *uts)
+{
+	int descs, pio_bytes, old_descs, old_pio_bytes;
+	struct blk_desc *dev_desc;
+	struct udevice *dev;
+	u8 high[4 * 512];
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 1, &dev));
+	ut_assertok(check_sdhci_adma(uts, dev));
+
+	/* The emulator refuses ADMA64 once the controller cannot do it */
+	sandbox_sdhci_set_64bit(dev, false);
+	ut_assertok(device_remove(dev));
+	ut_assertok(uclass_get_device(UCLASS_MMC, 1, &dev));
+	ut_assertok(check_sdhci_adma(uts, dev));
+
+	/*
+	 * Sandbox RAM is below 4GB, but the stack is not. ADMA32 cannot reach
+	 * it, so the transfer falls back to PIO.
+	 */
+	ut_assert(upper_32_bits((ulong)high));
+	ut_asserteq(1, blk_get_device_by_str("mmc", "1", &dev_desc));
+	sandbox_sdhci_get_stats(dev, &old_descs, &old_pio_bytes);
+	ut_asserteq(4, blk_dread(dev_desc, 30, 4, high));
+	ut_assertok(check_sdhci_data(uts, high, 30, 4));
+	sandbox_sdhci_get_stats(dev, &descs, &pio_bytes);
+	ut_asserteq(old_descs, descs);
+	ut_asserteq(4 * 512, pio_bytes - old_pio_bytes);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_sdhci_adma, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+#endif
@@ -14,6 +14,7 @@
 #include <dm/test.h>
 #include <test/ut.h>
 #include <asm/io.h>
+#include <asm/test.h>
 
 int dm_testdrv_op_count[DM_TEST_OP_COUNT];
 static struct unit_test_state *uts = &global_dm_test_state;
@@ -105,9 +106,19 @@ static const struct test_ops test_manual_ops = {
 	.ping = test_manual_drv_ping,
 };
 
+/* Let the time taken by manual devices be seen by timing tests */
+static void test_manual_delay(void)
+{
+	struct dm_test_state *dms = uts->priv;
+
+	if (dms && dms->op_delay_ms)
+		sandbox_timer_add_offset(dms->op_delay_ms);
+}
+
 static int test_manual_bind(struct udevice *dev)
 {
 	dm_testdrv_op_count[DM_TEST_OP_BIND]++;
+	test_manual_delay();
 
 	return 0;
 }
@@ -117,6 +128,7 @@ static int test_manual_probe(struct udevice *dev)
 	struct dm_test_state *dms = uts->priv;
 
 	dm_testdrv_op_count[DM_TEST_OP_PROBE]++;
+	test_manual_delay();
 	if (!dms->force_fail_alloc)
 		dev->priv = calloc(1, sizeof(struct dm_test_priv));
 	if (!dev->priv)
@@ -128,6 +140,7 @@ static int test_manual_probe(struct udevice *dev)
 static int test_manual_remove(struct udevice *dev)
 {
 	dm_testdrv_op_count[DM_TEST_OP_REMOVE]++;
+	test_manual_delay();
 	return 0;
 }
 
@@ -13,6 +13,7 @@
 #include <asm/state.h>
 #include <dm/test.h>
 #include <dm/root.h>
+#include <dm/timing.h>
 #include <dm/uclass-internal.h>
 #include <test/ut.h>
 
@@ -28,6 +29,8 @@ static int dm_test_init(struct unit_test_state *uts)
 
 	memset(dms, '\0', sizeof(*dms));
 	gd->dm_root = NULL;
+	/* The old devices are not unbound, so drop their timing too */
+	dm_timing_clear();
 	memset(dm_testdrv_op_count, '\0', sizeof(dm_testdrv_op_count));
 
 	ut_assertok(dm_init());
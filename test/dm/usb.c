@@ -7,13 +7,16 @@
 #include <common.h>
 #include <console.h>
 #include <dm.h>
+#include <bootstage.h>
 #include <usb.h>
 #include <asm/io.h>
 #include <asm/state.h>
 #include <asm/test.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/test.h>
 #include <dm/uclass-internal.h>
+#include <linux/usb/gadget.h>
 #include <test/ut.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -31,6 +34,218 @@ static int dm_test_usb_base(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_base, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
 
+/* Test the length chosen for OUT requests received in place */
+static int dm_test_usb_gadget_direct_rx(struct unit_test_state *uts)
+{
+	struct usb_gadget gadget;
+	struct usb_ep ep;
+	char *buf;
+
+	memset(&gadget, '\0', sizeof(gadget));
+	memset(&ep, '\0', sizeof(ep));
+	ep.maxpacket = 512;
+	buf = memalign(ARCH_DMA_MINALIGN, 0x10000);
+	ut_assertnonnull(buf);
+
+	/* Not supported by the controller */
+	ut_asserteq(0, usb_ep_direct_rx_len(&gadget, &ep, buf, 0x8000, 0x10000,
+					    0x4000));
+	gadget.direct_rx = 1;
+
+	/* Limited by the maximum, then by the bytes still expected */
+	ut_asserteq(0x4000, usb_ep_direct_rx_len(&gadget, &ep, buf, 0x8000,
+						 0x10000, 0x4000));
+	ut_asserteq(0x2000, usb_ep_direct_rx_len(&gadget, &ep, buf, 0x2000,
+						 0x10000, 0x4000));
+
+	/* The last request is rounded up to maxpacket, if there is room */
+	ut_asserteq(0x400, usb_ep_direct_rx_len(&gadget, &ep, buf, 0x3ff,
+						0x400, 0x4000));
+	ut_asserteq(0, usb_ep_direct_rx_len(&gadget, &ep, buf, 0x3ff, 0x3ff,
+					    0x4000));
+
+	/* Nothing left, or a destination not aligned for DMA */
+	ut_asserteq(0, usb_ep_direct_rx_len(&gadget, &ep, buf, 0, 0x10000,
+					    0x4000));
+	ut_asserteq(0, usb_ep_direct_rx_len(&gadget, &ep, buf + 1, 0x2000,
+					    0x10000, 0x4000));
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_usb_gadget_direct_rx, 0);
+
+/*
+ * A stub OUT endpoint. A queued request is held until the test lets the
+ * host send the next part of its data into it, as a controller would.
+ */
+static struct rx_stub {
+	const u8 *data;			/* what the host sends */
+	unsigned int size;
+	unsigned int sent;
+	struct usb_request *pending;
+	int queued;
+	int bad_len;			/* lengths not a maxpacket multiple */
+} rx_stub;
+
+static int rx_stub_queue(struct usb_ep *ep, struct usb_request *req,
+			 gfp_t gfp_flags)
+{
+	if (rx_stub.pending)
+		return -EBUSY;
+	if (req->length % ep->maxpacket)
+		rx_stub.bad_len++;
+	rx_stub.pending = req;
+	rx_stub.queued++;
+
+	return 0;
+}
+
+/* Receive the next transfer, ending with a short packet, and complete it */
+static void rx_stub_receive(struct usb_ep *ep)
+{
+	struct usb_request *req = rx_stub.pending;
+	unsigned int n = min(req->length, rx_stub.size - rx_stub.sent);
+
+	memcpy(req->buf, rx_stub.data + rx_stub.sent, n);
+	rx_stub.sent += n;
+	rx_stub.pending = NULL;
+	req->actual = n;
+	req->status = 0;
+	req->complete(ep, req);
+}
+
+static const struct usb_ep_ops rx_stub_ops = {
+	.queue		= rx_stub_queue,
+};
+
+/* A download in the way fastboot does it, into @dest */
+static struct rx_download {
+	struct usb_gadget *gadget;
+	u8 *dest;
+	unsigned int size;
+	unsigned int room;
+	unsigned int done;
+	u8 bounce[4096];
+	int copies;
+} rx_dl;
+
+static void rx_dl_setup(struct usb_ep *ep, struct usb_request *req)
+{
+	u8 *dest = rx_dl.dest + rx_dl.done;
+	unsigned int len;
+
+	len = usb_ep_direct_rx_len(rx_dl.gadget, ep, dest,
+				   rx_dl.size - rx_dl.done,
+				   rx_dl.room - rx_dl.done, 0x4000);
+	if (len) {
+		req->buf = dest;
+		req->length = len;
+	} else {
+		req->buf = rx_dl.bounce;
+		req->length = sizeof(rx_dl.bounce);
+	}
+}
+
+static void rx_dl_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	u8 *dest = rx_dl.dest + rx_dl.done;
+	unsigned int n = min(req->actual, rx_dl.size - rx_dl.done);
+
+	if (req->buf != dest) {
+		memcpy(dest, req->buf, n);
+		rx_dl.copies++;
+	}
+	rx_dl.done += n;
+	if (rx_dl.done < rx_dl.size) {
+		rx_dl_setup(ep, req);
+		usb_ep_queue(ep, req, 0);
+	}
+}
+
+/* Download @size bytes to @dest and check what arrived */
+static int rx_dl_run(struct unit_test_state *uts, struct usb_gadget *gadget,
+		     const u8 *data, u8 *dest, unsigned int size,
+		     unsigned int room)
+{
+	struct usb_request req;
+	struct usb_ep ep;
+
+	memset(&ep, '\0', sizeof(ep));
+	ep.ops = &rx_stub_ops;
+	ep.maxpacket = 512;
+	memset(&req, '\0', sizeof(req));
+	req.complete = rx_dl_complete;
+
+	memset(&rx_stub, '\0', sizeof(rx_stub));
+	rx_stub.data = data;
+	rx_stub.size = size;
+	memset(&rx_dl, '\0', sizeof(rx_dl));
+	rx_dl.gadget = gadget;
+	rx_dl.dest = dest;
+	rx_dl.size = size;
+	rx_dl.room = room;
+
+	rx_dl_setup(&ep, &req);
+	ut_assertok(usb_ep_queue(&ep, &req, 0));
+	while (rx_stub.pending)
+		rx_stub_receive(&ep);
+
+	ut_asserteq(size, rx_dl.done);
+	ut_asserteq(size, rx_stub.sent);
+	ut_asserteq(0, rx_stub.bad_len);
+	ut_assertok(memcmp(data, dest, size));
+
+	return 0;
+}
+
+/* Test a download through OUT requests which may be received in place */
+static int dm_test_usb_gadget_direct_rx_queue(struct unit_test_state *uts)
+{
+	const unsigned int size = 0x9000 + 100;
+	const unsigned int room = 0xa000;
+	struct usb_gadget gadget;
+	u8 *data, *buf;
+	int i;
+
+	memset(&gadget, '\0', sizeof(gadget));
+	data = malloc(size);
+	ut_assertnonnull(data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 7 + i / 256;
+	buf = memalign(ARCH_DMA_MINALIGN, room + 1);
+	ut_assertnonnull(buf);
+
+	/* Received in place, in requests of the maximum size */
+	gadget.direct_rx = 1;
+	memset(buf, '\xaa', room + 1);
+	ut_assertok(rx_dl_run(uts, &gadget, data, buf, size, room));
+	ut_asserteq(0, rx_dl.copies);
+	ut_asserteq(DIV_ROUND_UP(size, 0x4000), rx_stub.queued);
+	ut_asserteq(0xaa, buf[room]);
+
+	/* Without room to round up the last request, the end is copied */
+	memset(buf, '\xaa', room + 1);
+	ut_assertok(rx_dl_run(uts, &gadget, data, buf, size, size));
+	ut_asserteq(2, rx_dl.copies);
+	ut_asserteq(0xaa, buf[size]);
+
+	/* A destination which is not aligned for DMA is always copied */
+	ut_assertok(rx_dl_run(uts, &gadget, data, buf + 1, size, room - 1));
+	ut_asserteq(DIV_ROUND_UP(size, sizeof(rx_dl.bounce)), rx_dl.copies);
+
+	/* As is everything, if the controller cannot receive in place */
+	gadget.direct_rx = 0;
+	ut_assertok(rx_dl_run(uts, &gadget, data, buf, size, room));
+	ut_asserteq(rx_stub.queued, rx_dl.copies);
+
+	free(buf);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_usb_gadget_direct_rx_queue, 0);
+
 /*
  * Test that we can use the flash stick. This is more of a functional test. It
  * covers scanning the bug, setting up a hub and a flash stick and reading
@@ -58,6 +273,45 @@ static int dm_test_usb_flash(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_flash, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
 
+#ifdef CONFIG_USB_STORAGE_CACHE
+/* Test that a flash stick is not scanned in full each time USB starts */
+static int dm_test_usb_flash_cache(struct unit_test_state *uts)
+{
+	struct udevice *dev, *emul;
+	struct blk_desc *dev_desc;
+	int count;
+
+	state_set_skip_delays(true);
+	usb_stor_cache_invalidate();
+	ut_assertok(usb_init());
+	ut_assertok(uclass_get_device(UCLASS_MASS_STORAGE, 0, &dev));
+	ut_assertok(usb_emul_find_for_dev(dev, &emul));
+	count = sandbox_flash_get_inquiry_count(emul);
+	ut_assert(count > 0);
+	ut_assertok(usb_stop());
+
+	/* The second time, the details come from the cache */
+	ut_assertok(usb_init());
+	ut_assertok(uclass_get_device(UCLASS_MASS_STORAGE, 0, &dev));
+	ut_asserteq(count, sandbox_flash_get_inquiry_count(emul));
+	ut_assertok(blk_get_device_by_str("usb", "0", &dev_desc));
+	ut_asserteq(512, dev_desc->blksz);
+	ut_assert(dev_desc->lba > 0);
+	ut_asserteq_str("sandbox", dev_desc->vendor);
+	ut_assertok(usb_stop());
+
+	/* Once the cache is dropped, the device is asked again */
+	usb_stor_cache_invalidate();
+	ut_assertok(usb_init());
+	ut_assertok(uclass_get_device(UCLASS_MASS_STORAGE, 0, &dev));
+	ut_assert(sandbox_flash_get_inquiry_count(emul) > count);
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_flash_cache, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+#endif
+
 /* test that we can handle multiple storage devices */
 static int dm_test_usb_multi(struct unit_test_state *uts)
 {
@@ -74,6 +328,67 @@ static int dm_test_usb_multi(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_multi, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
 
+/*
+ * Test that one scan over two buses finds every device on the right bus,
+ * records the time taken and resets only one port of a hub at a time
+ */
+static int dm_test_usb_scan_buses(struct unit_test_state *uts)
+{
+	struct udevice *bus0, *bus1, *dev, *hub, *emul;
+	struct usb_bus_priv *priv;
+	int count0 = 0, count1 = 0;
+	int resets, max_in_reset;
+	uint32_t before;
+	int node;
+
+	/* Bring in the bus with a flash stick that test.dts leaves disabled */
+	node = fdt_path_offset(gd->fdt_blob, "/usb@0");
+	ut_assert(node >= 0);
+	ut_assertok(lists_bind_fdt(gd->dm_root, gd->fdt_blob, node, &bus0));
+	ut_assertok(uclass_get_device_by_name(UCLASS_USB, "usb@1", &bus1));
+
+	state_set_skip_delays(true);
+	before = bootstage_get_time(BOOTSTAGE_ID_ACCUM_USB_SCAN);
+	ut_assertok(usb_init());
+	ut_assert(bootstage_get_time(BOOTSTAGE_ID_ACCUM_USB_SCAN) > before);
+
+	for (uclass_first_device(UCLASS_MASS_STORAGE, &dev);
+	     dev;
+	     uclass_next_device(&dev)) {
+		if (usb_get_bus(dev) == bus0)
+			count0++;
+		else if (usb_get_bus(dev) == bus1)
+			count1++;
+		else
+			ut_assert(false);
+	}
+	ut_asserteq(1, count0);
+	ut_asserteq(3, count1);
+
+	/* Each bus gave out its own addresses: the hub, then the stick */
+	priv = dev_get_uclass_priv(bus0);
+	ut_asserteq(2, priv->next_addr);
+	ut_assertok(priv->scan_err);
+	priv = dev_get_uclass_priv(bus1);
+	ut_assertok(priv->scan_err);
+
+	/* The ports of each hub were reset one after the other */
+	ut_assertok(device_find_first_child(bus0, &hub));
+	ut_assertok(usb_emul_find_for_dev(hub, &emul));
+	sandbox_hub_get_reset_stats(emul, &resets, &max_in_reset);
+	ut_asserteq(1, resets);
+	ut_asserteq(1, max_in_reset);
+	ut_assertok(device_find_first_child(bus1, &hub));
+	ut_assertok(usb_emul_find_for_dev(hub, &emul));
+	sandbox_hub_get_reset_stats(emul, &resets, &max_in_reset);
+	ut_asserteq(4, resets);
+	ut_asserteq(1, max_in_reset);
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_scan_buses, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
 static int count_usb_devices(void)
 {
 	struct udevice *hub;
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <search.h>
+#include <test/env.h>
+#include <test/ut.h>
+
+#define HASH_TEST_VARS	1500
+
+/* Build an environment in import format, in an order unlike sorted */
+static char *hash_test_make_env(size_t *sizep)
+{
+	char *env, *p;
+	int i;
+
+	env = malloc(HASH_TEST_VARS * 32);
+	if (!env)
+		return NULL;
+	for (i = 0, p = env; i < HASH_TEST_VARS; i++) {
+		p += sprintf(p, "var%04d=value%d", (i * 7) % HASH_TEST_VARS, i);
+		*p++ = '\0';
+	}
+	*p++ = '\0';
+	*sizep = p - env;
+
+	return env;
+}
+
+/* Check that an exported environment is in order, and count the entries */
+static int hash_test_count_sorted(const char *env)
+{
+	const char *p, *prev = NULL;
+	int count = 0;
+
+	for (p = env; *p; p += strlen(p) + 1) {
+		if (prev && strcmp(prev, p) >= 0)
+			return -EINVAL;
+		prev = p;
+		count++;
+	}
+
+	return count;
+}
+
+/* Test that the table grows and export stays sorted as entries change */
+static int env_test_hash_grow(struct unit_test_state *uts)
+{
+	struct hsearch_data htab = { .table = NULL };
+	char name[20];
+	char *env, *res = NULL;
+	ENTRY e, *ep;
+	size_t size;
+	int i;
+
+	env = hash_test_make_env(&size);
+	ut_assertnonnull(env);
+
+	/* Start with a tiny table so that it has to grow many times */
+	ut_asserteq(1, hcreate_r(5, &htab));
+	ut_asserteq(1, himport_r(&htab, env, size, '\0', H_NOCLEAR, 0, 0,
+				 NULL));
+	ut_asserteq(HASH_TEST_VARS, htab.filled);
+	ut_assert(htab.size > HASH_TEST_VARS);
+
+	for (i = 0; i < HASH_TEST_VARS; i++) {
+		sprintf(name, "var%04d", i);
+		e.key = name;
+		ut_assert(hsearch_r(e, FIND, &ep, &htab, 0));
+	}
+
+	ut_assert(hexport_r(&htab, '\0', 0, &res, 0, 0, NULL) > 0);
+	ut_asserteq(HASH_TEST_VARS, hash_test_count_sorted(res));
+	free(res);
+	res = NULL;
+
+	/* The sorted list is now kept; change it and export again */
+	for (i = 0; i < HASH_TEST_VARS; i += 3) {
+		sprintf(name, "var%04d", i);
+		ut_asserteq(1, hdelete_r(name, &htab, 0));
+	}
+	for (i = 0; i < 100; i++) {
+		sprintf(name, "new%03d", 99 - i);
+		e.key = name;
+		e.data = "x";
+		ut_assert(hsearch_r(e, ENTER, &ep, &htab, 0));
+	}
+	ut_assert(hexport_r(&htab, '\0', 0, &res, 0, 0, NULL) > 0);
+	ut_asserteq(HASH_TEST_VARS - HASH_TEST_VARS / 3 + 100,
+		    hash_test_count_sorted(res));
+	free(res);
+
+	hdestroy_r(&htab);
+	free(env);
+
+	return 0;
+}
+ENV_TEST(env_test_hash_grow, 0);
+
+/* Measure import and export throughput for a large environment */
+static int env_test_hash_speed(struct unit_test_state *uts)
+{
+	struct hsearch_data htab = { .table = NULL };
+	ulong start, import_us, export_us, export2_us;
+	char *env, *res = NULL;
+	size_t size;
+
+	env = hash_test_make_env(&size);
+	ut_assertnonnull(env);
+
+	start = timer_get_us();
+	ut_asserteq(1, himport_r(&htab, env, size, '\0', 0, 0, 0, NULL));
+	import_us = timer_get_us() - start;
+
+	start = timer_get_us();
+	ut_assert(hexport_r(&htab, '\0', 0, &res, 0, 0, NULL) > 0);
+	export_us = timer_get_us() - start;
+	free(res);
+	res = NULL;
+
+	/* The second export can reuse the sorted list */
+	start = timer_get_us();
+	ut_assert(hexport_r(&htab, '\0', 0, &res, 0, 0, NULL) > 0);
+	export2_us = timer_get_us() - start;
+	free(res);
+
+	printf("%d variables: import %lu us, export %lu us, again %lu us\n",
+	       HASH_TEST_VARS, import_us, export_us, export2_us);
+
+	hdestroy_r(&htab);
+	free(env);
+
+	return 0;
+}
+ENV_TEST(env_test_hash_speed, 0);
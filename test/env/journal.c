@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <environment.h>
+#include <malloc.h>
+#include <test/env.h>
+#include <test/ut.h>
+
+/* Journal held in memory, in place of flash */
+static char journal_test_buf[CONFIG_ENV_JOURNAL_SIZE];
+
+static int journal_test_read(ulong offset, ulong size, void *buf)
+{
+	memcpy(buf, journal_test_buf + offset, size);
+
+	return 0;
+}
+
+static int journal_test_write(ulong offset, ulong size, const void *buf)
+{
+	memcpy(journal_test_buf + offset, buf, size);
+
+	return 0;
+}
+
+static int journal_test_erase(void)
+{
+	memset(journal_test_buf, 0xff, sizeof(journal_test_buf));
+
+	return 0;
+}
+
+static const struct env_journal_ops journal_test_ops = {
+	.read	= journal_test_read,
+	.write	= journal_test_write,
+	.erase	= journal_test_erase,
+};
+
+static void journal_test_set_base(void)
+{
+	setenv("jtest_a", "1");
+	setenv("jtest_b", "2");
+	setenv("jtest_c", NULL);
+}
+
+/* Test that changes are saved to the journal and applied when loading */
+static int env_test_journal(struct unit_test_state *uts)
+{
+	env_t *base, *env;
+
+	base = malloc(sizeof(env_t));
+	env = malloc(sizeof(env_t));
+	ut_assertnonnull(base);
+	ut_assertnonnull(env);
+
+	/* As after a full save */
+	journal_test_set_base();
+	ut_assertok(env_export(base));
+	ut_assertok(env_journal_reset(&journal_test_ops, base));
+
+	/* Change, delete and add a variable */
+	setenv("jtest_a", "3");
+	setenv("jtest_b", NULL);
+	setenv("jtest_c", "4");
+	ut_assertok(env_export(env));
+	ut_assertok(env_journal_save(&journal_test_ops, env));
+	ut_assert(journal_test_buf[0] != (char)0xff);
+
+	/* Nothing has changed, so nothing is written */
+	ut_assertok(env_journal_save(&journal_test_ops, env));
+
+	/* Loading the base environment should apply the changes */
+	journal_test_set_base();
+	env_journal_load(&journal_test_ops, base->crc);
+	ut_asserteq_str("3", getenv("jtest_a"));
+	ut_asserteq_ptr(NULL, getenv("jtest_b"));
+	ut_asserteq_str("4", getenv("jtest_c"));
+
+	/* Records for a different environment must be ignored */
+	journal_test_set_base();
+	env_journal_load(&journal_test_ops, base->crc + 1);
+	ut_asserteq_str("1", getenv("jtest_a"));
+	ut_asserteq_str("2", getenv("jtest_b"));
+	ut_asserteq_ptr(NULL, getenv("jtest_c"));
+
+	/* ...and a full save is needed to erase them */
+	ut_asserteq(-ENOSPC, env_journal_save(&journal_test_ops, env));
+
+	setenv("jtest_a", NULL);
+	setenv("jtest_b", NULL);
+	free(env);
+	free(base);
+
+	return 0;
+}
+ENV_TEST(env_test_journal, 0);
@@ -2,10 +2,11 @@
 #
 # SPDX-License-Identifier: GPL-2.0
 
-# Test various network-related functionality, such as the dhcp, ping, and
-# tftpboot commands.
+# Test various network-related functionality, such as the dhcp, ping,
+# tftpboot and wget commands.
 
 import pytest
+import re
 import u_boot_utils
 
 """
@@ -47,6 +48,17 @@ env__net_tftp_readable_file = {
     "size": 5058624,
     "crc32": "c2244b26",
 }
+
+# Details regarding a file that may be read from an HTTP server at serverip,
+# for the wget command. The port defaults to 80. This variable may be omitted
+# or set to None if HTTP testing is not possible or desired.
+env__net_http_readable_file = {
+    "fn": "ubtest-readable.bin",
+    "port": 8080,
+    "addr": 0x10000000,
+    "size": 5058624,
+    "crc32": "c2244b26",
+}
 """
 
 net_set_up = False
@@ -157,3 +169,89 @@ def test_net_tftpboot(u_boot_console):
 
     output = u_boot_console.run_command('crc32 %x $filesize' % addr)
     assert expected_crc in output
+
+@pytest.mark.buildconfigspec('cmd_net')
+@pytest.mark.buildconfigspec('net_tftp_vars')
+def test_net_tftpboot_windowsize(u_boot_console):
+    """Test the tftpboot command with a TFTP window size (RFC 7440).
+
+    The file used by test_net_tftpboot is downloaded with a window size of 1
+    (lock-step) and then 16. Both must arrive intact; the throughput of each
+    is logged for comparison. A server which does not support the option
+    simply falls back to lock-step.
+    """
+
+    if not net_set_up:
+        pytest.skip('Network not initialized')
+
+    f = u_boot_console.config.env.get('env__net_tftp_readable_file', None)
+    if not f:
+        pytest.skip('No TFTP readable file to read')
+
+    addr = f.get('addr', None)
+    if not addr:
+        addr = u_boot_utils.find_ram_base(u_boot_console)
+
+    fn = f['fn']
+    sz = f.get('size', None)
+    expected_crc = f.get('crc32', None)
+    has_crc32 = (u_boot_console.config.buildconfig.get('config_cmd_crc32',
+        'n') == 'y')
+
+    for window in (1, 16):
+        u_boot_console.run_command('setenv tftpwindowsize %d' % window)
+        output = u_boot_console.run_command('tftpboot %x %s' % (addr, fn))
+        expected_text = 'Bytes transferred = '
+        if sz:
+            expected_text += '%d' % sz
+        assert expected_text in output
+        rate = re.search(r'\s([0-9.]+ (?:[KMGT]iB|Bytes)/s)', output)
+        u_boot_console.log.info('windowsize %d: %s' %
+            (window, rate.group(1) if rate else 'rate not shown'))
+
+        if expected_crc and has_crc32:
+            output = u_boot_console.run_command('crc32 %x $filesize' % addr)
+            assert expected_crc in output
+
+    u_boot_console.run_command('setenv tftpwindowsize')
+
+@pytest.mark.buildconfigspec('cmd_wget')
+def test_net_wget(u_boot_console):
+    """Test the wget command.
+
+    A file is downloaded from the HTTP server, its size and optionally its
+    CRC32 are validated.
+
+    The details of the file to download are provided by the boardenv_* file;
+    see the comment at the beginning of this file.
+    """
+
+    if not net_set_up:
+        pytest.skip('Network not initialized')
+
+    f = u_boot_console.config.env.get('env__net_http_readable_file', None)
+    if not f:
+        pytest.skip('No HTTP readable file to read')
+
+    addr = f.get('addr', None)
+    if not addr:
+        addr = u_boot_utils.find_ram_base(u_boot_console)
+
+    u_boot_console.run_command('setenv httpdstp %d' % f.get('port', 80))
+    output = u_boot_console.run_command('wget %x %s' % (addr, f['fn']))
+    u_boot_console.run_command('setenv httpdstp')
+    expected_text = 'Bytes transferred = '
+    sz = f.get('size', None)
+    if sz:
+        expected_text += '%d' % sz
+    assert expected_text in output
+
+    expected_crc = f.get('crc32', None)
+    if not expected_crc:
+        return
+
+    if u_boot_console.config.buildconfig.get('config_cmd_crc32', 'n') != 'y':
+        return
+
+    output = u_boot_console.run_command('crc32 %x $filesize' % addr)
+    assert expected_crc in output
@@ -72,6 +72,13 @@ root permissions. For example:
 
 This entry is only needed if any block_devs above contain a
 writable_fs_partition value.
+
+d) Optionally, the size of the test file and the minimum throughput expected
+from UMS in boardenv_*. The throughput of the file write and read-back is
+always logged. For example:
+
+env__ums_test_file_size = 64 * 1024 * 1024
+env__ums_min_kbps = 10000
 """
 
 @pytest.mark.buildconfigspec('cmd_usb_mass_storage')
@@ -117,8 +124,11 @@ def test_ums(u_boot_console, env__usb_dev_port, env__block_devs):
     else:
         host_ums_part_node = host_ums_dev_node
 
+    test_f_size = u_boot_console.config.env.get('env__ums_test_file_size',
+        1024 * 1024)
+    min_kbps = u_boot_console.config.env.get('env__ums_min_kbps', 0)
     test_f = u_boot_utils.PersistentRandomFile(u_boot_console, 'ums.bin',
-        1024 * 1024);
+        test_f_size);
     if have_writable_fs_partition:
         mounted_test_fn = mount_point + '/' + mount_subdir + test_f.fn
 
@@ -175,6 +185,23 @@ def test_ums(u_boot_console, env__usb_dev_port, env__block_devs):
         cmd = ('/bin/umount', host_ums_part_node)
         u_boot_utils.run_and_log(u_boot_console, cmd, ignore_errors)
 
+    def check_throughput(what, start):
+        """Log the throughput of transferring the test file.
+
+        Args:
+            what: The direction of the transfer, for the log.
+            start: The time.time() at which the transfer started.
+
+        Returns:
+            Nothing.
+        """
+
+        elapsed = max(time.time() - start, 0.001)
+        kbps = int(test_f_size / 1024 / elapsed)
+        u_boot_console.log.info('UMS %s: %d bytes in %.3f s (%d KiB/s)' %
+            (what, test_f_size, elapsed, kbps))
+        assert kbps >= min_kbps
+
     def stop_ums(ignore_errors):
         """Stop U-Boot's ums shell command from executing.
 
@@ -210,8 +237,12 @@ def test_ums(u_boot_console, env__usb_dev_port, env__block_devs):
             u_boot_utils.run_and_log(u_boot_console, cmd)
             if os.path.exists(mounted_test_fn):
                 raise Exception('Could not rm target UMS test file')
+            start = time.time()
             cmd = ('cp', test_f.abs_fn, mounted_test_fn)
             u_boot_utils.run_and_log(u_boot_console, cmd)
+            cmd = ('sync', mounted_test_fn)
+            u_boot_utils.run_and_log(u_boot_console, cmd)
+            check_throughput('write', start)
             ignore_cleanup_errors = False
         finally:
             umount(ignore_errors=ignore_cleanup_errors)
@@ -224,7 +255,9 @@ def test_ums(u_boot_console, env__usb_dev_port, env__block_devs):
         try:
             mount()
             u_boot_console.log.action('Reading test file back via UMS')
+            start = time.time()
             read_back_hash = u_boot_utils.md5sum_file(mounted_test_fn)
+            check_throughput('read', start)
             cmd = ('rm', '-f', mounted_test_fn)
             u_boot_utils.run_and_log(u_boot_console, cmd)
             ignore_cleanup_errors = False
@@ -0,0 +1,224 @@
+/*
+ * Test of writing a sparse image as it arrives, in pieces
+ *
+ * Copyright (C) 2016 agent <agent@local>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <image-sparse.h>
+
+#define TEST_BLKSZ		512	/* storage block size */
+#define TEST_SPARSE_BLKSZ	1024	/* block size in the sparse image */
+#define TEST_START		4	/* first block of the partition */
+#define TEST_BLOCKS		64	/* size of the partition */
+#define TEST_FILE_HDR_SZ	32	/* longer than sparse_header_t */
+#define TEST_FILL		0xdeadbeef
+#define TEST_UNTOUCHED		0xaa
+
+static u8 storage[(TEST_START + TEST_BLOCKS) * TEST_BLKSZ];
+static u8 expect[sizeof(storage)];
+static u8 image[8192];
+static unsigned int image_len;
+
+static lbaint_t test_write(struct sparse_storage *info, lbaint_t blk,
+			   lbaint_t blkcnt, const void *buffer)
+{
+	memcpy(storage + blk * info->blksz, buffer, blkcnt * info->blksz);
+
+	return blkcnt;
+}
+
+static lbaint_t test_reserve(struct sparse_storage *info, lbaint_t blk,
+			     lbaint_t blkcnt)
+{
+	return blkcnt;
+}
+
+static struct sparse_storage test_storage = {
+	.blksz		= TEST_BLKSZ,
+	.start		= TEST_START,
+	.size		= TEST_BLOCKS,
+	.write		= test_write,
+	.reserve	= test_reserve,
+};
+
+static u8 *add_chunk(u8 *p, int type, unsigned int blocks,
+		     unsigned int data_len)
+{
+	chunk_header_t *chunk = (chunk_header_t *)p;
+
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = blocks;
+	chunk->total_sz = sizeof(*chunk) + data_len;
+
+	return p + sizeof(*chunk);
+}
+
+/*
+ * Build a sparse image with one chunk of each type, and what it should
+ * leave in storage: raw (2 blocks), don't care (1), fill (3), CRC32, raw (1)
+ */
+static void make_sparse_image(void)
+{
+	sparse_header_t *hdr = (sparse_header_t *)image;
+	u8 *out = expect + TEST_START * TEST_BLKSZ;
+	u32 fill = TEST_FILL;
+	u8 *p;
+	int i;
+
+	memset(image, '\0', sizeof(image));
+	hdr->magic = SPARSE_HEADER_MAGIC;
+	hdr->major_version = 1;
+	hdr->file_hdr_sz = TEST_FILE_HDR_SZ;
+	hdr->chunk_hdr_sz = sizeof(chunk_header_t);
+	hdr->blk_sz = TEST_SPARSE_BLKSZ;
+	hdr->total_blks = 7;
+	hdr->total_chunks = 5;
+	p = image + TEST_FILE_HDR_SZ;
+
+	memset(expect, TEST_UNTOUCHED, sizeof(expect));
+	p = add_chunk(p, CHUNK_TYPE_RAW, 2, 2 * TEST_SPARSE_BLKSZ);
+	for (i = 0; i < 2 * TEST_SPARSE_BLKSZ; i++)
+		*p++ = *out++ = i * 7 + 1;
+
+	p = add_chunk(p, CHUNK_TYPE_DONT_CARE, 1, 0);
+	out += TEST_SPARSE_BLKSZ;
+
+	p = add_chunk(p, CHUNK_TYPE_FILL, 3, sizeof(fill));
+	memcpy(p, &fill, sizeof(fill));
+	p += sizeof(fill);
+	for (i = 0; i < 3 * TEST_SPARSE_BLKSZ; i += sizeof(fill))
+		memcpy(out + i, &fill, sizeof(fill));
+	out += 3 * TEST_SPARSE_BLKSZ;
+
+	p = add_chunk(p, CHUNK_TYPE_CRC32, 0, sizeof(u32));
+	p += sizeof(u32);
+
+	p = add_chunk(p, CHUNK_TYPE_RAW, 1, TEST_SPARSE_BLKSZ);
+	for (i = 0; i < TEST_SPARSE_BLKSZ; i++)
+		*p++ = *out++ = i * 3;
+
+	image_len = p - image;
+}
+
+/* A raw image that ends part way through a block */
+static void make_raw_image(void)
+{
+	u8 *out = expect + TEST_START * TEST_BLKSZ;
+	int i;
+
+	image_len = 5 * TEST_BLKSZ + 100;
+	memset(expect, TEST_UNTOUCHED, sizeof(expect));
+	for (i = 0; i < image_len; i++)
+		image[i] = out[i] = i * 5 + 3;
+	memset(out + image_len, '\0', TEST_BLKSZ - 100);
+}
+
+/*
+ * Write the first @len bytes of the image, in pieces of the given sizes,
+ * and return the result of finishing the stream
+ */
+static int write_stream(struct sparse_stream *ss, unsigned int len,
+			const unsigned int *sizes, int count)
+{
+	unsigned int pos, n;
+	int i;
+
+	memset(storage, TEST_UNTOUCHED, sizeof(storage));
+	if (sparse_stream_start(ss, &test_storage, "test", image_len))
+		return -ENOMEM;
+
+	for (pos = 0, i = 0; pos < len; pos += n, i++) {
+		n = min(len - pos, sizes[i % count]);
+		if (sparse_stream_write(ss, image + pos, n)) {
+			sparse_stream_abort(ss);
+			return -EIO;
+		}
+	}
+
+	return sparse_stream_finish(ss);
+}
+
+#define errcheck(statement) if (!(statement)) { \
+	fprintf(stderr, "\tFailed: %s\n", #statement); \
+	ret = 1; \
+	goto out; \
+}
+
+static int run_test(const char *name, const unsigned int *sizes, int count)
+{
+	struct sparse_stream ss;
+	int ret;
+
+	printf(" testing %s ...\n", name);
+
+	/* The whole image, however it is split, gives the same result */
+	errcheck(write_stream(&ss, image_len, sizes, count) == 0);
+	errcheck(memcmp(storage, expect, sizeof(storage)) == 0);
+
+	/* Any image cut short is reported as such */
+	errcheck(write_stream(&ss, image_len - 1, sizes, count) == -EIO);
+	errcheck(ss.error != NULL);
+
+	ret = 0;
+
+out:
+	printf(" %s: %s\n", name, ret == 0 ? "ok" : "FAILED");
+
+	return ret;
+}
+
+static int run_tests(void)
+{
+	static const unsigned int bytes[] = { 1 };
+	static const unsigned int small[] = { 1, 2, 3, 5, 7, 11, 13 };
+	static const unsigned int headers[] = { 27, 1, 4, 11, 1, 1000 };
+	static const unsigned int blocks[] = { 511, 512, 513, 4096 };
+	static const unsigned int whole[] = { sizeof(image) };
+	int err = 0;
+
+	err += run_test("single bytes", bytes, ARRAY_SIZE(bytes));
+	err += run_test("small pieces", small, ARRAY_SIZE(small));
+	err += run_test("split headers", headers, ARRAY_SIZE(headers));
+	err += run_test("block pieces", blocks, ARRAY_SIZE(blocks));
+	err += run_test("whole image", whole, ARRAY_SIZE(whole));
+
+	return err;
+}
+
+static int do_ut_sparse(cmd_tbl_t *cmdtp, int flag, int argc,
+			char *const argv[])
+{
+	struct sparse_stream ss;
+	int err = 0;
+
+	printf("sparse image:\n");
+	make_sparse_image();
+	err += run_tests();
+
+	printf("raw image:\n");
+	make_raw_image();
+	err += run_tests();
+
+	/* A sparse image with a bad chunk fails at that chunk */
+	make_sparse_image();
+	((chunk_header_t *)(image + TEST_FILE_HDR_SZ))->chunk_type = 0xcac5;
+	if (write_stream(&ss, image_len, &image_len, 1) != -EIO ||
+	    strcmp(ss.error, "Unknown chunk type")) {
+		printf(" bad chunk not reported\n");
+		err++;
+	}
+
+	printf("ut_sparse %s\n", err == 0 ? "ok" : "FAILED");
+
+	return err;
+}
+
+U_BOOT_CMD(
+	ut_sparse,	5,	1,	do_ut_sparse,
+	"Test of writing sparse images in pieces", ""
+);